@@ -52,6 +52,12 @@ Bool VG_(str_clo_cache_opt)(const HChar *arg,
                             cache_t* clo_D1c,
                             cache_t* clo_LLc);
 
+// Parses optval, the value of command line option opt, as a
+// "<size>,<assoc>,<line_size>" cache description into cache.  Exits
+// with an error message if it is malformed or not supported.
+void VG_(parse_cache_opt)(cache_t* cache, const HChar* opt,
+                          const HChar* optval);
+
 // Checks the correctness of the auto-detected caches.
 // If a cache has been configured by command line options, it
 // replaces the equivalent auto-detected cache.
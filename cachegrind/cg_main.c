@@ -31,6 +31,7 @@
 
 #include "pub_tool_basics.h"
 #include "pub_tool_debuginfo.h"
+#include "pub_tool_hashtable.h"
 #include "pub_tool_libcbase.h"
 #include "pub_tool_libcassert.h"
 #include "pub_tool_libcfile.h"
@@ -39,6 +40,8 @@
 #include "pub_tool_mallocfree.h"
 #include "pub_tool_options.h"
 #include "pub_tool_oset.h"
+#include "pub_tool_poolalloc.h"
+#include "pub_tool_threadstate.h"
 #include "pub_tool_tooliface.h"
 #include "pub_tool_xarray.h"
 #include "pub_tool_clientstate.h"
@@ -61,6 +64,7 @@
 
 static Bool  clo_cache_sim  = True;  /* do cache simulation? */
 static Bool  clo_branch_sim = False; /* do branch simulation? */
+static Bool  clo_private_caches = False; /* per-thread L1 and L2? */
 static const HChar* clo_cachegrind_out_file = "cachegrind.out.%p";
 
 /*------------------------------------------------------------*/
@@ -81,6 +85,13 @@ typedef
    }
    CacheCC;
 
+typedef
+   struct {
+      ULong m;  /* D1 coherence misses */
+      ULong fs; /* ... of which caused by false sharing */
+   }
+   CohCC;
+
 typedef
    struct {
       ULong b;  /* total # branches of this kind */
@@ -91,45 +102,47 @@ typedef
 //------------------------------------------------------------
 // Primary data structure #1: CC table
 // - Holds the per-source-line hit/miss stats, grouped by file/function/line.
-// - an ordered set of CCs.  CC indexing done by file/function/line (as
-//   determined from the instrAddr).
-// - Traversed for dumping stats at end in file/func/line hierarchy.
+// - a hash table of CCs, keyed by file/function/line (as determined from
+//   the instrAddr), with files and functions given by string table ids.
+// - CCs are allocated from a pool and never freed.
+// - Sorted once at the end for dumping stats in file/func/line hierarchy.
 
 typedef struct {
-   HChar* file;
-   const HChar* fn;
+   UInt   file;  /* string table id */
+   UInt   fn;    /* string table id */
    Int    line;
 }
 CodeLoc;
 
-typedef struct {
-   CodeLoc  loc; /* Source location that these counts pertain to */
-   CacheCC  Ir;  /* Insn read counts */
-   CacheCC  Dr;  /* Data read counts */
-   CacheCC  Dw;  /* Data write/modify counts */
-   BranchCC Bc;  /* Conditional branch counts */
-   BranchCC Bi;  /* Indirect branch counts */
-} LineCC;
+typedef struct _LineCC LineCC;
+struct _LineCC {
+   LineCC*  next;  /* hash chain, MUST BE FIRST */
+   UWord    key;   /* hash of loc, MUST BE SECOND */
+   CodeLoc  loc;   /* Source location that these counts pertain to */
+   CacheCC  Ir;    /* Insn read counts */
+   CacheCC  Dr;    /* Data read counts */
+   CacheCC  Dw;    /* Data write/modify counts */
+   CohCC    Coh;   /* Coherence misses, only with --private-caches */
+   BranchCC Bc;    /* Conditional branch counts */
+   BranchCC Bi;    /* Indirect branch counts */
+};
 
-// First compare file, then fn, then line.
-static Word cmp_CodeLoc_LineCC(const void *vloc, const void *vcc)
+static UWord hash_CodeLoc(const CodeLoc* loc)
 {
-   Word res;
-   const CodeLoc* a = (const CodeLoc*)vloc;
-   const CodeLoc* b = &(((const LineCC*)vcc)->loc);
-
-   res = VG_(strcmp)(a->file, b->file);
-   if (0 != res)
-      return res;
+   return ((UWord)loc->file * 0x9E3779B1u) ^ ((UWord)loc->fn * 0x85EBCA6Bu)
+          ^ (UWord)loc->line;
+}
 
-   res = VG_(strcmp)(a->fn, b->fn);
-   if (0 != res)
-      return res;
+static Word cmp_LineCC(const void *va, const void *vb)
+{
+   const CodeLoc* a = &(((const LineCC*)va)->loc);
+   const CodeLoc* b = &(((const LineCC*)vb)->loc);
 
-   return a->line - b->line;
+   return a->file != b->file || a->fn != b->fn || a->line != b->line;
 }
 
-static OSet* CC_table;
+static VgHashTable* CC_table;
+static PoolAlloc*   CC_pool;
 
 //------------------------------------------------------------
 // Primary data structure #2: InstrInfo table
@@ -158,13 +171,22 @@ static OSet* instrInfoTable;
 
 //------------------------------------------------------------
 // Secondary data structure: string table
-// - holds strings, avoiding dups
+// - holds strings, avoiding dups, and gives each a small integer id
 // - used for filenames and function names, each of which will be
-//   pointed to by one or more CCs.
-// - it also allows equality checks just by pointer comparison, which
-//   is good when printing the output file at the end.
+//   referred to by one or more CCs.
+// - it also allows equality checks just by id comparison, which
+//   is good both when looking up CCs and when printing the output file.
+
+typedef struct _StrNode StrNode;
+struct _StrNode {
+   StrNode* next;  /* MUST BE FIRST */
+   UWord    key;   /* hash of str, MUST BE SECOND */
+   HChar*   str;
+   UInt     id;
+};
 
-static OSet* stringTable;
+static VgHashTable* stringTable;
+static XArray*      stringIds;    /* id -> HChar* */
 
 //------------------------------------------------------------
 // Stats
@@ -183,24 +205,42 @@ static Int  no_debugs           = 0;
 /*--- String table operations                              ---*/
 /*------------------------------------------------------------*/
 
-static Word stringCmp( const void* key, const void* elem )
+static UWord hash_string(const HChar* s)
+{
+   UWord h = 5381;
+   while (*s)
+      h = h * 33 + (UChar)*s++;
+   return h;
+}
+
+static Word stringCmp( const void* a, const void* b )
+{
+   return VG_(strcmp)(((const StrNode*)a)->str, ((const StrNode*)b)->str);
+}
+
+static const HChar* string_of_id(UInt id)
 {
-   return VG_(strcmp)(*(const HChar *const *)key, *(const HChar *const *)elem);
+   return *(HChar**)VG_(indexXA)(stringIds, id);
 }
 
-// Get a permanent string;  either pull it out of the string table if it's
+// Get the id of a string;  either pull it out of the string table if it's
 // been encountered before, or dup it and put it into the string table.
-static HChar* get_perm_string(const HChar* s)
+static UInt get_string_id(const HChar* s)
 {
-   HChar** s_ptr = VG_(OSetGen_Lookup)(stringTable, &s);
-   if (s_ptr) {
-      return *s_ptr;
-   } else {
-      HChar** s_node = VG_(OSetGen_AllocNode)(stringTable, sizeof(HChar*));
-      *s_node = VG_(strdup)("cg.main.gps.1", s);
-      VG_(OSetGen_Insert)(stringTable, s_node);
-      return *s_node;
+   StrNode  key;
+   StrNode* node;
+
+   key.key = hash_string(s);
+   key.str = CONST_CAST(HChar*, s);
+   node = VG_(HT_gen_lookup)(stringTable, &key, stringCmp);
+   if (!node) {
+      node      = VG_(malloc)("cg.main.gsi.1", sizeof(StrNode));
+      node->key = key.key;
+      node->str = VG_(strdup)("cg.main.gsi.2", s);
+      node->id  = VG_(addToXA)(stringIds, &node->str);
+      VG_(HT_add_node)(stringTable, node);
    }
+   return node->id;
 }
 
 /*------------------------------------------------------------*/
@@ -236,13 +276,13 @@ static void get_debug_info(Addr instr_addr, const HChar **dir,
    }
 }
 
-// Do a three step traversal: by file, then fn, then line.
+// Look the CC up by file, fn and line.
 // Returns a pointer to the line CC, creates a new one if necessary.
 static LineCC* get_lineCC(Addr origAddr)
 {
    const HChar *fn, *file, *dir;
    UInt    line;
-   CodeLoc loc;
+   LineCC  key;
    LineCC* lineCC;
 
    get_debug_info(origAddr, &dir, &file, &fn, &line);
@@ -256,31 +296,19 @@ static LineCC* get_lineCC(Addr origAddr)
       VG_(sprintf)(absfile, "%s", file);
    }
 
-   loc.file = absfile;
-   loc.fn   = fn;
-   loc.line = line;
+   key.loc.file = get_string_id(absfile);
+   key.loc.fn   = get_string_id(fn);
+   key.loc.line = line;
+   key.key      = hash_CodeLoc(&key.loc);
 
-   lineCC = VG_(OSetGen_Lookup)(CC_table, &loc);
+   lineCC = VG_(HT_gen_lookup)(CC_table, &key, cmp_LineCC);
    if (!lineCC) {
       // Allocate and zero a new node.
-      lineCC           = VG_(OSetGen_AllocNode)(CC_table, sizeof(LineCC));
-      lineCC->loc.file = get_perm_string(loc.file);
-      lineCC->loc.fn   = get_perm_string(loc.fn);
-      lineCC->loc.line = loc.line;
-      lineCC->Ir.a     = 0;
-      lineCC->Ir.m1    = 0;
-      lineCC->Ir.mL    = 0;
-      lineCC->Dr.a     = 0;
-      lineCC->Dr.m1    = 0;
-      lineCC->Dr.mL    = 0;
-      lineCC->Dw.a     = 0;
-      lineCC->Dw.m1    = 0;
-      lineCC->Dw.mL    = 0;
-      lineCC->Bc.b     = 0;
-      lineCC->Bc.mp    = 0;
-      lineCC->Bi.b     = 0;
-      lineCC->Bi.mp    = 0;
-      VG_(OSetGen_Insert)(CC_table, lineCC);
+      lineCC = VG_(allocEltPA)(CC_pool);
+      VG_(memset)(lineCC, 0, sizeof(LineCC));
+      lineCC->key = key.key;
+      lineCC->loc = key.loc;
+      VG_(HT_add_node)(CC_table, lineCC);
    }
 
    return lineCC;
@@ -290,6 +318,21 @@ static LineCC* get_lineCC(Addr origAddr)
 /*--- Cache simulation functions                           ---*/
 /*------------------------------------------------------------*/
 
+/* Simulates a data access by the instruction n, counted in cc.  Only
+ * the coherence simulation cares whether the access writes.
+ */
+__attribute__((always_inline))
+static __inline__
+void D1_doref(InstrInfo* n, Addr a, UChar size, CacheCC* cc, Bool is_write)
+{
+   if (UNLIKELY(cachesim_private))
+      cachesim_coh_D1_doref(a, size, is_write, &cc->m1, &cc->mL,
+                            &n->parent->Coh.m, &n->parent->Coh.fs);
+   else
+      cachesim_D1_doref(a, size, &cc->m1, &cc->mL);
+   cc->a++;
+}
+
 /* A common case for an instruction read event is that the
  * bytes read belong to the same cache line in both L1I and LL
  * (if cache line sizes of L1 and LL are the same).
@@ -393,9 +436,7 @@ void log_1IrNoX_1Dr_cache_access(InstrInfo* n, Addr data_addr, Word data_size)
 			 &n->parent->Ir.m1, &n->parent->Ir.mL);
    n->parent->Ir.a++;
 
-   cachesim_D1_doref(data_addr, data_size, 
-                     &n->parent->Dr.m1, &n->parent->Dr.mL);
-   n->parent->Dr.a++;
+   D1_doref(n, data_addr, data_size, &n->parent->Dr, False);
 }
 
 static VG_REGPARM(3)
@@ -408,9 +449,19 @@ void log_1IrNoX_1Dw_cache_access(InstrInfo* n, Addr data_addr, Word data_size)
 			 &n->parent->Ir.m1, &n->parent->Ir.mL);
    n->parent->Ir.a++;
 
-   cachesim_D1_doref(data_addr, data_size, 
-                     &n->parent->Dw.m1, &n->parent->Dw.mL);
-   n->parent->Dw.a++;
+   D1_doref(n, data_addr, data_size, &n->parent->Dw, True);
+}
+
+/* A modify is counted as a read, but is a write as far as coherence is
+   concerned; only used with --private-caches. */
+static VG_REGPARM(3)
+void log_1IrNoX_1Dm_cache_access(InstrInfo* n, Addr data_addr, Word data_size)
+{
+   cachesim_I1_doref_NoX(n->instr_addr, n->instr_len,
+			 &n->parent->Ir.m1, &n->parent->Ir.mL);
+   n->parent->Ir.a++;
+
+   D1_doref(n, data_addr, data_size, &n->parent->Dr, True);
 }
 
 /* Note that addEvent_D_guarded assumes that log_0Ir_1Dr_cache_access
@@ -421,9 +472,7 @@ void log_0Ir_1Dr_cache_access(InstrInfo* n, Addr data_addr, Word data_size)
 {
    //VG_(printf)("0Ir_1Dr:  CCaddr=0x%010lx,  daddr=0x%010lx,  dsize=%lu\n",
    //            n, data_addr, data_size);
-   cachesim_D1_doref(data_addr, data_size, 
-                     &n->parent->Dr.m1, &n->parent->Dr.mL);
-   n->parent->Dr.a++;
+   D1_doref(n, data_addr, data_size, &n->parent->Dr, False);
 }
 
 /* See comment on log_0Ir_1Dr_cache_access. */
@@ -432,9 +481,14 @@ void log_0Ir_1Dw_cache_access(InstrInfo* n, Addr data_addr, Word data_size)
 {
    //VG_(printf)("0Ir_1Dw:  CCaddr=0x%010lx,  daddr=0x%010lx,  dsize=%lu\n",
    //            n, data_addr, data_size);
-   cachesim_D1_doref(data_addr, data_size, 
-                     &n->parent->Dw.m1, &n->parent->Dw.mL);
-   n->parent->Dw.a++;
+   D1_doref(n, data_addr, data_size, &n->parent->Dw, True);
+}
+
+/* See comment on log_1IrNoX_1Dm_cache_access. */
+static VG_REGPARM(3)
+void log_0Ir_1Dm_cache_access(InstrInfo* n, Addr data_addr, Word data_size)
+{
+   D1_doref(n, data_addr, data_size, &n->parent->Dr, True);
 }
 
 /* For branches, we consult two different predictors, one which
@@ -742,8 +796,13 @@ static void flushEvents ( CgState* cgs )
                   immediately preceding Ir.  Same applies to analogous
                   assertions in the subsequent cases. */
                tl_assert(ev2->inode == ev->inode);
-               helperName = "log_1IrNoX_1Dr_cache_access";
-               helperAddr = &log_1IrNoX_1Dr_cache_access;
+               if (cachesim_private && ev2->tag == Ev_Dm) {
+                  helperName = "log_1IrNoX_1Dm_cache_access";
+                  helperAddr = &log_1IrNoX_1Dm_cache_access;
+               } else {
+                  helperName = "log_1IrNoX_1Dr_cache_access";
+                  helperAddr = &log_1IrNoX_1Dr_cache_access;
+               }
                argv = mkIRExprVec_3( i_node_expr,
                                      get_Event_dea(ev2),
                                      mkIRExpr_HWord( get_Event_dszB(ev2) ) );
@@ -823,8 +882,13 @@ static void flushEvents ( CgState* cgs )
          case Ev_Dr:
          case Ev_Dm:
             /* Data read or modify */
-            helperName = "log_0Ir_1Dr_cache_access";
-            helperAddr = &log_0Ir_1Dr_cache_access;
+            if (cachesim_private && ev->tag == Ev_Dm) {
+               helperName = "log_0Ir_1Dm_cache_access";
+               helperAddr = &log_0Ir_1Dm_cache_access;
+            } else {
+               helperName = "log_0Ir_1Dr_cache_access";
+               helperAddr = &log_0Ir_1Dr_cache_access;
+            }
             argv = mkIRExprVec_3( i_node_expr, 
                                   get_Event_dea(ev), 
                                   mkIRExpr_HWord( get_Event_dszB(ev) ) );
@@ -1360,6 +1424,10 @@ IRSB* cg_instrument ( VgCallbackClosure* closure,
 static cache_t clo_I1_cache = UNDEFINED_CACHE;
 static cache_t clo_D1_cache = UNDEFINED_CACHE;
 static cache_t clo_LL_cache = UNDEFINED_CACHE;
+static cache_t clo_L2_cache = UNDEFINED_CACHE;  /* size -1: no L2 */
+
+static ReplPolicy clo_LL_policy = Policy_LRU;
+static Bool       clo_cache_inclusive = False;
 
 /*------------------------------------------------------------*/
 /*--- cg_fini() and related function                       ---*/
@@ -1370,16 +1438,163 @@ static cache_t clo_LL_cache = UNDEFINED_CACHE;
 static CacheCC  Ir_total;
 static CacheCC  Dr_total;
 static CacheCC  Dw_total;
+static CohCC    Coh_total;
 static BranchCC Bc_total;
 static BranchCC Bi_total;
 
+/* The output file is written through a large buffer, and the per-line
+   counts are formatted by hand; it can have millions of lines. */
+#define OUT_BUF_SIZE  (64 * 1024)
+
+static HChar* out_buf;
+static Int    out_used;
+static Int    out_fd;
+static Bool   out_write_failed;
+
+// Writes all of buf[0 .. len-1], retrying after a short write.  A failed
+// write is remembered and reported once the file is closed.
+static void out_write(const HChar* buf, Int len)
+{
+   Int res;
+
+   while (len > 0 && !out_write_failed) {
+      res = VG_(write)(out_fd, buf, len);
+      if (res <= 0) {
+         out_write_failed = True;
+         return;
+      }
+      buf += res;
+      len -= res;
+   }
+}
+
+static void out_flush(void)
+{
+   if (out_used > 0)
+      out_write(out_buf, out_used);
+   out_used = 0;
+}
+
+static void out_puts(const HChar* str)
+{
+   Int len = VG_(strlen)(str);
+
+   if (out_used + len > OUT_BUF_SIZE) {
+      out_flush();
+      if (len > OUT_BUF_SIZE) {
+         out_write(str, len);
+         return;
+      }
+   }
+   VG_(memcpy)(out_buf + out_used, str, len);
+   out_used += len;
+}
+
+static void add_to_out_buf(HChar c, void* opaque)
+{
+   if (out_used == OUT_BUF_SIZE)
+      out_flush();
+   out_buf[out_used++] = c;
+}
+
+// Formats straight into the output buffer, so there is no limit on the
+// length of the result.
+static void out_printf(const HChar* format, ...) PRINTF_CHECK(1, 2);
+static void out_printf(const HChar* format, ...)
+{
+   va_list vargs;
+
+   va_start(vargs, format);
+   VG_(vcbprintf)(add_to_out_buf, NULL, format, vargs);
+   va_end(vargs);
+}
+
+// Writes ' ' and the decimal value of each of vals[0 .. n-1].
+static void out_counts(const ULong* vals, Int n)
+{
+   HChar tmp[24];
+   Int   i, k;
+
+   if (out_used + n * 21 > OUT_BUF_SIZE)
+      out_flush();
+   for (i = 0; i < n; i++) {
+      ULong v = vals[i];
+      k = sizeof(tmp);
+      do {
+         tmp[--k] = '0' + v % 10;
+         v /= 10;
+      } while (v != 0);
+      out_buf[out_used++] = ' ';
+      VG_(memcpy)(out_buf + out_used, tmp + k, sizeof(tmp) - k);
+      out_used += sizeof(tmp) - k;
+   }
+}
+
+// Collects the counts to be printed for lineCC, according to the events
+// being collected.  Returns their number.
+static Int get_counts(const LineCC* lineCC, ULong* vals)
+{
+   Int n = 0;
+
+   vals[n++] = lineCC->Ir.a;
+   if (clo_cache_sim) {
+      vals[n++] = lineCC->Ir.m1;
+      vals[n++] = lineCC->Ir.mL;
+      vals[n++] = lineCC->Dr.a;
+      vals[n++] = lineCC->Dr.m1;
+      vals[n++] = lineCC->Dr.mL;
+      vals[n++] = lineCC->Dw.a;
+      vals[n++] = lineCC->Dw.m1;
+      vals[n++] = lineCC->Dw.mL;
+   }
+   if (cachesim_private) {
+      vals[n++] = lineCC->Coh.m;
+      vals[n++] = lineCC->Coh.fs;
+   }
+   if (clo_branch_sim) {
+      vals[n++] = lineCC->Bc.b;
+      vals[n++] = lineCC->Bc.mp;
+      vals[n++] = lineCC->Bi.b;
+      vals[n++] = lineCC->Bi.mp;
+   }
+   return n;
+}
+
+// Rank of each string id in strcmp order, so that the CCs can be sorted
+// without comparing strings.
+static UInt* string_rank;
+
+static Int cmp_string_ids(const void* va, const void* vb)
+{
+   return VG_(strcmp)(string_of_id(*(const UInt*)va),
+                      string_of_id(*(const UInt*)vb));
+}
+
+// First compare file, then fn, then line.
+static Int cmp_LineCC_ptrs(const void* va, const void* vb)
+{
+   const CodeLoc* a = &((*(const LineCC* const*)va)->loc);
+   const CodeLoc* b = &((*(const LineCC* const*)vb)->loc);
+
+   if (a->file != b->file)
+      return string_rank[a->file] < string_rank[b->file] ? -1 : 1;
+   if (a->fn != b->fn)
+      return string_rank[a->fn] < string_rank[b->fn] ? -1 : 1;
+   return a->line < b->line ? -1 : a->line > b->line ? 1 : 0;
+}
+
 static void fprint_CC_table_and_calc_totals(void)
 {
-   Int     i;
-   VgFile  *fp;
-   HChar   *currFile = NULL;
-   const HChar *currFn = NULL;
+   Int     i, n_vals;
+   UInt    n_strings, n_CCs;
+   SysRes  sres;
+   UInt    currFile = 0;
+   UInt    currFn   = 0;
+   UInt*   order;
    LineCC* lineCC;
+   LineCC** CCs;
+   LineCC  total;
+   ULong   vals[15];
 
    // Setup output filename.  Nb: it's important to do this now, ie. as late
    // as possible.  If we do it at start-up and the program forks and the
@@ -1389,9 +1604,9 @@ static void fprint_CC_table_and_calc_totals(void)
    HChar* cachegrind_out_file =
       VG_(expand_file_name)("--cachegrind-out-file", clo_cachegrind_out_file);
 
-   fp = VG_(fopen)(cachegrind_out_file, VKI_O_CREAT|VKI_O_TRUNC|VKI_O_WRONLY,
-                                        VKI_S_IRUSR|VKI_S_IWUSR);
-   if (fp == NULL) {
+   sres = VG_(open)(cachegrind_out_file, VKI_O_CREAT|VKI_O_TRUNC|VKI_O_WRONLY,
+                                         VKI_S_IRUSR|VKI_S_IWUSR);
+   if (sr_isError(sres)) {
       // If the file can't be opened for whatever reason (conflict
       // between multiple cachegrinded processes?), give up now.
       VG_(umsg)("error: can't open cache simulation output file '%s'\n",
@@ -1399,51 +1614,76 @@ static void fprint_CC_table_and_calc_totals(void)
       VG_(umsg)("       ... so simulation results will be missing.\n");
       VG_(free)(cachegrind_out_file);
       return;
-   } else {
-      VG_(free)(cachegrind_out_file);
    }
+   out_fd   = sr_Res(sres);
+   out_buf  = VG_(malloc)("cg.main.fct.1", OUT_BUF_SIZE);
+   out_used = 0;
+   out_write_failed = False;
 
    // "desc:" lines (giving I1/D1/LL cache configuration).  The spaces after
    // the 2nd colon makes cg_annotate's output look nicer.
-   VG_(fprintf)(fp,  "desc: I1 cache:         %s\n"
-                     "desc: D1 cache:         %s\n"
-                     "desc: LL cache:         %s\n",
-                     I1.desc_line, D1.desc_line, LL.desc_line);
+   out_printf("desc: I1 cache:         %s\n"
+              "desc: D1 cache:         %s\n",
+              I1.desc_line, D1.desc_line);
+   if (cachesim_have_L2)
+      out_printf("desc: L2 cache:         %s\n", L2.desc_line);
+   out_printf("desc: LL cache:         %s\n", LL.desc_line);
 
    // "cmd:" line
-   VG_(fprintf)(fp, "cmd: %s", VG_(args_the_exename));
+   out_puts("cmd: ");
+   out_puts(VG_(args_the_exename));
    for (i = 0; i < VG_(sizeXA)( VG_(args_for_client) ); i++) {
       HChar* arg = * (HChar**) VG_(indexXA)( VG_(args_for_client), i );
-      VG_(fprintf)(fp, " %s", arg);
+      out_puts(" ");
+      out_puts(arg);
    }
    // "events:" line
    if (clo_cache_sim && clo_branch_sim) {
-      VG_(fprintf)(fp, "\nevents: Ir I1mr ILmr Dr D1mr DLmr Dw D1mw DLmw "
-                                  "Bc Bcm Bi Bim\n");
+      out_puts("\nevents: Ir I1mr ILmr Dr D1mr DLmr Dw D1mw DLmw ");
+      if (cachesim_private)
+         out_puts("D1cm D1fs ");
+      out_puts("Bc Bcm Bi Bim\n");
    }
    else if (clo_cache_sim && !clo_branch_sim) {
-      VG_(fprintf)(fp, "\nevents: Ir I1mr ILmr Dr D1mr DLmr Dw D1mw DLmw "
-                                  "\n");
+      out_puts("\nevents: Ir I1mr ILmr Dr D1mr DLmr Dw D1mw DLmw ");
+      if (cachesim_private)
+         out_puts("D1cm D1fs");
+      out_puts("\n");
    }
    else if (!clo_cache_sim && clo_branch_sim) {
-      VG_(fprintf)(fp, "\nevents: Ir Bc Bcm Bi Bim\n");
+      out_puts("\nevents: Ir Bc Bcm Bi Bim\n");
    }
    else {
-      VG_(fprintf)(fp, "\nevents: Ir\n");
+      out_puts("\nevents: Ir\n");
    }
 
+   // Rank the strings, then sort the CCs by file, fn and line.
+   n_strings   = VG_(sizeXA)(stringIds);
+   order       = VG_(malloc)("cg.main.fct.2", (n_strings + 1) * sizeof(UInt));
+   string_rank = VG_(malloc)("cg.main.fct.3", (n_strings + 1) * sizeof(UInt));
+   for (i = 0; i < n_strings; i++)
+      order[i] = i;
+   VG_(ssort)(order, n_strings, sizeof(UInt), cmp_string_ids);
+   for (i = 0; i < n_strings; i++)
+      string_rank[order[i]] = i;
+   VG_(free)(order);
+
+   CCs = (LineCC**)VG_(HT_to_array)(CC_table, &n_CCs);
+   VG_(ssort)(CCs, n_CCs, sizeof(LineCC*), cmp_LineCC_ptrs);
+
    // Traverse every lineCC
-   VG_(OSetGen_ResetIter)(CC_table);
-   while ( (lineCC = VG_(OSetGen_Next)(CC_table)) ) {
+   VG_(memset)(&total, 0, sizeof(total));
+   for (i = 0; i < n_CCs; i++) {
       Bool just_hit_a_new_file = False;
+      lineCC = CCs[i];
       // If we've hit a new file, print a "fl=" line.  Note that because
-      // each string is stored exactly once in the string table, we can use
-      // pointer comparison rather than strcmp() to test for equality, which
-      // is good because most of the time the comparisons are equal and so
-      // the whole strings would have to be checked.
-      if ( lineCC->loc.file != currFile ) {
+      // each string is stored exactly once in the string table, we can
+      // compare ids rather than strings.
+      if ( i == 0 || lineCC->loc.file != currFile ) {
          currFile = lineCC->loc.file;
-         VG_(fprintf)(fp, "fl=%s\n", currFile);
+         out_puts("fl=");
+         out_puts(string_of_id(currFile));
+         out_puts("\n");
          distinct_files++;
          just_hit_a_new_file = True;
       }
@@ -1453,102 +1693,64 @@ static void fprint_CC_table_and_calc_totals(void)
       // in the old file, hence the just_hit_a_new_file test).
       if ( just_hit_a_new_file || lineCC->loc.fn != currFn ) {
          currFn = lineCC->loc.fn;
-         VG_(fprintf)(fp, "fn=%s\n", currFn);
+         out_puts("fn=");
+         out_puts(string_of_id(currFn));
+         out_puts("\n");
          distinct_fns++;
       }
 
       // Print the LineCC
-      if (clo_cache_sim && clo_branch_sim) {
-         VG_(fprintf)(fp,  "%d %llu %llu %llu"
-                             " %llu %llu %llu"
-                             " %llu %llu %llu"
-                             " %llu %llu %llu %llu\n",
-                            lineCC->loc.line,
-                            lineCC->Ir.a, lineCC->Ir.m1, lineCC->Ir.mL, 
-                            lineCC->Dr.a, lineCC->Dr.m1, lineCC->Dr.mL,
-                            lineCC->Dw.a, lineCC->Dw.m1, lineCC->Dw.mL,
-                            lineCC->Bc.b, lineCC->Bc.mp, 
-                            lineCC->Bi.b, lineCC->Bi.mp);
-      }
-      else if (clo_cache_sim && !clo_branch_sim) {
-         VG_(fprintf)(fp,  "%d %llu %llu %llu"
-                             " %llu %llu %llu"
-                             " %llu %llu %llu\n",
-                            lineCC->loc.line,
-                            lineCC->Ir.a, lineCC->Ir.m1, lineCC->Ir.mL, 
-                            lineCC->Dr.a, lineCC->Dr.m1, lineCC->Dr.mL,
-                            lineCC->Dw.a, lineCC->Dw.m1, lineCC->Dw.mL);
-      }
-      else if (!clo_cache_sim && clo_branch_sim) {
-         VG_(fprintf)(fp,  "%d %llu"
-                             " %llu %llu %llu %llu\n",
-                            lineCC->loc.line,
-                            lineCC->Ir.a, 
-                            lineCC->Bc.b, lineCC->Bc.mp, 
-                            lineCC->Bi.b, lineCC->Bi.mp);
-      }
-      else {
-         VG_(fprintf)(fp,  "%d %llu\n",
-                            lineCC->loc.line,
-                            lineCC->Ir.a);
-      }
+      out_printf("%d", lineCC->loc.line);
+      n_vals = get_counts(lineCC, vals);
+      out_counts(vals, n_vals);
+      out_puts("\n");
 
       // Update summary stats
-      Ir_total.a  += lineCC->Ir.a;
-      Ir_total.m1 += lineCC->Ir.m1;
-      Ir_total.mL += lineCC->Ir.mL;
-      Dr_total.a  += lineCC->Dr.a;
-      Dr_total.m1 += lineCC->Dr.m1;
-      Dr_total.mL += lineCC->Dr.mL;
-      Dw_total.a  += lineCC->Dw.a;
-      Dw_total.m1 += lineCC->Dw.m1;
-      Dw_total.mL += lineCC->Dw.mL;
-      Bc_total.b  += lineCC->Bc.b;
-      Bc_total.mp += lineCC->Bc.mp;
-      Bi_total.b  += lineCC->Bi.b;
-      Bi_total.mp += lineCC->Bi.mp;
+      total.Ir.a  += lineCC->Ir.a;
+      total.Ir.m1 += lineCC->Ir.m1;
+      total.Ir.mL += lineCC->Ir.mL;
+      total.Dr.a  += lineCC->Dr.a;
+      total.Dr.m1 += lineCC->Dr.m1;
+      total.Dr.mL += lineCC->Dr.mL;
+      total.Dw.a  += lineCC->Dw.a;
+      total.Dw.m1 += lineCC->Dw.m1;
+      total.Dw.mL += lineCC->Dw.mL;
+      total.Coh.m  += lineCC->Coh.m;
+      total.Coh.fs += lineCC->Coh.fs;
+      total.Bc.b  += lineCC->Bc.b;
+      total.Bc.mp += lineCC->Bc.mp;
+      total.Bi.b  += lineCC->Bi.b;
+      total.Bi.mp += lineCC->Bi.mp;
 
       distinct_lines++;
    }
+   VG_(free)(CCs);
+   VG_(free)(string_rank);
+   string_rank = NULL;
+
+   Ir_total = total.Ir;
+   Dr_total = total.Dr;
+   Dw_total = total.Dw;
+   Coh_total = total.Coh;
+   Bc_total = total.Bc;
+   Bi_total = total.Bi;
 
    // Summary stats must come after rest of table, since we calculate them
    // during traversal.  */
-   if (clo_cache_sim && clo_branch_sim) {
-      VG_(fprintf)(fp,  "summary:"
-                        " %llu %llu %llu"
-                        " %llu %llu %llu"
-                        " %llu %llu %llu"
-                        " %llu %llu %llu %llu\n", 
-                        Ir_total.a, Ir_total.m1, Ir_total.mL,
-                        Dr_total.a, Dr_total.m1, Dr_total.mL,
-                        Dw_total.a, Dw_total.m1, Dw_total.mL,
-                        Bc_total.b, Bc_total.mp, 
-                        Bi_total.b, Bi_total.mp);
-   }
-   else if (clo_cache_sim && !clo_branch_sim) {
-      VG_(fprintf)(fp,  "summary:"
-                        " %llu %llu %llu"
-                        " %llu %llu %llu"
-                        " %llu %llu %llu\n",
-                        Ir_total.a, Ir_total.m1, Ir_total.mL,
-                        Dr_total.a, Dr_total.m1, Dr_total.mL,
-                        Dw_total.a, Dw_total.m1, Dw_total.mL);
-   }
-   else if (!clo_cache_sim && clo_branch_sim) {
-      VG_(fprintf)(fp,  "summary:"
-                        " %llu"
-                        " %llu %llu %llu %llu\n", 
-                        Ir_total.a,
-                        Bc_total.b, Bc_total.mp, 
-                        Bi_total.b, Bi_total.mp);
-   }
-   else {
-      VG_(fprintf)(fp, "summary:"
-                        " %llu\n", 
-                        Ir_total.a);
+   out_puts("summary:");
+   n_vals = get_counts(&total, vals);
+   out_counts(vals, n_vals);
+   out_puts("\n");
+
+   out_flush();
+   VG_(close)(out_fd);
+   VG_(free)(out_buf);
+   if (out_write_failed) {
+      VG_(umsg)("error: can't write cache simulation output file '%s'\n",
+                cachegrind_out_file );
+      VG_(umsg)("       ... so simulation results will be incomplete.\n");
    }
-
-   VG_(fclose)(fp);
+   VG_(free)(cachegrind_out_file);
 }
 
 static UInt ULong_width(ULong n)
@@ -1633,6 +1835,11 @@ static void cg_fini(Int exitcode)
                 l1, D_total.mL  * 100.0 / D_total.a,
                 l2, Dr_total.mL * 100.0 / Dr_total.a,
                 l3, Dw_total.mL * 100.0 / Dw_total.a);
+
+      /* Coherence results, a subset of the D1 misses */
+      if (cachesim_private)
+         VG_(umsg)("D1  coh misses:%'*llu  (%'*llu false sharing)\n",
+                   l1, Coh_total.m, l2, Coh_total.fs);
       VG_(umsg)("\n");
 
       /* LL overall results */
@@ -1653,6 +1860,15 @@ static void cg_fini(Int exitcode)
                 l1, LL_total_m  * 100.0 / (Ir_total.a + D_total.a),
                 l2, LL_total_mr * 100.0 / (Ir_total.a + Dr_total.a),
                 l3, LL_total_mw * 100.0 / Dw_total.a);
+
+      /* L2 results; the LL refs above are the L2 refs in that case */
+      if (cachesim_have_L2) {
+         VG_(sprintf)(fmt, "%%s %%,%dllu\n", l1);
+         VG_(umsg)("\n");
+         VG_(umsg)(fmt, "L2 misses:    ", cachesim_L2_misses);
+         VG_(umsg)("L2 miss rate:  %*.1f%%\n",
+                   l1, cachesim_L2_misses * 100.0 / LL_total);
+      }
    }
 
    /* If branch profiling is enabled, show branch overall results. */
@@ -1702,11 +1918,15 @@ static void cg_fini(Int exitcode)
                 no_debugs * 100.0 / debug_lookups, no_debugs);
 
       VG_(dmsg)("cachegrind: string table size: %u\n",
-                VG_(OSetGen_Size)(stringTable));
+                VG_(HT_count_nodes)(stringTable));
       VG_(dmsg)("cachegrind: CC table size: %u\n",
-                VG_(OSetGen_Size)(CC_table));
+                VG_(HT_count_nodes)(CC_table));
       VG_(dmsg)("cachegrind: InstrInfo table size: %u\n",
                 VG_(OSetGen_Size)(instrInfoTable));
+      if (cachesim_private)
+         VG_(dmsg)("cachegrind: coherence invalidations: %llu, "
+                   "directory size: %u\n", coh_invalidations,
+                   VG_(HT_count_nodes)(coh_dir));
    }
 }
 
@@ -1737,20 +1957,49 @@ void cg_discard_superblock_info ( Addr orig_addr64, VexGuestExtents vge )
    VG_(OSetGen_FreeNode)(instrInfoTable, sbInfo);
 }
 
+/*--------------------------------------------------------------------*/
+/*--- Thread tracking for --private-caches                         ---*/
+/*--------------------------------------------------------------------*/
+
+static void cg_start_client_code ( ThreadId tid, ULong blocks_dispatched )
+{
+   if (tid == cachesim_tid)
+      return;
+   cachesim_switch_thread(tid);
+}
+
+static void cg_pre_thread_ll_create ( ThreadId parent, ThreadId child )
+{
+   cachesim_reset_thread(child);
+}
+
 /*--------------------------------------------------------------------*/
 /*--- Command line processing                                      ---*/
 /*--------------------------------------------------------------------*/
 
 static Bool cg_process_cmd_line_option(const HChar* arg)
 {
+   const HChar* tmp_str;
+
    if (VG_(str_clo_cache_opt)(arg,
                               &clo_I1_cache,
                               &clo_D1_cache,
                               &clo_LL_cache)) {}
 
+   else if VG_STR_CLO( arg, "--L2-cache", tmp_str) {
+      VG_(parse_cache_opt)(&clo_L2_cache, arg, tmp_str);
+   }
+   else if VG_XACT_CLO(arg, "--LL-policy=lru",    clo_LL_policy, Policy_LRU) {}
+   else if VG_XACT_CLO(arg, "--LL-policy=plru",   clo_LL_policy, Policy_PLRU) {}
+   else if VG_XACT_CLO(arg, "--LL-policy=rrip",   clo_LL_policy, Policy_RRIP) {}
+   else if VG_XACT_CLO(arg, "--LL-policy=random", clo_LL_policy,
+                                                  Policy_Random) {}
+   else if VG_BOOL_CLO(arg, "--cache-inclusive", clo_cache_inclusive) {}
+
    else if VG_STR_CLO( arg, "--cachegrind-out-file", clo_cachegrind_out_file) {}
    else if VG_BOOL_CLO(arg, "--cache-sim",  clo_cache_sim)  {}
    else if VG_BOOL_CLO(arg, "--branch-sim", clo_branch_sim) {}
+   else if VG_BOOL_CLO(arg, "--private-caches", clo_private_caches) {}
    else
       return False;
 
@@ -1761,6 +2010,14 @@ static void cg_print_usage(void)
 {
    VG_(print_cache_clo_opts)();
    VG_(printf)(
+"    --L2-cache=<size>,<assoc>,<line_size>  add an L2 cache [none]\n"
+"    --LL-policy=lru|plru|rrip|random LL cache replacement policy [lru]\n"
+"    --cache-inclusive=yes|no [no]    make lower cache levels inclusive\n"
+"                                     of the upper ones?\n"
+"    --private-caches=yes|no [no]     give each thread its own L1 and L2\n"
+"                                     caches, and count coherence misses\n"
+"                                     (at most one per line per thread\n"
+"                                     switch)?\n"
 "    --cache-sim=yes|no  [yes]        collect cache stats?\n"
 "    --branch-sim=yes|no [no]         collect branch prediction stats?\n"
 "    --cachegrind-out-file=<file>     output file name [cachegrind.out.%%p]\n"
@@ -1808,21 +2065,17 @@ static void cg_post_clo_init(void)
 {
    cache_t I1c, D1c, LLc; 
 
-   CC_table =
-      VG_(OSetGen_Create)(offsetof(LineCC, loc),
-                          cmp_CodeLoc_LineCC,
-                          VG_(malloc), "cg.main.cpci.1",
-                          VG_(free));
+   CC_table = VG_(HT_construct)("cg.main.cpci.1");
+   CC_pool  = VG_(newPA)(sizeof(LineCC), 1000,
+                         VG_(malloc), "cg.main.cpci.5", VG_(free));
    instrInfoTable =
       VG_(OSetGen_Create)(/*keyOff*/0,
                           NULL,
                           VG_(malloc), "cg.main.cpci.2",
                           VG_(free));
-   stringTable =
-      VG_(OSetGen_Create)(/*keyOff*/0,
-                          stringCmp,
-                          VG_(malloc), "cg.main.cpci.3",
-                          VG_(free));
+   stringTable = VG_(HT_construct)("cg.main.cpci.3");
+   stringIds   = VG_(newXA)(VG_(malloc), "cg.main.cpci.6",
+                            VG_(free), sizeof(HChar*));
 
    VG_(post_clo_init_configure_caches)(&I1c, &D1c, &LLc,
                                        &clo_I1_cache,
@@ -1834,6 +2087,8 @@ static void cg_post_clo_init(void)
    // cache lines at any cache level
    min_line_size = (I1c.line_size < D1c.line_size) ? I1c.line_size : D1c.line_size;
    min_line_size = (LLc.line_size < min_line_size) ? LLc.line_size : min_line_size;
+   if (clo_L2_cache.size != -1 && clo_L2_cache.line_size < min_line_size)
+      min_line_size = clo_L2_cache.line_size;
 
    Int largest_load_or_store_size
       = VG_(machine_get_size_of_largest_guest_register)();
@@ -1849,7 +2104,17 @@ static void cg_post_clo_init(void)
       VG_(exit)(1);
    }
 
-   cachesim_initcaches(I1c, D1c, LLc);
+   cachesim_initcaches(I1c, D1c, LLc,
+                       clo_L2_cache.size == -1 ? NULL : &clo_L2_cache,
+                       clo_LL_policy, clo_cache_inclusive);
+
+   if (!clo_cache_sim)
+      clo_private_caches = False;
+   if (clo_private_caches) {
+      cachesim_init_private();
+      VG_(track_start_client_code)(cg_start_client_code);
+      VG_(track_pre_thread_ll_create)(cg_pre_thread_ll_create);
+   }
 }
 
 VG_DETERMINE_INTERFACE_VERSION(cg_pre_clo_init)
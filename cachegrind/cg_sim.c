@@ -36,8 +36,26 @@
       - both blocks hit                  --> one hit
       - one block hits, the other misses --> one miss
       - both blocks miss                 --> one miss (not two)
+  - L1 caches and the optional L2 always use LRU replacement; the LL
+    cache uses the policy given by --LL-policy
+  - with an LRU LL, no L2 and a non-inclusive hierarchy (the default),
+    only the original LRU code below is used
 */
 
+typedef enum {
+   Policy_LRU,     /* true LRU, tags kept in MRU..LRU order */
+   Policy_PLRU,    /* bit-PLRU: one MRU bit per way */
+   Policy_RRIP,    /* static RRIP, 2-bit re-reference prediction values */
+   Policy_Random
+} ReplPolicy;
+
+#define RRIP_MAX     3
+#define RRIP_INSERT  2
+
+/* Tag never used by a real block, for lines invalidated by an
+   inclusive lower level. */
+#define INVALID_TAG  (~(UWord)0)
+
 typedef struct {
    Int          size;                   /* bytes */
    Int          assoc;
@@ -48,10 +66,23 @@ typedef struct {
    Int          tag_shift;
    HChar        desc_line[128];         /* large enough */
    UWord*       tags;
+   ReplPolicy   policy;
+   UChar*       meta;                   /* per-way policy state, or NULL */
 } cache_t2;
 
+static const HChar* policy_name(ReplPolicy p)
+{
+   switch (p) {
+      case Policy_LRU:    return "lru";
+      case Policy_PLRU:   return "plru";
+      case Policy_RRIP:   return "rrip";
+      case Policy_Random: return "random";
+      default:            tl_assert(0);
+   }
+}
+
 /* By this point, the size/assoc/line_size has been checked. */
-static void cachesim_initcache(cache_t config, cache_t2* c)
+static void cachesim_initcache(cache_t config, cache_t2* c, ReplPolicy policy)
 {
    Int i;
 
@@ -77,6 +108,39 @@ static void cachesim_initcache(cache_t config, cache_t2* c)
 
    for (i = 0; i < c->sets * c->assoc; i++)
       c->tags[i] = 0;
+
+   c->policy = policy;
+   c->meta   = NULL;
+   if (policy != Policy_LRU) {
+      VG_(sprintf)(c->desc_line + VG_(strlen)(c->desc_line),
+                   ", %s replacement", policy_name(policy));
+      c->meta = VG_(malloc)("cg.sim.ci.2", c->sets * c->assoc);
+      /* Empty ways are the first candidates for eviction. */
+      VG_(memset)(c->meta, policy == Policy_RRIP ? RRIP_MAX : 0,
+                  c->sets * c->assoc);
+   }
+}
+
+/* Returns the index of tag in set[0 .. n-1], or -1.  Comparing four
+ * ways per iteration without early exits lets the compiler turn the
+ * compares into vector operations on highly associative caches.
+ */
+__attribute__((always_inline))
+static __inline__
+Int cachesim_find_way(const UWord* set, Int n, UWord tag)
+{
+   Int i = 0;
+
+   for (; i + 4 <= n; i += 4) {
+      if ((set[i]   == tag) | (set[i+1] == tag) |
+          (set[i+2] == tag) | (set[i+3] == tag))
+         break;
+   }
+   for (; i < n; i++) {
+      if (set[i] == tag)
+         return i;
+   }
+   return -1;
 }
 
 /* This attribute forces GCC to inline the function, getting rid of a
@@ -101,15 +165,14 @@ Bool cachesim_setref_is_miss(cache_t2* c, UInt set_no, UWord tag)
 
    /* If the tag is one other than the MRU, move it into the MRU spot  */
    /* and shuffle the rest down.                                       */
-   for (i = 1; i < c->assoc; i++) {
-      if (tag == set[i]) {
-         for (j = i; j > 0; j--) {
-            set[j] = set[j - 1];
-         }
-         set[0] = tag;
-
-         return False;
+   i = 1 + cachesim_find_way(set + 1, c->assoc - 1, tag);
+   if (i > 0) {
+      for (j = i; j > 0; j--) {
+         set[j] = set[j - 1];
       }
+      set[0] = tag;
+
+      return False;
    }
 
    /* A miss;  install this tag as MRU, shuffle rest down. */
@@ -166,12 +229,496 @@ Bool cachesim_ref_is_miss(cache_t2* c, Addr a, UChar size)
 static cache_t2 LL;
 static cache_t2 I1;
 static cache_t2 D1;
+static cache_t2 L2;
+
+static Bool  cachesim_have_L2   = False;
+static Bool  cachesim_inclusive = False;
+/* True with --private-caches, see below. */
+static Bool  cachesim_private   = False;
+/* True if anything below L1 differs from the plain LRU LL cache. */
+static Bool  cachesim_gen       = False;
+static UInt  cachesim_seed      = 1;
+static ULong cachesim_L2_misses = 0;
+
+/* L2C may be NULL, meaning no L2 cache. */
+static void cachesim_initcaches(cache_t I1c, cache_t D1c, cache_t LLc,
+                                cache_t* L2c, ReplPolicy LL_policy,
+                                Bool inclusive)
+{
+   cachesim_initcache(I1c, &I1, Policy_LRU);
+   cachesim_initcache(D1c, &D1, Policy_LRU);
+   cachesim_initcache(LLc, &LL, LL_policy);
+   if (L2c)
+      cachesim_initcache(*L2c, &L2, Policy_LRU);
+
+   cachesim_have_L2   = L2c != NULL;
+   cachesim_inclusive = inclusive;
+   cachesim_gen       = LL_policy != Policy_LRU || cachesim_have_L2
+                        || inclusive;
+}
+
+/*------------------------------------------------------------*/
+/*--- Generic lower levels                                 ---*/
+/*------------------------------------------------------------*/
+
+/* Everything in this section is only used when cachesim_gen is set,
+   so it is kept out of line, away from the LRU fast path. */
+
+/* Removes block from cache c (which must be LRU), shuffling the less
+   recently used ways up.  TAGS is c->tags, or the tags of the same
+   cache for another thread. */
+static void cachesim_invalidate_block(cache_t2* c, UWord* tags, UWord block)
+{
+   UWord* set = &(tags[(block & c->sets_min_1) * c->assoc]);
+   Int    i   = cachesim_find_way(set, c->assoc, block);
+
+   if (i < 0)
+      return;
+   for (; i < c->assoc - 1; i++)
+      set[i] = set[i + 1];
+   set[c->assoc - 1] = INVALID_TAG;
+}
+
+static void cachesim_evicted_private(Addr a, Addr end);
+
+/* Back-invalidation: block (of cache c) was just evicted from c, so
+   remove every part of it from the caches above c. */
+static void cachesim_evicted(cache_t2* c, UWord block)
+{
+   Addr a   = block << c->line_size_bits;
+   Addr end = a + c->line_size;
+   Addr b;
+
+   /* The LL cache is shared, so with private caches the block has to go
+      from the caches of every thread. */
+   if (c == &LL && cachesim_private) {
+      cachesim_evicted_private(a, end);
+      return;
+   }
+   if (c == &LL && cachesim_have_L2) {
+      for (b = a; b < end; b += L2.line_size)
+         cachesim_invalidate_block(&L2, L2.tags, b >> L2.line_size_bits);
+   }
+   for (b = a; b < end; b += I1.line_size)
+      cachesim_invalidate_block(&I1, I1.tags, b >> I1.line_size_bits);
+   for (b = a; b < end; b += D1.line_size)
+      cachesim_invalidate_block(&D1, D1.tags, b >> D1.line_size_bits);
+}
+
+/* Picks the way to replace in a set of a non-LRU cache. */
+static Int cachesim_victim(cache_t2* c, UChar* meta)
+{
+   Int i;
+
+   switch (c->policy) {
+      case Policy_PLRU:
+         for (i = 0; i < c->assoc; i++)
+            if (meta[i] == 0)
+               return i;
+         /* only when assoc == 1: the MRU bits are reset once all set */
+         return 0;
+
+      case Policy_RRIP:
+         for (;;) {
+            for (i = 0; i < c->assoc; i++)
+               if (meta[i] == RRIP_MAX)
+                  return i;
+            for (i = 0; i < c->assoc; i++)
+               meta[i]++;
+         }
+
+      case Policy_Random:
+         /* The low bits of VG_(random)() have a short period. */
+         return (VG_(random)(&cachesim_seed) >> 16) % c->assoc;
+
+      default:
+         tl_assert(0);
+   }
+}
+
+/* Updates the policy state for an access to way w. */
+static void cachesim_touch(cache_t2* c, UChar* meta, Int w, Bool fill)
+{
+   Int i;
+
+   switch (c->policy) {
+      case Policy_PLRU:
+         meta[w] = 1;
+         for (i = 0; i < c->assoc; i++)
+            if (meta[i] == 0)
+               return;
+         for (i = 0; i < c->assoc; i++)
+            meta[i] = 0;
+         meta[w] = 1;
+         break;
+
+      case Policy_RRIP:
+         meta[w] = fill ? RRIP_INSERT : 0;
+         break;
+
+      case Policy_Random:
+         break;
+
+      default:
+         tl_assert(0);
+   }
+}
+
+static Bool cachesim_gen_setref_is_miss(cache_t2* c, UInt set_no, UWord tag)
+{
+   UWord* set = &(c->tags[set_no * c->assoc]);
+   UChar* meta;
+   UWord  victim;
+   Int    w;
+
+   if (c->policy == Policy_LRU) {
+      if (tag == set[0])
+         return False;
+      victim = set[c->assoc - 1];
+      if (!cachesim_setref_is_miss(c, set_no, tag))
+         return False;
+      if (cachesim_inclusive && victim != INVALID_TAG)
+         cachesim_evicted(c, victim);
+      return True;
+   }
+
+   meta = &(c->meta[set_no * c->assoc]);
+   w = cachesim_find_way(set, c->assoc, tag);
+   if (w >= 0) {
+      cachesim_touch(c, meta, w, False);
+      return False;
+   }
+
+   w = cachesim_victim(c, meta);
+   victim = set[w];
+   set[w] = tag;
+   cachesim_touch(c, meta, w, True);
+   if (cachesim_inclusive && victim != INVALID_TAG)
+      cachesim_evicted(c, victim);
+   return True;
+}
+
+/* As cachesim_ref_is_miss, for any policy. */
+static Bool cachesim_gen_ref_is_miss(cache_t2* c, Addr a, UChar size)
+{
+   UWord block1 =  a         >> c->line_size_bits;
+   UWord block2 = (a+size-1) >> c->line_size_bits;
+
+   if (block1 == block2)
+      return cachesim_gen_setref_is_miss(c, block1 & c->sets_min_1, block1);
+
+   tl_assert(block1 + 1 == block2);
+   if (cachesim_gen_setref_is_miss(c, block1 & c->sets_min_1, block1)) {
+      cachesim_gen_setref_is_miss(c, block2 & c->sets_min_1, block2);
+      return True;
+   }
+   return cachesim_gen_setref_is_miss(c, block2 & c->sets_min_1, block2);
+}
+
+/* An L1 miss: look the access up in the L2 (if any) and the LL cache.
+   Returns True if it misses in the LL cache. */
+__attribute__((noinline))
+static Bool cachesim_gen_below_L1_is_miss(Addr a, UChar size)
+{
+   if (cachesim_have_L2) {
+      if (!cachesim_gen_ref_is_miss(&L2, a, size))
+         return False;
+      cachesim_L2_misses++;
+   }
+   return cachesim_gen_ref_is_miss(&LL, a, size);
+}
+
+/*------------------------------------------------------------*/
+/*--- Private caches and coherence                         ---*/
+/*------------------------------------------------------------*/
+
+/* With private caches, each thread has its own I1, D1 and L2 (if any),
+   while the LL cache is shared.  The tag arrays of the running thread
+   are swapped into I1, D1 and L2, so the functions above work
+   unchanged.
+
+   Coherence is modelled for the D1 caches, MESI-style: a directory
+   records which threads hold each D1 line, and a write invalidates the
+   line in the D1 and L2 caches of the other holders.  An invalidated D1
+   way keeps its place in the set, with COH_BIT set in its tag.  A later
+   miss that finds that tag would have hit without the invalidation, so
+   it is counted as a coherence miss.  It is also counted as false
+   sharing if none of the bytes it touches were written since the
+   invalidation. */
+
+#define COH_BIT      ((UWord)1 << (8 * sizeof(UWord) - 1))
+#define SHARER_BITS  (8 * sizeof(UWord))
+
+typedef struct {
+   UWord* I1_tags;
+   UWord* D1_tags;
+   UWord* L2_tags;    /* NULL if no L2 */
+} ThreadCaches;
+
+typedef struct _DirEntry DirEntry;
+struct _DirEntry {
+   DirEntry* next;     /* MUST BE FIRST */
+   UWord     key;      /* D1 block, MUST BE SECOND */
+   UWord     sharers;  /* bit (tid % SHARER_BITS) set per holder */
+   UWord     written;  /* granules written since the last invalidation */
+};
+
+static ThreadId      cachesim_tid     = 1;
+static ThreadCaches** thread_caches;   /* indexed by ThreadId */
+static ThreadId      thread_caches_max = 1;  /* highest tid with caches */
+static VgHashTable*  coh_dir;
+static PoolAlloc*    coh_dir_pool;
+static Int           coh_granule_bits;  /* log2 of bytes per 'written' bit */
+static ULong         coh_invalidations = 0;
+
+static UWord* cachesim_new_tags(cache_t2* c)
+{
+   return VG_(calloc)("cg.sim.cnt.1", c->sets * c->assoc, sizeof(UWord));
+}
+
+/* Called after cachesim_initcaches; the caches set up there become
+   those of the first thread. */
+static void cachesim_init_private(void)
+{
+   ThreadCaches* tc = VG_(malloc)("cg.sim.cip.1", sizeof(ThreadCaches));
+
+   thread_caches = VG_(calloc)("cg.sim.cip.4", VG_N_THREADS,
+                               sizeof(ThreadCaches*));
+   tc->I1_tags = I1.tags;
+   tc->D1_tags = D1.tags;
+   tc->L2_tags = cachesim_have_L2 ? L2.tags : NULL;
+   thread_caches[cachesim_tid] = tc;
+
+   coh_dir      = VG_(HT_construct)("cg.sim.cip.2");
+   coh_dir_pool = VG_(newPA)(sizeof(DirEntry), 1000,
+                             VG_(malloc), "cg.sim.cip.3", VG_(free));
+   coh_granule_bits = D1.line_size_bits - VG_(log2)(SHARER_BITS);
+   if (coh_granule_bits < 0)
+      coh_granule_bits = 0;
+   cachesim_private = True;
+}
+
+static void cachesim_switch_thread(ThreadId tid)
+{
+   ThreadCaches* tc;
+
+   if (tid == cachesim_tid)
+      return;
+   tc = thread_caches[tid];
+   if (tc == NULL) {
+      tc = VG_(malloc)("cg.sim.cst.1", sizeof(ThreadCaches));
+      tc->I1_tags = cachesim_new_tags(&I1);
+      tc->D1_tags = cachesim_new_tags(&D1);
+      tc->L2_tags = cachesim_have_L2 ? cachesim_new_tags(&L2) : NULL;
+      thread_caches[tid] = tc;
+      if (tid > thread_caches_max)
+         thread_caches_max = tid;
+   }
+   I1.tags = tc->I1_tags;
+   D1.tags = tc->D1_tags;
+   if (cachesim_have_L2)
+      L2.tags = tc->L2_tags;
+   cachesim_tid = tid;
+}
+
+/* A new thread reusing tid starts with cold caches.  Stale directory
+   bits for it are harmless: invalidating a line it no longer holds is
+   a no-op. */
+static void cachesim_reset_thread(ThreadId tid)
+{
+   ThreadCaches* tc = thread_caches[tid];
+
+   if (tc == NULL)
+      return;
+   VG_(memset)(tc->I1_tags, 0, I1.sets * I1.assoc * sizeof(UWord));
+   VG_(memset)(tc->D1_tags, 0, D1.sets * D1.assoc * sizeof(UWord));
+   if (tc->L2_tags)
+      VG_(memset)(tc->L2_tags, 0, L2.sets * L2.assoc * sizeof(UWord));
+}
+
+static DirEntry* coh_dir_add(UWord block, ThreadId tid)
+{
+   DirEntry* e = VG_(HT_lookup)(coh_dir, block);
+
+   if (e == NULL) {
+      e = VG_(allocEltPA)(coh_dir_pool);
+      e->key     = block;
+      e->sharers = 0;
+      e->written = 0;
+      VG_(HT_add_node)(coh_dir, e);
+   }
+   e->sharers |= (UWord)1 << (tid % SHARER_BITS);
+   return e;
+}
+
+static void coh_dir_remove(UWord block, ThreadId tid)
+{
+   DirEntry* e = VG_(HT_lookup)(coh_dir, block);
+
+   if (e == NULL)
+      return;
+   e->sharers &= ~((UWord)1 << (tid % SHARER_BITS));
+   if (e->sharers == 0) {
+      VG_(HT_remove)(coh_dir, block);
+      VG_(freeEltPA)(coh_dir_pool, e);
+   }
+}
+
+/* Invalidates D1 block in the private caches of thread tid. */
+static void coh_invalidate(ThreadId tid, UWord block)
+{
+   ThreadCaches* tc = thread_caches[tid];
+   UWord* set;
+   Addr   a, b;
+   Int    w;
+
+   if (tc == NULL)
+      return;
+   set = &(tc->D1_tags[(block & D1.sets_min_1) * D1.assoc]);
+   w = cachesim_find_way(set, D1.assoc, block);
+   if (w >= 0)
+      set[w] = block | COH_BIT;
+
+   if (tc->L2_tags) {
+      a = block << D1.line_size_bits;
+      for (b = a; b < a + D1.line_size; b += L2.line_size)
+         cachesim_invalidate_block(&L2, tc->L2_tags, b >> L2.line_size_bits);
+   }
+}
+
+/* Back-invalidation of the LL block a .. end-1 from the private caches of
+   all threads.  A D1 line is removed whether or not it has been
+   invalidated by a write, since it would now miss in any case. */
+static void cachesim_evicted_private(Addr a, Addr end)
+{
+   ThreadCaches* tc;
+   ThreadId tid;
+   UWord    block;
+   Addr     b;
+
+   for (tid = 1; tid <= thread_caches_max; tid++) {
+      tc = thread_caches[tid];
+      if (tc == NULL)
+         continue;
+      if (tc->L2_tags) {
+         for (b = a; b < end; b += L2.line_size)
+            cachesim_invalidate_block(&L2, tc->L2_tags,
+                                      b >> L2.line_size_bits);
+      }
+      for (b = a; b < end; b += I1.line_size)
+         cachesim_invalidate_block(&I1, tc->I1_tags, b >> I1.line_size_bits);
+      for (b = a; b < end; b += D1.line_size) {
+         block = b >> D1.line_size_bits;
+         cachesim_invalidate_block(&D1, tc->D1_tags, block);
+         cachesim_invalidate_block(&D1, tc->D1_tags, block | COH_BIT);
+         coh_dir_remove(block, tid);
+      }
+   }
+}
+
+/* Bits of the 'written' mask covering bytes lo .. hi of a D1 line. */
+static UWord coh_mask(Addr lo, Addr hi)
+{
+   UWord first = (lo & (D1.line_size - 1)) >> coh_granule_bits;
+   UWord last  = (hi & (D1.line_size - 1)) >> coh_granule_bits;
+
+   return (~(UWord)0 >> (SHARER_BITS - 1 - last)) & (~(UWord)0 << first);
+}
+
+/* LRU lookup of block in D1.  On a miss, *victim is the evicted tag, or
+   0 if an invalidated way was reused, in which case *coh is set. */
+static Bool cachesim_coh_setref_is_miss(UWord block, UWord* victim, Bool* coh)
+{
+   UWord* set = &(D1.tags[(block & D1.sets_min_1) * D1.assoc]);
+   Bool   miss = False;
+   Int    i, j;
 
-static void cachesim_initcaches(cache_t I1c, cache_t D1c, cache_t LLc)
+   if (set[0] == block)
+      return False;
+   i = cachesim_find_way(set, D1.assoc, block);
+   if (i < 0) {
+      miss = True;
+      i = cachesim_find_way(set, D1.assoc, block | COH_BIT);
+      if (i >= 0) {
+         *coh    = True;
+         *victim = 0;
+      } else {
+         i = D1.assoc - 1;
+         *victim = set[i];
+      }
+   }
+   for (j = i; j > 0; j--)
+      set[j] = set[j - 1];
+   set[0] = block;
+   return miss;
+}
+
+/* As cachesim_D1_doref, with coherence.  A modify counts as a write. */
+static void cachesim_coh_D1_doref(Addr a, UChar size, Bool is_write,
+                                  ULong* m1, ULong* mL,
+                                  ULong* cm, ULong* fs)
 {
-   cachesim_initcache(I1c, &I1);
-   cachesim_initcache(D1c, &D1);
-   cachesim_initcache(LLc, &LL);
+   UWord block1 =  a         >> D1.line_size_bits;
+   UWord block2 = (a+size-1) >> D1.line_size_bits;
+   UWord me     = (UWord)1 << (cachesim_tid % SHARER_BITS);
+   Bool  miss = False, coh = False, false_sharing = True;
+   UWord block, victim, others, mask;
+   UInt  k;
+   ThreadId tid;
+   DirEntry* e;
+
+   tl_assert(block2 - block1 <= 1);
+   for (block = block1; block <= block2; block++) {
+      Bool line_coh = False;
+      Addr lo = block == block1 ? a : block << D1.line_size_bits;
+      Addr hi = block == block2 ? a + size - 1
+                                : ((block + 1) << D1.line_size_bits) - 1;
+
+      mask = coh_mask(lo, hi);
+      e = NULL;
+      if (cachesim_coh_setref_is_miss(block, &victim, &line_coh)) {
+         miss = True;
+         if (victim != 0 && !(victim & COH_BIT))
+            coh_dir_remove(victim, cachesim_tid);
+         e = coh_dir_add(block, cachesim_tid);
+         if (line_coh) {
+            coh = True;
+            if (e->written & mask)
+               false_sharing = False;
+         }
+      }
+      if (is_write) {
+         if (e == NULL)
+            e = coh_dir_add(block, cachesim_tid);
+         others = e->sharers & ~me;
+         if (others) {
+            coh_invalidations++;
+            e->sharers = me;
+            e->written = 0;
+            /* More than SHARER_BITS threads share bits. */
+            for (k = 0; others != 0; k++, others >>= 1) {
+               if (!(others & 1))
+                  continue;
+               for (tid = k; tid < VG_N_THREADS; tid += SHARER_BITS)
+                  if (tid != cachesim_tid)
+                     coh_invalidate(tid, block);
+            }
+         }
+         e->written |= mask;
+      }
+   }
+
+   if (miss) {
+      (*m1)++;
+      if (LIKELY(!cachesim_gen) ? cachesim_ref_is_miss(&LL, a, size)
+                                : cachesim_gen_below_L1_is_miss(a, size))
+         (*mL)++;
+      if (coh) {
+         (*cm)++;
+         if (false_sharing)
+            (*fs)++;
+      }
+   }
 }
 
 __attribute__((always_inline))
@@ -180,7 +727,8 @@ void cachesim_I1_doref_Gen(Addr a, UChar size, ULong* m1, ULong *mL)
 {
    if (cachesim_ref_is_miss(&I1, a, size)) {
       (*m1)++;
-      if (cachesim_ref_is_miss(&LL, a, size))
+      if (LIKELY(!cachesim_gen) ? cachesim_ref_is_miss(&LL, a, size)
+                                : cachesim_gen_below_L1_is_miss(a, size))
          (*mL)++;
    }
 }
@@ -197,8 +745,12 @@ void cachesim_I1_doref_NoX(Addr a, UChar size, ULong* m1, ULong *mL)
    if (cachesim_setref_is_miss(&I1, I1_set, block)) {
       UInt  LL_set = block & LL.sets_min_1;
       (*m1)++;
+      if (UNLIKELY(cachesim_gen)) {
+         if (cachesim_gen_below_L1_is_miss(a, size))
+            (*mL)++;
+      }
       // can use block as tag as L1I and LL cache line sizes are equal
-      if (cachesim_setref_is_miss(&LL, LL_set, block))
+      else if (cachesim_setref_is_miss(&LL, LL_set, block))
          (*mL)++;
    }
 }
@@ -209,7 +761,8 @@ void cachesim_D1_doref(Addr a, UChar size, ULong* m1, ULong *mL)
 {
    if (cachesim_ref_is_miss(&D1, a, size)) {
       (*m1)++;
-      if (cachesim_ref_is_miss(&LL, a, size))
+      if (LIKELY(!cachesim_gen) ? cachesim_ref_is_miss(&LL, a, size)
+                                : cachesim_gen_below_L1_is_miss(a, size))
          (*mL)++;
    }
 }
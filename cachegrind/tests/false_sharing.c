@@ -0,0 +1,46 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+// Two threads update different words of the same cache line.  With
+// --private-caches=yes the resulting D1 misses are coherence misses,
+// and they are caused by false sharing.
+
+static struct {
+   volatile long a;
+   volatile long b;
+} counters;
+
+static void* inc_a(void* arg)
+{
+   int i;
+   for (i = 0; i < 10000; i++) {
+      counters.a++;
+      if (i % 100 == 0)
+         sched_yield();
+   }
+   return NULL;
+}
+
+static void* inc_b(void* arg)
+{
+   int i;
+   for (i = 0; i < 10000; i++) {
+      counters.b++;
+      if (i % 100 == 0)
+         sched_yield();
+   }
+   return NULL;
+}
+
+int main(void)
+{
+   pthread_t t1, t2;
+
+   pthread_create(&t1, NULL, inc_a, NULL);
+   pthread_create(&t2, NULL, inc_b, NULL);
+   pthread_join(t1, NULL);
+   pthread_join(t2, NULL);
+   printf("%ld\n", counters.a + counters.b);
+   return 0;
+}
@@ -0,0 +1,52 @@
+// Access patterns whose LL miss counts differ between the replacement
+// policies, for the LL cache configured in the ll_policy*.vgtest files
+// (16 KB, 4-way, 64 B lines, so 64 sets) behind a 4 KB D1.  All arrays
+// are line aligned and every LL set receives the same number of lines,
+// so the miss counts do not depend on where the arrays end up in memory.
+// This file is compiled with optimization such that the loop variables
+// stay in registers and the only data accesses are those to the arrays.
+
+#define LINE_SIZE 64
+#define LL_SETS   64
+#define N_PASSES  100
+
+// Five lines per LL set, scanned cyclically.
+static volatile char cyclic[5 * LL_SETS * LINE_SIZE]
+   __attribute__((aligned(LINE_SIZE)));
+// Two lines per LL set that are used twice on every pass ...
+static volatile char hot[2 * LL_SETS * LINE_SIZE]
+   __attribute__((aligned(LINE_SIZE)));
+// ... and three lines per LL set per pass that are used only once.
+static volatile char stream[N_PASSES * 3 * LL_SETS * LINE_SIZE]
+   __attribute__((aligned(LINE_SIZE)));
+
+__attribute__((noinline))
+static int scan(void)
+{
+   int pass, i, sum = 0;
+
+   for (pass = 0; pass < N_PASSES; pass++)
+      for (i = 0; i < 5 * LL_SETS; i++)
+         sum += cyclic[i * LINE_SIZE];
+   return sum;
+}
+
+__attribute__((noinline))
+static int reuse(void)
+{
+   int pass, rep, i, sum = 0;
+
+   for (pass = 0; pass < N_PASSES; pass++) {
+      for (rep = 0; rep < 2; rep++)
+         for (i = 0; i < 2 * LL_SETS; i++)
+            sum += hot[i * LINE_SIZE];
+      for (i = 0; i < 3 * LL_SETS; i++)
+         sum += stream[(pass * 3 * LL_SETS + i) * LINE_SIZE];
+   }
+   return sum;
+}
+
+int main(void)
+{
+   return scan() + reuse();
+}
@@ -35,32 +35,25 @@
 /*--- BBCC operations                                      ---*/
 /*------------------------------------------------------------*/
 
-#define N_BBCC_INITIAL_ENTRIES  10437
+/* number of buckets, see cchash.c */
+#define N_BBCC_INITIAL_BUCKETS  4096
 
 /* BBCC table (key is BB/Context), per thread, resizable */
 bbcc_hash current_bbccs;
 
 void CLG_(init_bbcc_hash)(bbcc_hash* bbccs)
 {
-   Int i;
-
    CLG_ASSERT(bbccs != 0);
 
-   bbccs->size    = N_BBCC_INITIAL_ENTRIES;
-   bbccs->entries = 0;
-   bbccs->table = (BBCC**) CLG_MALLOC("cl.bbcc.ibh.1",
-                                      bbccs->size * sizeof(BBCC*));
-
-   for (i = 0; i < bbccs->size; i++) bbccs->table[i] = NULL;
+   CLG_(init_cc_hash)(&(bbccs->h), N_BBCC_INITIAL_BUCKETS, "cl.bbcc.ibh.1");
+   bbccs->dirty = 0;
 }
 
 void CLG_(copy_current_bbcc_hash)(bbcc_hash* dst)
 {
   CLG_ASSERT(dst != 0);
 
-  dst->size    = current_bbccs.size;
-  dst->entries = current_bbccs.entries;
-  dst->table   = current_bbccs.table;
+  *dst = current_bbccs;
 }
 
 bbcc_hash* CLG_(get_current_bbcc_hash)()
@@ -72,9 +65,7 @@ void CLG_(set_current_bbcc_hash)(bbcc_hash* h)
 {
   CLG_ASSERT(h != 0);
 
-  current_bbccs.size    = h->size;
-  current_bbccs.entries = h->entries;
-  current_bbccs.table   = h->table;
+  current_bbccs = *h;
 }
 
 /*
@@ -111,25 +102,61 @@ void CLG_(zero_bbcc)(BBCC* bbcc)
 
 
 
-void CLG_(forall_bbccs)(void (*func)(BBCC*))
+/* BBCCs getting cost are put on the dirty list of the current thread,
+ * so that dumping and zeroing does not have to visit all BBCCs.
+ * A BBCC is dirty iff ecounter_sum or ret_counter is non-zero.
+ */
+void CLG_(set_bbcc_dirty)(BBCC* bbcc)
 {
-  BBCC *bbcc, *bbcc2;
-  int i, j;
-	
-  for (i = 0; i < current_bbccs.size; i++) {
-    if ((bbcc=current_bbccs.table[i]) == NULL) continue;
-    while (bbcc) {
-      /* every bbcc should have a rec_array */
-      CLG_ASSERT(bbcc->rec_array != 0);
-
-      for(j=0;j<bbcc->cxt->fn[0]->separate_recursions;j++) {
-	if ((bbcc2 = bbcc->rec_array[j]) == 0) continue;
-
-	(*func)(bbcc2);
-      }
-      bbcc = bbcc->next;
-    }
+  CLG_ASSERT(!bbcc->dirty);
+
+  bbcc->dirty = True;
+  bbcc->next_dirty = current_bbccs.dirty;
+  current_bbccs.dirty = bbcc;
+}
+
+void CLG_(forall_dirty_bbccs)(void (*func)(BBCC*))
+{
+  BBCC* bbcc;
+
+  for(bbcc = current_bbccs.dirty; bbcc; bbcc = bbcc->next_dirty)
+    (*func)(bbcc);
+}
+
+/* To be called when the cost of all dirty BBCCs was zeroed */
+void CLG_(clear_dirty_bbccs)(void)
+{
+  BBCC *bbcc, *next;
+
+  for(bbcc = current_bbccs.dirty; bbcc; bbcc = next) {
+    next = bbcc->next_dirty;
+    bbcc->dirty = False;
+    bbcc->next_dirty = 0;
   }
+  current_bbccs.dirty = 0;
+}
+
+static void (*forall_func)(BBCC*);
+
+static void forall_rec_bbccs(void* entry)
+{
+  BBCC *bbcc = (BBCC*) entry, *bbcc2;
+  int j;
+
+  /* every bbcc should have a rec_array */
+  CLG_ASSERT(bbcc->rec_array != 0);
+
+  for(j=0;j<bbcc->cxt->fn[0]->separate_recursions;j++) {
+    if ((bbcc2 = bbcc->rec_array[j]) == 0) continue;
+
+    (*forall_func)(bbcc2);
+  }
+}
+
+void CLG_(forall_bbccs)(void (*func)(BBCC*))
+{
+  forall_func = func;
+  CLG_(forall_cc_hash)(&(current_bbccs.h), forall_rec_bbccs);
 }
 
 
@@ -144,14 +171,29 @@ void CLG_(forall_bbccs)(void (*func)(BBCC*))
  */
 
 static __inline__
-UInt bbcc_hash_idx(BB* bb, Context* cxt, UInt size)
+UWord bbcc_hash_key(BB* bb, Context* cxt)
 {
    CLG_ASSERT(bb != 0);
    CLG_ASSERT(cxt != 0);
 
-   return ((Addr)bb + (Addr)cxt) % size;
+   return cc_hash_words((UWord)bb, (UWord)cxt);
+}
+
+static Bool bbcc_matches(void* entry, const void* key)
+{
+   const BBCC* bbcc = (const BBCC*) entry;
+   const BBCC* k    = (const BBCC*) key;
+
+   return (bbcc->bb == k->bb) && (bbcc->cxt == k->cxt);
+}
+
+static __inline__
+Bool bbcc_usable(BBCC* bbcc, Context* cxt)
+{
+   if (!bbcc || bbcc->cxt != cxt) return False;
+   /* if we don't dump threads separate, tid doesn't have to match */
+   return !CLG_(clo).separate_threads || bbcc->tid == CLG_(current_tid);
 }
- 
 
 /* Lookup for a BBCC in hash.
  */ 
@@ -159,27 +201,23 @@ static
 BBCC* lookup_bbcc(BB* bb, Context* cxt)
 {
    BBCC* bbcc = bb->last_bbcc;
-   UInt  idx;
-
-   /* check LRU */
-   if (bbcc->cxt == cxt) {
-       if (!CLG_(clo).separate_threads) {
-	   /* if we don't dump threads separate, tid doesn't have to match */
-	   return bbcc;
-       }
-       if (bbcc->tid == CLG_(current_tid)) return bbcc;
-   }
+   BBCC  key;
+
+   /* check LRU: the last two contexts this BB was executed in.
+    * The second entry catches BBs alternately used in two contexts,
+    * e.g. a function called from two sites with --separate-callers */
+   if (bbcc_usable(bbcc, cxt)) return bbcc;
+   bbcc = bb->prev_bbcc;
+   if (bbcc_usable(bbcc, cxt)) return bbcc;
 
    CLG_(stat).bbcc_lru_misses++;
 
-   idx = bbcc_hash_idx(bb, cxt, current_bbccs.size);
-   bbcc = current_bbccs.table[idx];
-   while (bbcc &&
-	  (bb      != bbcc->bb ||
-	   cxt     != bbcc->cxt)) {
-       bbcc = bbcc->next;
-   }
-   
+   key.bb  = bb;
+   key.cxt = cxt;
+   bbcc = (BBCC*) CLG_(lookup_cc_hash)(&(current_bbccs.h),
+                                       bbcc_hash_key(bb, cxt),
+                                       bbcc_matches, &key);
+
    CLG_DEBUG(2,"  lookup_bbcc(BB %#lx, Cxt %u, fn '%s'): %p (tid %u)\n",
 	    bb_addr(bb), cxt->base_number, cxt->fn[0]->name, 
 	    bbcc, bbcc ? bbcc->tid : 0);
@@ -191,57 +229,6 @@ BBCC* lookup_bbcc(BB* bb, Context* cxt)
 }
 
 
-/* double size of hash table 1 (addr->BBCC) */
-static void resize_bbcc_hash(void)
-{
-    Int i, new_size, conflicts1 = 0, conflicts2 = 0;
-    BBCC** new_table;
-    UInt new_idx;
-    BBCC *curr_BBCC, *next_BBCC;
-
-    new_size = 2*current_bbccs.size+3;
-    new_table = (BBCC**) CLG_MALLOC("cl.bbcc.rbh.1",
-                                    new_size * sizeof(BBCC*));
- 
-    for (i = 0; i < new_size; i++)
-      new_table[i] = NULL;
- 
-    for (i = 0; i < current_bbccs.size; i++) {
-	if (current_bbccs.table[i] == NULL) continue;
- 
-	curr_BBCC = current_bbccs.table[i];
-	while (NULL != curr_BBCC) {
-	    next_BBCC = curr_BBCC->next;
-
-	    new_idx = bbcc_hash_idx(curr_BBCC->bb,
-				    curr_BBCC->cxt,
-				    new_size);
-
-	    curr_BBCC->next = new_table[new_idx];
-	    new_table[new_idx] = curr_BBCC;
-	    if (curr_BBCC->next) {
-		conflicts1++;
-		if (curr_BBCC->next->next)
-		    conflicts2++;
-	    }
-
-	    curr_BBCC = next_BBCC;
-	}
-    }
-
-    VG_(free)(current_bbccs.table);
-
-
-    CLG_DEBUG(0,"Resize BBCC Hash: %u => %d (entries %u, conflicts %d/%d)\n",
-	     current_bbccs.size, new_size,
-	     current_bbccs.entries, conflicts1, conflicts2);
-
-    current_bbccs.size = new_size;
-    current_bbccs.table = new_table;
-    CLG_(stat).bbcc_hash_resizes++;
-}
-
-
 static __inline
 BBCC** new_recursion(int size)
 {
@@ -289,6 +276,8 @@ BBCC* new_bbcc(BB* bb)
        bbcc->jmp[i].jcc_list = 0;
    }
    bbcc->ecounter_sum = 0;
+   bbcc->dirty = False;
+   bbcc->next_dirty = 0;
 
    /* Init pointer caches (LRU) */
    bbcc->lru_next_bbcc = 0;
@@ -318,24 +307,17 @@ BBCC* new_bbcc(BB* bb)
 static
 void insert_bbcc_into_hash(BBCC* bbcc)
 {
-    UInt idx;
-    
     CLG_ASSERT(bbcc->cxt != 0);
 
     CLG_DEBUG(3,"+ insert_bbcc_into_hash(BB %#lx, fn '%s')\n",
 	     bb_addr(bbcc->bb), bbcc->cxt->fn[0]->name);
 
-    /* check fill degree of hash and resize if needed (>90%) */
-    current_bbccs.entries++;
-    if (100 * current_bbccs.entries / current_bbccs.size > 90)
-	resize_bbcc_hash();
-
-    idx = bbcc_hash_idx(bbcc->bb, bbcc->cxt, current_bbccs.size);
-    bbcc->next = current_bbccs.table[idx];
-    current_bbccs.table[idx] = bbcc;
+    if (CLG_(insert_cc_hash)(&(current_bbccs.h),
+			     bbcc_hash_key(bbcc->bb, bbcc->cxt), bbcc))
+	CLG_(stat).bbcc_hash_resizes++;
 
     CLG_DEBUG(3,"- insert_bbcc_into_hash: %u entries\n",
-	     current_bbccs.entries);
+	     current_bbccs.h.entries);
 }
 
 /* String is returned in a dynamically allocated buffer. Caller is
@@ -510,6 +492,8 @@ static void handleUnderflow(BB* bb)
   }
   else if (CLG_(current_state).collect)
     source_bbcc->ecounter_sum++;
+  if (source_bbcc->ecounter_sum > 0 && !source_bbcc->dirty)
+    CLG_(set_bbcc_dirty)(source_bbcc);
   
   /* Force a new top context, will be set active by push_cxt() */
   CLG_(current_fn_stack).top--;
@@ -606,6 +590,7 @@ void CLG_(setup_bbcc)(BB* bb)
       if (CLG_(current_state).collect) {
 	if (!CLG_(current_state).nonskipped) {
 	  last_bbcc->ecounter_sum++;
+	  if (!last_bbcc->dirty) CLG_(set_bbcc_dirty)(last_bbcc);
 	  last_bbcc->jmp[passed].ecounter++;
 	  if (!CLG_(clo).simulate_cache) {
 	      /* update Ir cost */              
@@ -819,7 +804,10 @@ void CLG_(setup_bbcc)(BB* bb)
     if (!bbcc)
       bbcc = clone_bbcc(bb->bbcc_list, CLG_(current_state).cxt, 0);
     
-    bb->last_bbcc = bbcc;
+    if (bb->last_bbcc != bbcc) {
+      bb->prev_bbcc = bb->last_bbcc;
+      bb->last_bbcc = bbcc;
+    }
   }
 
   /* save for fast lookup */
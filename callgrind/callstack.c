@@ -352,6 +352,7 @@ void CLG_(pop_call_stack)()
 	   * the ret_counter is used to check if a BBCC dump is needed.
 	   */
 	  jcc->from->ret_counter++;
+	  if (!jcc->from->dirty) CLG_(set_bbcc_dirty)(jcc->from);
 	}
 	CLG_(stat).ret_counter++;
 
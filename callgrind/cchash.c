@@ -0,0 +1,191 @@
+/*--------------------------------------------------------------------*/
+/*--- Callgrind                                                    ---*/
+/*---                                                    cchash.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Callgrind, a Valgrind tool for call tracing.
+
+   Copyright (C) 2002-2017, Josef Weidendorfer (Josef.Weidendorfer@gmx.de)
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#include "global.h"
+
+/*------------------------------------------------------------*/
+/*--- Cost center hash tables                              ---*/
+/*------------------------------------------------------------*/
+
+/* The BBCC and jCC tables are open-addressed with linear probing
+ * over buckets of CC_HASH_SLOTS slots. A bucket holds the full hash
+ * values of its entries next to the pointers, so a lookup compares
+ * hash values within one cache line and only dereferences an entry
+ * whose hash matches. Entries are never removed, so the probe
+ * sequence for a key ends at the first bucket with a free slot.
+ *
+ * When the fill degree exceeds 75%, a table of double size is
+ * allocated, and the buckets of the old table are copied over a few
+ * at a time with every following insertion. Until all are copied,
+ * lookups which fail in the new table also search the old one, which
+ * is not modified while it is drained.
+ */
+
+/* Number of old buckets copied per insertion while resizing.
+ * The old table has to be drained before the new one reaches its own
+ * resize limit, which is at least 3 insertions per old bucket away. */
+#define CC_HASH_MOVE_PER_INSERT 2
+
+static cc_bucket* new_buckets(const HChar* cc, UInt size)
+{
+    cc_bucket* table;
+
+    table = (cc_bucket*) CLG_MALLOC(cc, size * sizeof(cc_bucket));
+    VG_(memset)(table, 0, size * sizeof(cc_bucket));
+    return table;
+}
+
+void CLG_(init_cc_hash)(cc_hash* h, UInt size, const HChar* cc)
+{
+    CLG_ASSERT(h != 0);
+    /* power of 2 */
+    CLG_ASSERT(size > 0 && (size & (size - 1)) == 0);
+
+    h->size      = size;
+    h->entries   = 0;
+    h->table     = new_buckets(cc, size);
+    h->old_size  = 0;
+    h->moved     = 0;
+    h->old_table = 0;
+    h->cc        = cc;
+}
+
+static void* lookup_in(cc_bucket* table, UInt size, UWord hash,
+		       cc_hash_match match, const void* key)
+{
+    UInt i, idx = hash & (size - 1);
+    cc_bucket* b;
+
+    while(1) {
+	b = &table[idx];
+	for(i = 0; i < CC_HASH_SLOTS; i++) {
+	    if (b->hash[i] == hash && (*match)(b->entry[i], key))
+		return b->entry[i];
+	    if (b->hash[i] == 0) return 0;
+	}
+	idx = (idx + 1) & (size - 1);
+    }
+}
+
+void* CLG_(lookup_cc_hash)(cc_hash* h, UWord hash,
+			   cc_hash_match match, const void* key)
+{
+    void* entry;
+
+    CLG_ASSERT(hash != 0);
+
+    entry = lookup_in(h->table, h->size, hash, match, key);
+    if (entry || !h->old_table) return entry;
+
+    return lookup_in(h->old_table, h->old_size, hash, match, key);
+}
+
+static void insert_into(cc_bucket* table, UInt size,
+			UWord hash, void* entry)
+{
+    UInt i, idx = hash & (size - 1);
+    cc_bucket* b;
+
+    while(1) {
+	b = &table[idx];
+	for(i = 0; i < CC_HASH_SLOTS; i++) {
+	    if (b->hash[i] != 0) continue;
+	    b->hash[i]  = hash;
+	    b->entry[i] = entry;
+	    return;
+	}
+	idx = (idx + 1) & (size - 1);
+    }
+}
+
+/* copy up to <count> buckets of the old table into the current one */
+static void move_buckets(cc_hash* h, UInt count)
+{
+    UInt i;
+    cc_bucket* b;
+
+    while(count > 0 && h->moved < h->old_size) {
+	b = &h->old_table[h->moved];
+	for(i = 0; i < CC_HASH_SLOTS && b->hash[i] != 0; i++)
+	    insert_into(h->table, h->size, b->hash[i], b->entry[i]);
+	h->moved++;
+	count--;
+    }
+    if (h->moved < h->old_size) return;
+
+    VG_(free)(h->old_table);
+    h->old_table = 0;
+    h->old_size  = 0;
+    h->moved     = 0;
+}
+
+/* Returns True if a resize was started */
+Bool CLG_(insert_cc_hash)(cc_hash* h, UWord hash, void* entry)
+{
+    Bool resized = False;
+
+    CLG_ASSERT(hash != 0);
+
+    if (h->old_table)
+	move_buckets(h, CC_HASH_MOVE_PER_INSERT);
+
+    h->entries++;
+    if (4 * (ULong)h->entries > 3 * (ULong)h->size * CC_HASH_SLOTS) {
+	/* a previous resize is always finished by now */
+	CLG_ASSERT(h->old_table == 0);
+
+	CLG_DEBUG(0, "Resize %s: %u => %u buckets (entries %u)\n",
+		  h->cc, h->size, 2 * h->size, h->entries);
+
+	h->old_table = h->table;
+	h->old_size  = h->size;
+	h->moved     = 0;
+	h->size      = 2 * h->size;
+	h->table     = new_buckets(h->cc, h->size);
+	resized = True;
+    }
+
+    insert_into(h->table, h->size, hash, entry);
+    return resized;
+}
+
+/* Calls <func> once for every entry: entries of old buckets not yet
+ * copied are only found in the old table */
+void CLG_(forall_cc_hash)(cc_hash* h, void (*func)(void*))
+{
+    UInt i, j;
+
+    for(i = 0; i < h->size; i++)
+	for(j = 0; j < CC_HASH_SLOTS && h->table[i].hash[j] != 0; j++)
+	    (*func)(h->table[i].entry[j]);
+
+    if (!h->old_table) return;
+    for(i = h->moved; i < h->old_size; i++)
+	for(j = 0; j < CC_HASH_SLOTS && h->old_table[i].hash[j] != 0; j++)
+	    (*func)(h->old_table[i].entry[j]);
+}
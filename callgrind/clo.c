@@ -427,6 +427,7 @@ Bool CLG_(process_cmd_line_option)(const HChar* arg)
    else if VG_BOOL_CLO(arg, "--compress-strings", CLG_(clo).compress_strings) {}
    else if VG_BOOL_CLO(arg, "--compress-mangled", CLG_(clo).compress_mangled) {}
    else if VG_BOOL_CLO(arg, "--compress-pos",     CLG_(clo).compress_pos) {}
+   else if VG_BOOL_CLO(arg, "--compress-output",  CLG_(clo).compress_output) {}
 
    else if VG_STR_CLO(arg, "--fn-skip", tmp_str) {
        fn_config* fnc = get_fnc(tmp_str);
@@ -556,6 +557,7 @@ void CLG_(print_usage)(void)
 "    --compress-strings=no|yes Compress strings in profile dump? [yes]\n"
 "    --compress-pos=no|yes     Compress positions in profile dump? [yes]\n"
 "    --combine-dumps=no|yes    Concat all dumps into same file [no]\n"
+"    --compress-output=no|yes  Write dumps gzip-compressed [no]\n"
 #if CLG_EXPERIMENTAL
 "    --compress-events=no|yes  Compress events in profile dump? [no]\n"
 "    --dump-bb=no|yes          Dump basic block address of costs? [no]\n"
@@ -635,6 +637,7 @@ void CLG_(set_clo_defaults)(void)
   CLG_(clo).compress_mangled = False;
   CLG_(clo).compress_events  = False;
   CLG_(clo).compress_pos     = True;
+  CLG_(clo).compress_output  = False;
   CLG_(clo).mangle_names     = True;
   CLG_(clo).dump_line        = True;
   CLG_(clo).dump_instr       = False;
@@ -59,6 +59,68 @@ Int CLG_(get_dump_counter)(void)
 /*--- Output file related stuff                            ---*/
 /*------------------------------------------------------------*/
 
+/* All dump output goes through one large buffer, reused for every
+ * dump file. With --compress-output=yes, each full buffer is
+ * compressed as one deflate block (see gzip.c).
+ */
+#define DUMP_BUFSIZE  (1<<20)
+
+static DumpFile dump_file;
+
+static void dump_flush(DumpFile* fp)
+{
+    if (fp->used == 0) return;
+
+    if (fp->gzip)
+	CLG_(gz_write)(&(fp->gz), fp->buf, fp->used);
+    else
+	VG_(write)(fp->fd, fp->buf, fp->used);
+    fp->used = 0;
+}
+
+static void add_to_dumpfile(HChar c, void* p)
+{
+    DumpFile* fp = (DumpFile*) p;
+
+    fp->buf[fp->used++] = c;
+    if (fp->used == DUMP_BUFSIZE) dump_flush(fp);
+}
+
+void CLG_(fprintf)(DumpFile *fp, const HChar *format, ...)
+{
+    va_list vargs;
+
+    va_start(vargs, format);
+    VG_(vcbprintf)(add_to_dumpfile, fp, format, vargs);
+    va_end(vargs);
+}
+
+/* Only one dump file can be open at a time */
+static DumpFile* dump_open(const HChar* name, Int flags, Int mode)
+{
+    SysRes res = VG_(open)(name, flags, mode);
+
+    if (sr_isError(res)) return NULL;
+
+    if (!dump_file.buf)
+	dump_file.buf = (HChar*) CLG_MALLOC("cl.dump.do.1", DUMP_BUFSIZE);
+    dump_file.fd   = sr_Res(res);
+    dump_file.used = 0;
+    dump_file.gzip = CLG_(clo).compress_output;
+    if (dump_file.gzip)
+	CLG_(gz_open)(&(dump_file.gz), dump_file.fd);
+
+    return &dump_file;
+}
+
+static void dump_close(DumpFile* fp)
+{
+    dump_flush(fp);
+    if (fp->gzip)
+	CLG_(gz_close)(&(fp->gz));
+    VG_(close)(fp->fd);
+}
+
 /* Boolean dumping array */
 static Bool* dump_array = 0;
 static Int   dump_array_size = 0;
@@ -124,67 +186,67 @@ void init_fpos(FnPos* p)
 }
 
 
-static void print_obj(VgFile *fp, const HChar* prefix, obj_node* obj)
+static void print_obj(DumpFile *fp, const HChar* prefix, obj_node* obj)
 {
     if (CLG_(clo).compress_strings) {
 	CLG_ASSERT(obj_dumped != 0);
 	if (obj_dumped[obj->number])
-            VG_(fprintf)(fp, "%s(%u)\n", prefix, obj->number);
+            CLG_(fprintf)(fp, "%s(%u)\n", prefix, obj->number);
 	else {
-            VG_(fprintf)(fp, "%s(%u) %s\n", prefix, obj->number, obj->name);
+            CLG_(fprintf)(fp, "%s(%u) %s\n", prefix, obj->number, obj->name);
 	}
     }
     else
-        VG_(fprintf)(fp, "%s%s\n", prefix, obj->name);
+        CLG_(fprintf)(fp, "%s%s\n", prefix, obj->name);
 
 #if 0
     /* add mapping parameters the first time a object is dumped
      * format: mp=0xSTART SIZE 0xOFFSET */
     if (!obj_dumped[obj->number]) {
 	obj_dumped[obj->number];
-	VG_(fprintf)(fp, "mp=%p %p %p\n",
-		     pos->obj->start, pos->obj->size, pos->obj->offset);
+	CLG_(fprintf)(fp, "mp=%p %p %p\n",
+		      pos->obj->start, pos->obj->size, pos->obj->offset);
     }
 #else
     obj_dumped[obj->number] = True;
 #endif
 }
 
-static void print_file(VgFile *fp, const char *prefix, const file_node* file)
+static void print_file(DumpFile *fp, const char *prefix, const file_node* file)
 {
     if (CLG_(clo).compress_strings) {
 	CLG_ASSERT(file_dumped != 0);
 	if (file_dumped[file->number])
-            VG_(fprintf)(fp, "%s(%u)\n", prefix, file->number);
+            CLG_(fprintf)(fp, "%s(%u)\n", prefix, file->number);
 	else {
-            VG_(fprintf)(fp, "%s(%u) %s\n", prefix, file->number, file->name);
+            CLG_(fprintf)(fp, "%s(%u) %s\n", prefix, file->number, file->name);
 	    file_dumped[file->number] = True;
 	}
     }
     else
-        VG_(fprintf)(fp, "%s%s\n", prefix, file->name);
+        CLG_(fprintf)(fp, "%s%s\n", prefix, file->name);
 }
 
 /*
  * tag can be "fn", "cfn", "jfn"
  */
-static void print_fn(VgFile *fp, const HChar* tag, const fn_node* fn)
+static void print_fn(DumpFile *fp, const HChar* tag, const fn_node* fn)
 {
-    VG_(fprintf)(fp, "%s=",tag);
+    CLG_(fprintf)(fp, "%s=",tag);
     if (CLG_(clo).compress_strings) {
 	CLG_ASSERT(fn_dumped != 0);
 	if (fn_dumped[fn->number])
-	    VG_(fprintf)(fp, "(%u)\n", fn->number);
+	    CLG_(fprintf)(fp, "(%u)\n", fn->number);
 	else {
-	    VG_(fprintf)(fp, "(%u) %s\n", fn->number, fn->name);
+	    CLG_(fprintf)(fp, "(%u) %s\n", fn->number, fn->name);
 	    fn_dumped[fn->number] = True;
 	}
     }
     else
-        VG_(fprintf)(fp, "%s\n", fn->name);
+        CLG_(fprintf)(fp, "%s\n", fn->name);
 }
 
-static void print_mangled_fn(VgFile *fp, const HChar* tag, 
+static void print_mangled_fn(DumpFile *fp, const HChar* tag, 
 			     Context* cxt, int rec_index)
 {
     int i;
@@ -196,8 +258,8 @@ static void print_mangled_fn(VgFile *fp, const HChar* tag,
 
 	CLG_ASSERT(cxt_dumped != 0);
 	if (cxt_dumped[cxt->base_number+rec_index]) {
-            VG_(fprintf)(fp, "%s=(%u)\n",
-			     tag, cxt->base_number + rec_index);
+            CLG_(fprintf)(fp, "%s=(%u)\n",
+			  tag, cxt->base_number + rec_index);
 	    return;
 	}
 
@@ -207,8 +269,8 @@ static void print_mangled_fn(VgFile *fp, const HChar* tag,
 	    CLG_ASSERT(cxt->fn[i-1]->pure_cxt != 0);
 	    n = cxt->fn[i-1]->pure_cxt->base_number;
 	    if (cxt_dumped[n]) continue;
-	    VG_(fprintf)(fp, "%s=(%d) %s\n",
-			     tag, n, cxt->fn[i-1]->name);
+	    CLG_(fprintf)(fp, "%s=(%d) %s\n",
+			  tag, n, cxt->fn[i-1]->name);
 
 	    cxt_dumped[n] = True;
 	    last = cxt->fn[i-1]->pure_cxt;
@@ -216,41 +278,41 @@ static void print_mangled_fn(VgFile *fp, const HChar* tag,
 	/* If the last context was the context to print, we are finished */
 	if ((last == cxt) && (rec_index == 0)) return;
 
-	VG_(fprintf)(fp, "%s=(%u) (%u)", tag,
-			 cxt->base_number + rec_index,
-			 cxt->fn[0]->pure_cxt->base_number);
+	CLG_(fprintf)(fp, "%s=(%u) (%u)", tag,
+		      cxt->base_number + rec_index,
+		      cxt->fn[0]->pure_cxt->base_number);
 	if (rec_index >0)
-	    VG_(fprintf)(fp, "'%d", rec_index +1);
+	    CLG_(fprintf)(fp, "'%d", rec_index +1);
 	for(i=1;i<cxt->size;i++)
-	    VG_(fprintf)(fp, "'(%u)", 
-			      cxt->fn[i]->pure_cxt->base_number);
-	VG_(fprintf)(fp, "\n");
+	    CLG_(fprintf)(fp, "'(%u)", 
+			  cxt->fn[i]->pure_cxt->base_number);
+	CLG_(fprintf)(fp, "\n");
 
 	cxt_dumped[cxt->base_number+rec_index] = True;
 	return;
     }
 
 
-    VG_(fprintf)(fp, "%s=", tag);
+    CLG_(fprintf)(fp, "%s=", tag);
     if (CLG_(clo).compress_strings) {
 	CLG_ASSERT(cxt_dumped != 0);
 	if (cxt_dumped[cxt->base_number+rec_index]) {
-	    VG_(fprintf)(fp, "(%u)\n", cxt->base_number + rec_index);
+	    CLG_(fprintf)(fp, "(%u)\n", cxt->base_number + rec_index);
 	    return;
 	}
 	else {
-	    VG_(fprintf)(fp, "(%u) ", cxt->base_number + rec_index);
+	    CLG_(fprintf)(fp, "(%u) ", cxt->base_number + rec_index);
 	    cxt_dumped[cxt->base_number+rec_index] = True;
 	}
     }
 
-    VG_(fprintf)(fp, "%s", cxt->fn[0]->name);
+    CLG_(fprintf)(fp, "%s", cxt->fn[0]->name);
     if (rec_index >0)
-	VG_(fprintf)(fp, "'%d", rec_index +1);
+	CLG_(fprintf)(fp, "'%d", rec_index +1);
     for(i=1;i<cxt->size;i++)
-	VG_(fprintf)(fp, "'%s", cxt->fn[i]->name);
+	CLG_(fprintf)(fp, "'%s", cxt->fn[i]->name);
 
-    VG_(fprintf)(fp, "\n");
+    CLG_(fprintf)(fp, "\n");
 }
 
 
@@ -260,7 +322,7 @@ static void print_mangled_fn(VgFile *fp, const HChar* tag,
  * the <last> position, update <last>
  * Return True if something changes.
  */
-static Bool print_fn_pos(VgFile *fp, FnPos* last, BBCC* bbcc)
+static Bool print_fn_pos(DumpFile *fp, FnPos* last, BBCC* bbcc)
 {
     Bool res = False;
 
@@ -273,7 +335,7 @@ static Bool print_fn_pos(VgFile *fp, FnPos* last, BBCC* bbcc)
 
     if (!CLG_(clo).mangle_names) {
 	if (last->rec_index != bbcc->rec_index) {
-	    VG_(fprintf)(fp, "rec=%u\n\n", bbcc->rec_index);
+	    CLG_(fprintf)(fp, "rec=%u\n\n", bbcc->rec_index);
 	    last->rec_index = bbcc->rec_index;
 	    last->cxt = 0; /* reprint context */
 	    res = True;
@@ -287,7 +349,7 @@ static Bool print_fn_pos(VgFile *fp, FnPos* last, BBCC* bbcc)
 	    if (curr_from == 0) {
 		if (last_from != 0) {
 		    /* switch back to no context */
-		    VG_(fprintf)(fp, "frfn=(spontaneous)\n");
+		    CLG_(fprintf)(fp, "frfn=(spontaneous)\n");
 		    res = True;
 		}
 	    }
@@ -433,7 +495,7 @@ static void init_fcost(AddrCost* c, Addr addr, Addr bbaddr, file_node* file)
  * print position change inside of a BB (last -> curr)
  * this doesn't update last to curr!
  */
-static void fprint_apos(VgFile *fp, AddrPos* curr, AddrPos* last,
+static void fprint_apos(DumpFile *fp, AddrPos* curr, AddrPos* last,
                         file_node* func_file)
 {
     CLG_ASSERT(curr->file != 0);
@@ -452,7 +514,7 @@ static void fprint_apos(VgFile *fp, AddrPos* curr, AddrPos* last,
 
     if (CLG_(clo).dump_bbs) {
 	if (curr->line != last->line) {
-	    VG_(fprintf)(fp, "ln=%u\n", curr->line);
+	    CLG_(fprintf)(fp, "ln=%u\n", curr->line);
 	}
     }
 }
@@ -466,24 +528,24 @@ static void fprint_apos(VgFile *fp, AddrPos* curr, AddrPos* last,
  * This doesn't set last to curr afterwards!
  */
 static
-void fprint_pos(VgFile *fp, const AddrPos* curr, const AddrPos* last)
+void fprint_pos(DumpFile *fp, const AddrPos* curr, const AddrPos* last)
 {
     if (0) //CLG_(clo).dump_bbs)
-	VG_(fprintf)(fp, "%lu ", curr->addr - curr->bb_addr);
+	CLG_(fprintf)(fp, "%lu ", curr->addr - curr->bb_addr);
     else {
 	if (CLG_(clo).dump_instr) {
 	    int diff = curr->addr - last->addr;
 	    if ( CLG_(clo).compress_pos && (last->addr >0) && 
 		 (diff > -100) && (diff < 100)) {
 		if (diff >0)
-		    VG_(fprintf)(fp, "+%d ", diff);
+		    CLG_(fprintf)(fp, "+%d ", diff);
 		else if (diff==0)
-		    VG_(fprintf)(fp, "* ");
+		    CLG_(fprintf)(fp, "* ");
 	        else
-		    VG_(fprintf)(fp, "%d ", diff);
+		    CLG_(fprintf)(fp, "%d ", diff);
 	    }
 	    else
-		VG_(fprintf)(fp, "%#lx ", curr->addr);
+		CLG_(fprintf)(fp, "%#lx ", curr->addr);
 	}
 
 	if (CLG_(clo).dump_bb) {
@@ -491,14 +553,14 @@ void fprint_pos(VgFile *fp, const AddrPos* curr, const AddrPos* last)
 	    if ( CLG_(clo).compress_pos && (last->bb_addr >0) && 
 		 (diff > -100) && (diff < 100)) {
 		if (diff >0)
-		    VG_(fprintf)(fp, "+%d ", diff);
+		    CLG_(fprintf)(fp, "+%d ", diff);
 		else if (diff==0)
-		    VG_(fprintf)(fp, "* ");
+		    CLG_(fprintf)(fp, "* ");
 	        else
-		    VG_(fprintf)(fp, "%d ", diff);
+		    CLG_(fprintf)(fp, "%d ", diff);
 	    }
 	    else
-		VG_(fprintf)(fp, "%#lx ", curr->bb_addr);
+		CLG_(fprintf)(fp, "%#lx ", curr->bb_addr);
 	}
 
 	if (CLG_(clo).dump_line) {
@@ -507,14 +569,14 @@ void fprint_pos(VgFile *fp, const AddrPos* curr, const AddrPos* last)
 		 (diff > -100) && (diff < 100)) {
 
 		if (diff >0)
-		    VG_(fprintf)(fp, "+%d ", diff);
+		    CLG_(fprintf)(fp, "+%d ", diff);
 		else if (diff==0)
-		    VG_(fprintf)(fp, "* ");
+		    CLG_(fprintf)(fp, "* ");
 	        else
-		    VG_(fprintf)(fp, "%d ", diff);
+		    CLG_(fprintf)(fp, "%d ", diff);
 	    }
 	    else
-		VG_(fprintf)(fp, "%u ", curr->line);
+		CLG_(fprintf)(fp, "%u ", curr->line);
 	}
     }
 }
@@ -525,10 +587,10 @@ void fprint_pos(VgFile *fp, const AddrPos* curr, const AddrPos* last)
  */
 
 static
-void fprint_cost(VgFile *fp, const EventMapping* es, const ULong* cost)
+void fprint_cost(DumpFile *fp, const EventMapping* es, const ULong* cost)
 {
   HChar *mcost = CLG_(mappingcost_as_string)(es, cost);
-  VG_(fprintf)(fp, "%s\n", mcost);
+  CLG_(fprintf)(fp, "%s\n", mcost);
   CLG_FREE(mcost);
 }
 
@@ -539,7 +601,7 @@ void fprint_cost(VgFile *fp, const EventMapping* es, const ULong* cost)
  * funcPos is the source position of the first line of actual function.
  * Something is written only if cost != 0; returns True in this case.
  */
-static void fprint_fcost(VgFile *fp, AddrCost* c, AddrPos* last)
+static void fprint_fcost(DumpFile *fp, AddrCost* c, AddrPos* last)
 {
   CLG_DEBUGIF(3) {
     CLG_DEBUG(2, "   print_fcost(file '%s', line %u, bb %#lx, addr %#lx):\n",
@@ -559,7 +621,7 @@ static void fprint_fcost(VgFile *fp, AddrCost* c, AddrPos* last)
 
 /* Write out the calls from jcc (at pos)
  */
-static void fprint_jcc(VgFile *fp, jCC* jcc, AddrPos* curr, AddrPos* last,
+static void fprint_jcc(DumpFile *fp, jCC* jcc, AddrPos* curr, AddrPos* last,
                        ULong ecounter)
 {
     static AddrPos target;
@@ -613,19 +675,19 @@ static void fprint_jcc(VgFile *fp, jCC* jcc, AddrPos* curr, AddrPos* last,
 	    
 	if (jcc->jmpkind == jk_CondJump) {
 	    /* format: jcnd=<followed>/<executions> <target> */
-	    VG_(fprintf)(fp, "jcnd=%llu/%llu ",
-			 jcc->call_counter, ecounter);
+	    CLG_(fprintf)(fp, "jcnd=%llu/%llu ",
+			  jcc->call_counter, ecounter);
 	}
 	else {
 	    /* format: jump=<jump count> <target> */
-	    VG_(fprintf)(fp, "jump=%llu ",
-			 jcc->call_counter);
+	    CLG_(fprintf)(fp, "jump=%llu ",
+			  jcc->call_counter);
 	}
 		
 	fprint_pos(fp, &target, last);
-	VG_(fprintf)(fp, "\n");
+	CLG_(fprintf)(fp, "\n");
 	fprint_pos(fp, curr, last);
-	VG_(fprintf)(fp, "\n");
+	CLG_(fprintf)(fp, "\n");
 
 	jcc->call_counter = 0;
 	return;
@@ -650,11 +712,11 @@ static void fprint_jcc(VgFile *fp, jCC* jcc, AddrPos* curr, AddrPos* last,
 	print_fn(fp, "cfn", jcc->to->cxt->fn[0]);
 
     if (!CLG_(is_zero_cost)( CLG_(sets).full, jcc->cost)) {
-        VG_(fprintf)(fp, "calls=%llu ", 
-		   jcc->call_counter);
+        CLG_(fprintf)(fp, "calls=%llu ", 
+		      jcc->call_counter);
 
 	fprint_pos(fp, &target, last);
-        VG_(fprintf)(fp, "\n");
+        CLG_(fprintf)(fp, "\n");
 	fprint_pos(fp, curr, last);
 	fprint_cost(fp, CLG_(dumpmap), jcc->cost);
 
@@ -678,7 +740,7 @@ static int currSum;
  * - JCCs of the unique jump of this BB
  * returns True if something was written 
  */
-static Bool fprint_bbcc(VgFile *fp, BBCC* bbcc, AddrPos* last)
+static Bool fprint_bbcc(DumpFile *fp, BBCC* bbcc, AddrPos* last)
 {
   InstrInfo* instr_info;
   ULong ecounter;
@@ -794,7 +856,7 @@ static Bool fprint_bbcc(VgFile *fp, BBCC* bbcc, AddrPos* last)
       CLG_(add_and_zero_cost)( CLG_(sets).full,
 			      currCost->cost, bbcc->skipped );
 #if 0
-      VG_(fprintf)(fp, "# Skipped\n");
+      CLG_(fprintf)(fp, "# Skipped\n");
 #endif
       fprint_fcost(fp, currCost, last);
     }
@@ -816,7 +878,7 @@ static Bool fprint_bbcc(VgFile *fp, BBCC* bbcc, AddrPos* last)
       fprint_apos(fp, &(currCost->p), last, bbcc->cxt->fn[0]->file);
       fprint_fcost(fp, currCost, last);
     }
-    if (CLG_(clo).dump_bbs) VG_(fprintf)(fp, "\n");
+    if (CLG_(clo).dump_bbs) CLG_(fprintf)(fp, "\n");
     
     /* when every cost was immediately written, we must have done so,
      * as this function is only called when there's cost in a BBCC
@@ -1101,7 +1163,7 @@ BBCC** prepare_dump(void)
     
     /* if we do not separate among threads, this gives all */
     /* count number of BBCCs with >0 executions */
-    CLG_(forall_bbccs)(hash_addCount);
+    CLG_(forall_dirty_bbccs)(hash_addCount);
 
     /* even if we do not separate among threads,
      * call stacks are separated */
@@ -1117,7 +1179,7 @@ BBCC** prepare_dump(void)
       (BBCC**) CLG_MALLOC("cl.dump.pd.1",
                           (prepare_count+1) * sizeof(BBCC*));    
 
-    CLG_(forall_bbccs)(hash_addPtr);
+    CLG_(forall_dirty_bbccs)(hash_addPtr);
 
     if (CLG_(clo).separate_threads)
       cs_addPtr(0);
@@ -1142,11 +1204,11 @@ BBCC** prepare_dump(void)
 
 
 
-static void fprint_cost_ln(VgFile *fp, const HChar* prefix,
+static void fprint_cost_ln(DumpFile *fp, const HChar* prefix,
 			   const EventMapping* em, const ULong* cost)
 {
     HChar *mcost = CLG_(mappingcost_as_string)(em, cost);
-    VG_(fprintf)(fp, "%s%s\n", prefix, mcost);
+    CLG_(fprintf)(fp, "%s%s\n", prefix, mcost);
     CLG_FREE(mcost);
 }
 
@@ -1171,12 +1233,12 @@ void file_err(void)
  *
  * Returns the file descriptor, and -1 on error (no write permission)
  */
-static VgFile *new_dumpfile(int tid, const HChar* trigger)
+static DumpFile *new_dumpfile(int tid, const HChar* trigger)
 {
     Bool appending = False;
     int i;
     FullCost sum = 0;
-    VgFile *fp;
+    DumpFile *fp;
 
     CLG_ASSERT(dumps_initialized);
     CLG_ASSERT(filename != 0);
@@ -1190,17 +1252,17 @@ static VgFile *new_dumpfile(int tid, const HChar* trigger)
 	if (CLG_(clo).separate_threads)
 	    VG_(sprintf)(filename+i, "-%02d", tid);
 
-	fp = VG_(fopen)(filename, VKI_O_WRONLY|VKI_O_TRUNC, 0);
+	fp = dump_open(filename, VKI_O_WRONLY|VKI_O_TRUNC, 0);
     }
     else {
 	VG_(sprintf)(filename, "%s", out_file);
-        fp = VG_(fopen)(filename, VKI_O_WRONLY|VKI_O_APPEND, 0);
+        fp = dump_open(filename, VKI_O_WRONLY|VKI_O_APPEND, 0);
 	if (fp && out_counter>1)
 	    appending = True;
     }
 
     if (fp == NULL) {
-	fp = VG_(fopen)(filename, VKI_O_CREAT|VKI_O_WRONLY,
+	fp = dump_open(filename, VKI_O_CREAT|VKI_O_WRONLY,
                         VKI_S_IRUSR|VKI_S_IWUSR);
 	if (fp == NULL) {
 	    /* If the file can not be opened for whatever reason (conflict
@@ -1217,55 +1279,55 @@ static VgFile *new_dumpfile(int tid, const HChar* trigger)
 
     if (!appending) {
 	/* callgrind format specification, has to be on 1st line */
-	VG_(fprintf)(fp, "# callgrind format\n");
+	CLG_(fprintf)(fp, "# callgrind format\n");
 
 	/* version */
-	VG_(fprintf)(fp, "version: 1\n");
+	CLG_(fprintf)(fp, "version: 1\n");
 
 	/* creator */
-	VG_(fprintf)(fp, "creator: callgrind-" VERSION "\n");
+	CLG_(fprintf)(fp, "creator: callgrind-" VERSION "\n");
 
 	/* "pid:" line */
-	VG_(fprintf)(fp, "pid: %d\n", VG_(getpid)());
+	CLG_(fprintf)(fp, "pid: %d\n", VG_(getpid)());
 
 	/* "cmd:" line */
-	VG_(fprintf)(fp, "cmd: %s", cmdbuf);
+	CLG_(fprintf)(fp, "cmd: %s", cmdbuf);
     }
 
-    VG_(fprintf)(fp, "\npart: %d\n", out_counter);
+    CLG_(fprintf)(fp, "\npart: %d\n", out_counter);
     if (CLG_(clo).separate_threads) {
-	VG_(fprintf)(fp, "thread: %d\n", tid);
+	CLG_(fprintf)(fp, "thread: %d\n", tid);
     }
 
     /* "desc:" lines */
     if (!appending) {
-        VG_(fprintf)(fp, "\n");
+        CLG_(fprintf)(fp, "\n");
 
 #if 0
 	/* Global options changing the tracing behaviour */
-	VG_(fprintf)(fp, "\ndesc: Option: --skip-plt=%s\n",
-		     CLG_(clo).skip_plt ? "yes" : "no");
-	VG_(fprintf)(fp, "desc: Option: --collect-jumps=%s\n",
-		     CLG_(clo).collect_jumps ? "yes" : "no");
-	VG_(fprintf)(fp, "desc: Option: --separate-recs=%d\n",
-		     CLG_(clo).separate_recursions);
-	VG_(fprintf)(fp, "desc: Option: --separate-callers=%d\n",
-		     CLG_(clo).separate_callers);
-
-	VG_(fprintf)(fp, "desc: Option: --dump-bbs=%s\n",
-		     CLG_(clo).dump_bbs ? "yes" : "no");
-	VG_(fprintf)(fp, "desc: Option: --separate-threads=%s\n",
-		     CLG_(clo).separate_threads ? "yes" : "no");
+	CLG_(fprintf)(fp, "\ndesc: Option: --skip-plt=%s\n",
+		      CLG_(clo).skip_plt ? "yes" : "no");
+	CLG_(fprintf)(fp, "desc: Option: --collect-jumps=%s\n",
+		      CLG_(clo).collect_jumps ? "yes" : "no");
+	CLG_(fprintf)(fp, "desc: Option: --separate-recs=%d\n",
+		      CLG_(clo).separate_recursions);
+	CLG_(fprintf)(fp, "desc: Option: --separate-callers=%d\n",
+		      CLG_(clo).separate_callers);
+
+	CLG_(fprintf)(fp, "desc: Option: --dump-bbs=%s\n",
+		      CLG_(clo).dump_bbs ? "yes" : "no");
+	CLG_(fprintf)(fp, "desc: Option: --separate-threads=%s\n",
+		      CLG_(clo).separate_threads ? "yes" : "no");
 #endif
 
 	(*CLG_(cachesim).dump_desc)(fp);
     }
 
-    VG_(fprintf)(fp, "\ndesc: Timerange: Basic block %llu - %llu\n",
-		 bbs_done, CLG_(stat).bb_executions);
+    CLG_(fprintf)(fp, "\ndesc: Timerange: Basic block %llu - %llu\n",
+		  bbs_done, CLG_(stat).bb_executions);
 
-    VG_(fprintf)(fp, "desc: Trigger: %s\n",
-		 trigger ? trigger : "Program termination");
+    CLG_(fprintf)(fp, "desc: Trigger: %s\n",
+		  trigger ? trigger : "Program termination");
 
 #if 0
    /* Output function specific config
@@ -1274,23 +1336,23 @@ static VgFile *new_dumpfile(int tid, const HChar* trigger)
        fnc = fnc_table[i];
        while (fnc) {
 	   if (fnc->skip) {
-	       VG_(fprintf)(fp, "desc: Option: --fn-skip=%s\n", fnc->name);
+	       CLG_(fprintf)(fp, "desc: Option: --fn-skip=%s\n", fnc->name);
 	   }
 	   if (fnc->dump_at_enter) {
-	       VG_(fprintf)(fp, "desc: Option: --fn-dump-at-enter=%s\n",
-			    fnc->name);
+	       CLG_(fprintf)(fp, "desc: Option: --fn-dump-at-enter=%s\n",
+			     fnc->name);
 	   }   
 	   if (fnc->dump_at_leave) {
-	       VG_(fprintf)(fp, "desc: Option: --fn-dump-at-leave=%s\n",
-			    fnc->name);
+	       CLG_(fprintf)(fp, "desc: Option: --fn-dump-at-leave=%s\n",
+			     fnc->name);
 	   }
 	   if (fnc->separate_callers != CLG_(clo).separate_callers) {
-	       VG_(fprintf)(fp, "desc: Option: --separate-callers%d=%s\n",
-			    fnc->separate_callers, fnc->name);
+	       CLG_(fprintf)(fp, "desc: Option: --separate-callers%d=%s\n",
+			     fnc->separate_callers, fnc->name);
 	   }   
 	   if (fnc->separate_recursions != CLG_(clo).separate_recursions) {
-	       VG_(fprintf)(fp, "desc: Option: --separate-recs%d=%s\n",
-			    fnc->separate_recursions, fnc->name);
+	       CLG_(fprintf)(fp, "desc: Option: --separate-recs%d=%s\n",
+			     fnc->separate_recursions, fnc->name);
 	   }   
 	   fnc = fnc->next;
        }
@@ -1298,14 +1360,14 @@ static VgFile *new_dumpfile(int tid, const HChar* trigger)
 #endif
 
    /* "positions:" line */
-   VG_(fprintf)(fp, "\npositions:%s%s%s\n",
-		CLG_(clo).dump_instr ? " instr" : "",
-		CLG_(clo).dump_bb    ? " bb" : "",
-		CLG_(clo).dump_line  ? " line" : "");
+   CLG_(fprintf)(fp, "\npositions:%s%s%s\n",
+		 CLG_(clo).dump_instr ? " instr" : "",
+		 CLG_(clo).dump_bb    ? " bb" : "",
+		 CLG_(clo).dump_line  ? " line" : "");
 
    /* "events:" line */
    HChar *evmap = CLG_(eventmapping_as_string)(CLG_(dumpmap));
-   VG_(fprintf)(fp, "events: %s\n", evmap);
+   CLG_(fprintf)(fp, "events: %s\n", evmap);
    VG_(free)(evmap);
 
    /* summary lines */
@@ -1335,7 +1397,7 @@ static VgFile *new_dumpfile(int tid, const HChar* trigger)
    /* all dumped cost will be added to total_fcc */
    CLG_(init_cost_lz)( CLG_(sets).full, &dump_total_cost );
 
-   VG_(fprintf)(fp, "\n\n");
+   CLG_(fprintf)(fp, "\n\n");
 
    if (VG_(clo_verbosity) > 1)
        VG_(message)(Vg_DebugMsg, "Dump to %s\n", filename);
@@ -1344,7 +1406,7 @@ static VgFile *new_dumpfile(int tid, const HChar* trigger)
 }
 
 
-static void close_dumpfile(VgFile *fp)
+static void close_dumpfile(DumpFile *fp)
 {
     if (fp == NULL) return;
 
@@ -1354,7 +1416,7 @@ static void close_dumpfile(VgFile *fp)
     CLG_(add_cost_lz)(CLG_(sets).full, 
 		     &CLG_(total_cost), dump_total_cost);
 
-    VG_(fclose)(fp);
+    dump_close(fp);
 
     if (filename[0] == '.') {
 	if (-1 == VG_(rename) (filename, filename+1)) {
@@ -1378,7 +1440,7 @@ static void print_bbccs_of_thread(thread_info* ti)
 
   CLG_DEBUG(1, "+ print_bbccs(tid %u)\n", CLG_(current_tid));
 
-  VgFile *print_fp = new_dumpfile(CLG_(current_tid), print_trigger);
+  DumpFile *print_fp = new_dumpfile(CLG_(current_tid), print_trigger);
   if (print_fp == NULL) {
     CLG_DEBUG(1, "- print_bbccs(tid %u): No output...\n", CLG_(current_tid));
     return;
@@ -1405,7 +1467,7 @@ static void print_bbccs_of_thread(thread_info* ti)
 	/* switch back to file of function */
 	print_file(print_fp, "fe=", lastFnPos.cxt->fn[0]->file);
       }
-      VG_(fprintf)(print_fp, "\n");
+      CLG_(fprintf)(print_fp, "\n");
     }
     
     if (*p == 0) break;
@@ -1423,16 +1485,16 @@ static void print_bbccs_of_thread(thread_info* ti)
 	/* FIXME: Specify Object of BB if different to object of fn */
         int i;
 	ULong ecounter = (*p)->ecounter_sum;
-        VG_(fprintf)(print_fp, "bb=%#lx ", (UWord)(*p)->bb->offset);
+        CLG_(fprintf)(print_fp, "bb=%#lx ", (UWord)(*p)->bb->offset);
 	for(i = 0; i<(*p)->bb->cjmp_count;i++) {
-	    VG_(fprintf)(print_fp, "%u %llu ", 
-				(*p)->bb->jmp[i].instr,
-				ecounter);
+	    CLG_(fprintf)(print_fp, "%u %llu ", 
+			  (*p)->bb->jmp[i].instr,
+			  ecounter);
 	    ecounter -= (*p)->jmp[i].ecounter;
 	}
-	VG_(fprintf)(print_fp, "%u %llu\n", 
-		     (*p)->bb->instr_count,
-		     ecounter);
+	CLG_(fprintf)(print_fp, "%u %llu\n", 
+		      (*p)->bb->instr_count,
+		      ecounter);
     }
     
     fprint_bbcc(print_fp, *p, &lastAPos);
@@ -1442,6 +1504,9 @@ static void print_bbccs_of_thread(thread_info* ti)
 
   close_dumpfile(print_fp);
   VG_(free)(array);
+
+  /* all BBCCs with cost were dumped and zeroed */
+  CLG_(clear_dirty_bbccs)();
   
   /* set counters of last dump */
   CLG_(copy_cost)( CLG_(sets).full, ti->lastdump_cost,
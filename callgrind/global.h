@@ -81,6 +81,7 @@ struct _CommandLineOptions {
   Bool compress_strings;
   Bool compress_events;
   Bool compress_pos;
+  Bool compress_output;     /* Write dumps gzip-compressed? */
   Bool mangle_names;
   Bool compress_mangled;
   Bool dump_line;
@@ -216,8 +217,7 @@ typedef enum {
  * <next_from> in the JCC struct.
  *
  * For fast lookup, JCCs are reachable with a hash table, keyed by
- * the (from_bbcc,to) pair. <next_hash> is used for the JCC chain
- * of one hash table entry.
+ * the (from_bbcc,jmp,to) triple.
  *
  * Cost <sum> holds event counts for already returned executions.
  * <last> are the event counters at last enter of the subroutine.
@@ -230,7 +230,6 @@ typedef enum {
 
 struct _jCC {
   ClgJumpKind jmpkind; /* jk_Call, jk_Jump, jk_CondJump */
-  jCC* next_hash;   /* for hash entry chain */
   jCC* next_from;   /* next JCC from a BBCC */
   BBCC *from, *to;  /* call arc from/to this BBCC */
   UInt jmp;         /* jump no. in source */
@@ -295,6 +294,7 @@ struct _BB {
         
   BBCC*      bbcc_list;  /* BBCCs for same BB (see next_bbcc in BBCC) */
   BBCC*      last_bbcc;  /* Temporary: Cached for faster access (LRU) */
+  BBCC*      prev_bbcc;  /* BBCC with other context used before last_bbcc */
 
   /* filled by CLG_(instrument) if not seen before */
   UInt       cjmp_count;  /* number of side exits */
@@ -370,6 +370,8 @@ struct _BBCC {
 			    * used to check if a dump for this BBCC is needed */
     
     BBCC*    next_bbcc;    /* Chain of BBCCs for same BB */
+    BBCC*    next_dirty;   /* Chain of BBCCs with cost (see bbcc_hash) */
+    Bool     dirty;
     BBCC*    lru_next_bbcc; /* BBCC executed next the last time */
     
     jCC*     lru_from_jcc; /* Temporary: Cached for faster access (LRU) */
@@ -377,7 +379,6 @@ struct _BBCC {
     FullCost skipped;      /* cost for skipped functions called from 
 			    * jmp_addr. Allocated lazy */
     
-    BBCC*    next;         /* entry chain in hash */
     ULong*   cost;         /* start of 64bit costs for this BBCC */
     ULong    ecounter_sum; /* execution counter for first instruction of BB */
     JmpData  jmp[0];
@@ -515,16 +516,38 @@ struct _cxt_hash {
  * There are variables for the current state of each part,
  * on which a thread state is copied at thread switch.
  */
+
+/* Open-addressed hash table for BBCCs and jCCs, see cchash.c.
+ * A bucket fills one cache line on 64-bit hosts.
+ * Hash value 0 marks a free slot. */
+#define CC_HASH_SLOTS (32 / sizeof(UWord))
+
+typedef struct _cc_bucket cc_bucket;
+struct _cc_bucket {
+  UWord hash[CC_HASH_SLOTS];
+  void* entry[CC_HASH_SLOTS];
+};
+
+typedef struct _cc_hash cc_hash;
+struct _cc_hash {
+  UInt size, entries;    /* size in buckets, a power of 2 */
+  cc_bucket* table;
+  UInt old_size, moved;  /* table being drained after a resize */
+  cc_bucket* old_table;
+  const HChar* cc;       /* cost center for allocations */
+};
+
+typedef Bool (*cc_hash_match)(void* entry, const void* key);
+
 typedef struct _bbcc_hash bbcc_hash;
 struct _bbcc_hash {
-  UInt size, entries;
-  BBCC** table;
+  cc_hash h;
+  BBCC* dirty;   /* BBCCs with cost since last dump/zeroing */
 };
 
 typedef struct _jcc_hash jcc_hash;
 struct _jcc_hash {
-  UInt size, entries;
-  jCC** table;
+  cc_hash h;
   jCC* spontaneous;
 };
 
@@ -617,6 +640,30 @@ struct _FnPos {
     UInt line;
 };
 
+/* gzip stream state, see gzip.c */
+#define GZ_OUT_SIZE 65536
+
+typedef struct _gz_stream gz_stream;
+struct _gz_stream {
+    Int   fd;
+    UInt  crc, size;      /* of uncompressed data */
+    ULong bits;           /* pending output bits */
+    Int   nbits;
+    Int   out_used;
+    UChar out[GZ_OUT_SIZE];
+};
+
+/* A profile dump file. Output is collected in one large buffer,
+ * which is written (compressed with --compress-output=yes) when full */
+typedef struct _DumpFile DumpFile;
+struct _DumpFile {
+    Int   fd;
+    Bool  gzip;
+    Int   used;
+    HChar* buf;
+    gz_stream gz;
+};
+
 /*------------------------------------------------------------*/
 /*--- Cache simulator interface                            ---*/
 /*------------------------------------------------------------*/
@@ -627,10 +674,11 @@ struct cachesim_if
     Bool (*parse_opt)(const HChar* arg);
     void (*post_clo_init)(void);
     void (*clear)(void);
-    void (*dump_desc)(VgFile *fp);
+    void (*dump_desc)(DumpFile *fp);
     void (*printstat)(Int,Int,Int);
     void (*add_icost)(SimCost, BBCC*, InstrInfo*, ULong);
     void (*finish)(void);
+    void (*switch_thread)(ThreadId);
     
     void (*log_1I0D)(InstrInfo*) VG_REGPARM(1);
     void (*log_2I0D)(InstrInfo*, InstrInfo*) VG_REGPARM(2);
@@ -717,12 +765,31 @@ file_node* CLG_(get_file_node)(obj_node*, const HChar *dirname,
                                const HChar* filename);
 fn_node*  CLG_(get_fn_node)(BB* bb);
 
+/* from cchash.c */
+void CLG_(init_cc_hash)(cc_hash* h, UInt size, const HChar* cc);
+void* CLG_(lookup_cc_hash)(cc_hash* h, UWord hash,
+                           cc_hash_match match, const void* key);
+Bool CLG_(insert_cc_hash)(cc_hash* h, UWord hash, void* entry);
+void CLG_(forall_cc_hash)(cc_hash* h, void (*func)(void*));
+
+/* Hash value for a pair of words, never 0 */
+static __inline__ UWord cc_hash_words(UWord a, UWord b)
+{
+   UWord h = (a ^ (b * (UWord)0x9E3779B97F4A7C15ULL)) *
+             (UWord)0xBF58476D1CE4E5B9ULL;
+   h ^= h >> (4 * sizeof(UWord));
+   return h ? h : 1;
+}
+
 /* from bbcc.c */
 void CLG_(init_bbcc_hash)(bbcc_hash* bbccs);
 void CLG_(copy_current_bbcc_hash)(bbcc_hash* dst);
 bbcc_hash* CLG_(get_current_bbcc_hash)(void);
 void CLG_(set_current_bbcc_hash)(bbcc_hash*);
 void CLG_(forall_bbccs)(void (*func)(BBCC*));
+void CLG_(set_bbcc_dirty)(BBCC* bbcc);
+void CLG_(forall_dirty_bbccs)(void (*func)(BBCC*));
+void CLG_(clear_dirty_bbccs)(void);
 void CLG_(zero_bbcc)(BBCC* bbcc);
 BBCC* CLG_(get_bbcc)(BB* bb);
 BBCC* CLG_(clone_bbcc)(BBCC* orig, Context* cxt, Int rec_index);
@@ -772,6 +839,12 @@ void CLG_(run_post_signal_on_call_stack_bottom)(void);
 
 /* from dump.c */
 void CLG_(init_dumps)(void);
+void CLG_(fprintf)(DumpFile *fp, const HChar *format, ...) PRINTF_CHECK(2, 3);
+
+/* from gzip.c */
+void CLG_(gz_open)(gz_stream* gz, Int fd);
+void CLG_(gz_write)(gz_stream* gz, const HChar* data, Int len);
+void CLG_(gz_close)(gz_stream* gz);
 
 /*------------------------------------------------------------*/
 /*--- Exported global variables                            ---*/
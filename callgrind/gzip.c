@@ -0,0 +1,262 @@
+/*--------------------------------------------------------------------*/
+/*--- Callgrind                                                    ---*/
+/*---                                                      gzip.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Callgrind, a Valgrind tool for call tracing.
+
+   Copyright (C) 2002-2017, Josef Weidendorfer (Josef.Weidendorfer@gmx.de)
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#include "global.h"
+
+/*------------------------------------------------------------*/
+/*--- gzip compressed output (--compress-output=yes)       ---*/
+/*------------------------------------------------------------*/
+
+/* A minimal gzip writer (RFC 1951/1952) for profile dumps.
+ *
+ * Every chunk passed to CLG_(gz_write) becomes one deflate block
+ * with the fixed Huffman code. Matches are searched with hash chains
+ * inside of the chunk only, so the chunks (the dump buffer, see dump.c)
+ * should be large. The text format of profile data compresses well
+ * even without dynamic Huffman codes: repeated names, positions and
+ * cost lines mostly turn into short matches.
+ *
+ * Every dump file opened writes one gzip member. Appended dumps
+ * (--combine-dumps=yes) result in a multi-member gzip file, which
+ * gzip and callgrind_annotate read as one stream.
+ */
+
+#define GZ_WSIZE       32768    /* maximal match distance */
+#define GZ_WMASK       (GZ_WSIZE-1)
+#define GZ_HASH_BITS   15
+#define GZ_HASH_SIZE   (1<<GZ_HASH_BITS)
+#define GZ_MIN_MATCH   3
+#define GZ_MAX_MATCH   258
+#define GZ_MAX_CHAIN   32       /* candidates checked per position */
+
+/* Hash chains: <head> is the last position in the chunk with a given
+ * hash of 3 bytes, <prev> links to the previous one in the window.
+ * Positions are stored +1, with 0 meaning "none". */
+static Int* gz_head = 0;
+static Int* gz_prev = 0;
+static UInt gz_crc_table[256];
+
+/* Base values and extra bits of length codes 257..285 and
+ * distance codes 0..29 */
+static const UShort len_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const UChar len_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const UShort dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577 };
+static const UChar dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static void gz_init_tables(void)
+{
+    UInt i, k, c;
+
+    if (gz_head) return;
+
+    gz_head = (Int*) CLG_MALLOC("cl.gzip.it.1", GZ_HASH_SIZE * sizeof(Int));
+    gz_prev = (Int*) CLG_MALLOC("cl.gzip.it.2", GZ_WSIZE * sizeof(Int));
+
+    for(i = 0; i < 256; i++) {
+	c = i;
+	for(k = 0; k < 8; k++)
+	    c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+	gz_crc_table[i] = c;
+    }
+}
+
+static void gz_flush_out(gz_stream* gz)
+{
+    if (gz->out_used == 0) return;
+    VG_(write)(gz->fd, gz->out, gz->out_used);
+    gz->out_used = 0;
+}
+
+static __inline__ void gz_put_byte(gz_stream* gz, UChar b)
+{
+    if (gz->out_used == GZ_OUT_SIZE) gz_flush_out(gz);
+    gz->out[gz->out_used++] = b;
+}
+
+/* append <n> bits of <val>, LSB first */
+static __inline__ void gz_put_bits(gz_stream* gz, UInt val, Int n)
+{
+    gz->bits |= (ULong)val << gz->nbits;
+    gz->nbits += n;
+    while(gz->nbits >= 8) {
+	gz_put_byte(gz, (UChar)gz->bits);
+	gz->bits >>= 8;
+	gz->nbits -= 8;
+    }
+}
+
+/* Huffman codes are sent MSB first */
+static __inline__ void gz_put_code(gz_stream* gz, UInt code, Int n)
+{
+    UInt rev = 0;
+    Int i;
+
+    for(i = 0; i < n; i++) {
+	rev = (rev << 1) | (code & 1);
+	code >>= 1;
+    }
+    gz_put_bits(gz, rev, n);
+}
+
+/* fixed Huffman code of literal/length symbol */
+static void gz_put_sym(gz_stream* gz, UInt sym)
+{
+    if (sym < 144)      gz_put_code(gz, 0x30 + sym, 8);
+    else if (sym < 256) gz_put_code(gz, 0x190 + sym - 144, 9);
+    else if (sym < 280) gz_put_code(gz, sym - 256, 7);
+    else                gz_put_code(gz, 0xC0 + sym - 280, 8);
+}
+
+static void gz_put_match(gz_stream* gz, Int len, Int dist)
+{
+    Int c = 0;
+
+    while(c < 28 && len_base[c+1] <= len) c++;
+    gz_put_sym(gz, 257 + c);
+    if (len_extra[c])
+	gz_put_bits(gz, len - len_base[c], len_extra[c]);
+
+    c = 0;
+    while(c < 29 && dist_base[c+1] <= dist) c++;
+    gz_put_code(gz, c, 5);
+    if (dist_extra[c])
+	gz_put_bits(gz, dist - dist_base[c], dist_extra[c]);
+}
+
+static __inline__ UInt gz_hash(const UChar* p)
+{
+    return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & (GZ_HASH_SIZE-1);
+}
+
+void CLG_(gz_open)(gz_stream* gz, Int fd)
+{
+    static const UChar header[10] = {
+	0x1f, 0x8b, 8 /* deflate */, 0, 0, 0, 0, 0, 0, 3 /* Unix */ };
+    Int i;
+
+    gz_init_tables();
+
+    gz->fd       = fd;
+    gz->crc      = 0xFFFFFFFF;
+    gz->size     = 0;
+    gz->bits     = 0;
+    gz->nbits    = 0;
+    gz->out_used = 0;
+    for(i = 0; i < 10; i++)
+	gz_put_byte(gz, header[i]);
+}
+
+/* Compress <len> bytes as one (non-final) deflate block */
+void CLG_(gz_write)(gz_stream* gz, const HChar* data, Int len)
+{
+    const UChar* d = (const UChar*) data;
+    Int pos, i, h, cand, chain, l, best_len, best_dist;
+    UInt crc = gz->crc;
+
+    if (len == 0) return;
+
+    for(i = 0; i < len; i++)
+	crc = gz_crc_table[(crc ^ d[i]) & 0xFF] ^ (crc >> 8);
+    gz->crc = crc;
+    gz->size += len;
+
+    VG_(memset)(gz_head, 0, GZ_HASH_SIZE * sizeof(Int));
+
+    /* BFINAL=0, BTYPE=01 (fixed Huffman codes) */
+    gz_put_bits(gz, 2, 3);
+
+    pos = 0;
+    while(pos < len) {
+	best_len = 0;
+	best_dist = 0;
+	if (pos + GZ_MIN_MATCH <= len) {
+	    h = gz_hash(d + pos);
+	    cand = gz_head[h] - 1;
+	    chain = GZ_MAX_CHAIN;
+	    while(cand >= 0 && pos - cand <= GZ_WSIZE && chain-- > 0) {
+		if (d[cand + best_len] == d[pos + best_len]) {
+		    l = 0;
+		    while(l < GZ_MAX_MATCH && pos + l < len &&
+			  d[cand + l] == d[pos + l]) l++;
+		    if (l > best_len) {
+			best_len = l;
+			best_dist = pos - cand;
+			if (l == GZ_MAX_MATCH || pos + l == len) break;
+		    }
+		}
+		cand = gz_prev[cand & GZ_WMASK] - 1;
+	    }
+	}
+
+	if (best_len < GZ_MIN_MATCH) {
+	    best_len = 1;
+	    gz_put_sym(gz, d[pos]);
+	}
+	else
+	    gz_put_match(gz, best_len, best_dist);
+
+	/* insert all positions covered into the hash chains */
+	for(i = 0; i < best_len; i++, pos++) {
+	    if (pos + GZ_MIN_MATCH > len) continue;
+	    h = gz_hash(d + pos);
+	    gz_prev[pos & GZ_WMASK] = gz_head[h];
+	    gz_head[h] = pos + 1;
+	}
+    }
+
+    /* end of block */
+    gz_put_sym(gz, 256);
+}
+
+void CLG_(gz_close)(gz_stream* gz)
+{
+    UInt crc = gz->crc ^ 0xFFFFFFFF;
+    Int i;
+
+    /* empty final block: BFINAL=1, BTYPE=01, end of block */
+    gz_put_bits(gz, 3, 3);
+    gz_put_sym(gz, 256);
+    if (gz->nbits > 0)
+	gz_put_bits(gz, 0, 8 - gz->nbits);
+
+    for(i = 0; i < 4; i++)
+	gz_put_byte(gz, (UChar)(crc >> (8*i)));
+    for(i = 0; i < 4; i++)
+	gz_put_byte(gz, (UChar)(gz->size >> (8*i)));
+
+    gz_flush_out(gz);
+}
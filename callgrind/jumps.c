@@ -32,34 +32,24 @@
 /*--- Jump Cost Center (JCC) operations, including Calls   ---*/
 /*------------------------------------------------------------*/
 
-#define N_JCC_INITIAL_ENTRIES  4437
+/* number of buckets, see cchash.c */
+#define N_JCC_INITIAL_BUCKETS  2048
 
 static jcc_hash current_jccs;
 
 void CLG_(init_jcc_hash)(jcc_hash* jccs)
 {
-   Int i;
-
    CLG_ASSERT(jccs != 0);
 
-   jccs->size    = N_JCC_INITIAL_ENTRIES;
-   jccs->entries = 0;
-   jccs->table = (jCC**) CLG_MALLOC("cl.jumps.ijh.1",
-                                    jccs->size * sizeof(jCC*));
+   CLG_(init_cc_hash)(&(jccs->h), N_JCC_INITIAL_BUCKETS, "cl.jumps.ijh.1");
    jccs->spontaneous = 0;
-
-   for (i = 0; i < jccs->size; i++)
-     jccs->table[i] = 0;
 }
 
-
 void CLG_(copy_current_jcc_hash)(jcc_hash* dst)
 {
   CLG_ASSERT(dst != 0);
 
-  dst->size        = current_jccs.size;
-  dst->entries     = current_jccs.entries;
-  dst->table       = current_jccs.table;
+  dst->h           = current_jccs.h;
   dst->spontaneous = current_jccs.spontaneous;
 }
 
@@ -67,81 +57,31 @@ void CLG_(set_current_jcc_hash)(jcc_hash* h)
 {
   CLG_ASSERT(h != 0);
 
-  current_jccs.size        = h->size;
-  current_jccs.entries     = h->entries;
-  current_jccs.table       = h->table;
+  current_jccs.h           = h->h;
   current_jccs.spontaneous = h->spontaneous;
 }
 
 __inline__
-static UInt jcc_hash_idx(BBCC* from, UInt jmp, BBCC* to, UInt size)
+static UWord jcc_hash_key(BBCC* from, UInt jmp, BBCC* to)
 {
-  return (UInt) ( (UWord)from + 7* (UWord)to + 13*jmp) % size;
-} 
+  return cc_hash_words(cc_hash_words((UWord)from, jmp), (UWord)to);
+}
 
-/* double size of jcc table  */
-static void resize_jcc_table(void)
+static Bool jcc_matches(void* entry, const void* key)
 {
-    Int i, new_size, conflicts1 = 0, conflicts2 = 0;
-    jCC** new_table;
-    UInt new_idx;
-    jCC *curr_jcc, *next_jcc;
-
-    new_size  = 2* current_jccs.size +3;
-    new_table = (jCC**) CLG_MALLOC("cl.jumps.rjt.1",
-                                   new_size * sizeof(jCC*));
- 
-    for (i = 0; i < new_size; i++)
-      new_table[i] = NULL;
- 
-    for (i = 0; i < current_jccs.size; i++) {
-	if (current_jccs.table[i] == NULL) continue;
- 
-	curr_jcc = current_jccs.table[i];
-	while (NULL != curr_jcc) {
-	    next_jcc = curr_jcc->next_hash;
-
-	    new_idx = jcc_hash_idx(curr_jcc->from, curr_jcc->jmp,
-				    curr_jcc->to, new_size);
-
-	    curr_jcc->next_hash = new_table[new_idx];
-	    new_table[new_idx] = curr_jcc;
-	    if (curr_jcc->next_hash) {
-		conflicts1++;
-		if (curr_jcc->next_hash->next_hash)
-		    conflicts2++;
-	    }
-
-	    curr_jcc = next_jcc;
-	}
-    }
-
-    VG_(free)(current_jccs.table);
+  const jCC* jcc = (const jCC*) entry;
+  const jCC* k   = (const jCC*) key;
 
-
-    CLG_DEBUG(0, "Resize JCC Hash: %u => %d (entries %u, conflicts %d/%d)\n",
-	     current_jccs.size, new_size,
-	     current_jccs.entries, conflicts1, conflicts2);
-
-    current_jccs.size  = new_size;
-    current_jccs.table = new_table;
-    CLG_(stat).jcc_hash_resizes++;
+  return (jcc->from == k->from) && (jcc->jmp == k->jmp) && (jcc->to == k->to);
 }
 
 
-
 /* new jCC structure: a call was done to a BB of a BBCC 
  * for a spontaneous call, from is 0 (i.e. caller unknown)
  */
 static jCC* new_jcc(BBCC* from, UInt jmp, BBCC* to)
 {
    jCC* jcc;
-   UInt new_idx;
-
-   /* check fill degree of jcc hash table and resize if needed (>80%) */
-   current_jccs.entries++;
-   if (10 * current_jccs.entries / current_jccs.size > 8)
-       resize_jcc_table();
 
    jcc = (jCC*) CLG_MALLOC("cl.jumps.nj.1", sizeof(jCC));
 
@@ -167,9 +107,9 @@ static jCC* new_jcc(BBCC* from, UInt jmp, BBCC* to)
    }
 
    /* insert into JCC hash table */
-   new_idx = jcc_hash_idx(from, jmp, to, current_jccs.size);
-   jcc->next_hash = current_jccs.table[new_idx];
-   current_jccs.table[new_idx] = jcc;
+   if (CLG_(insert_cc_hash)(&(current_jccs.h),
+			    jcc_hash_key(from, jmp, to), jcc))
+       CLG_(stat).jcc_hash_resizes++;
 
    CLG_(stat).distinct_jccs++;
 
@@ -186,7 +126,7 @@ static jCC* new_jcc(BBCC* from, UInt jmp, BBCC* to)
 jCC* CLG_(get_jcc)(BBCC* from, UInt jmp, BBCC* to)
 {
     jCC* jcc;
-    UInt idx;
+    jCC  key;
 
     CLG_DEBUG(5, "+ get_jcc(bbcc %p/%u => bbcc %p)\n",
 		from, jmp, to);
@@ -208,15 +148,12 @@ jCC* CLG_(get_jcc)(BBCC* from, UInt jmp, BBCC* to)
 
     CLG_(stat).jcc_lru_misses++;
 
-    idx = jcc_hash_idx(from, jmp, to, current_jccs.size);
-    jcc = current_jccs.table[idx];
-
-    while(jcc) {
-	if ((jcc->from == from) &&
-	    (jcc->jmp == jmp) &&
-	    (jcc->to == to)) break;
-	jcc = jcc->next_hash;
-    }
+    key.from = from;
+    key.jmp  = jmp;
+    key.to   = to;
+    jcc = (jCC*) CLG_(lookup_cc_hash)(&(current_jccs.h),
+                                      jcc_hash_key(from, jmp, to),
+                                      jcc_matches, &key);
 
     if (!jcc)
 	jcc = new_jcc(from, jmp, to);
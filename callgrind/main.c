@@ -1407,7 +1407,8 @@ static void zero_thread_cost(thread_info* t)
     CLG_(current_call_stack).entry[i].jcc->call_counter = 0;
   }
 
-  CLG_(forall_bbccs)(CLG_(zero_bbcc));
+  CLG_(forall_dirty_bbccs)(CLG_(zero_bbcc));
+  CLG_(clear_dirty_bbccs)();
 
   /* set counter for last dump */
   CLG_(copy_cost)( CLG_(sets).full, 
@@ -32,6 +32,8 @@
 
 #include "global.h"
 
+#include "pub_tool_threadstate.h"
+
 
 /* Notes:
   - simulates a write-allocate cache
@@ -103,6 +105,7 @@ static Bool clo_simulate_writeback = False;
 static Bool clo_simulate_hwpref = False;
 static Bool clo_simulate_sectors = False;
 static Bool clo_collect_cacheuse = False;
+static Bool clo_private_caches = False;
 
 /* Following global vars are setup before by setup_bbcc():
  *
@@ -1278,6 +1281,61 @@ static void log_0I1Dw(InstrInfo* ii, Addr data_addr, Word data_size)
 
 
 
+/*------------------------------------------------------------*/
+/*--- Private L1 caches                                    ---*/
+/*------------------------------------------------------------*/
+
+/* With --private-caches=yes, every thread has its own I1 and D1
+ * caches, while LL is shared. The tags of the running thread are
+ * swapped into I1 and D1 on a thread switch, so the simulators above
+ * need no change. Not supported together with --cacheuse.
+ */
+
+typedef struct {
+  UWord* I1_tags;
+  UWord* D1_tags;
+} thread_caches;
+
+static thread_caches** private_caches = 0; /* indexed by ThreadId */
+static ThreadId private_caches_tid = VG_INVALID_THREADID;
+
+static
+void cachesim_switch_thread(ThreadId tid)
+{
+  thread_caches* tc;
+
+  if (!clo_private_caches || tid == private_caches_tid) return;
+
+  if (private_caches == 0)
+    private_caches = CLG_MALLOC("cl.sim.cst.1",
+                                VG_N_THREADS * sizeof(thread_caches*));
+  if (private_caches_tid == VG_INVALID_THREADID) {
+    /* the caches set up at initialization belong to the first thread */
+    Int i;
+    for(i=0; i<VG_N_THREADS; i++) private_caches[i] = 0;
+    tc = CLG_MALLOC("cl.sim.cst.2", sizeof(thread_caches));
+    tc->I1_tags = I1.tags;
+    tc->D1_tags = D1.tags;
+    private_caches[tid] = tc;
+  }
+  else if (private_caches[tid] == 0) {
+    tc = CLG_MALLOC("cl.sim.cst.2", sizeof(thread_caches));
+    I1.tags = tc->I1_tags = CLG_MALLOC("cl.sim.cst.3",
+                                       sizeof(UWord) * I1.sets * I1.assoc);
+    D1.tags = tc->D1_tags = CLG_MALLOC("cl.sim.cst.4",
+                                       sizeof(UWord) * D1.sets * D1.assoc);
+    cachesim_clearcache(&I1);
+    cachesim_clearcache(&D1);
+    private_caches[tid] = tc;
+  }
+
+  tc = private_caches[tid];
+  I1.tags = tc->I1_tags;
+  D1.tags = tc->D1_tags;
+  private_caches_tid = tid;
+}
+
+
 /*------------------------------------------------------------*/
 /*--- Cache configuration                                  ---*/
 /*------------------------------------------------------------*/
@@ -1386,6 +1444,13 @@ static void cachesim_post_clo_init(void)
 	  clo_simulate_writeback = False;
       }
 
+      if (clo_private_caches) {
+	  VG_(message)(Vg_DebugMsg,
+		       "warning: private caches can not be "
+                       "used with cache usage\n");
+	  clo_private_caches = False;
+      }
+
       simulator.I1_Read  = cacheuse_I1_doRead;
       simulator.D1_Read  = cacheuse_D1_doRead;
       simulator.D1_Write = cacheuse_D1_doRead;
@@ -1434,11 +1499,11 @@ void cachesim_clear(void)
 }
 
 
-static void cachesim_dump_desc(VgFile *fp)
+static void cachesim_dump_desc(DumpFile *fp)
 {
-  VG_(fprintf)(fp, "\ndesc: I1 cache: %s\n", I1.desc_line);
-  VG_(fprintf)(fp, "desc: D1 cache: %s\n", D1.desc_line);
-  VG_(fprintf)(fp, "desc: LL cache: %s\n", LL.desc_line);
+  CLG_(fprintf)(fp, "\ndesc: I1 cache: %s\n", I1.desc_line);
+  CLG_(fprintf)(fp, "desc: D1 cache: %s\n", D1.desc_line);
+  CLG_(fprintf)(fp, "desc: LL cache: %s\n", LL.desc_line);
 }
 
 static
@@ -1451,7 +1516,8 @@ void cachesim_print_opts(void)
 #if CLG_EXPERIMENTAL
 "    --simulate-sectors=no|yes Simulate sectored behaviour [no]\n"
 #endif
-"    --cacheuse=no|yes         Collect cache block use [no]\n");
+"    --cacheuse=no|yes         Collect cache block use [no]\n"
+"    --private-caches=no|yes   Per-thread I1/D1 caches, shared LL [no]\n");
   VG_(print_cache_clo_opts)();
 }
 
@@ -1465,6 +1531,7 @@ static Bool cachesim_parse_opt(const HChar* arg)
    if      VG_BOOL_CLO(arg, "--simulate-wb",      clo_simulate_writeback) {}
    else if VG_BOOL_CLO(arg, "--simulate-hwpref",  clo_simulate_hwpref)    {}
    else if VG_BOOL_CLO(arg, "--simulate-sectors", clo_simulate_sectors)   {}
+   else if VG_BOOL_CLO(arg, "--private-caches",   clo_private_caches)     {}
 
    else if VG_BOOL_CLO(arg, "--cacheuse", clo_collect_cacheuse) {
       if (clo_collect_cacheuse) {
@@ -1707,6 +1774,7 @@ struct cachesim_if CLG_(cachesim) = {
   .printstat     = cachesim_printstat,
   .add_icost     = cachesim_add_icost,
   .finish        = cachesim_finish,
+  .switch_thread = cachesim_switch_thread,
 
   /* these will be set by cachesim_post_clo_init */
   .log_1I0D        = 0,
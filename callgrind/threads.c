@@ -155,6 +155,9 @@ void CLG_(switch_thread)(ThreadId tid)
   CLG_(current_tid) = tid;
   CLG_ASSERT(tid < VG_N_THREADS);
 
+  if (tid != VG_INVALID_THREADID && CLG_(clo).simulate_cache)
+    (*CLG_(cachesim).switch_thread)(tid);
+
   if (tid != VG_INVALID_THREADID) {
     thread_info* t;
 
@@ -36,6 +36,7 @@
 #include "pub_core_libcprint.h"
 #include "pub_core_xarray.h"
 #include "pub_core_debuginfo.h"
+#include "pub_core_errormgr.h"
 #include "pub_core_execontext.h"
 #include "pub_core_addrinfo.h"
 #include "pub_core_mallocfree.h"
@@ -662,6 +663,113 @@ void VG_(pp_addrinfo_mc) ( Addr a, const AddrInfo* ai, Bool maybe_gcc )
    pp_addrinfo_WRK (a, ai, True /*mc*/, maybe_gcc);
 }
 
+static const HChar* binrep_BlockKind ( BlockKind bk )
+{
+   switch (bk) {
+      case Block_Mallocd:              return "mallocd";
+      case Block_Freed:                return "freed";
+      case Block_MempoolChunk:         return "mempool";
+      case Block_UserG:                return "user";
+      case Block_ClientArenaMallocd:   return "client-arena";
+      case Block_ClientArenaFree:      return "client-arena-free";
+      case Block_ValgrindArenaMallocd: return "valgrind-arena";
+      case Block_ValgrindArenaFree:    return "valgrind-arena-free";
+      default:                         vg_assert(0);
+   }
+}
+
+/* The binary counterpart of pp_addrinfo_WRK.  Only the raw values are
+   written; they are put into words by the report converter. */
+void VG_(binrep_addrinfo) ( Addr a, const AddrInfo* ai )
+{
+   switch (ai->tag) {
+      case Addr_Undescribed:
+         VG_(core_panic)("binrep_addrinfo Addr_Undescribed");
+
+      case Addr_Unknown:
+         VG_(binrep_string)("addr.kind", "unknown");
+         break;
+
+      case Addr_Stack:
+         VG_(binrep_string)("addr.kind", "stack");
+         VG_(binrep_word)("addr.thread", tnr_else_tid(ai->Addr.Stack.tinfo));
+         if (ai->Addr.Stack.frameNo != -1 && ai->Addr.Stack.IP != 0) {
+            VG_(binrep_sword)("addr.frame", ai->Addr.Stack.frameNo);
+            VG_(binrep_word)("addr.frame_ip", ai->Addr.Stack.IP);
+         }
+         if (ai->Addr.Stack.stackPos != StackPos_stacked)
+            VG_(binrep_sword)("addr.sp_offset", ai->Addr.Stack.spoffset);
+         if (ai->Addr.Stack.stackPos == StackPos_guard_page)
+            VG_(binrep_word)("addr.guard_page", 1);
+         break;
+
+      case Addr_Block:
+         VG_(binrep_string)("addr.kind",
+                            binrep_BlockKind(ai->Addr.Block.block_kind));
+         VG_(binrep_string)("addr.block", ai->Addr.Block.block_desc);
+         VG_(binrep_word)("addr.block_size", ai->Addr.Block.block_szB);
+         VG_(binrep_sword)("addr.offset", ai->Addr.Block.rwoffset);
+         if (ai->Addr.Block.freed_at != VG_(null_ExeContext)())
+            VG_(binrep_ExeContext)("addr.freed_at", ai->Addr.Block.freed_at);
+         if (ai->Addr.Block.allocated_at != VG_(null_ExeContext)())
+            VG_(binrep_ExeContext)("addr.alloc_at",
+                                   ai->Addr.Block.allocated_at);
+         if (ai->Addr.Block.alloc_tinfo.tnr || ai->Addr.Block.alloc_tinfo.tid)
+            VG_(binrep_word)("addr.alloc_thread",
+                             tnr_else_tid(ai->Addr.Block.alloc_tinfo));
+         break;
+
+      case Addr_DataSym:
+         VG_(binrep_string)("addr.kind", "data");
+         VG_(binrep_string)("addr.symbol", ai->Addr.DataSym.name);
+         VG_(binrep_sword)("addr.offset", ai->Addr.DataSym.offset);
+         break;
+
+      case Addr_Variable:
+         /* The variable descriptions are produced by the debug info
+            reader at error time, so they are written as they are. */
+         VG_(binrep_string)("addr.kind", "variable");
+         if (ai->Addr.Variable.descr1)
+            VG_(binrep_string)("addr.descr1",
+                       (HChar*)VG_(indexXA)(ai->Addr.Variable.descr1, 0));
+         if (ai->Addr.Variable.descr2)
+            VG_(binrep_string)("addr.descr2",
+                       (HChar*)VG_(indexXA)(ai->Addr.Variable.descr2, 0));
+         break;
+
+      case Addr_SectKind:
+         VG_(binrep_string)("addr.kind", "section");
+         VG_(binrep_string)("addr.section",
+                            VG_(pp_SectKind)(ai->Addr.SectKind.kind));
+         VG_(binrep_string)("addr.object", ai->Addr.SectKind.objname);
+         break;
+
+      case Addr_BrkSegment:
+         VG_(binrep_string)("addr.kind", "brk");
+         VG_(binrep_word)("addr.brk_base", VG_(brk_base));
+         VG_(binrep_word)("addr.brk_limit", ai->Addr.BrkSegment.brk_limit);
+         break;
+
+      case Addr_SegmentKind: {
+         HChar perms[4];
+         perms[0] = ai->Addr.SegmentKind.hasR ? 'r' : '-';
+         perms[1] = ai->Addr.SegmentKind.hasW ? 'w' : '-';
+         perms[2] = ai->Addr.SegmentKind.hasX ? 'x' : '-';
+         perms[3] = 0;
+         VG_(binrep_string)("addr.kind", "segment");
+         VG_(binrep_string)("addr.segment",
+                            pp_SegKind(ai->Addr.SegmentKind.segkind));
+         VG_(binrep_string)("addr.perms", perms);
+         if (ai->Addr.SegmentKind.filename)
+            VG_(binrep_string)("addr.object", ai->Addr.SegmentKind.filename);
+         break;
+      }
+
+      default:
+         VG_(core_panic)("binrep_addrinfo");
+   }
+}
+
 
 /*--------------------------------------------------------------------*/
 /*--- end                                             m_addrinfo.c ---*/
@@ -41,10 +41,13 @@
 #include "pub_core_libcfile.h"
 #include "pub_core_libcprint.h"
 #include "pub_core_libcproc.h"         // For VG_(getpid)()
+#include "pub_core_clientstate.h"      // For VG_(args_the_exename)
 #include "pub_core_seqmatch.h"
 #include "pub_core_mallocfree.h"
 #include "pub_core_options.h"
+#include "pub_core_oset.h"
 #include "pub_core_stacktrace.h"
+#include "pub_core_syscall.h"         // VG_(strerror)
 #include "pub_core_tooliface.h"
 #include "pub_core_translate.h"        // for VG_(translate)()
 #include "pub_core_xarray.h"           // VG_(xaprintf) et al
@@ -645,6 +648,343 @@ static void pp_Error ( const Error* err, Bool allow_db_attach, Bool xml )
 }
 
 
+/*------------------------------------------------------------*/
+/*--- Binary reports                                       ---*/
+/*------------------------------------------------------------*/
+
+/* A binary report (--binary-report-file) is a stream of records, each
+   made of a one-byte tag followed by its fields.  Integers are in host
+   byte order, and words are host words.  A string is a UInt length
+   followed by the characters, without a terminating zero.
+
+   The file starts with the 8 characters "VGBINREP" followed by the
+   UInts BINREP_VERSION and sizeof(UWord).  Then come the records:
+
+     'T' str tool
+     'P' UInt pid, UInt ppid, str exe, UInt n_args, n_args * str arg
+     'M' Word avma, Word size, Word bias, str filename
+           text mapping of an object, written before the first stack
+           trace having an IP in it
+     'C' UInt ecu, UInt n_ips, n_ips * Word ip
+           stack trace of an ExeContext
+     'K' Int ekind, str name        name of an error kind
+     'F' UInt id, str name          name of a field
+     'E' UInt unique, UInt tid, Int ekind, UInt where_ecu, Word addr
+           start of an error
+     'w' UInt field, Word value     unsigned field of the current error
+     'i' UInt field, Word value     signed field
+     's' UInt field, str value      string field
+     'c' UInt field, UInt ecu       stack trace field
+     'e'                            end of the current error
+     'N' UInt unique, UInt count    number of occurrences of an error
+     'S' UInt errs_found, UInt err_contexts,
+         UInt errs_suppressed, UInt supp_contexts
+     'Z'                            end of the report
+
+   'M', 'C', 'K' and 'F' records are written once, the first time what
+   they describe is needed, so they can appear between the fields of an
+   error.  Nothing is symbolised when writing the report: that is left
+   to the converter. */
+
+#define BINREP_VERSION  1
+#define BINREP_BUF_SZB  65536
+
+static struct {
+   Bool    on;        // --binary-report-file given and file opened
+   Int     fd;        // -1 when output is discarded (forked child)
+   HChar*  fname;     // expanded file name
+   UChar*  buf;       // pending output
+   UInt    used;      // nr of bytes used in buf
+   OSet*   ecus;      // ECUs whose stack trace was written
+   OSet*   maps;      // text avmas whose mapping was written
+   OSet*   ekinds;    // error kinds whose name was written
+   XArray* fields;    // of const HChar*: field names, indexed by id
+} binrep;
+
+static void binrep_flush ( void )
+{
+   UInt done = 0;
+   while (binrep.fd >= 0 && done < binrep.used) {
+      Int n = VG_(write)(binrep.fd, binrep.buf + done, binrep.used - done);
+      if (n <= 0) {
+         VG_(umsg)("Cannot write binary report '%s'; "
+                   "no further errors will be written to it.\n",
+                   binrep.fname);
+         binrep.fd = -1;
+         break;
+      }
+      done += n;
+   }
+   binrep.used = 0;
+}
+
+static void binrep_bytes ( const void* p, UInt n )
+{
+   const UChar* b = p;
+   while (n > 0) {
+      UInt chunk = BINREP_BUF_SZB - binrep.used;
+      if (chunk == 0) {
+         binrep_flush();
+         continue;
+      }
+      if (chunk > n)
+         chunk = n;
+      VG_(memcpy)(binrep.buf + binrep.used, b, chunk);
+      binrep.used += chunk;
+      b += chunk;
+      n -= chunk;
+   }
+}
+
+static void binrep_tag   ( HChar tag ) { binrep_bytes(&tag, 1); }
+static void binrep_UInt  ( UInt u )    { binrep_bytes(&u, sizeof(UInt)); }
+static void binrep_UWord ( UWord w )   { binrep_bytes(&w, sizeof(UWord)); }
+
+static void binrep_str ( const HChar* s )
+{
+   UInt n = VG_(strlen)(s);
+   binrep_UInt(n);
+   binrep_bytes(s, n);
+}
+
+/* Writes the text mapping containing ip, if not yet written. */
+static void binrep_mapping ( DiEpoch ep, Addr ip )
+{
+   DebugInfo* di = VG_(find_DebugInfo)(ep, ip);
+   Addr avma;
+
+   if (di == NULL)
+      return;
+   avma = VG_(DebugInfo_get_text_avma)(di);
+   if (VG_(OSetWord_Contains)(binrep.maps, avma))
+      return;
+   VG_(OSetWord_Insert)(binrep.maps, avma);
+   binrep_tag('M');
+   binrep_UWord(avma);
+   binrep_UWord(VG_(DebugInfo_get_text_size)(di));
+   binrep_UWord((UWord)VG_(DebugInfo_get_text_bias)(di));
+   binrep_str(VG_(DebugInfo_get_filename)(di));
+}
+
+/* Writes the stack trace of ec, if not yet written, and returns its
+   ECU. */
+static UInt binrep_context ( ExeContext* ec )
+{
+   UInt       ecu   = VG_(get_ECU_from_ExeContext)(ec);
+   DiEpoch    ep    = VG_(get_ExeContext_epoch)(ec);
+   StackTrace ips   = VG_(get_ExeContext_StackTrace)(ec);
+   UInt       n_ips = VG_(get_ExeContext_n_ips)(ec);
+   UInt       i;
+
+   if (VG_(OSetWord_Contains)(binrep.ecus, ecu))
+      return ecu;
+   VG_(OSetWord_Insert)(binrep.ecus, ecu);
+   for (i = 0; i < n_ips; i++)
+      binrep_mapping(ep, ips[i]);
+   binrep_tag('C');
+   binrep_UInt(ecu);
+   binrep_UInt(n_ips);
+   for (i = 0; i < n_ips; i++)
+      binrep_UWord(ips[i]);
+   return ecu;
+}
+
+/* Returns the id of the field name, writing it if it is new.  There
+   are only a few different names, which are string literals: compare
+   the pointers first. */
+static UInt binrep_field ( const HChar* field )
+{
+   Word i, n = VG_(sizeXA)(binrep.fields);
+
+   for (i = 0; i < n; i++)
+      if (*(const HChar**)VG_(indexXA)(binrep.fields, i) == field)
+         return i;
+   for (i = 0; i < n; i++)
+      if (VG_(strcmp)(*(const HChar**)VG_(indexXA)(binrep.fields, i),
+                      field) == 0)
+         return i;
+   VG_(addToXA)(binrep.fields, &field);
+   binrep_tag('F');
+   binrep_UInt(n);
+   binrep_str(field);
+   return n;
+}
+
+void VG_(binrep_word) ( const HChar* field, UWord w )
+{
+   UInt id = binrep_field(field);
+   binrep_tag('w');
+   binrep_UInt(id);
+   binrep_UWord(w);
+}
+
+void VG_(binrep_sword) ( const HChar* field, Word w )
+{
+   UInt id = binrep_field(field);
+   binrep_tag('i');
+   binrep_UInt(id);
+   binrep_UWord((UWord)w);
+}
+
+void VG_(binrep_string) ( const HChar* field, const HChar* s )
+{
+   UInt id = binrep_field(field);
+   binrep_tag('s');
+   binrep_UInt(id);
+   binrep_str(s);
+}
+
+void VG_(binrep_ExeContext) ( const HChar* field, ExeContext* ec )
+{
+   UInt id  = binrep_field(field);
+   UInt ecu = binrep_context(ec);
+   binrep_tag('c');
+   binrep_UInt(id);
+   binrep_UInt(ecu);
+}
+
+/* The binary counterpart of pp_Error. */
+static void binrep_Error ( const Error* err )
+{
+   ThreadState* tst = VG_(get_ThreadState)(err->tid);
+   UInt ecu;
+
+   if (!VG_(OSetWord_Contains)(binrep.ekinds, (UWord)(Word)err->ekind)) {
+      VG_(OSetWord_Insert)(binrep.ekinds, (UWord)(Word)err->ekind);
+      binrep_tag('K');
+      binrep_UInt((UInt)err->ekind);
+      binrep_str(VG_TDICT_CALL(tool_get_error_name, err));
+   }
+   ecu = binrep_context(err->where);
+
+   binrep_tag('E');
+   binrep_UInt(err->unique);
+   binrep_UInt(err->tid);
+   binrep_UInt((UInt)err->ekind);
+   binrep_UInt(ecu);
+   binrep_UWord(err->addr);
+   if (tst->thread_name)
+      VG_(binrep_string)("threadname", tst->thread_name);
+   VG_TDICT_CALL(tool_binrep_Error, err);
+   binrep_tag('e');
+}
+
+static void binrep_open_file ( void )
+{
+   SysRes sres;
+   Int    fd;
+
+   binrep.fname = VG_(expand_file_name)("--binary-report-file",
+                                        VG_(clo_binary_report_fname_unexpanded));
+   sres = VG_(open)(binrep.fname,
+                    VKI_O_CREAT|VKI_O_WRONLY|VKI_O_TRUNC,
+                    VKI_S_IRUSR|VKI_S_IWUSR|VKI_S_IRGRP|VKI_S_IROTH);
+   if (sr_isError(sres)) {
+      VG_(fmsg)("Cannot create binary report file '%s': %s\n",
+                binrep.fname, VG_(strerror)(sr_Err(sres)));
+      VG_(exit)(1);
+      /*NOTREACHED*/
+   }
+   // Move the fd into the safe range, so it doesn't conflict with any
+   // app fds.
+   fd = VG_(fcntl)(sr_Res(sres), VKI_F_DUPFD, VG_(fd_hard_limit));
+   VG_(close)(sr_Res(sres));
+   if (fd < 0) {
+      VG_(fmsg)("Cannot move binary report file descriptor "
+                "into safe range\n");
+      VG_(exit)(1);
+      /*NOTREACHED*/
+   }
+   VG_(fcntl)(fd, VKI_F_SETFD, VKI_FD_CLOEXEC);
+   binrep.fd = fd;
+}
+
+/* Starts a new report in the file just opened: forgets what was written
+   to any previous one, and writes the header. */
+static void binrep_start ( void )
+{
+   Word i;
+
+   if (binrep.ecus != NULL) {
+      VG_(OSetWord_Destroy)(binrep.ecus);
+      VG_(OSetWord_Destroy)(binrep.maps);
+      VG_(OSetWord_Destroy)(binrep.ekinds);
+      VG_(deleteXA)(binrep.fields);
+   }
+   binrep.ecus   = VG_(OSetWord_Create)(VG_(malloc), "errormgr.binrep.2",
+                                        VG_(free));
+   binrep.maps   = VG_(OSetWord_Create)(VG_(malloc), "errormgr.binrep.3",
+                                        VG_(free));
+   binrep.ekinds = VG_(OSetWord_Create)(VG_(malloc), "errormgr.binrep.4",
+                                        VG_(free));
+   binrep.fields = VG_(newXA)(VG_(malloc), "errormgr.binrep.5",
+                              VG_(free), sizeof(const HChar*));
+
+   binrep_bytes("VGBINREP", 8);
+   binrep_UInt(BINREP_VERSION);
+   binrep_UInt(sizeof(UWord));
+   binrep_tag('T');
+   binrep_str(VG_(details).name);
+   binrep_tag('P');
+   binrep_UInt(VG_(getpid)());
+   binrep_UInt(VG_(getppid)());
+   binrep_str(VG_(args_the_exename));
+   binrep_UInt(VG_(sizeXA)(VG_(args_for_client)));
+   for (i = 0; i < VG_(sizeXA)(VG_(args_for_client)); i++)
+      binrep_str(*(HChar**)VG_(indexXA)(VG_(args_for_client), i));
+}
+
+/* In a forked child, the pending output belongs to the parent, as do
+   the records describing what was already written.  If the file name
+   depends on the pid, the child starts a report of its own; otherwise
+   its errors are not written. */
+static void binrep_atfork_child ( ThreadId tid )
+{
+   HChar* fname;
+
+   binrep.used = 0;
+   if (binrep.fd < 0)
+      return;
+   VG_(close)(binrep.fd);
+   binrep.fd = -1;
+   if (VG_(clo_child_silent_after_fork))
+      return;
+   fname = VG_(expand_file_name)("--binary-report-file",
+                                 VG_(clo_binary_report_fname_unexpanded));
+   if (VG_(strcmp)(fname, binrep.fname) != 0) {
+      VG_(free)(binrep.fname);
+      binrep_open_file();
+      binrep_start();
+   }
+   VG_(free)(fname);
+}
+
+void VG_(open_binary_report) ( void )
+{
+   vg_assert(VG_(clo_binary_report_fname_unexpanded) != NULL);
+   vg_assert(VG_(needs).binary_report);
+
+   binrep_open_file();
+   binrep.on   = True;
+   binrep.buf  = VG_(malloc)("errormgr.binrep.1", BINREP_BUF_SZB);
+   binrep.used = 0;
+   binrep_start();
+   VG_(atfork)(NULL, NULL, binrep_atfork_child);
+}
+
+/* Shows a new error: either writes it to the binary report, or prints
+   it. */
+static void show_Error ( const Error* err, Bool allow_db_attach )
+{
+   if (binrep.on) {
+      binrep_Error(err);
+      do_actions_on_error(err, allow_db_attach);
+   } else {
+      pp_Error(err, allow_db_attach, VG_(clo_xml));
+   }
+}
+
+
 /* Construct an error */
 static
 void construct_error ( Error* err, ThreadId tid, ErrorKind ekind, Addr a,
@@ -848,7 +1188,7 @@ void VG_(maybe_record_error) ( ThreadId tid,
       n_errs_found++;
       n_errs_shown++;
       /* Actually show the error; more complex than you might think. */
-      pp_Error( p, /*allow_db_attach*/True, VG_(clo_xml) );
+      show_Error( p, /*allow_db_attach*/True );
    } else {
       n_supp_contexts++;
       n_errs_suppressed++;
@@ -898,7 +1238,7 @@ Bool VG_(unique_error) ( ThreadId tid, ErrorKind ekind, Addr a, const HChar* s,
          /* update stats */
          n_errs_shown++;
          /* Actually show the error; more complex than you might think. */
-         pp_Error(&err, allow_db_attach, VG_(clo_xml));
+         show_Error(&err, allow_db_attach);
       }
       return False;
 
@@ -976,7 +1316,7 @@ static Bool show_used_suppressions ( void )
    suppressions used. */
 void VG_(show_all_errors) (  Int verbosity, Bool xml )
 {
-   Int    i, n_min;
+   Int    i, n_min, n_contexts;
    Error *p, *p_min;
    Bool   any_supp;
 
@@ -1005,7 +1345,10 @@ void VG_(show_all_errors) (  Int verbosity, Bool xml )
       Once an error is shown, we add a huge value to its count to filter it
       out.
       After having shown all errors, we reset count to the original value. */
-   for (i = 0; i < n_err_contexts; i++) {
+   // Errors written to a binary report are not printed here: the
+   // report has their counts.
+   n_contexts = binrep.on ? 0 : n_err_contexts;
+   for (i = 0; i < n_contexts; i++) {
       n_min = (1 << 30) - 1;
       p_min = NULL;
       for (p = errors; p != NULL; p = p->next) {
@@ -1087,6 +1430,34 @@ void VG_(show_error_counts_as_XML) ( void )
 }
 
 
+/* Finishes the binary report: writes the occurrence counts of the
+   errors, and the error summary. */
+void VG_(close_binary_report) ( void )
+{
+   Error* err;
+
+   if (!binrep.on)
+      return;
+   for (err = errors; err != NULL; err = err->next) {
+      if (err->supp != NULL)
+         continue;
+      binrep_tag('N');
+      binrep_UInt(err->unique);
+      binrep_UInt(err->count);
+   }
+   binrep_tag('S');
+   binrep_UInt(n_errs_found);
+   binrep_UInt(n_err_contexts);
+   binrep_UInt(n_errs_suppressed);
+   binrep_UInt(n_supp_contexts);
+   binrep_tag('Z');
+   binrep_flush();
+   if (binrep.fd >= 0)
+      VG_(close)(binrep.fd);
+   binrep.fd = -1;
+}
+
+
 /*------------------------------------------------------------*/
 /*--- Suppression parsing                                  ---*/
 /*------------------------------------------------------------*/
@@ -122,6 +122,8 @@ static void usage_NORETURN ( Bool debug_help )
 "    --xml-file=<file>         XML output to <file>\n"
 "    --xml-socket=ipaddr:port  XML output to socket ipaddr:port\n"
 "    --xml-user-comment=STR    copy STR verbatim into XML output\n"
+"    --binary-report-file=<file> write errors to <file> in binary form,\n"
+"                              to be converted by valgrind-report (some tools only)\n"
 "    --demangle=no|yes         automatically demangle C++ names? [yes]\n"
 "    --num-callers=<number>    show <number> callers in stack traces [12]\n"
 "    --error-limit=no|yes      stop showing new errors if too many? [yes]\n"
@@ -779,6 +781,9 @@ void main_process_cmd_line_options( void )
          xml_to = VgLogTo_Socket;
       }
 
+      else if VG_STR_CLO(arg, "--binary-report-file",
+                              VG_(clo_binary_report_fname_unexpanded)) {}
+
       else if VG_STR_CLO(arg, "--debuginfo-server",
                               VG_(clo_debuginfo_server)) {}
 
@@ -968,6 +973,27 @@ void main_process_cmd_line_options( void )
       /*NOTREACHED*/
    }
 
+   /* Likewise for binary reports.  Errors written to a binary report
+      are not printed, so there is nothing to generate a suppression
+      from, and XML output would be empty. */
+   if (VG_(clo_binary_report_fname_unexpanded) != NULL) {
+      if (!VG_(needs).binary_report) {
+         VG_(fmsg_bad_option)("--binary-report-file",
+            "%s does not support binary reports.\n", VG_(details).name);
+      }
+      if (VG_(clo_xml)) {
+         VG_(fmsg_bad_option)("--xml=yes together with --binary-report-file",
+            "Errors can be reported in XML or in a binary report, "
+            "not both.\n");
+      }
+      if (VG_(clo_gen_suppressions) > 0) {
+         VG_(fmsg_bad_option)(
+            "--gen-suppressions together with --binary-report-file",
+            "Suppressions cannot be generated for errors written to a "
+            "binary report.\n");
+      }
+   }
+
    vg_assert( VG_(clo_gen_suppressions) >= 0 );
    vg_assert( VG_(clo_gen_suppressions) <= 2 );
 
@@ -1022,6 +1048,9 @@ void main_process_cmd_line_options( void )
       children, if requested via --log|xml-file= options. */
    VG_(atfork)(NULL, NULL, VG_(logging_atfork_child));
 
+   if (VG_(clo_binary_report_fname_unexpanded) != NULL)
+      VG_(open_binary_report)();
+
    // Suppressions related stuff
 
    if (VG_(clo_default_supp) &&
@@ -2158,6 +2187,8 @@ void shutdown_actions_NORETURN( ThreadId tid,
    if (VG_(needs).core_errors || VG_(needs).tool_errors)
       VG_(show_all_errors)(VG_(clo_verbosity), VG_(clo_xml));
 
+   VG_(close_binary_report)();
+
    if (VG_(clo_xml)) {
       VG_(printf_xml)("\n");
       VG_(printf_xml)("</valgrindoutput>\n");
@@ -891,6 +891,17 @@ void VG_(force_vgdb_poll) ( void )
    vgdb_next_poll = VGDB_POLL_ASAP;
 }
 
+/* Tell the tool that thread tid is about to run client code.  No
+   translation is executing at this point, so the tool may discard
+   some.  This must therefore be done before looking up the host code
+   address to run. */
+static void start_client_code ( ThreadId tid )
+{
+   VG_(ok_to_discard_translations) = True;
+   VG_TRACK( start_client_code, tid, bbs_done );
+   VG_(ok_to_discard_translations) = False;
+}
+
 /* Run the thread tid for a while, and return a VG_TRC_* value
    indicating why VG_(disp_run_translations) stopped, and possibly an
    auxiliary word.  Also, only allow the thread to run for at most
@@ -934,7 +945,12 @@ void run_thread_for_a_while ( /*OUT*/HWord* two_words,
    /* Clear return area. */
    two_words[0] = two_words[1] = 0;
 
-   /* Figure out where we're starting from. */
+   /* Figure out where we're starting from.  The tool is told first, as
+      it may discard translations.  For a no-redir translation,
+      handle_noredir_jump has done that before looking it up. */
+   if (!use_alt_host_addr)
+      start_client_code( tid );
+
    if (use_alt_host_addr) {
       /* unusual case -- no-redir translation */
       host_code_addr = alt_host_addr;
@@ -960,6 +976,7 @@ void run_thread_for_a_while ( /*OUT*/HWord* two_words,
                which case we can return now claiming it's not
                findable. */
             two_words[0] = VG_TRC_INNER_FASTMISS; /* hmm, is that right? */
+            VG_TRACK( stop_client_code, tid, bbs_done );
             return;
          }
       }
@@ -996,9 +1013,6 @@ void run_thread_for_a_while ( /*OUT*/HWord* two_words,
 
    /* Set up return-value area. */
 
-   // Tell the tool this thread is about to run client code
-   VG_TRACK( start_client_code, tid, bbs_done );
-
    vg_assert(VG_(in_generated_code) == False);
    VG_(in_generated_code) = True;
 
@@ -1207,6 +1221,8 @@ void handle_noredir_jump ( /*OUT*/HWord* two_words,
    Addr  hcode = 0;
    Addr  ip    = VG_(get_IP)(tid);
 
+   start_client_code( tid );
+
    Bool  found = VG_(search_unredir_transtab)( &hcode, ip );
    if (!found) {
       /* Not found; we need to request a translation. */
@@ -1222,6 +1238,7 @@ void handle_noredir_jump ( /*OUT*/HWord* two_words,
 	 // or the thread has been marked for termination.  Either
 	 // way, we just need to go back into the scheduler loop.
          two_words[0] = VG_TRC_BORING;
+         VG_TRACK( stop_client_code, tid, bbs_done );
          return;
       }
 
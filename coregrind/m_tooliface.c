@@ -99,6 +99,7 @@ VgNeeds VG_(needs) = {
    .var_info	         = False,
    .malloc_replacement   = False,
    .xml_output           = False,
+   .binary_report        = False,
    .final_IR_tidy_pass   = False
 };
 
@@ -368,6 +369,14 @@ void VG_(needs_xml_output)( void )
    VG_(needs).xml_output = True;
 }
 
+void VG_(needs_binary_report)(
+   void (*binrep_Error)(const Error*)
+)
+{
+   VG_(needs).binary_report = True;
+   VG_(tdict).tool_binrep_Error = binrep_Error;
+}
+
 void VG_(needs_final_IR_tidy_pass)( 
    IRSB*(*final_tidy)(IRSB*)
 )
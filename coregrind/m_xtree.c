@@ -277,6 +277,33 @@ XTree* VG_(XT_snapshot)(XTree* xt)
    return nxt;
 }
 
+XTree* VG_(XT_empty_copy)(XTree* xt)
+{
+   XTree* nxt;
+
+   vg_assert(xt);
+
+   nxt = xt->alloc_fn(xt->cc, sizeof(struct _XTree) );
+
+   *nxt = *xt;
+   addRef_XT_shared(nxt->shared);
+   nxt->tmp_data = nxt->alloc_fn(nxt->cc, nxt->dataSzB);
+   nxt->data = VG_(newXA)(nxt->alloc_fn, nxt->cc, nxt->free_fn, nxt->dataSzB);
+
+   return nxt;
+}
+
+void VG_(XT_grow)(XTree* xt, UInt n_xecu)
+{
+   vg_assert(n_xecu <= VG_(sizeXA)(xt->shared->xec));
+
+   if (n_xecu <= VG_(sizeXA)(xt->data))
+      return;
+   xt->init_data_fn(xt->tmp_data);
+   while (VG_(sizeXA)(xt->data) < n_xecu)
+      VG_(addToXA)(xt->data, xt->tmp_data);
+}
+
 void VG_(XT_delete) ( XTree* xt )
 {
    vg_assert(xt);
@@ -360,6 +387,11 @@ void VG_(XT_sub_from_xecu) (XTree* xt, Xecu xecu, const void* value)
    xt->sub_data_fn(data, value);
 }
 
+UInt VG_(XT_n_xecu) (XTree* xt)
+{
+   return (UInt)VG_(sizeXA)(xt->data);
+}
+
 UInt VG_(XT_n_ips_sel) (XTree* xt, Xecu xecu)
 {
    xec* xe = (xec*)VG_(indexXA)(xt->shared->xec, xecu);
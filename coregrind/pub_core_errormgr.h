@@ -62,6 +62,12 @@ extern void VG_(show_last_error)          ( void );
 
 extern void VG_(show_error_counts_as_XML) ( void );
 
+/* Opens the file given with --binary-report-file, after which errors
+   are written to it instead of being printed.  At the end of the run,
+   VG_(close_binary_report) writes the error counts and closes it. */
+extern void VG_(open_binary_report)       ( void );
+extern void VG_(close_binary_report)      ( void );
+
 extern Bool VG_(is_action_requested)      ( const HChar* action, Bool* clo );
 
 extern Bool VG_(showing_core_errors)      ( void );
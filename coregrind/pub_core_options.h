@@ -126,6 +126,11 @@ extern Bool  VG_(clo_child_silent_after_fork);
 extern const HChar *VG_(clo_log_fname_unexpanded);
 extern const HChar *VG_(clo_xml_fname_unexpanded);
 
+/* If the user specified --binary-report-file=STR, this holds STR before
+   expansion.  Errors are then written to that file in binary form
+   instead of being printed. */
+extern const HChar *VG_(clo_binary_report_fname_unexpanded);
+
 /* Add timestamps to log messages?  default: NO */
 extern Bool  VG_(clo_time_stamp);
 
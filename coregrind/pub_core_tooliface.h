@@ -94,6 +94,7 @@ typedef
       Bool var_info;
       Bool malloc_replacement;
       Bool xml_output;
+      Bool binary_report;
       Bool final_IR_tidy_pass;
    } 
    VgNeeds;
@@ -177,6 +178,9 @@ typedef struct {
    // VG_(needs).xml_output
    // (none)
 
+   // VG_(needs).binary_report
+   void (*tool_binrep_Error)(const Error*);
+
    // -- Event tracking functions ------------------------------------
    void (*track_new_mem_startup)     (Addr, SizeT, Bool, Bool, Bool, ULong);
    void (*track_new_mem_stack_signal)(Addr, SizeT, ThreadId);
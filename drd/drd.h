@@ -99,6 +99,22 @@
    VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__DRD_STOP_TRACE_ADDR, \
                                    &(x), sizeof(x), 0, 0, 0)
 
+/**
+ * Tell DRD to watch the specified variable. If DRD has been started with
+ * --watch-only=yes or --watch-sample-pages, only accesses to watched
+ * variables and to sampled pages are checked for data races.
+ */
+#define DRD_WATCH_VAR(x)                                             \
+   VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__DRD_START_WATCH_ADDR, \
+                                   &(x), sizeof(x), 0, 0, 0)
+
+/**
+ * Tell DRD to stop watching the specified variable.
+ */
+#define DRD_STOP_WATCHING_VAR(x)                                     \
+   VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__DRD_STOP_WATCH_ADDR,  \
+                                   &(x), sizeof(x), 0, 0, 0)
+
 /**
  * @defgroup RaceDetectionAnnotations Data race detection annotations.
  *
@@ -527,6 +543,17 @@ enum {
       = VG_USERREQ_TOOL_BASE('H','G') + 256 + 34,
    /* args: Addr. */
 
+   /* To ask the DRD tool to watch the specified range. This client request */
+   /* is binary compatible with VALGRIND_HG_WATCH_RANGE(). */
+   VG_USERREQ__DRD_START_WATCH_ADDR
+      = VG_USERREQ_TOOL_BASE('H','G') + 256 + 62,
+   /* args: Addr, SizeT. */
+   /* To ask the DRD tool to stop watching the specified range. This client */
+   /* request is binary compatible with VALGRIND_HG_UNWATCH_RANGE(). */
+   VG_USERREQ__DRD_STOP_WATCH_ADDR
+      = VG_USERREQ_TOOL_BASE('H','G') + 256 + 63,
+   /* args: Addr, SizeT. */
+
 };
 
 
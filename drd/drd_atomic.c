@@ -0,0 +1,179 @@
+/*
+  This file is part of drd, a thread error detector.
+
+  Copyright (C) 2006-2017 Bart Van Assche <bvanassche@acm.org>.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+  02111-1307, USA.
+
+  The GNU General Public License is contained in the file COPYING.
+*/
+
+
+
+#include "drd_atomic.h"
+#include "drd_thread.h"
+#include "drd_vc.h"
+#include "pub_tool_libcassert.h"  /* tl_assert()               */
+#include "pub_tool_mallocfree.h"  /* VG_(malloc)(), VG_(free)()*/
+#include "pub_tool_oset.h"
+
+
+/* Type definitions. */
+
+/**
+ * Synchronization information associated with a memory location that has
+ * been accessed by an atomic read-modify-write instruction.
+ */
+struct atomic_info
+{
+   Addr        a;  // Address of the atomic variable. Key of s_atomic_set.
+   VectorClock vc; // Combination of all vector clocks released via 'a'.
+};
+
+
+/* Local variables. */
+
+static OSet* s_atomic_set;
+static ULong s_atomic_rmw_count;
+static ULong s_atomic_acquire_skip_count;
+
+
+/* Function definitions. */
+
+static struct atomic_info* atomic_get_or_allocate(const Addr a)
+{
+   struct atomic_info* p;
+
+   if (!s_atomic_set)
+      s_atomic_set = VG_(OSetGen_Create)(offsetof(struct atomic_info, a), 0,
+                                         VG_(malloc), "drd.atomic",
+                                         VG_(free));
+   p = VG_(OSetGen_Lookup)(s_atomic_set, &a);
+   if (!p)
+   {
+      p = VG_(OSetGen_AllocNode)(s_atomic_set, sizeof(*p));
+      p->a = a;
+      DRD_(vc_init)(&p->vc, 0, 0);
+      VG_(OSetGen_Insert)(s_atomic_set, p);
+   }
+   return p;
+}
+
+/**
+ * Model an atomic read-modify-write of the location associated with 'p' by
+ * thread 'tid'. If 'release' is true, the vector clock of 'tid' is released
+ * via 'p'. The vector clock released via 'p' by other threads is acquired.
+ * At most one new segment is started for 'tid', and none if the operation
+ * neither releases anything nor acquires new ordering information.
+ */
+static void atomic_do_rmw(const DrdThreadId tid, struct atomic_info* const p,
+                          const Bool release)
+{
+   const Bool acquire = !DRD_(vc_lte)(&p->vc, DRD_(thread_get_vc)(tid));
+   VectorClock old_vc;
+
+   if (!acquire)
+      s_atomic_acquire_skip_count++;
+   if (!acquire && !release)
+      return;
+
+   if (release)
+      DRD_(vc_combine)(&p->vc, DRD_(thread_get_vc)(tid));
+   DRD_(thread_new_segment)(tid);
+   if (acquire)
+   {
+      DRD_(vc_copy)(&old_vc, DRD_(thread_get_vc)(tid));
+      DRD_(vc_combine)(DRD_(thread_get_vc)(tid), &p->vc);
+      DRD_(thread_update_conflict_set)(tid, &old_vc);
+      DRD_(vc_cleanup)(&old_vc);
+   }
+}
+
+/**
+ * Called after an atomic read-modify-write of address 'a' has been
+ * performed. A successful read-modify-write has both acquire and release
+ * semantics while a failed compare-and-swap only has acquire semantics.
+ */
+VG_REGPARM(2) void DRD_(atomic_rmw)(const Addr a, const UWord success)
+{
+   const DrdThreadId tid = DRD_(thread_get_running_tid)();
+   struct atomic_info* p;
+
+   if (!DRD_(running_thread_is_recording_loads)())
+      return;
+
+   s_atomic_rmw_count++;
+
+   if (success)
+      p = atomic_get_or_allocate(a);
+   else
+      p = s_atomic_set ? VG_(OSetGen_Lookup)(s_atomic_set, &a) : NULL;
+   if (p)
+      atomic_do_rmw(tid, p, success != 0);
+}
+
+/**
+ * Remove the clock of thread 'tid' from the vector clocks of all atomic
+ * variables. Called when 'tid' is deleted. Since the segments of a deleted
+ * thread are no longer checked for conflicts, no ordering information is
+ * lost, and a thread that is assigned the same DrdThreadId later on is not
+ * considered to be ordered after the releases of its predecessor.
+ */
+void DRD_(atomic_remove_thread_clock)(const DrdThreadId tid)
+{
+   struct atomic_info* p;
+
+   if (!s_atomic_set)
+      return;
+
+   VG_(OSetGen_ResetIter)(s_atomic_set);
+   while ((p = VG_(OSetGen_Next)(s_atomic_set)) != 0)
+      DRD_(vc_remove)(&p->vc, tid);
+}
+
+/**
+ * Discard the synchronization information of all atomic variables in the
+ * address range [ a1, a2 [.
+ */
+void DRD_(atomic_stop_using_mem)(const Addr a1, const Addr a2)
+{
+   struct atomic_info* p;
+   Addr removed_at;
+
+   if (!s_atomic_set || VG_(OSetGen_Size)(s_atomic_set) == 0)
+      return;
+
+   VG_(OSetGen_ResetIterAt)(s_atomic_set, &a1);
+   for ( ; (p = VG_(OSetGen_Next)(s_atomic_set)) != 0 && p->a < a2; )
+   {
+      removed_at = p->a;
+      p = VG_(OSetGen_Remove)(s_atomic_set, &removed_at);
+      tl_assert(p);
+      DRD_(vc_cleanup)(&p->vc);
+      VG_(OSetGen_FreeNode)(s_atomic_set, p);
+      VG_(OSetGen_ResetIterAt)(s_atomic_set, &removed_at);
+   }
+}
+
+ULong DRD_(get_atomic_rmw_count)(void)
+{
+   return s_atomic_rmw_count;
+}
+
+ULong DRD_(get_atomic_acquire_skip_count)(void)
+{
+   return s_atomic_acquire_skip_count;
+}
@@ -0,0 +1,48 @@
+/*
+  This file is part of drd, a thread error detector.
+
+  Copyright (C) 2006-2017 Bart Van Assche <bvanassche@acm.org>.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+  02111-1307, USA.
+
+  The GNU General Public License is contained in the file COPYING.
+*/
+
+
+#ifndef __DRD_ATOMIC_H
+#define __DRD_ATOMIC_H
+
+
+/*
+ * Modeling of atomic read-modify-write instructions (compare-and-swap,
+ * load-linked / store-conditional) as C11 acquire / release operations.
+ */
+
+
+#include "drd_basics.h"      /* DRD_(), DrdThreadId */
+#include "pub_tool_basics.h" /* Addr   */
+
+
+/* Function declarations. */
+
+VG_REGPARM(2) void DRD_(atomic_rmw)(const Addr a, const UWord success);
+void DRD_(atomic_remove_thread_clock)(const DrdThreadId tid);
+void DRD_(atomic_stop_using_mem)(const Addr a1, const Addr a2);
+ULong DRD_(get_atomic_rmw_count)(void);
+ULong DRD_(get_atomic_acquire_skip_count)(void);
+
+
+#endif /* __DRD_ATOMIC_H */
@@ -39,6 +39,7 @@
 static void bm2_merge(struct bitmap2* const bm2l,
                       const struct bitmap2* const bm2r);
 static void bm2_print(const struct bitmap2* const bm2);
+static void bm_radix_free(struct bm_radix_node* const node, const int level);
 
 
 /* Local variables. */
@@ -47,6 +48,9 @@ static OSet* s_bm2_set_template;
 static ULong s_bitmap_creation_count;
 static ULong s_bitmap_merge_count;
 static ULong s_bitmap2_merge_count;
+static ULong s_bitmap_radix_count;
+UInt DRD_(g_bm_cache_size) = 4;
+UInt DRD_(g_bm_radix_min_bm2_count) = DRD_BITMAP_RADIX_MIN_BM2_COUNT;
 
 
 /* Function definitions. */
@@ -59,6 +63,22 @@ void DRD_(bm_module_init)(void)
                                       VG_(free), 512, sizeof(struct bitmap2));
 }
 
+/** Set the number of lookup cache elements used per bitmap. */
+void DRD_(bm_set_cache_size)(const UInt n)
+{
+   tl_assert(1 <= n && n <= DRD_BITMAP_N_CACHE_ELEM);
+   DRD_(g_bm_cache_size) = n;
+}
+
+/**
+ * Enable or disable radix tree indices. If enabled, a bitmap gets such an
+ * index once it holds more than min_bm2_count second level bitmaps.
+ */
+void DRD_(bm_set_radix_index)(const Bool enabled, const UInt min_bm2_count)
+{
+   DRD_(g_bm_radix_min_bm2_count) = enabled ? min_bm2_count : ~0U;
+}
+
 void DRD_(bm_module_cleanup)(void)
 {
    tl_assert(s_bm2_set_template);
@@ -105,6 +125,7 @@ void DRD_(bm_init)(struct bitmap* const bm)
       bm->cache[i].bm2 = 0;
    }
    bm->oset = VG_(OSetGen_EmptyClone)(s_bm2_set_template);
+   bm->radix = NULL;
 
    s_bitmap_creation_count++;
 }
@@ -112,9 +133,106 @@ void DRD_(bm_init)(struct bitmap* const bm)
 /** Free the memory allocated by DRD_(bm_init)(). */
 void DRD_(bm_cleanup)(struct bitmap* const bm)
 {
+   if (bm->radix)
+   {
+      bm_radix_free(bm->radix, BM_RADIX_LEVELS - 1);
+      bm->radix = NULL;
+   }
    VG_(OSetGen_Destroy)(bm->oset);
 }
 
+static struct bm_radix_node* bm_radix_new_node(void)
+{
+   struct bm_radix_node* node;
+
+   node = VG_(malloc)("drd.bitmap.radix", sizeof(*node));
+   VG_(memset)(node, 0, sizeof(*node));
+   return node;
+}
+
+static void bm_radix_free(struct bm_radix_node* const node, const int level)
+{
+   unsigned i;
+
+   if (level > 0)
+   {
+      for (i = 0; i < BM_RADIX_FANOUT; i++)
+      {
+         if (node->child[i])
+            bm_radix_free(node->child[i], level - 1);
+      }
+   }
+   VG_(free)(node);
+}
+
+/** Add bm2 to the radix tree index of bm. */
+static void bm_radix_add(struct bitmap* const bm, struct bitmap2* const bm2)
+{
+   struct bm_radix_node* node = bm->radix;
+   const UWord a1 = bm2->addr;
+   int level;
+
+   if (! bm_radix_covers(a1))
+      return;
+
+   for (level = BM_RADIX_LEVELS - 1; level > 0; level--)
+   {
+      const UWord i = (a1 >> (level * BM_RADIX_BITS)) & (BM_RADIX_FANOUT - 1);
+
+      if (! node->child[i])
+         node->child[i] = bm_radix_new_node();
+      node = node->child[i];
+   }
+   node->child[a1 & (BM_RADIX_FANOUT - 1)] = bm2;
+}
+
+/**
+ * Insert the second level bitmap bm2, which has just been inserted in the
+ * OSet of bm, in the radix tree index of bm. Creates that index if bm does
+ * not have one yet.
+ */
+void DRD_(bm_radix_insert)(struct bitmap* const bm, struct bitmap2* const bm2)
+{
+   if (bm->radix)
+   {
+      bm_radix_add(bm, bm2);
+   }
+   else
+   {
+      struct bitmap2* p;
+
+      s_bitmap_radix_count++;
+      bm->radix = bm_radix_new_node();
+      VG_(OSetGen_ResetIter)(bm->oset);
+      while ((p = VG_(OSetGen_Next)(bm->oset)) != NULL)
+         bm_radix_add(bm, p);
+   }
+}
+
+/**
+ * Remove the second level bitmap for address_msb() value a1 from the radix
+ * tree index of bm. Interior nodes are kept until the bitmap is cleaned up.
+ */
+void DRD_(bm_radix_remove)(struct bitmap* const bm, const UWord a1)
+{
+   struct bm_radix_node* node = bm->radix;
+   int level;
+
+   tl_assert(node);
+
+   if (! bm_radix_covers(a1))
+      return;
+
+   for (level = BM_RADIX_LEVELS - 1; level > 0; level--)
+   {
+      node = node->child[(a1 >> (level * BM_RADIX_BITS))
+                         & (BM_RADIX_FANOUT - 1)];
+      if (! node)
+         return;
+   }
+   node->child[a1 & (BM_RADIX_FANOUT - 1)] = NULL;
+}
+
 /**
  * Record an access of type access_type at addresses a .. a + size - 1 in
  * bitmap bm.
@@ -350,15 +468,14 @@ Bool DRD_(bm_has_any_load_g)(struct bitmap* const bm)
    for ( ; (bm2 = VG_(OSetGen_Next)(bm->oset)) != NULL; ) {
       Addr b_start;
       Addr b_end;
-      UWord b0;
       const struct bitmap1* const p1 = &bm2->bm1;
 
       b_start = make_address(bm2->addr, 0);
       b_end = make_address(bm2->addr + 1, 0);
 
-      for (b0 = address_lsb(b_start); b0 <= address_lsb(b_end - 1); b0++)
-         if (bm0_is_set(p1->bm0_r, b0))
-            return True;
+      if (bm0_is_any_set_in_range(p1->bm0_r, address_lsb(b_start),
+                                  address_lsb(b_end - 1)))
+         return True;
    }
    return False;
 }
@@ -384,7 +501,6 @@ DRD_(bm_has_any_load)(struct bitmap* const bm, const Addr a1, const Addr a2)
       {
          Addr b_start;
          Addr b_end;
-         UWord b0;
          const struct bitmap1* const p1 = &bm2->bm1;
 
          if (make_address(bm2->addr, 0) < a1)
@@ -404,12 +520,10 @@ DRD_(bm_has_any_load)(struct bitmap* const bm, const Addr a1, const Addr a2)
          tl_assert(b_start < b_end);
          tl_assert(address_lsb(b_start) <= address_lsb(b_end - 1));
 
-         for (b0 = address_lsb(b_start); b0 <= address_lsb(b_end - 1); b0++)
+         if (bm0_is_any_set_in_range(p1->bm0_r, address_lsb(b_start),
+                                     address_lsb(b_end - 1)))
          {
-            if (bm0_is_set(p1->bm0_r, b0))
-            {
-               return True;
-            }
+            return True;
          }
       }
    }
@@ -437,7 +551,6 @@ Bool DRD_(bm_has_any_store)(struct bitmap* const bm,
       {
          Addr b_start;
          Addr b_end;
-         UWord b0;
          const struct bitmap1* const p1 = &bm2->bm1;
 
          if (make_address(bm2->addr, 0) < a1)
@@ -457,12 +570,10 @@ Bool DRD_(bm_has_any_store)(struct bitmap* const bm,
          tl_assert(b_start < b_end);
          tl_assert(address_lsb(b_start) <= address_lsb(b_end - 1));
 
-         for (b0 = address_lsb(b_start); b0 <= address_lsb(b_end - 1); b0++)
+         if (bm0_is_any_set_in_range(p1->bm0_w, address_lsb(b_start),
+                                     address_lsb(b_end - 1)))
          {
-            if (bm0_is_set(p1->bm0_w, b0))
-            {
-               return True;
-            }
+            return True;
          }
       }
    }
@@ -492,7 +603,6 @@ Bool DRD_(bm_has_any_access)(struct bitmap* const bm,
       {
          Addr b_start;
          Addr b_end;
-         UWord b0;
          const struct bitmap1* const p1 = &bm2->bm1;
 
          if (make_address(bm2->addr, 0) < a1)
@@ -512,16 +622,16 @@ Bool DRD_(bm_has_any_access)(struct bitmap* const bm,
          tl_assert(b_start < b_end);
          tl_assert(address_lsb(b_start) <= address_lsb(b_end - 1));
 
-         for (b0 = address_lsb(b_start); b0 <= address_lsb(b_end - 1); b0++)
+         /*
+          * Note: the statement below uses a binary or instead of a logical
+          * or on purpose.
+          */
+         if (bm0_is_any_set_in_range(p1->bm0_r, address_lsb(b_start),
+                                     address_lsb(b_end - 1))
+             | bm0_is_any_set_in_range(p1->bm0_w, address_lsb(b_start),
+                                       address_lsb(b_end - 1)))
          {
-            /*
-             * Note: the statement below uses a binary or instead of a logical
-             * or on purpose.
-             */
-            if (bm0_is_set(p1->bm0_r, b0) | bm0_is_set(p1->bm0_w, b0))
-            {
-               return True;
-            }
+            return True;
          }
       }
    }
@@ -825,7 +935,6 @@ Bool DRD_(bm_has_conflict_with)(struct bitmap* const bm,
       {
          Addr b_start;
          Addr b_end;
-         UWord b0;
          const struct bitmap1* const p1 = &bm2->bm1;
 
          if (make_address(bm2->addr, 0) < a1)
@@ -845,25 +954,18 @@ Bool DRD_(bm_has_conflict_with)(struct bitmap* const bm,
          tl_assert(b_start < b_end);
          tl_assert(address_lsb(b_start) <= address_lsb(b_end - 1));
 
-         for (b0 = address_lsb(b_start); b0 <= address_lsb(b_end - 1); b0++)
+         if (bm0_is_any_set_in_range(p1->bm0_w, address_lsb(b_start),
+                                     address_lsb(b_end - 1)))
          {
-            if (access_type == eLoad)
-            {
-               if (bm0_is_set(p1->bm0_w, b0))
-               {
-                  return True;
-               }
-            }
-            else
-            {
-               tl_assert(access_type == eStore);
-               if (bm0_is_set(p1->bm0_r, b0)
-                   | bm0_is_set(p1->bm0_w, b0))
-               {
-                  return True;
-               }
-            }
+            return True;
+         }
+         if (access_type == eStore
+             && bm0_is_any_set_in_range(p1->bm0_r, address_lsb(b_start),
+                                        address_lsb(b_end - 1)))
+         {
+            return True;
          }
+         tl_assert(access_type == eLoad || access_type == eStore);
       }
    }
    return False;
@@ -1009,9 +1111,9 @@ Bool DRD_(bm_equal)(struct bitmap* const lhs, struct bitmap* const rhs)
 
 void DRD_(bm_swap)(struct bitmap* const bm1, struct bitmap* const bm2)
 {
-   OSet* const tmp = bm1->oset;
-   bm1->oset = bm2->oset;
-   bm2->oset = tmp;
+   struct bitmap tmp = *bm1;
+   *bm1 = *bm2;
+   *bm2 = tmp;
 }
 
 /** Merge bitmaps *lhs and *rhs into *lhs. */
@@ -1187,19 +1289,23 @@ int DRD_(bm_has_races)(struct bitmap* const lhs, struct bitmap* const rhs)
 
       for (k = 0; k < BITMAP1_UWORD_COUNT; k++)
       {
+         /*
+          * Evaluate HAS_RACE() for all the addresses covered by one UWord at
+          * once, and only look at individual bits if there is a race.
+          */
+         UWord races = (bm1l->bm0_w[k] & (bm1r->bm0_r[k] | bm1r->bm0_w[k]))
+                       | (bm1r->bm0_w[k] & bm1l->bm0_r[k]);
          unsigned b;
-         for (b = 0; b < BITS_PER_UWORD; b++)
+
+         for (b = 0; races; b++, races >>= 1)
          {
-            UWord const access_mask
-               = ((bm1l->bm0_r[k] & bm0_mask(b)) ? LHS_R : 0)
-               | ((bm1l->bm0_w[k] & bm0_mask(b)) ? LHS_W : 0)
-               | ((bm1r->bm0_r[k] & bm0_mask(b)) ? RHS_R : 0)
-               | ((bm1r->bm0_w[k] & bm0_mask(b)) ? RHS_W : 0);
-            Addr const a = make_address(bm2l->addr, k * BITS_PER_UWORD | b);
-            if (HAS_RACE(access_mask) && ! DRD_(is_suppressed)(a, a + 1))
-            {
+            Addr a;
+
+            if (! (races & 1))
+               continue;
+            a = make_address(bm2l->addr, k * BITS_PER_UWORD | b);
+            if (! DRD_(is_suppressed)(a, a + 1))
                return 1;
-            }
          }
       }
    }
@@ -1257,6 +1363,12 @@ ULong DRD_(bm_get_bitmap2_merge_count)(void)
    return s_bitmap2_merge_count;
 }
 
+/** Return the number of bitmaps for which a radix tree index was built. */
+ULong DRD_(bm_get_bitmap_radix_count)(void)
+{
+   return s_bitmap_radix_count;
+}
+
 /** Compute *bm2l |= *bm2r. */
 static
 void bm2_merge(struct bitmap2* const bm2l, const struct bitmap2* const bm2r)
@@ -1272,9 +1384,6 @@ void bm2_merge(struct bitmap2* const bm2l, const struct bitmap2* const bm2r)
    for (k = 0; k < BITMAP1_UWORD_COUNT; k++)
    {
       bm2l->bm1.bm0_r[k] |= bm2r->bm1.bm0_r[k];
-   }
-   for (k = 0; k < BITMAP1_UWORD_COUNT; k++)
-   {
       bm2l->bm1.bm0_w[k] |= bm2r->bm1.bm0_w[k];
    }
 }
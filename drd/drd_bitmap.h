@@ -214,6 +214,15 @@ Addr first_address_with_higher_uword_msb(const Addr a)
 
 static ULong s_bitmap2_creation_count;
 
+/* Number of lookup cache elements in use. */
+extern UInt DRD_(g_bm_cache_size);
+
+/*
+ * A bitmap gets a radix tree index once it holds more second level bitmaps
+ * than this. ~0 if radix tree indices are disabled.
+ */
+extern UInt DRD_(g_bm_radix_min_bm2_count);
+
 
 
 /*********************************************************************/
@@ -324,6 +333,37 @@ static __inline__ UWord bm0_is_any_set(const UWord* bm0,
 }
 
 
+/**
+ * Return a nonzero value if any of the bits b0_first .. b0_last (inclusive)
+ * is set in bm0. Unlike bm0_is_any_set() the range may span multiple UWords;
+ * these are tested a whole UWord at a time.
+ */
+static __inline__ UWord bm0_is_any_set_in_range(const UWord* bm0,
+                                                const UWord b0_first,
+                                                const UWord b0_last)
+{
+   const UWord k_first = uword_msb(b0_first);
+   const UWord k_last  = uword_msb(b0_last);
+   const UWord mask_first = ~(UWord)0 << uword_lsb(b0_first);
+   const UWord mask_last
+      = ~(UWord)0 >> (BITS_PER_UWORD - 1 - uword_lsb(b0_last));
+   UWord k;
+
+#ifdef ENABLE_DRD_CONSISTENCY_CHECKS
+   tl_assert(b0_first <= b0_last);
+#endif
+   if (k_first == k_last)
+      return bm0[k_first] & mask_first & mask_last;
+   if (bm0[k_first] & mask_first)
+      return 1;
+   for (k = k_first + 1; k < k_last; k++)
+   {
+      if (bm0[k])
+         return 1;
+   }
+   return bm0[k_last] & mask_last;
+}
+
 
 /*********************************************************************/
 /*           Functions for manipulating a struct bitmap.             */
@@ -344,6 +384,62 @@ static __inline__
 struct bitmap2* bm2_insert(struct bitmap* const bm, const UWord a1);
 
 
+/*
+ * Radix tree index. Maps an address_msb() value onto the second level bitmap
+ * for that value. Covers the lowest BM_RADIX_LEVELS * BM_RADIX_BITS bits of
+ * address_msb(), i.e. all user space addresses on the supported platforms.
+ * Second level bitmaps for higher addresses are only present in the OSet.
+ */
+#if BITS_PER_BITS_PER_UWORD == 6
+#define BM_RADIX_LEVELS 4
+#define BM_RADIX_BITS   9
+#else
+#define BM_RADIX_LEVELS 2
+#define BM_RADIX_BITS   10
+#endif
+#define BM_RADIX_FANOUT (1U << BM_RADIX_BITS)
+
+struct bm_radix_node
+{
+   void* child[BM_RADIX_FANOUT];
+};
+
+void DRD_(bm_radix_insert)(struct bitmap* const bm,
+                           struct bitmap2* const bm2);
+void DRD_(bm_radix_remove)(struct bitmap* const bm, const UWord a1);
+
+/** Whether a1 is covered by the radix tree index. */
+static __inline__
+Bool bm_radix_covers(const UWord a1)
+{
+   return (a1 >> (BM_RADIX_LEVELS * BM_RADIX_BITS)) == 0;
+}
+
+/**
+ * Look up the second level bitmap for address_msb() value a1 in the index of
+ * bm, or in its OSet if bm has no radix tree index.
+ */
+static __inline__
+struct bitmap2* bm2_index_lookup(struct bitmap* const bm, const UWord a1)
+{
+   if (bm->radix && bm_radix_covers(a1))
+   {
+      const struct bm_radix_node* node = bm->radix;
+      int level;
+
+      for (level = BM_RADIX_LEVELS - 1; level > 0; level--)
+      {
+         node = node->child[(a1 >> (level * BM_RADIX_BITS))
+                            & (BM_RADIX_FANOUT - 1)];
+         if (! node)
+            return NULL;
+      }
+      return node->child[a1 & (BM_RADIX_FANOUT - 1)];
+   }
+   return VG_(OSetGen_Lookup)(bm->oset, &a1);
+}
+
+
 
 /**
  * Rotate elements cache[0..n-1] such that the element at position n-1 is
@@ -419,7 +515,7 @@ Bool bm_cache_lookup(struct bitmap* const bm, const UWord a1,
    }
 #endif
 #if DRD_BITMAP_N_CACHE_ELEM >= 5
-   if (a1 == bm->cache[4].a1)
+   if (DRD_(g_bm_cache_size) >= 5 && a1 == bm->cache[4].a1)
    {
       *bm2 = bm->cache[4].bm2;
       bm_cache_rotate(bm->cache, 5);
@@ -427,7 +523,7 @@ Bool bm_cache_lookup(struct bitmap* const bm, const UWord a1,
    }
 #endif
 #if DRD_BITMAP_N_CACHE_ELEM >= 6
-   if (a1 == bm->cache[5].a1)
+   if (DRD_(g_bm_cache_size) >= 6 && a1 == bm->cache[5].a1)
    {
       *bm2 = bm->cache[5].bm2;
       bm_cache_rotate(bm->cache, 6);
@@ -435,7 +531,7 @@ Bool bm_cache_lookup(struct bitmap* const bm, const UWord a1,
    }
 #endif
 #if DRD_BITMAP_N_CACHE_ELEM >= 7
-   if (a1 == bm->cache[6].a1)
+   if (DRD_(g_bm_cache_size) >= 7 && a1 == bm->cache[6].a1)
    {
       *bm2 = bm->cache[6].bm2;
       bm_cache_rotate(bm->cache, 7);
@@ -443,7 +539,7 @@ Bool bm_cache_lookup(struct bitmap* const bm, const UWord a1,
    }
 #endif
 #if DRD_BITMAP_N_CACHE_ELEM >= 8
-   if (a1 == bm->cache[7].a1)
+   if (DRD_(g_bm_cache_size) >= 8 && a1 == bm->cache[7].a1)
    {
       *bm2 = bm->cache[7].bm2;
       bm_cache_rotate(bm->cache, 8);
@@ -466,27 +562,23 @@ void bm_update_cache(struct bitmap* const bm,
 #if DRD_BITMAP_N_CACHE_ELEM > 8
 #error Please update the code below.
 #endif
-#if DRD_BITMAP_N_CACHE_ELEM >= 8
-   bm->cache[7] = bm->cache[6];
-#endif
-#if DRD_BITMAP_N_CACHE_ELEM >= 7
-   bm->cache[6] = bm->cache[5];
-#endif
-#if DRD_BITMAP_N_CACHE_ELEM >= 6
-   bm->cache[5] = bm->cache[4];
-#endif
-#if DRD_BITMAP_N_CACHE_ELEM >= 5
-   bm->cache[4] = bm->cache[3];
-#endif
-#if DRD_BITMAP_N_CACHE_ELEM >= 4
-   bm->cache[3] = bm->cache[2];
-#endif
-#if DRD_BITMAP_N_CACHE_ELEM >= 3
-   bm->cache[2] = bm->cache[1];
-#endif
-#if DRD_BITMAP_N_CACHE_ELEM >= 2
-   bm->cache[1] = bm->cache[0];
-#endif
+   /*
+    * Cache elements at or beyond DRD_(g_bm_cache_size) are never written to
+    * and hence never match.
+    */
+   if (DRD_(g_bm_cache_size) > 4)
+   {
+      UInt i;
+
+      for (i = DRD_(g_bm_cache_size) - 1; i >= 4; i--)
+         bm->cache[i] = bm->cache[i - 1];
+   }
+   if (DRD_(g_bm_cache_size) >= 4)
+      bm->cache[3] = bm->cache[2];
+   if (DRD_(g_bm_cache_size) >= 3)
+      bm->cache[2] = bm->cache[1];
+   if (DRD_(g_bm_cache_size) >= 2)
+      bm->cache[1] = bm->cache[0];
    bm->cache[0].a1  = a1;
    bm->cache[0].bm2 = bm2;
 }
@@ -510,7 +602,7 @@ const struct bitmap2* bm2_lookup(struct bitmap* const bm, const UWord a1)
 
    if (! bm_cache_lookup(bm, a1, &bm2))
    {
-      bm2 = VG_(OSetGen_Lookup)(bm->oset, &a1);
+      bm2 = bm2_index_lookup(bm, a1);
       bm_update_cache(bm, a1, bm2);
    }
    return bm2;
@@ -535,7 +627,7 @@ bm2_lookup_exclusive(struct bitmap* const bm, const UWord a1)
 
    if (! bm_cache_lookup(bm, a1, &bm2))
    {
-      bm2 = VG_(OSetGen_Lookup)(bm->oset, &a1);
+      bm2 = bm2_index_lookup(bm, a1);
    }
 
    return bm2;
@@ -573,6 +665,11 @@ struct bitmap2* bm2_insert(struct bitmap* const bm, const UWord a1)
    bm2 = VG_(OSetGen_AllocNode)(bm->oset, sizeof(*bm2));
    bm2->addr = a1;
    VG_(OSetGen_Insert)(bm->oset, bm2);
+   if (bm->radix
+       || VG_(OSetGen_Size)(bm->oset) > DRD_(g_bm_radix_min_bm2_count))
+   {
+      DRD_(bm_radix_insert)(bm, bm2);
+   }
 
    bm_update_cache(bm, a1, bm2);
 
@@ -616,7 +713,7 @@ struct bitmap2* bm2_lookup_or_insert(struct bitmap* const bm, const UWord a1)
    }
    else
    {
-      bm2 = VG_(OSetGen_Lookup)(bm->oset, &a1);
+      bm2 = bm2_index_lookup(bm, a1);
       if (! bm2)
       {
          bm2 = bm2_insert(bm, a1);
@@ -650,6 +747,8 @@ void bm2_remove(struct bitmap* const bm, const UWord a1)
    tl_assert(bm);
 #endif
 
+   if (bm->radix)
+      DRD_(bm_radix_remove)(bm, a1);
    bm2 = VG_(OSetGen_Remove)(bm->oset, &a1);
    VG_(OSetGen_FreeNode)(bm->oset, bm2);
 
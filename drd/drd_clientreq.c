@@ -261,6 +261,14 @@ static Bool handle_client_request(ThreadId vg_tid, UWord* arg, UWord* ret)
       DRD_(stop_tracing_address_range)(arg[1], arg[1] + arg[2]);
       break;
 
+   case VG_USERREQ__DRD_START_WATCH_ADDR:
+      DRD_(start_watching_address_range)(arg[1], arg[1] + arg[2]);
+      break;
+
+   case VG_USERREQ__DRD_STOP_WATCH_ADDR:
+      DRD_(stop_watching_address_range)(arg[1], arg[1] + arg[2]);
+      break;
+
    case VG_USERREQ__DRD_RECORD_LOADS:
       DRD_(thread_set_record_loads)(drd_tid, arg[1]);
       break;
@@ -22,6 +22,7 @@
 */
 
 
+#include "drd_atomic.h"
 #include "drd_bitmap.h"
 #include "drd_thread_bitmap.h"
 #include "drd_vc.h"            /* DRD_(vc_snprint)() */
@@ -59,11 +60,31 @@
 #error Unknown architecture.
 #endif
 
+#if defined(VG_BIGENDIAN)
+#define END Iend_BE
+#elif defined(VG_LITTLEENDIAN)
+#define END Iend_LE
+#else
+#error "Unknown endianness"
+#endif
+
+/*
+ * Multiplier used for picking the pages that are checked for data races if
+ * --watch-sample-pages has been specified (2**64 divided by the golden
+ * ratio, truncated to the width of an address).
+ */
+#define WATCH_SAMPLE_MULTIPLIER ((Addr)0x9E3779B97F4A7C15ULL)
+#define WATCH_SAMPLE_PAGE_SHIFT 12
+
 
 /* Local variables. */
 
 static Bool s_check_stack_accesses = False;
 static Bool s_first_race_only      = False;
+static Bool s_model_atomics        = False;
+static Bool s_watch_only           = False;
+/* log2 of the --watch-sample-pages argument; zero means no sampling. */
+static UInt s_watch_sample_bits    = 0;
 
 
 /* Function definitions. */
@@ -90,6 +111,57 @@ void DRD_(set_first_race_only)(const Bool fro)
    s_first_race_only = fro;
 }
 
+Bool DRD_(get_model_atomics)(void)
+{
+   return s_model_atomics;
+}
+
+void DRD_(set_model_atomics)(const Bool m)
+{
+   tl_assert(m == False || m == True);
+   s_model_atomics = m;
+}
+
+Bool DRD_(get_watch_only)(void)
+{
+   return s_watch_only;
+}
+
+void DRD_(set_watch_only)(const Bool w)
+{
+   tl_assert(w == False || w == True);
+   s_watch_only = w;
+}
+
+/**
+ * Check one out of every n pages for data races, where n must be a power of
+ * two. Passing zero disables sampling.
+ */
+void DRD_(set_watch_sample_pages)(const UInt n)
+{
+   tl_assert((n & (n - 1)) == 0);
+   s_watch_sample_bits = 0;
+   while (s_watch_sample_bits < 31 && (1U << s_watch_sample_bits) < n)
+      s_watch_sample_bits++;
+}
+
+/**
+ * Whether memory accesses are only checked for data races if they happen
+ * inside a watched address range or a sampled page.
+ */
+static Bool watch_restricted(void)
+{
+   return s_watch_only || s_watch_sample_bits > 0;
+}
+
+/** Whether the page that contains address 'addr' has been sampled. */
+static __inline__ Bool watch_page_is_sampled(const Addr addr)
+{
+   return s_watch_sample_bits > 0
+      && (((addr >> WATCH_SAMPLE_PAGE_SHIFT) * WATCH_SAMPLE_MULTIPLIER)
+          >> (8 * sizeof(Addr) - s_watch_sample_bits)) == 0;
+}
+
 void DRD_(trace_mem_access)(const Addr addr, const SizeT size,
                             const BmAccessTypeT access_type,
                             const HWord stored_value_hi,
@@ -140,6 +212,22 @@ static VG_REGPARM(3) void drd_trace_mem_store(const Addr addr,const SizeT size,
                                  stored_value_lo);
 }
 
+/**
+ * Trace a store by a dirty helper (--trace-addr), whose value is not known.
+ */
+static VG_REGPARM(2) void drd_trace_mem_write(const Addr addr, const SizeT size)
+{
+   if (DRD_(is_any_traced)(addr, addr + size))
+   {
+      HChar* vc;
+
+      vc = DRD_(vc_aprint)(DRD_(thread_get_vc)(DRD_(thread_get_running_tid)()));
+      DRD_(trace_msg_w_bt)("store 0x%lx size %lu (thread %u / vc %s)",
+                           addr, size, DRD_(thread_get_running_tid)(), vc);
+      VG_(free)(vc);
+   }
+}
+
 static void drd_report_race(const Addr addr, const SizeT size,
                             const BmAccessTypeT access_type)
 {
@@ -305,6 +393,30 @@ static VG_REGPARM(1) void drd_trace_store_8(Addr addr)
    }
 }
 
+/*
+ * The instrumented code only calls the two functions below for accesses that
+ * overlap the smallest address range that contains all watched ranges or
+ * that start in a sampled page. Since that range may also contain addresses
+ * that are not watched, check again before updating the segment bitmaps.
+ */
+static VG_REGPARM(2) void drd_trace_watched_load(Addr addr, SizeT size)
+{
+   if (watch_page_is_sampled(addr)
+       || DRD_(is_any_watched)(addr, addr + size))
+   {
+      DRD_(trace_load)(addr, size);
+   }
+}
+
+static VG_REGPARM(2) void drd_trace_watched_store(Addr addr, SizeT size)
+{
+   if (watch_page_is_sampled(addr)
+       || DRD_(is_any_watched)(addr, addr + size))
+   {
+      DRD_(trace_store)(addr, size);
+   }
+}
+
 /**
  * Return true if and only if addr_expr matches the pattern (SP) or
  * <offset>(SP).
@@ -470,6 +582,125 @@ static void instr_trace_mem_store(IRSB* const bb, IRExpr* const addr_expr,
    addStmtToIRSB(bb, IRStmt_Dirty(di) );
 }
 
+/** Assign expression 'e' to a new temporary and return that temporary. */
+static IRExpr* assign_new_tmp(IRSB* const bb, const IRType ty, IRExpr* const e)
+{
+   const IRTemp tmp = newIRTemp(bb->tyenv, ty);
+
+   addStmtToIRSB(bb, IRStmt_WrTmp(tmp, e));
+   return IRExpr_RdTmp(tmp);
+}
+
+/** Combine the Ity_I1 atoms 'arg1' and 'arg2' with Iop_And32 or Iop_Or32. */
+static IRExpr* combine_1(IRSB* const bb, const IROp op,
+                         IRExpr* const arg1, IRExpr* const arg2)
+{
+   IRExpr* const wide1 = assign_new_tmp(bb, Ity_I32,
+                                        IRExpr_Unop(Iop_1Uto32, arg1));
+   IRExpr* const wide2 = assign_new_tmp(bb, Ity_I32,
+                                        IRExpr_Unop(Iop_1Uto32, arg2));
+   IRExpr* const res = assign_new_tmp(bb, Ity_I32,
+                                      IRExpr_Binop(op, wide1, wide2));
+
+   return assign_new_tmp(bb, Ity_I1, IRExpr_Unop(Iop_32to1, res));
+}
+
+/**
+ * Instrument the client code to trace the memory accessed by a dirty helper
+ * (--trace-addr).
+ */
+static void instr_trace_mem_dirty(IRSB* const bb, IRExpr* const addr_expr,
+                                  const HWord size, const IREffect mFx)
+{
+   if (mFx == Ifx_Read || mFx == Ifx_Modify)
+      instr_trace_mem_load(bb, addr_expr, size, NULL/* no guard */);
+   if (mFx == Ifx_Write || mFx == Ifx_Modify)
+      addStmtToIRSB(bb, IRStmt_Dirty(
+                       unsafeIRDirty_0_N(/*regparms*/2,
+                          "drd_trace_mem_write",
+                          VG_(fnptr_to_fnentry)(drd_trace_mem_write),
+                          mkIRExprVec_2(addr_expr, mkIRExpr_HWord(size)))));
+}
+
+/**
+ * Instrument the client code to check a memory access for data races only if
+ * it overlaps the smallest address range that contains all watched address
+ * ranges or starts in a sampled page. The range bounds are loaded at run
+ * time such that watching another address range does not require
+ * retranslation.
+ */
+static void instr_watched_access(IRSB* const bb, IRExpr* const addr_expr,
+                                 const HWord size, const Bool is_store,
+                                 IRExpr* const guard/* NULL => True */)
+{
+   const IRType ty = typeOfIRExpr(bb->tyenv, addr_expr);
+   const Bool is64 = ty == Ity_I64;
+   IRExpr* lo;
+   IRExpr* len;
+   IRExpr* off;
+   IRExpr* cond;
+   IRDirty* di;
+
+   tl_assert(ty == Ity_I32 || ty == Ity_I64);
+
+   /*
+    * addr < lo + len && addr + size > lo, that is
+    * (addr - (lo - (size - 1))) <u len + (size - 1)
+    */
+   lo = assign_new_tmp(bb, ty, IRExpr_Load(END, ty,
+                          mkIRExpr_HWord((HWord)&DRD_(g_watch_lo))));
+   len = assign_new_tmp(bb, ty, IRExpr_Load(END, ty,
+                           mkIRExpr_HWord((HWord)&DRD_(g_watch_size))));
+   if (size > 1) {
+      lo = assign_new_tmp(bb, ty, IRExpr_Binop(is64 ? Iop_Sub64 : Iop_Sub32,
+                                               lo, mkIRExpr_HWord(size - 1)));
+      len = assign_new_tmp(bb, ty, IRExpr_Binop(is64 ? Iop_Add64 : Iop_Add32,
+                                                len, mkIRExpr_HWord(size - 1)));
+   }
+   off = assign_new_tmp(bb, ty, IRExpr_Binop(is64 ? Iop_Sub64 : Iop_Sub32,
+                                             addr_expr, lo));
+   cond = assign_new_tmp(bb, Ity_I1,
+                         IRExpr_Binop(is64 ? Iop_CmpLT64U : Iop_CmpLT32U,
+                                      off, len));
+
+   if (s_watch_sample_bits > 0) {
+      /* ((addr >> 12) * multiplier) >> (width - bits) == 0 */
+      const UInt width = is64 ? 64 : 32;
+      IRExpr* hash;
+
+      hash = assign_new_tmp(bb, ty,
+                IRExpr_Binop(is64 ? Iop_Shr64 : Iop_Shr32, addr_expr,
+                             IRExpr_Const(IRConst_U8(WATCH_SAMPLE_PAGE_SHIFT))));
+      hash = assign_new_tmp(bb, ty,
+                IRExpr_Binop(is64 ? Iop_Mul64 : Iop_Mul32, hash,
+                             mkIRExpr_HWord(WATCH_SAMPLE_MULTIPLIER)));
+      hash = assign_new_tmp(bb, ty,
+                IRExpr_Binop(is64 ? Iop_Shr64 : Iop_Shr32, hash,
+                             IRExpr_Const(IRConst_U8(width
+                                                     - s_watch_sample_bits))));
+      hash = assign_new_tmp(bb, Ity_I1,
+                IRExpr_Binop(is64 ? Iop_CmpEQ64 : Iop_CmpEQ32, hash,
+                             mkIRExpr_HWord(0)));
+      cond = combine_1(bb, Iop_Or32, cond, hash);
+   }
+
+   if (guard)
+      cond = combine_1(bb, Iop_And32, cond, guard);
+
+   if (is_store)
+      di = unsafeIRDirty_0_N(/*regparms*/2,
+                             "drd_trace_watched_store",
+                             VG_(fnptr_to_fnentry)(drd_trace_watched_store),
+                             mkIRExprVec_2(addr_expr, mkIRExpr_HWord(size)));
+   else
+      di = unsafeIRDirty_0_N(/*regparms*/2,
+                             "drd_trace_watched_load",
+                             VG_(fnptr_to_fnentry)(drd_trace_watched_load),
+                             mkIRExprVec_2(addr_expr, mkIRExpr_HWord(size)));
+   di->guard = cond;
+   addStmtToIRSB(bb, IRStmt_Dirty(di));
+}
+
 static void instrument_load(IRSB* const bb, IRExpr* const addr_expr,
                             const HWord size,
                             IRExpr* const guard/* NULL => True */)
@@ -481,6 +712,11 @@ static void instrument_load(IRSB* const bb, IRExpr* const addr_expr,
    if (!s_check_stack_accesses && is_stack_access(bb, addr_expr))
       return;
 
+   if (watch_restricted()) {
+      instr_watched_access(bb, addr_expr, size, False, guard);
+      return;
+   }
+
    switch (size)
    {
    case 1:
@@ -545,6 +781,11 @@ static void instrument_store(IRSB* const bb, IRExpr* addr_expr,
    if (!s_check_stack_accesses && is_stack_access(bb, addr_expr))
       return;
 
+   if (watch_restricted()) {
+      instr_watched_access(bb, addr_expr, size, True, guard_expr);
+      return;
+   }
+
    switch (size)
    {
    case 1:
@@ -588,6 +829,78 @@ static void instrument_store(IRSB* const bb, IRExpr* addr_expr,
    addStmtToIRSB(bb, IRStmt_Dirty(di));
 }
 
+/** Return the equality comparison operator for integer type 'ty'. */
+static IROp cmp_eq_op(const IRType ty)
+{
+   switch (sizeofIRType(ty))
+   {
+   case 1: return Iop_CmpEQ8;
+   case 2: return Iop_CmpEQ16;
+   case 4: return Iop_CmpEQ32;
+   case 8: return Iop_CmpEQ64;
+   default: tl_assert(0);
+   }
+   return Iop_INVALID;
+}
+
+/**
+ * Instrument the client code such that DRD_(atomic_rmw)() is called after
+ * the compare-and-swap 'cas' has been performed. The CAS succeeded if the
+ * old value equals the expected value. Must be called after the CAS
+ * statement itself has been added to 'bb'.
+ */
+static void instr_atomic_cas(IRSB* const bb, const IRCAS* const cas)
+{
+   const IRType ty = typeOfIRExpr(bb->tyenv, cas->expdLo);
+   const Bool   word64 = sizeof(HWord) == 8;
+   IRExpr*      success;
+   IRDirty*     di;
+
+   success = assign_new_tmp(bb, Ity_I1,
+                            IRExpr_Binop(cmp_eq_op(ty),
+                                         IRExpr_RdTmp(cas->oldLo),
+                                         cas->expdLo));
+   if (cas->oldHi != IRTemp_INVALID)
+   {
+      IRExpr* const success_hi
+         = assign_new_tmp(bb, Ity_I1,
+                          IRExpr_Binop(cmp_eq_op(ty),
+                                       IRExpr_RdTmp(cas->oldHi),
+                                       cas->expdHi));
+      success = combine_1(bb, Iop_And32, success, success_hi);
+   }
+   success = assign_new_tmp(bb, word64 ? Ity_I64 : Ity_I32,
+                            IRExpr_Unop(word64 ? Iop_1Uto64 : Iop_1Uto32,
+                                        success));
+   di = unsafeIRDirty_0_N(/*regparms*/2,
+                          "drd_atomic_rmw",
+                          VG_(fnptr_to_fnentry)(DRD_(atomic_rmw)),
+                          mkIRExprVec_2(cas->addr, success));
+   addStmtToIRSB(bb, IRStmt_Dirty(di));
+}
+
+/**
+ * Instrument the client code such that a load-linked / store-conditional
+ * pair is modeled as a single atomic read-modify-write: a successful
+ * store-conditional both acquires and releases via the accessed location.
+ * Must be called after the LLSC statement 'st' has been added to 'bb'.
+ */
+static void instr_atomic_llsc(IRSB* const bb, const IRStmt* const st)
+{
+   IRDirty* di;
+
+   if (st->Ist.LLSC.storedata == NULL)
+      return;
+
+   di = unsafeIRDirty_0_N(/*regparms*/2,
+                          "drd_atomic_rmw",
+                          VG_(fnptr_to_fnentry)(DRD_(atomic_rmw)),
+                          mkIRExprVec_2(st->Ist.LLSC.addr,
+                                        mkIRExpr_HWord(1)));
+   di->guard = IRExpr_RdTmp(st->Ist.LLSC.result);
+   addStmtToIRSB(bb, IRStmt_Dirty(di));
+}
+
 IRSB* DRD_(instrument)(VgCallbackClosure* const closure,
                        IRSB* const bb_in,
                        const VexGuestLayout* const layout,
@@ -707,6 +1020,17 @@ IRSB* DRD_(instrument)(VgCallbackClosure* const closure,
             case Ifx_Modify:
                tl_assert(d->mAddr);
                tl_assert(d->mSize > 0);
+               if (UNLIKELY(DRD_(any_address_is_traced)()))
+                  instr_trace_mem_dirty(bb, d->mAddr, d->mSize, mFx);
+               if (watch_restricted()) {
+                  if (mFx == Ifx_Read || mFx == Ifx_Modify)
+                     instr_watched_access(bb, d->mAddr, d->mSize, False,
+                                          NULL/* no guard */);
+                  if (mFx == Ifx_Write || mFx == Ifx_Modify)
+                     instr_watched_access(bb, d->mAddr, d->mSize, True,
+                                          NULL/* no guard */);
+                  break;
+               }
                argv = mkIRExprVec_2(d->mAddr, mkIRExpr_HWord(d->mSize));
                if (mFx == Ifx_Read || mFx == Ifx_Modify) {
                   di = unsafeIRDirty_0_N(
@@ -741,7 +1065,9 @@ IRSB* DRD_(instrument)(VgCallbackClosure* const closure,
              * between conflicting atomic operations nor between atomic
              * operations and non-atomic reads. Conflicts between atomic
              * operations and non-atomic write operations are still reported
-             * however.
+             * however. With --model-atomics=yes the atomic access itself is
+             * not checked but modeled as an acquire and, if it succeeded, a
+             * release on the accessed location.
              */
             Int    dataSize;
             IRCAS* cas = st->Ist.CAS.details;
@@ -756,15 +1082,19 @@ IRSB* DRD_(instrument)(VgCallbackClosure* const closure,
                instr_trace_mem_store(bb, cas->addr, cas->dataHi, cas->dataLo,
                                      NULL/* no guard */);
 
-            instrument_load(bb, cas->addr, dataSize, NULL/*no guard*/);
+            if (!s_model_atomics)
+               instrument_load(bb, cas->addr, dataSize, NULL/*no guard*/);
          }
          addStmtToIRSB(bb, st);
+         if (instrument && s_model_atomics)
+            instr_atomic_cas(bb, st->Ist.CAS.details);
          break;
 
       case Ist_LLSC: {
          /*
           * Ignore store-conditionals (except for tracing), and handle
-          * load-linked's exactly like normal loads.
+          * load-linked's exactly like normal loads, unless atomic
+          * instructions are modeled as acquire / release operations.
           */
          IRType dataTy;
 
@@ -778,8 +1108,9 @@ IRSB* DRD_(instrument)(VgCallbackClosure* const closure,
                                                    sizeofIRType(dataTy),
                                                    NULL /* no guard */);
 
-               instrument_load(bb, addr_expr, sizeofIRType(dataTy),
-                               NULL/*no guard*/);
+               if (!s_model_atomics)
+                  instrument_load(bb, addr_expr, sizeofIRType(dataTy),
+                                  NULL/*no guard*/);
             }
          } else {
             /* SC */
@@ -788,6 +1119,8 @@ IRSB* DRD_(instrument)(VgCallbackClosure* const closure,
                                   NULL/* no guard */);
          }
          addStmtToIRSB(bb, st);
+         if (instrument && s_model_atomics)
+            instr_atomic_llsc(bb, st);
          break;
       }
 
@@ -39,6 +39,11 @@ Bool DRD_(get_check_stack_accesses)(void);
 void DRD_(set_check_stack_accesses)(const Bool c);
 Bool DRD_(get_first_race_only)(void);
 void DRD_(set_first_race_only)(const Bool fro);
+Bool DRD_(get_model_atomics)(void);
+void DRD_(set_model_atomics)(const Bool m);
+Bool DRD_(get_watch_only)(void);
+void DRD_(set_watch_only)(const Bool w);
+void DRD_(set_watch_sample_pages)(const UInt n);
 IRSB* DRD_(instrument)(VgCallbackClosure* const closure,
                        IRSB* const bb_in,
                        const VexGuestLayout* const layout,
@@ -22,6 +22,7 @@
 */
 
 
+#include "drd_atomic.h"
 #include "drd_barrier.h"
 #include "drd_clientobj.h"
 #include "drd_clientreq.h"
@@ -67,8 +68,11 @@ static Bool trace_sectsuppr;
  */
 static Bool DRD_(process_cmd_line_option)(const HChar* arg)
 {
+   int bitmap_cache_size      = -1;
+   int bitmap_radix_index     = -1;
    int check_stack_accesses   = -1;
    int join_list_vol          = -1;
+   int model_atomics          = -1;
    int exclusive_threshold_ms = -1;
    int first_race_only        = -1;
    int report_signal_unlocked = -1;
@@ -89,14 +93,21 @@ static Bool DRD_(process_cmd_line_option)(const HChar* arg)
    int trace_segment          = -1;
    int trace_semaphore        = -1;
    int trace_suppression      = -1;
+   int watch_only             = -1;
+   int watch_sample_pages     = -1;
    const HChar* trace_address = 0;
    const HChar* ptrace_address= 0;
 
-   if      VG_BOOL_CLO(arg, "--check-stack-var",     check_stack_accesses) {}
+   if      VG_XACT_CLO(arg, "--bitmap-index=oset",   bitmap_radix_index, 0) {}
+   else if VG_XACT_CLO(arg, "--bitmap-index=radix",  bitmap_radix_index, 1) {}
+   else if VG_BINT_CLO(arg, "--bitmap-cache-size",   bitmap_cache_size,
+                       1, DRD_BITMAP_N_CACHE_ELEM) {}
+   else if VG_BOOL_CLO(arg, "--check-stack-var",     check_stack_accesses) {}
    else if VG_INT_CLO (arg, "--join-list-vol",       join_list_vol) {}
    else if VG_BOOL_CLO(arg, "--drd-stats",           s_print_stats) {}
    else if VG_BOOL_CLO(arg, "--first-race-only",     first_race_only) {}
    else if VG_BOOL_CLO(arg, "--free-is-write",       DRD_(g_free_is_write)) {}
+   else if VG_BOOL_CLO(arg, "--model-atomics",       model_atomics) {}
    else if VG_BOOL_CLO(arg,"--report-signal-unlocked",report_signal_unlocked)
    {}
    else if VG_BOOL_CLO(arg, "--segment-merging",     segment_merging) {}
@@ -128,9 +139,20 @@ static Bool DRD_(process_cmd_line_option)(const HChar* arg)
    else if VG_STR_CLO (arg, "--ptrace-addr",         ptrace_address) {}
    else if VG_INT_CLO (arg, "--shared-threshold",    shared_threshold_ms)    {}
    else if VG_STR_CLO (arg, "--trace-addr",          trace_address) {}
+   else if VG_BOOL_CLO(arg, "--watch-only",          watch_only) {}
+   else if VG_BINT_CLO(arg, "--watch-sample-pages",  watch_sample_pages,
+                       0, 1 << 20) {
+      if ((watch_sample_pages & (watch_sample_pages - 1)) != 0)
+         VG_(fmsg_bad_option)(arg, "The argument must be a power of two.\n");
+   }
    else
       return VG_(replacement_malloc_process_cmd_line_option)(arg);
 
+   if (bitmap_cache_size != -1)
+      DRD_(bm_set_cache_size)(bitmap_cache_size);
+   if (bitmap_radix_index != -1)
+      DRD_(bm_set_radix_index)(bitmap_radix_index,
+                               DRD_BITMAP_RADIX_MIN_BM2_COUNT);
    if (check_stack_accesses != -1)
       DRD_(set_check_stack_accesses)(check_stack_accesses);
    if (exclusive_threshold_ms != -1)
@@ -144,6 +166,8 @@ static Bool DRD_(process_cmd_line_option)(const HChar* arg)
    }
    if (join_list_vol != -1)
       DRD_(thread_set_join_list_vol)(join_list_vol);
+   if (model_atomics != -1)
+      DRD_(set_model_atomics)(model_atomics);
    if (report_signal_unlocked != -1)
    {
       DRD_(cond_set_report_signal_unlocked)(report_signal_unlocked);
@@ -197,6 +221,10 @@ static Bool DRD_(process_cmd_line_option)(const HChar* arg)
       DRD_(semaphore_set_trace)(trace_semaphore);
    if (trace_suppression != -1)
       DRD_(suppression_set_trace)(trace_suppression);
+   if (watch_only != -1)
+      DRD_(set_watch_only)(watch_only);
+   if (watch_sample_pages != -1)
+      DRD_(set_watch_sample_pages)(watch_sample_pages);
 
    return True;
 }
@@ -204,6 +232,11 @@ static Bool DRD_(process_cmd_line_option)(const HChar* arg)
 static void DRD_(print_usage)(void)
 {
    VG_(printf)(
+"    --bitmap-cache-size=<1..8> Number of recently used 4 KB regions whose\n"
+"                              access bitmaps are cached per segment [4].\n"
+"    --bitmap-index=oset|radix Data structure used to look up the access\n"
+"                              bitmaps of segments touching many regions\n"
+"                              [radix].\n"
 "    --check-stack-var=yes|no  Whether or not to report data races on\n"
 "                              stack variables [no].\n"
 "    --exclusive-threshold=<n> Print an error message if any mutex or\n"
@@ -214,6 +247,9 @@ static void DRD_(print_usage)(void)
 "    --free-is-write=yes|no    Whether to report races between freeing memory\n"
 "                              and subsequent accesses of that memory[no].\n"
 "    --join-list-vol=<n>       Number of threads to delay cleanup for [10].\n"
+"    --model-atomics=yes|no    Model atomic read-modify-write instructions as\n"
+"                              acquire/release operations on the accessed\n"
+"                              location instead of checking them [no].\n"
 "    --report-signal-unlocked=yes|no Whether to report calls to\n"
 "                              pthread_cond_signal() where the mutex associated\n"
 "                              with the signal via pthread_cond_wait() is not\n"
@@ -224,7 +260,8 @@ static void DRD_(print_usage)(void)
 "        improve the accuracy of the so-called 'other segments' displayed\n"
 "        in race reports but can also trigger an out of memory error.\n"
 "    --segment-merging-interval=<n> Perform segment merging every time n new\n"
-"        segments have been created. Default: %d.\n"
+"        segments have been created. Zero means that the interval grows with\n"
+"        the number of segments that are alive [0].\n"
 "    --shared-threshold=<n>    Print an error message if a reader lock\n"
 "                              is held longer than the specified time (in\n"
 "                              milliseconds) [off]\n"
@@ -232,6 +269,11 @@ static void DRD_(print_usage)(void)
 "    --show-stack-usage=yes|no Print stack usage at thread exit time [no].\n"
 "    --ignore-thread-creation=yes|no Ignore activities during thread \n"
 "                              creation [%s].\n"
+"    --watch-only=yes|no       Only check accesses to address ranges watched\n"
+"                              via DRD_WATCH_VAR() for data races [no].\n"
+"    --watch-sample-pages=<n>  Also check accesses to one out of every n\n"
+"                              pages, where n is a power of two. Implies\n"
+"                              --watch-only=yes if n > 0 [0].\n"
 "\n"
 "  drd options for monitoring process behavior:\n"
 "    --ptrace-addr=<address>[+<length>] Trace all load and store activity for\n"
@@ -249,7 +291,6 @@ static void DRD_(print_usage)(void)
 "    --trace-mutex=yes|no      Trace all mutex activity [no].\n"
 "    --trace-rwlock=yes|no     Trace all reader-writer lock activity[no].\n"
 "    --trace-semaphore=yes|no  Trace all semaphore activity [no].\n",
-DRD_(thread_get_segment_merge_interval)(),
 DRD_(ignore_thread_creation) ? "yes" : "no"
 );
 }
@@ -393,6 +434,7 @@ void drd_stop_using_mem(const Addr a1, const SizeT len,
       else if (DRD_(g_free_is_write))
 	 DRD_(trace_store)(a1, len);
       DRD_(clientobj_stop_using_mem)(a1, a2);
+      DRD_(atomic_stop_using_mem)(a1, a2);
       DRD_(suppression_stop_using_mem)(a1, a2);
    }
 }
@@ -793,6 +835,10 @@ static void DRD_(fini)(Int exitcode)
                    "           %llu partial updates because of thread join"
                    " operations.\n",
                    pu_join);
+      VG_(message)(Vg_UserMsg,
+                   "           %llu context switches handled by partial"
+                   " updates.\n",
+                   DRD_(thread_get_switch_conflict_set_count)());
       VG_(message)(Vg_UserMsg,
                    " segments: created %llu segments, max %llu alive,\n",
                    DRD_(sg_get_segments_created_count)(),
@@ -801,6 +847,9 @@ static void DRD_(fini)(Int exitcode)
                    "           %llu discard points and %llu merges.\n",
                    DRD_(thread_get_discard_ordered_segments_count)(),
                    DRD_(sg_get_segment_merge_count)());
+      VG_(message)(Vg_UserMsg,
+                   "   clocks: %llu clocks of deleted threads removed.\n",
+                   DRD_(thread_get_vc_compaction_count)());
       VG_(message)(Vg_UserMsg,
                    "segmnt cr: %llu mutex, %llu rwlock, %llu semaphore and"
                    " %llu barrier.\n",
@@ -813,9 +862,18 @@ static void DRD_(fini)(Int exitcode)
                    " and %llu level two bitmaps were allocated.\n",
                    DRD_(bm_get_bitmap_creation_count)(),
                    DRD_(bm_get_bitmap2_creation_count)());
+      VG_(message)(Vg_UserMsg,
+                   "           %llu radix tree indices were built.\n",
+                   DRD_(bm_get_bitmap_radix_count)());
       VG_(message)(Vg_UserMsg,
                    "    mutex: %llu non-recursive lock/unlock events.\n",
                    DRD_(get_mutex_lock_count)());
+      if (DRD_(get_model_atomics)())
+         VG_(message)(Vg_UserMsg,
+                      "  atomics: %llu read-modify-write operations,"
+                      " %llu acquires without new ordering.\n",
+                      DRD_(get_atomic_rmw_count)(),
+                      DRD_(get_atomic_acquire_skip_count)());
       DRD_(print_malloc_stats)();
    }
 
@@ -33,12 +33,19 @@
 /* Global variables. */
 
 Bool DRD_(g_any_address_traced) = False;
+/*
+ * Start and size of the smallest address range that contains all watched
+ * address ranges. Loaded by instrumented code, hence not static.
+ */
+Addr  DRD_(g_watch_lo);
+SizeT DRD_(g_watch_size);
 
 
 /* Local variables. */
 
 static struct bitmap* s_suppressed;
 static struct bitmap* s_traced;
+static struct bitmap* s_watched;
 static Bool s_trace_suppression;
 
 
@@ -53,10 +60,13 @@ void DRD_(suppression_init)(void)
 {
    tl_assert(s_suppressed == 0);
    tl_assert(s_traced     == 0);
+   tl_assert(s_watched    == 0);
    s_suppressed = DRD_(bm_new)();
    s_traced     = DRD_(bm_new)();
+   s_watched    = DRD_(bm_new)();
    tl_assert(s_suppressed);
    tl_assert(s_traced);
+   tl_assert(s_watched);
 }
 
 void DRD_(start_suppression)(const Addr a1, const Addr a2,
@@ -154,6 +164,63 @@ Bool DRD_(is_any_traced)(const Addr a1, const Addr a2)
    return DRD_(bm_has_any_access)(s_traced, a1, a2);
 }
 
+/**
+ * Start watching the address range [a1,a2). If --watch-only=yes or
+ * --watch-sample-pages has been specified, only accesses to watched address
+ * ranges and to sampled pages are checked for data races.
+ */
+void DRD_(start_watching_address_range)(const Addr a1, const Addr a2)
+{
+   Addr lo, hi;
+
+   tl_assert(a1 <= a2);
+
+   if (s_trace_suppression)
+      VG_(message)(Vg_DebugMsg, "start_watching(0x%lx, %lu)\n",
+                   a1, a2 - a1);
+
+   if (a1 == a2)
+      return;
+
+   DRD_(bm_access_range_load)(s_watched, a1, a2);
+   if (DRD_(g_watch_size) == 0) {
+      lo = a1;
+      hi = a2;
+   } else {
+      lo = DRD_(g_watch_lo) < a1 ? DRD_(g_watch_lo) : a1;
+      hi = DRD_(g_watch_lo) + DRD_(g_watch_size) > a2
+         ? DRD_(g_watch_lo) + DRD_(g_watch_size) : a2;
+   }
+   DRD_(g_watch_lo)   = lo;
+   DRD_(g_watch_size) = hi - lo;
+}
+
+/**
+ * Stop watching the address range [a1,a2). The range that contains all
+ * watched address ranges only shrinks once no address is watched anymore.
+ */
+void DRD_(stop_watching_address_range)(const Addr a1, const Addr a2)
+{
+   tl_assert(a1 <= a2);
+
+   if (s_trace_suppression)
+      VG_(message)(Vg_DebugMsg, "stop_watching(0x%lx, %lu)\n",
+                   a1, a2 - a1);
+
+   if (DRD_(g_watch_size) != 0) {
+      DRD_(bm_clear_load)(s_watched, a1, a2);
+      if (!DRD_(bm_has_any_load_g)(s_watched)) {
+         DRD_(g_watch_lo)   = 0;
+         DRD_(g_watch_size) = 0;
+      }
+   }
+}
+
+Bool DRD_(is_any_watched)(const Addr a1, const Addr a2)
+{
+   return DRD_(bm_has_any_load)(s_watched, a1, a2);
+}
+
 /**
  * Stop using the memory range [a1,a2). Stop tracing memory accesses to
  * non-persistent address ranges.
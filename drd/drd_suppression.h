@@ -7,6 +7,8 @@
 
 
 extern Bool DRD_(g_any_address_traced);
+extern Addr  DRD_(g_watch_lo);
+extern SizeT DRD_(g_watch_size);
 
 
 void DRD_(suppression_set_trace)(const Bool trace_suppression);
@@ -22,6 +24,9 @@ void DRD_(start_tracing_address_range)(const Addr a1, const Addr a2,
                                        const Bool persistent);
 void DRD_(stop_tracing_address_range)(const Addr a1, const Addr a2);
 Bool DRD_(is_any_traced)(const Addr a1, const Addr a2);
+void DRD_(start_watching_address_range)(const Addr a1, const Addr a2);
+void DRD_(stop_watching_address_range)(const Addr a1, const Addr a2);
+Bool DRD_(is_any_watched)(const Addr a1, const Addr a2);
 void DRD_(suppression_stop_using_mem)(const Addr a1, const Addr a2);
 
 
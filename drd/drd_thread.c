@@ -22,6 +22,7 @@
 */
 
 
+#include "drd_atomic.h"
 #include "drd_error.h"
 #include "drd_barrier.h"
 #include "drd_clientobj.h"
@@ -49,32 +50,40 @@ static void thread_append_segment(const DrdThreadId tid, Segment* const sg);
 static void thread_discard_segment(const DrdThreadId tid, Segment* const sg);
 static void thread_compute_conflict_set(struct bitmap** conflict_set,
                                         const DrdThreadId tid);
+static void thread_switch_conflict_set(const DrdThreadId from,
+                                       const DrdThreadId to);
 static Bool thread_conflict_set_up_to_date(const DrdThreadId tid);
+static void thread_compact_vcs(void);
 
 
 /* Local variables. */
 
 static ULong    s_context_switch_count;
 static ULong    s_discard_ordered_segments_count;
+static ULong    s_vc_compaction_count;
 static ULong    s_compute_conflict_set_count;
 static ULong    s_update_conflict_set_count;
 static ULong    s_update_conflict_set_new_sg_count;
 static ULong    s_update_conflict_set_sync_count;
 static ULong    s_update_conflict_set_join_count;
+static ULong    s_switch_conflict_set_count;
 static ULong    s_conflict_set_bitmap_creation_count;
 static ULong    s_conflict_set_bitmap2_creation_count;
 static ThreadId s_vg_running_tid  = VG_INVALID_THREADID;
 DrdThreadId     DRD_(g_drd_running_tid) = DRD_INVALID_THREADID;
 ThreadInfo*     DRD_(g_threadinfo);
 struct bitmap*  DRD_(g_conflict_set);
+/* Thread for which DRD_(g_conflict_set) is up to date, if any. */
+static DrdThreadId s_conflict_set_tid = DRD_INVALID_THREADID;
 Bool DRD_(verify_conflict_set);
 static Bool     s_trace_context_switches = False;
 static Bool     s_trace_conflict_set = False;
 static Bool     s_trace_conflict_set_bm = False;
 static Bool     s_trace_fork_join = False;
 static Bool     s_segment_merging = True;
-static Bool     s_new_segments_since_last_merge;
-static int      s_segment_merge_interval = 10;
+static unsigned s_new_segments_since_last_merge;
+/* Zero means: merge segments when the number of live segments has grown. */
+static int      s_segment_merge_interval = 0;
 static unsigned s_join_list_vol = 10;
 static unsigned s_deletion_head;
 static unsigned s_deletion_tail;
@@ -128,7 +137,10 @@ void DRD_(thread_set_segment_merging)(const Bool m)
    s_segment_merging = m;
 }
 
-/** Get the segment merging interval. */
+/**
+ * Get the segment merging interval. Zero means that the interval is derived
+ * from the number of segments that are alive.
+ */
 int DRD_(thread_get_segment_merge_interval)(void)
 {
    return s_segment_merge_interval;
@@ -535,6 +547,13 @@ void DRD_(thread_delete)(const DrdThreadId tid, const Bool detached)
       tl_assert(!DRD_(g_threadinfo)[tid].detached_posix_thread);
    DRD_(g_threadinfo)[tid].sg_first = NULL;
    DRD_(g_threadinfo)[tid].sg_last = NULL;
+   DRD_(atomic_remove_thread_clock)(tid);
+
+   /*
+    * The segments of tid may have been part of the conflict set. Make sure
+    * that it gets recomputed from scratch upon the next context switch.
+    */
+   s_conflict_set_tid = DRD_INVALID_THREADID;
 
    tl_assert(!DRD_(IsValidDrdThreadId)(tid));
 }
@@ -585,6 +604,7 @@ void DRD_(drd_thread_atfork_child)(const DrdThreadId tid)
 
    DRD_(bm_cleanup)(DRD_(g_conflict_set));
    DRD_(bm_init)(DRD_(g_conflict_set));
+   s_conflict_set_tid = DRD_INVALID_THREADID;
 }
 
 /** Called just before pthread_cancel(). */
@@ -785,7 +805,17 @@ void DRD_(thread_set_running_tid)(const ThreadId vg_tid,
       }
       s_vg_running_tid = vg_tid;
       DRD_(g_drd_running_tid) = drd_tid;
-      thread_compute_conflict_set(&DRD_(g_conflict_set), drd_tid);
+      if (DRD_(g_conflict_set)
+          && s_conflict_set_tid != drd_tid
+          && DRD_(IsValidDrdThreadId)(s_conflict_set_tid)
+          && DRD_(g_threadinfo)[s_conflict_set_tid].sg_last
+          && DRD_(g_threadinfo)[drd_tid].sg_last) {
+         thread_switch_conflict_set(s_conflict_set_tid, drd_tid);
+      } else {
+         thread_compute_conflict_set(&DRD_(g_conflict_set), drd_tid);
+      }
+      s_conflict_set_tid = drd_tid;
+      tl_assert(thread_conflict_set_up_to_date(drd_tid));
       s_context_switch_count++;
    }
 
@@ -1004,6 +1034,59 @@ static void thread_discard_ordered_segments(void)
    DRD_(vc_cleanup)(&thread_vc_min);
 }
 
+/**
+ * Remove the clocks of threads that no longer exist from all vector clocks.
+ * The clock of a thread that has been deleted can be removed once all
+ * segments agree on its value: removing an element that has the same value
+ * in every vector clock does not change the ordering of any two segments,
+ * and since the thread no longer exists its clock will not change anymore.
+ * Vector clocks of programs that create many short-lived threads would
+ * otherwise keep growing with every thread that ever existed.
+ */
+static void thread_compact_vcs(void)
+{
+   VectorClock dead;
+   Segment* sg;
+   unsigned i;
+   unsigned n;
+
+   /*
+    * A thread clock can only have the same value in every segment if the
+    * minimum of the latest vector clocks of all threads includes it. Keep
+    * only the clocks of deleted threads in that minimum.
+    */
+   DRD_(vc_init)(&dead, 0, 0);
+   DRD_(thread_compute_minimum_vc)(&dead);
+   n = 0;
+   for (i = 0; i < dead.size; i++) {
+      if (dead.vc[i].count > 0 && !DRD_(g_threadinfo)[dead.vc[i].threadid].valid)
+         dead.vc[n++] = dead.vc[i];
+   }
+
+   for (sg = DRD_(g_sg_list); sg && n > 0; sg = sg->g_next) {
+      for (i = 0; i < n; ) {
+         if (DRD_(vc_get)(&sg->vc, dead.vc[i].threadid) != dead.vc[i].count)
+            dead.vc[i] = dead.vc[--n];
+         else
+            i++;
+      }
+   }
+
+   for (sg = DRD_(g_sg_list); sg && n > 0; sg = sg->g_next)
+      for (i = 0; i < n; i++)
+         DRD_(vc_remove)(&sg->vc, dead.vc[i].threadid);
+
+   if (DRD_(sg_get_trace)()) {
+      for (i = 0; i < n; i++)
+         VG_(message)(Vg_DebugMsg,
+                      "Removed clock %u of thread %u from all vector clocks\n",
+                      dead.vc[i].count, dead.vc[i].threadid);
+   }
+
+   s_vc_compaction_count += n;
+   DRD_(vc_cleanup)(&dead);
+}
+
 /**
  * An implementation of the property 'equiv(sg1, sg2)' as defined in the paper
  * by Mark Christiaens e.a. The property equiv(sg1, sg2) holds if and only if
@@ -1121,6 +1204,33 @@ static void thread_merge_segments(void)
    }
 }
 
+/**
+ * Decide whether segment merging should be performed now. If no merging
+ * interval has been specified, merge after the number of segments that are
+ * alive has grown by half since the previous merge. Since the cost of
+ * merging is proportional to the number of segments that are alive, this
+ * keeps the amortized cost of merging per new segment constant while
+ * bounding the number of segments that are alive to a small multiple of
+ * the number of segments that cannot be merged.
+ */
+static Bool thread_segment_merge_due(void)
+{
+   unsigned interval;
+
+   if (!s_segment_merging)
+      return False;
+
+   if (s_segment_merge_interval > 0) {
+      interval = s_segment_merge_interval;
+   } else {
+      const ULong alive = DRD_(sg_get_segments_alive_count)();
+
+      interval = alive / 2 > SEGMENT_MERGE_MIN_INTERVAL
+         ? alive / 2 : SEGMENT_MERGE_MIN_INTERVAL;
+   }
+   return ++s_new_segments_since_last_merge >= interval;
+}
+
 /**
  * Create a new segment for the specified thread, and discard any segments
  * that cannot cause races anymore.
@@ -1145,10 +1255,10 @@ void DRD_(thread_new_segment)(const DrdThreadId tid)
 
    tl_assert(thread_conflict_set_up_to_date(DRD_(g_drd_running_tid)));
 
-   if (s_segment_merging
-       && ++s_new_segments_since_last_merge >= s_segment_merge_interval)
+   if (thread_segment_merge_due())
    {
       thread_discard_ordered_segments();
+      thread_compact_vcs();
       thread_merge_segments();
    }
 }
@@ -1188,6 +1298,8 @@ void DRD_(thread_combine_vc_join)(DrdThreadId joiner, DrdThreadId joinee)
    } else {
       DRD_(vc_combine)(DRD_(thread_get_vc)(joiner),
                        DRD_(thread_get_vc)(joinee));
+      if (joiner == s_conflict_set_tid)
+         s_conflict_set_tid = DRD_INVALID_THREADID;
    }
 
    thread_discard_ordered_segments();
@@ -1258,10 +1370,10 @@ void DRD_(thread_new_segment_and_combine_vc)(DrdThreadId tid, const Segment* sg)
 
    thread_combine_vc_sync(tid, sg);
 
-   if (s_segment_merging
-       && ++s_new_segments_since_last_merge >= s_segment_merge_interval)
+   if (thread_segment_merge_due())
    {
       thread_discard_ordered_segments();
+      thread_compact_vcs();
       thread_merge_segments();
    }
 }
@@ -1659,6 +1771,105 @@ void DRD_(thread_update_conflict_set)(const DrdThreadId tid,
    tl_assert(thread_conflict_set_up_to_date(DRD_(g_drd_running_tid)));
 }
 
+/**
+ * Turn the conflict set of thread 'from' into the conflict set of thread
+ * 'to'. Only the second-level bitmaps touched by a segment that is in one of
+ * both conflict sets but not in the other one are recomputed. This is
+ * cheaper than thread_compute_conflict_set() if both conflict sets have many
+ * segments in common, which is the case if a context switch happens between
+ * threads that did not synchronize with each other since the last context
+ * switch.
+ */
+static void thread_switch_conflict_set(const DrdThreadId from,
+                                       const DrdThreadId to)
+{
+   const VectorClock* from_vc;
+   const VectorClock* to_vc;
+   unsigned j;
+
+   tl_assert(from != to);
+   tl_assert(DRD_(IsValidDrdThreadId)(from));
+   tl_assert(DRD_(IsValidDrdThreadId)(to));
+   tl_assert(to == DRD_(g_drd_running_tid));
+   tl_assert(DRD_(g_conflict_set));
+
+   if (s_trace_conflict_set) {
+      VG_(message)(Vg_DebugMsg,
+                   "switching conflict set from thread %u to thread %u\n",
+                   from, to);
+   }
+
+   from_vc = &DRD_(g_threadinfo)[from].sg_last->vc;
+   to_vc   = &DRD_(g_threadinfo)[to].sg_last->vc;
+
+   DRD_(bm_unmark)(DRD_(g_conflict_set));
+
+   for (j = 0; j < DRD_N_THREADS; j++) {
+      Segment* q;
+
+      if (! DRD_(IsValidDrdThreadId)(j))
+         continue;
+
+      /*
+       * Segments are ordered per thread, so once a segment precedes both
+       * the current segment of 'from' and that of 'to', all segments before
+       * it do too.
+       */
+      for (q = DRD_(g_threadinfo)[j].sg_last;
+           q && !(DRD_(vc_lte)(&q->vc, from_vc)
+                  && DRD_(vc_lte)(&q->vc, to_vc));
+           q = q->thr_prev) {
+         const Bool included_in_old_conflict_set
+            = j != from
+            && !DRD_(vc_lte)(&q->vc, from_vc)
+            && !DRD_(vc_lte)(from_vc, &q->vc);
+         const Bool included_in_new_conflict_set
+            = j != to
+            && !DRD_(vc_lte)(&q->vc, to_vc)
+            && !DRD_(vc_lte)(to_vc, &q->vc);
+
+         if (UNLIKELY(s_trace_conflict_set)) {
+            HChar* str;
+
+            str = DRD_(vc_aprint)(&q->vc);
+            VG_(message)(Vg_DebugMsg,
+                         "conflict set: [%u] %s segment %s\n", j,
+                         included_in_old_conflict_set
+                         != included_in_new_conflict_set
+                         ? "merging" : "ignoring", str);
+            VG_(free)(str);
+         }
+         if (included_in_old_conflict_set != included_in_new_conflict_set)
+            DRD_(bm_mark)(DRD_(g_conflict_set), DRD_(sg_bm)(q));
+      }
+   }
+
+   DRD_(bm_clear_marked)(DRD_(g_conflict_set));
+
+   for (j = 0; j < DRD_N_THREADS; j++) {
+      if (j != to && DRD_(IsValidDrdThreadId)(j)) {
+         Segment* q;
+         for (q = DRD_(g_threadinfo)[j].sg_last;
+              q && !DRD_(vc_lte)(&q->vc, to_vc);
+              q = q->thr_prev) {
+            if (!DRD_(vc_lte)(to_vc, &q->vc))
+               DRD_(bm_merge2_marked)(DRD_(g_conflict_set), DRD_(sg_bm)(q));
+         }
+      }
+   }
+
+   DRD_(bm_remove_cleared_marked)(DRD_(g_conflict_set));
+
+   s_switch_conflict_set_count++;
+
+   if (s_trace_conflict_set_bm)
+   {
+      VG_(message)(Vg_DebugMsg, "[%u] switched conflict set:\n", to);
+      DRD_(bm_print)(DRD_(g_conflict_set));
+      VG_(message)(Vg_DebugMsg, "[%u] end of switched conflict set.\n", to);
+   }
+}
+
 /** Report the number of context switches performed. */
 ULong DRD_(thread_get_context_switch_count)(void)
 {
@@ -1671,6 +1882,12 @@ ULong DRD_(thread_get_discard_ordered_segments_count)(void)
    return s_discard_ordered_segments_count;
 }
 
+/** Report the number of thread clocks removed from all vector clocks. */
+ULong DRD_(thread_get_vc_compaction_count)(void)
+{
+   return s_vc_compaction_count;
+}
+
 /** Return how many times the conflict set has been updated entirely. */
 ULong DRD_(thread_get_compute_conflict_set_count)()
 {
@@ -1683,6 +1900,15 @@ ULong DRD_(thread_get_update_conflict_set_count)(void)
    return s_update_conflict_set_count;
 }
 
+/**
+ * Return how many times the conflict set has been updated partially
+ * because of a context switch.
+ */
+ULong DRD_(thread_get_switch_conflict_set_count)(void)
+{
+   return s_switch_conflict_set_count;
+}
+
 /**
  * Return how many times the conflict set has been updated partially
  * because a new segment has been created.
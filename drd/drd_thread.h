@@ -41,6 +41,12 @@
 /** Maximum number of threads DRD keeps information about. */
 #define DRD_N_THREADS VG_N_THREADS
 
+/**
+ * Minimum number of new segments between two segment merging passes if no
+ * merging interval has been specified.
+ */
+#define SEGMENT_MERGE_MIN_INTERVAL 10
+
 /** A number different from any valid DRD thread ID. */
 #define DRD_INVALID_THREADID 0
 
@@ -207,8 +213,10 @@ void DRD_(thread_report_conflicting_segments)(const DrdThreadId tid,
 ULong DRD_(thread_get_context_switch_count)(void);
 ULong DRD_(thread_get_report_races_count)(void);
 ULong DRD_(thread_get_discard_ordered_segments_count)(void);
+ULong DRD_(thread_get_vc_compaction_count)(void);
 ULong DRD_(thread_get_compute_conflict_set_count)(void);
 ULong DRD_(thread_get_update_conflict_set_count)(void);
+ULong DRD_(thread_get_switch_conflict_set_count)(void);
 ULong DRD_(thread_get_update_conflict_set_new_sg_count)(void);
 ULong DRD_(thread_get_update_conflict_set_sync_count)(void);
 ULong DRD_(thread_get_update_conflict_set_join_count)(void);
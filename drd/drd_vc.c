@@ -111,6 +111,63 @@ void DRD_(vc_increment)(VectorClock* const vc, DrdThreadId const tid)
    }
 }
 
+/**
+ * Look up the index of the clock of thread 'tid' in vector clock 'vc'.
+ *
+ * @return Index of the element for thread 'tid' if it is present and
+ *   vc->size otherwise.
+ */
+static unsigned DRD_(vc_find)(const VectorClock* const vc,
+                              DrdThreadId const tid)
+{
+   unsigned lo = 0;
+   unsigned hi = vc->size;
+
+   while (lo < hi)
+   {
+      const unsigned mid = lo + (hi - lo) / 2;
+
+      if (vc->vc[mid].threadid < tid)
+         lo = mid + 1;
+      else if (vc->vc[mid].threadid > tid)
+         hi = mid;
+      else
+         return mid;
+   }
+   return vc->size;
+}
+
+/**
+ * @return The clock of thread 'tid' in vector clock 'vc', or zero if 'vc'
+ *   does not have an element for thread 'tid'.
+ */
+UInt DRD_(vc_get)(const VectorClock* const vc, DrdThreadId const tid)
+{
+   const unsigned i = DRD_(vc_find)(vc, tid);
+
+   return i < vc->size ? vc->vc[i].count : 0;
+}
+
+/**
+ * Remove the clock of thread 'tid' from vector clock 'vc'. This does not
+ * change the ordering between vector clocks as long as it is done for all
+ * vector clocks that have the same value for thread 'tid'.
+ */
+void DRD_(vc_remove)(VectorClock* const vc, DrdThreadId const tid)
+{
+   const unsigned i = DRD_(vc_find)(vc, tid);
+
+   if (i < vc->size)
+   {
+      VG_(memmove)(&vc->vc[i], &vc->vc[i + 1],
+                   (vc->size - i - 1) * sizeof(vc->vc[0]));
+      vc->size--;
+   }
+#ifdef ENABLE_DRD_CONSISTENCY_CHECKS
+   DRD_(vc_check)(vc);
+#endif
+}
+
 /**
  * @return True if vector clocks vc1 and vc2 are ordered, and false otherwise.
  * Order is as imposed by thread synchronization actions ("happens before").
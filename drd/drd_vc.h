@@ -77,6 +77,8 @@ void DRD_(vc_cleanup)(VectorClock* const vc);
 void DRD_(vc_copy)(VectorClock* const new, const VectorClock* const rhs);
 void DRD_(vc_assign)(VectorClock* const lhs, const VectorClock* const rhs);
 void DRD_(vc_increment)(VectorClock* const vc, DrdThreadId const tid);
+UInt DRD_(vc_get)(const VectorClock* const vc, DrdThreadId const tid);
+void DRD_(vc_remove)(VectorClock* const vc, DrdThreadId const tid);
 static __inline__
 Bool DRD_(vc_lte)(const VectorClock* const vc1,
                   const VectorClock* const vc2);
@@ -63,19 +63,35 @@ struct bm_cache_elem
    struct bitmap2* bm2;
 };
 
-#define DRD_BITMAP_N_CACHE_ELEM 4
+/*
+ * Maximum number of lookup cache elements. How many of these are used is
+ * set at startup via DRD_(bm_set_cache_size)().
+ */
+#define DRD_BITMAP_N_CACHE_ELEM 8
+
+/*
+ * Unless radix tree indices have been disabled (--bitmap-index=oset), number
+ * of second level bitmaps above which a bitmap gets a radix tree index.
+ */
+#define DRD_BITMAP_RADIX_MIN_BM2_COUNT 16
+
+struct bm_radix_node;
 
 /* Complete bitmap. */
 struct bitmap
 {
-   struct bm_cache_elem cache[DRD_BITMAP_N_CACHE_ELEM];
-   OSet*                oset;
+   struct bm_cache_elem  cache[DRD_BITMAP_N_CACHE_ELEM];
+   OSet*                 oset;
+   /* Radix tree index over the nodes in oset, or NULL if there is none. */
+   struct bm_radix_node* radix;
 };
 
 
 /* Function declarations. */
 
 void DRD_(bm_module_init)(void);
+void DRD_(bm_set_cache_size)(const UInt n);
+void DRD_(bm_set_radix_index)(const Bool enabled, const UInt min_bm2_count);
 void DRD_(bm_module_cleanup)(void);
 struct bitmap* DRD_(bm_new)(void);
 void DRD_(bm_delete)(struct bitmap* const bm);
@@ -149,5 +165,6 @@ void DRD_(bm_print)(struct bitmap* bm);
 ULong DRD_(bm_get_bitmap_creation_count)(void);
 ULong DRD_(bm_get_bitmap2_creation_count)(void);
 ULong DRD_(bm_get_bitmap2_merge_count)(void);
+ULong DRD_(bm_get_bitmap_radix_count)(void);
 
 #endif /* __PUB_DRD_BITMAP_H */
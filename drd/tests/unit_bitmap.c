@@ -325,7 +325,7 @@ int main(int argc, char** argv)
   int inner_loop_step = ADDR_GRANULARITY;
   int optchar;
 
-  while ((optchar = getopt(argc, argv, "s:t:q")) != EOF)
+  while ((optchar = getopt(argc, argv, "rs:t:q")) != EOF)
   {
     switch (optchar)
     {
@@ -338,9 +338,13 @@ int main(int argc, char** argv)
     case 'q':
       s_verbose = 0;
       break;
+    case 'r':
+      DRD_(bm_set_radix_index)(True, 0);
+      break;
     default:
       fprintf(stderr,
-              "Usage: %s [-s<outer_loop_step>] [-t<inner_loop_step>] [-q].\n",
+              "Usage: %s [-r] [-s<outer_loop_step>] [-t<inner_loop_step>]"
+              " [-q].\n",
               argv[0]);
       break;
     }
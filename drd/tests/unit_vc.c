@@ -36,6 +36,8 @@ void* VG_(memset)(void *s, Int c, SizeT sz)
 { return memset(s, c, sz); }
 void* VG_(memcpy)(void *d, const void *s, SizeT sz)
 { return memcpy(d, s, sz); }
+void* VG_(memmove)(void *d, const void *s, SizeT sz)
+{ return memmove(d, s, sz); }
 Int VG_(memcmp)(const void* s1, const void* s2, SizeT n)
 { return memcmp(s1, s2, n); }
 UInt VG_(printf)(const HChar *format, ...)
@@ -93,6 +95,15 @@ static void vc_unittest(void)
   fprintf(stderr, ") = %d sw %d\n",
           DRD_(vc_lte)(&vc4, &vc5), DRD_(vc_lte)(&vc5, &vc4));
 
+  fprintf(stderr, "vc_get(vc3, 3) = %u, vc_get(vc3, 4) = %u\n",
+          DRD_(vc_get)(&vc3, 3), DRD_(vc_get)(&vc3, 4));
+  DRD_(vc_remove)(&vc3, 3);
+  fprintf(stderr, "vc_remove(vc3, 3): %s\n", (str = DRD_(vc_aprint)(&vc3)));
+  free(str);
+  DRD_(vc_remove)(&vc3, 4);
+  fprintf(stderr, "vc_remove(vc3, 4): %s\n", (str = DRD_(vc_aprint)(&vc3)));
+  free(str);
+
   for (i = 0; i < 64; i++)
     DRD_(vc_reserve)(&vc1, i);
   for (i = 64; i > 0; i--)
@@ -41,11 +41,12 @@
 #include "pub_tool_libcbase.h"   /* VG_(strlen) */
 #include "pub_tool_libcprint.h"  /* VG_(printf) */
 #include "pub_tool_libcassert.h" /* VG_(exit) */
+#include "pub_tool_libcfile.h"   /* VG_(open) */
 #include "pub_tool_mallocfree.h" /* VG_(malloc) */
 #include "pub_tool_machine.h"    /* VG_(fnptr_to_fnentry) */
 #include "pub_tool_debuginfo.h"  /* VG_(get_fnname) */
 
-#include "pub_tool_oset.h"       /* ordered set stuff */
+#include "pub_tool_hashtable.h"  /* hash table stuff */
 
    /* instruction special cases */
 #define REP_INSTRUCTION   0x1
@@ -65,9 +66,22 @@ static HChar *bb_out_file=NULL;
    /* output parameters */
 static Bool instr_count_only=False;
 static Bool generate_pc_file=False;
+static Bool binary_output=False;
+
+   /* SimPoint parameters */
+static Int clo_simpoints=0;     /* max number of SimPoints, 0 for none */
+static const HChar *clo_simpoint_out_file="simpoints.out.%p";
+static HChar *simpoint_out_file=NULL;
+
+   /* binary BBV file: "BBV1", then the interval size */
+#define BINARY_MAGIC    "BBV1"
+#define BINARY_BUF_SIZE 65536
+
+   /* dimensions of the projected vectors used for clustering */
+#define PROJ_DIMS 15
 
    /* Global values */
-static OSet* instr_info_table;  /* table that holds the basic block info */
+static VgHashTable *instr_info_table;  /* table that holds the basic block info */
 static Int block_num=1;         /* global next block number */
 static Int current_thread=0;
 static Int allocated_threads=1;
@@ -83,10 +97,20 @@ struct thread_info {
    ULong unique_rep_count;
    ULong fldcw_count;       /* fldcw count */
    VgFile *bbtrace_fp;      /* file pointer */
+   Int bbtrace_fd;          /* file descriptor and buffer for */
+   UChar *out_buf;          /*    --bb-out-format=binary      */
+   Int out_used;
+   struct BB_info **touched;  /* blocks entered in this interval */
+   Int n_touched;
+   Int touched_size;
+   Double *proj;            /* projected vector of each interval */
+   Int n_intervals;
+   Int proj_size;
 };
 
 struct BB_info {
-   Addr       BB_addr;           /* used as key, must be first           */
+   struct BB_info *next;         /* hash chain, must be first            */
+   Addr       BB_addr;           /* used as key, must be second          */
    Int        n_instrs;          /* instructions in the basic block      */
    Int        block_num;         /* unique block identifier              */
    Int        *inst_counter;     /* times entered * num_instructions     */
@@ -95,11 +119,21 @@ struct BB_info {
 };
 
 
+   /* order of blocks by address, for the output files */
+static Int cmp_BB_addr(const void *v1, const void *v2)
+{
+   Addr a1=(*(struct BB_info * const *)v1)->BB_addr;
+   Addr a2=(*(struct BB_info * const *)v2)->BB_addr;
+
+   return a1<a2 ? -1 : (a1>a2 ? 1 : 0);
+}
+
    /* dump the optional PC file, which contains basic block number to */
    /*   instruction address and function name mappings                */
 static void dumpPcFile(void)
 {
-   struct BB_info   *bb_elem;
+   struct BB_info   **bb_elems;
+   UInt   n_elems,i;
    VgFile *fp;
 
    pc_out_file =
@@ -112,78 +146,234 @@ static void dumpPcFile(void)
       VG_(exit)(1);
    }
 
-      /* Loop through the table, printing the number, address, */
-      /*    and function name for each basic block             */
-   VG_(OSetGen_ResetIter)(instr_info_table);
-   while ( (bb_elem = VG_(OSetGen_Next)(instr_info_table)) ) {
-      VG_(fprintf)( fp, "F:%d:%lx:%s\n", bb_elem->block_num,
-                    bb_elem->BB_addr, bb_elem->fn_name);
+      /* Loop through the blocks in address order, printing the */
+      /*    number, address, and function name for each one      */
+   bb_elems = (struct BB_info **)VG_(HT_to_array)(instr_info_table, &n_elems);
+   VG_(ssort)(bb_elems, n_elems, sizeof(struct BB_info *), cmp_BB_addr);
+   for(i=0;i<n_elems;i++) {
+      VG_(fprintf)( fp, "F:%d:%lx:%s\n", bb_elems[i]->block_num,
+                    bb_elems[i]->BB_addr, bb_elems[i]->fn_name);
    }
+   VG_(free)(bb_elems);
 
    VG_(fclose)(fp);
 }
 
-static VgFile *open_tracefile(Int thread_num)
+   /* Put the name of a per-thread output file in temp_string, */
+   /*   which needs room for VG_(strlen)(name) + 12 chars        */
+static void thread_file_name(HChar *temp_string, const HChar *name,
+                             Int thread_num)
 {
-   VgFile *fp;
-   // Allocate a buffer large enough for the general case "%s.%d" below
-   HChar temp_string[VG_(strlen)(bb_out_file) + 1 + 10 + 1];
-
       /* For thread 1, don't append any thread number  */
       /* This lets the single-thread case not have any */
       /* extra values appended to the file name.       */
    if (thread_num==1) {
-      VG_(strcpy)(temp_string, bb_out_file);
+      VG_(strcpy)(temp_string, name);
    }
    else {
-      VG_(sprintf)(temp_string,"%s.%d",bb_out_file,thread_num);
+      VG_(sprintf)(temp_string,"%s.%d",name,thread_num);
    }
+}
+
+static VgFile *open_file(const HChar *temp_string, const HChar *what)
+{
+   VgFile *fp;
 
    fp = VG_(fopen)(temp_string, VKI_O_CREAT|VKI_O_TRUNC|VKI_O_WRONLY,
                    VKI_S_IRUSR|VKI_S_IWUSR|VKI_S_IRGRP|VKI_S_IWGRP);
 
    if (fp == NULL) {
-      VG_(umsg)("Error: cannot create bb file %s\n",temp_string);
+      VG_(umsg)("Error: cannot create %s file %s\n",what,temp_string);
       VG_(exit)(1);
    }
 
    return fp;
 }
 
-static void handle_overflow(void)
+static VgFile *open_tracefile(Int thread_num)
+{
+   // Allocate a buffer large enough for the general case "%s.%d"
+   HChar temp_string[VG_(strlen)(bb_out_file) + 1 + 10 + 1];
+
+   thread_file_name(temp_string, bb_out_file, thread_num);
+   return open_file(temp_string, "bb");
+}
+
+   /* Binary BBV files are written through our own buffer, */
+   /*   as VG_(fprintf) only handles text                  */
+static void flush_binary(struct thread_info *t)
+{
+   if (t->out_used > 0) {
+      VG_(write)(t->bbtrace_fd, t->out_buf, t->out_used);
+      t->out_used=0;
+   }
+}
+
+static void put_binary(struct thread_info *t, UInt value)
+{
+   if (t->out_used + sizeof(UInt) > BINARY_BUF_SIZE) {
+      flush_binary(t);
+   }
+   VG_(memcpy)(t->out_buf + t->out_used, &value, sizeof(UInt));
+   t->out_used+=sizeof(UInt);
+}
+
+static void open_binary_tracefile(Int thread_num)
 {
+   struct thread_info *t=&bbv_thread[thread_num];
+   HChar temp_string[VG_(strlen)(bb_out_file) + 1 + 10 + 1];
+   SysRes sres;
+
+   thread_file_name(temp_string, bb_out_file, thread_num);
+   sres = VG_(open)(temp_string, VKI_O_CREAT|VKI_O_TRUNC|VKI_O_WRONLY,
+                    VKI_S_IRUSR|VKI_S_IWUSR|VKI_S_IRGRP|VKI_S_IWGRP);
+   if (sr_isError(sres)) {
+      VG_(umsg)("Error: cannot create bb file %s\n",temp_string);
+      VG_(exit)(1);
+   }
+   t->bbtrace_fd=sr_Res(sres);
+   t->out_buf=VG_(malloc)("bbv_main.c out_buf", BINARY_BUF_SIZE);
+   t->out_used=0;
+
+   VG_(memcpy)(t->out_buf, BINARY_MAGIC, 4);
+   t->out_used=4;
+   put_binary(t, interval_size);
+}
+
+   /* Element dim of the random projection of block bb_num,     */
+   /*   uniformly distributed in [-1,1).  This is a hash of both, */
+   /*   so the projection matrix need not be stored.              */
+static Double proj_elem(Int bb_num, Int dim)
+{
+   ULong x=((ULong)bb_num * PROJ_DIMS + dim) + 0x9E3779B97F4A7C15ULL;
+
+   x=(x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+   x=(x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+   x=x ^ (x >> 31);
+
+   return (Double)(x >> 11) / (Double)(1ULL << 52) - 1.0;
+}
+
+   /* Keep the normalized, projected BBV of the interval just */
+   /*   finished for the SimPoint clustering at exit          */
+static void project_interval(struct thread_info *t)
+{
+   Double *v,total=0;
+   Int i,d;
+
+   if (t->n_intervals==t->proj_size) {
+      t->proj_size=t->proj_size ? 2*t->proj_size : 1024;
+      t->proj=VG_(realloc)("bbv_main.c proj", t->proj,
+                           t->proj_size*PROJ_DIMS*sizeof(Double));
+   }
+   v=&t->proj[t->n_intervals*PROJ_DIMS];
+   for(d=0;d<PROJ_DIMS;d++) {
+      v[d]=0;
+   }
+   for(i=0;i<t->n_touched;i++) {
+      Int count=t->touched[i]->inst_counter[current_thread];
+      total+=count;
+      for(d=0;d<PROJ_DIMS;d++) {
+         v[d]+=count*proj_elem(t->touched[i]->block_num,d);
+      }
+   }
+   for(d=0;d<PROJ_DIMS;d++) {
+      v[d]/=total;
+   }
+   t->n_intervals++;
+}
+
+   /* Write out the BBV of the interval just finished.  Only the  */
+   /*   blocks entered in the interval are in the touched list, so */
+   /*   this costs nothing for the others.                         */
+static __attribute__((noinline))
+void dump_interval(void)
+{
+   struct thread_info *t=&bbv_thread[current_thread];
    struct BB_info *bb_elem;
+   Int i;
 
-   if (bbv_thread[current_thread].dyn_instr > interval_size) {
+   if (clo_simpoints > 0) {
+      project_interval(t);
+   }
 
-      if (!instr_count_only) {
+   if (binary_output) {
+      if (t->out_buf == NULL) {
+         open_binary_tracefile(current_thread);
+      }
 
-            /* If our output file hasn't been opened, open it */
-         if (bbv_thread[current_thread].bbtrace_fp == NULL) {
-            bbv_thread[current_thread].bbtrace_fp=open_tracefile(current_thread);
-         }
+         /* the number of entries, then block/count pairs */
+      put_binary(t, t->n_touched);
+      for(i=0;i<t->n_touched;i++) {
+         bb_elem=t->touched[i];
+         put_binary(t, bb_elem->block_num);
+         put_binary(t, bb_elem->inst_counter[current_thread]);
+         bb_elem->inst_counter[current_thread] = 0;
+      }
+   }
+   else {
+         /* If our output file hasn't been opened, open it */
+      if (t->bbtrace_fp == NULL) {
+         t->bbtrace_fp=open_tracefile(current_thread);
+      }
 
-           /* put an entry to the bb.out file */
+        /* put an entry to the bb.out file, in address order */
 
-         VG_(fprintf)(bbv_thread[current_thread].bbtrace_fp, "T");
+      VG_(ssort)(t->touched, t->n_touched, sizeof(struct BB_info *),
+                 cmp_BB_addr);
 
-         VG_(OSetGen_ResetIter)(instr_info_table);
-         while ( (bb_elem = VG_(OSetGen_Next)(instr_info_table)) ) {
-            if ( bb_elem->inst_counter[current_thread] != 0 ) {
-               VG_(fprintf)(bbv_thread[current_thread].bbtrace_fp, ":%d:%d   ",
-                            bb_elem->block_num,
-                            bb_elem->inst_counter[current_thread]);
-               bb_elem->inst_counter[current_thread] = 0;
-            }
-         }
+      VG_(fprintf)(t->bbtrace_fp, "T");
+
+      for(i=0;i<t->n_touched;i++) {
+         bb_elem=t->touched[i];
+         VG_(fprintf)(t->bbtrace_fp, ":%d:%d   ",
+                      bb_elem->block_num,
+                      bb_elem->inst_counter[current_thread]);
+         bb_elem->inst_counter[current_thread] = 0;
+      }
+
+      VG_(fprintf)(t->bbtrace_fp, "\n");
+   }
+   t->n_touched=0;
+}
+
+static void handle_overflow(void)
+{
+   if (bbv_thread[current_thread].dyn_instr > interval_size) {
 
-         VG_(fprintf)(bbv_thread[current_thread].bbtrace_fp, "\n");
+      if (!instr_count_only) {
+         dump_interval();
       }
 
       bbv_thread[current_thread].dyn_instr -= interval_size;
    }
 }
 
+   /* Add a block to the touched list, when it is first */
+   /*   entered in an interval                           */
+static __attribute__((noinline))
+void add_touched(struct BB_info *bbInfo)
+{
+   struct thread_info *t=&bbv_thread[current_thread];
+
+   if (instr_count_only) return;
+
+   if (t->n_touched==t->touched_size) {
+      t->touched_size=t->touched_size ? 2*t->touched_size : 256;
+      t->touched=VG_(realloc)("bbv_main.c touched", t->touched,
+                              t->touched_size*sizeof(struct BB_info *));
+   }
+   t->touched[t->n_touched++]=bbInfo;
+}
+
+static inline void count_block(struct BB_info *bbInfo, Int n_instrs)
+{
+   if (UNLIKELY(bbInfo->inst_counter[current_thread]==0)) {
+      add_touched(bbInfo);
+   }
+   bbInfo->inst_counter[current_thread]+=n_instrs;
+}
+
 
 static void close_out_reps(void)
 {
@@ -205,7 +395,7 @@ static VG_REGPARM(1) void per_instruction_BBV(struct BB_info *bbInfo)
       close_out_reps();
    }
 
-   bbInfo->inst_counter[current_thread]+=n_instrs;
+   count_block(bbInfo,n_instrs);
 
    bbv_thread[current_thread].total_instr+=n_instrs;
    bbv_thread[current_thread].dyn_instr +=n_instrs;
@@ -246,7 +436,7 @@ static VG_REGPARM(1) void per_instruction_BBV_fldcw(struct BB_info *bbInfo)
       /* count fldcw instructions */
    bbv_thread[current_thread].fldcw_count++;
 
-   bbInfo->inst_counter[current_thread]+=n_instrs;
+   count_block(bbInfo,n_instrs);
 
    bbv_thread[current_thread].total_instr+=n_instrs;
    bbv_thread[current_thread].dyn_instr +=n_instrs;
@@ -373,7 +563,7 @@ static IRSB* bbv_instrument ( VgCallbackClosure* closure,
    origAddr=st->Ist.IMark.addr;
 
       /* Get the BB_info */
-   bbInfo = VG_(OSetGen_Lookup)(instr_info_table, &origAddr);
+   bbInfo = VG_(HT_lookup)(instr_info_table, origAddr);
 
    if (bbInfo==NULL) {
 
@@ -381,7 +571,7 @@ static IRSB* bbv_instrument ( VgCallbackClosure* closure,
          /* could have been unloaded and then reloaded elsewhere in memory) */
 
          /* allocate and initialize a new basic block structure */
-      bbInfo=VG_(OSetGen_AllocNode)(instr_info_table, sizeof(struct BB_info));
+      bbInfo=VG_(malloc)("bbv_instrument", sizeof(struct BB_info));
       bbInfo->BB_addr = origAddr;
       bbInfo->n_instrs = n_instrs;
       bbInfo->inst_counter=VG_(calloc)("bbv_instrument",
@@ -397,7 +587,7 @@ static IRSB* bbv_instrument ( VgCallbackClosure* closure,
       bbInfo->is_entry=VG_(get_fnname_if_entry)(ep, origAddr, &fn_name);
       bbInfo->fn_name =VG_(strdup)("bbv_strings", fn_name);
          /* insert structure into table */
-      VG_(OSetGen_Insert)( instr_info_table, bbInfo );
+      VG_(HT_add_node)( instr_info_table, bbInfo );
    }
 
       /* Iterate through the basic block, putting the original   */
@@ -477,10 +667,19 @@ static struct thread_info *allocate_new_thread(struct thread_info *old,
       temp[i].rep_count=0;
       temp[i].fldcw_count=0;
       temp[i].bbtrace_fp=NULL;
+      temp[i].bbtrace_fd=-1;
+      temp[i].out_buf=NULL;
+      temp[i].out_used=0;
+      temp[i].touched=NULL;
+      temp[i].n_touched=0;
+      temp[i].touched_size=0;
+      temp[i].proj=NULL;
+      temp[i].n_intervals=0;
+      temp[i].proj_size=0;
    }
       /* expand the inst_counter on all allocated basic blocks */
-   VG_(OSetGen_ResetIter)(instr_info_table);
-   while ( (bb_elem = VG_(OSetGen_Next)(instr_info_table)) ) {
+   VG_(HT_ResetIter)(instr_info_table);
+   while ( (bb_elem = VG_(HT_Next)(instr_info_table)) ) {
       bb_elem->inst_counter =
                     VG_(realloc)("bbv_main.c inst_counter",
                                  bb_elem->inst_counter,
@@ -505,6 +704,280 @@ static void bbv_thread_called ( ThreadId tid, ULong nDisp )
 
 
 
+/*--------------------------------------------------------------------*/
+/*--- SimPoint clustering                                          ---*/
+/*--------------------------------------------------------------------*/
+
+   /* This follows the SimPoint 3 defaults: the BBVs are projected  */
+   /*   to 15 dimensions, k-means runs from several random initial  */
+   /*   samples for each k up to the maximum, and the smallest k    */
+   /*   whose BIC score reaches 90% of the range seen is chosen.    */
+   /* Each k-means iteration costs n*k distances, so the search     */
+   /*   costs up to KMEANS_SEEDS*KMEANS_MAX_ITER*n*maxK^2/2 of them. */
+   /*   Like SimPoint's -sampleSize, only a random sample of at     */
+   /*   most KMEANS_SAMPLE intervals is clustered, which bounds n;  */
+   /*   the others just go to the nearest of the final centers.     */
+#define KMEANS_SEEDS    5
+#define KMEANS_MAX_ITER 100
+#define KMEANS_SAMPLE   10000
+#define BIC_THRESHOLD   0.9
+
+   /* Natural logarithm, as there is no libm */
+static Double bbv_log(Double x)
+{
+   Double y,y2,term,sum=0;
+   Int e=0,n;
+
+   if (x < 1e-300) {
+      x=1e-300;
+   }
+      /* x = m * 2^e with m in [1,2) */
+   while (x >= 2.0) { x/=2.0; e++; }
+   while (x < 1.0)  { x*=2.0; e--; }
+
+      /* ln(m) = 2 * (y + y^3/3 + y^5/5 + ...), y = (m-1)/(m+1) <= 1/3 */
+   y=(x-1.0)/(x+1.0);
+   y2=y*y;
+   term=y;
+   for(n=1;n<40;n+=2) {
+      sum+=term/n;
+      term*=y2;
+   }
+   return 2.0*sum + e*0.69314718055994530942;
+}
+
+static Double dist2(const Double *a, const Double *b)
+{
+   Double d2=0;
+   Int d;
+
+   for(d=0;d<PROJ_DIMS;d++) {
+      d2+=(a[d]-b[d])*(a[d]-b[d]);
+   }
+   return d2;
+}
+
+   /* Index of the one of the k centers nearest to pt */
+static Int nearest_center(const Double *pt, const Double *centers, Int k)
+{
+   Int j,best=0;
+   Double d2,best_d2=dist2(pt, &centers[0]);
+
+   for(j=1;j<k;j++) {
+      d2=dist2(pt, &centers[j*PROJ_DIMS]);
+      if (d2 < best_d2) {
+         best_d2=d2;
+         best=j;
+      }
+   }
+   return best;
+}
+
+   /* Cluster the n points into k clusters, starting from k points */
+   /*   chosen with the seed.  Returns the sum of squared distances */
+static Double kmeans(const Double *pts, Int n, Int k, UInt seed,
+                     Int *assign, Double *centers, Int *sizes)
+{
+   Double sse=0;
+   Int i,j,d,iter,changed;
+
+   for(j=0;j<k;j++) {
+      i=VG_(random)(&seed) % n;
+      VG_(memcpy)(&centers[j*PROJ_DIMS], &pts[i*PROJ_DIMS],
+                  PROJ_DIMS*sizeof(Double));
+   }
+   for(i=0;i<n;i++) {
+      assign[i]=-1;
+   }
+
+   for(iter=0;iter<KMEANS_MAX_ITER;iter++) {
+      changed=0;
+      for(i=0;i<n;i++) {
+         Int best=nearest_center(&pts[i*PROJ_DIMS], centers, k);
+         if (assign[i]!=best) {
+            assign[i]=best;
+            changed++;
+         }
+      }
+      if (!changed) break;
+
+         /* move the centers; an empty cluster keeps its center */
+      for(j=0;j<k;j++) {
+         sizes[j]=0;
+      }
+      for(i=0;i<n;i++) {
+         sizes[assign[i]]++;
+      }
+      for(j=0;j<k;j++) {
+         if (sizes[j]==0) continue;
+         for(d=0;d<PROJ_DIMS;d++) {
+            centers[j*PROJ_DIMS+d]=0;
+         }
+      }
+      for(i=0;i<n;i++) {
+         for(d=0;d<PROJ_DIMS;d++) {
+            centers[assign[i]*PROJ_DIMS+d]+=pts[i*PROJ_DIMS+d];
+         }
+      }
+      for(j=0;j<k;j++) {
+         if (sizes[j]==0) continue;
+         for(d=0;d<PROJ_DIMS;d++) {
+            centers[j*PROJ_DIMS+d]/=sizes[j];
+         }
+      }
+   }
+
+   for(j=0;j<k;j++) {
+      sizes[j]=0;
+   }
+   for(i=0;i<n;i++) {
+      sizes[assign[i]]++;
+      sse+=dist2(&pts[i*PROJ_DIMS], &centers[assign[i]*PROJ_DIMS]);
+   }
+   return sse;
+}
+
+   /* Bayesian Information Criterion of a clustering, as in X-means */
+static Double bic(Int n, Int k, const Int *sizes, Double sse)
+{
+   Double var,loglike=0,n_params;
+   Int j;
+
+   var = n > k ? sse/((Double)(n-k)*PROJ_DIMS) : 0;
+   for(j=0;j<k;j++) {
+      if (sizes[j]==0) continue;
+      loglike+=sizes[j]*bbv_log((Double)sizes[j]/n)
+               - sizes[j]*PROJ_DIMS/2.0*bbv_log(2*3.14159265358979323846*var)
+               - (sizes[j]-k)/2.0;
+   }
+   n_params=(k-1) + PROJ_DIMS*k + 1;
+   return loglike - n_params/2.0*bbv_log(n);
+}
+
+static void write_simpoints(Int thread_num)
+{
+   struct thread_info *t=&bbv_thread[thread_num];
+   Int n=t->n_intervals;
+   Int m=n < KMEANS_SAMPLE ? n : KMEANS_SAMPLE;
+   Int max_k=clo_simpoints < m ? clo_simpoints : m;
+   Int *assign,*sizes,*best_assign,*closest,*perm;
+   Double *pts,*centers,*best_centers,*bics,min_bic,max_bic;
+   UInt *best_seeds,seed=12345;
+   Int i,j,k,s,tmp,chosen_k,cluster;
+   HChar temp_string[VG_(strlen)(simpoint_out_file) + 1 + 10 + 8 + 1];
+   VgFile *sp_fp,*w_fp;
+
+   assign=VG_(malloc)("bbv_main.c kmeans", m*sizeof(Int));
+   best_assign=VG_(malloc)("bbv_main.c kmeans", n*sizeof(Int));
+   sizes=VG_(malloc)("bbv_main.c kmeans", max_k*sizeof(Int));
+   closest=VG_(malloc)("bbv_main.c kmeans", max_k*sizeof(Int));
+   centers=VG_(malloc)("bbv_main.c kmeans", max_k*PROJ_DIMS*sizeof(Double));
+   best_centers=VG_(malloc)("bbv_main.c kmeans",
+                            max_k*PROJ_DIMS*sizeof(Double));
+   bics=VG_(malloc)("bbv_main.c kmeans", (max_k+1)*sizeof(Double));
+   best_seeds=VG_(malloc)("bbv_main.c kmeans", (max_k+1)*sizeof(UInt));
+
+      /* the m intervals to cluster: all of them, or a random sample */
+   pts=t->proj;
+   if (m < n) {
+      perm=VG_(malloc)("bbv_main.c kmeans", n*sizeof(Int));
+      pts=VG_(malloc)("bbv_main.c kmeans", m*PROJ_DIMS*sizeof(Double));
+      for(i=0;i<n;i++) {
+         perm[i]=i;
+      }
+      for(i=0;i<m;i++) {
+            /* high bits, as the low ones of VG_(random) cycle quickly */
+         j=i + (Int)(((ULong)VG_(random)(&seed) * (n-i)) >> 32);
+         tmp=perm[i]; perm[i]=perm[j]; perm[j]=tmp;
+         VG_(memcpy)(&pts[i*PROJ_DIMS], &t->proj[perm[i]*PROJ_DIMS],
+                     PROJ_DIMS*sizeof(Double));
+      }
+      VG_(free)(perm);
+   }
+
+      /* score the best of several clusterings for each k */
+   for(k=1;k<=max_k;k++) {
+      Double best_sse=0;
+      for(s=0;s<KMEANS_SEEDS;s++) {
+         Double sse;
+         UInt this_seed=VG_(random)(&seed);
+         sse=kmeans(pts, m, k, this_seed, assign, centers, sizes);
+         if (s==0 || sse < best_sse) {
+            best_sse=sse;
+            best_seeds[k]=this_seed;
+            bics[k]=bic(m, k, sizes, sse);
+         }
+      }
+   }
+
+      /* the smallest k scoring at least BIC_THRESHOLD of the range */
+   min_bic=max_bic=bics[1];
+   for(k=2;k<=max_k;k++) {
+      if (bics[k] < min_bic) min_bic=bics[k];
+      if (bics[k] > max_bic) max_bic=bics[k];
+   }
+   for(chosen_k=1;chosen_k<max_k;chosen_k++) {
+      if (bics[chosen_k] >= min_bic + BIC_THRESHOLD*(max_bic-min_bic)) break;
+   }
+   kmeans(pts, m, chosen_k, best_seeds[chosen_k],
+          assign, best_centers, sizes);
+
+      /* every interval, sampled or not, joins the nearest cluster */
+   for(j=0;j<chosen_k;j++) {
+      sizes[j]=0;
+   }
+   for(i=0;i<n;i++) {
+      best_assign[i]=nearest_center(&t->proj[i*PROJ_DIMS], best_centers,
+                                    chosen_k);
+      sizes[best_assign[i]]++;
+   }
+
+      /* each cluster is represented by the interval closest to its center */
+   for(j=0;j<chosen_k;j++) {
+      closest[j]=-1;
+   }
+   for(i=0;i<n;i++) {
+      j=best_assign[i];
+      if (closest[j]<0 ||
+          dist2(&t->proj[i*PROJ_DIMS], &best_centers[j*PROJ_DIMS]) <
+          dist2(&t->proj[closest[j]*PROJ_DIMS], &best_centers[j*PROJ_DIMS])) {
+         closest[j]=i;
+      }
+   }
+
+      /* the SimPoint utility's .simpoints and .weights formats */
+   thread_file_name(temp_string, simpoint_out_file, thread_num);
+   sp_fp=open_file(temp_string, "simpoint");
+   VG_(strcat)(temp_string, ".weights");
+   w_fp=open_file(temp_string, "simpoint");
+
+   cluster=0;
+   for(j=0;j<chosen_k;j++) {
+      if (sizes[j]==0) continue;
+      VG_(fprintf)(sp_fp, "%d %d\n", closest[j], cluster);
+      VG_(fprintf)(w_fp, "%f %d\n", (Double)sizes[j]/n, cluster);
+      cluster++;
+   }
+   VG_(fclose)(sp_fp);
+   VG_(fclose)(w_fp);
+
+   VG_(umsg)("Thread %d: %d SimPoints for %d intervals\n",
+             thread_num, cluster, n);
+
+   VG_(free)(assign);
+   VG_(free)(best_assign);
+   VG_(free)(sizes);
+   VG_(free)(closest);
+   VG_(free)(centers);
+   VG_(free)(best_centers);
+   VG_(free)(bics);
+   VG_(free)(best_seeds);
+   if (pts != t->proj) {
+      VG_(free)(pts);
+   }
+}
+
+
 /*--------------------------------------------------------------------*/
 /*--- Setup                                                        ---*/
 /*--------------------------------------------------------------------*/
@@ -513,6 +986,10 @@ static void bbv_post_clo_init(void)
 {
    bb_out_file =
           VG_(expand_file_name)("--bb-out-file", clo_bb_out_file);
+   if (clo_simpoints > 0) {
+      simpoint_out_file =
+          VG_(expand_file_name)("--simpoint-out-file", clo_simpoint_out_file);
+   }
 
       /* Try a closer approximation of basic blocks  */
       /* This is the same as the command line option */
@@ -529,6 +1006,10 @@ static Bool bbv_process_cmd_line_option(const HChar* arg)
       generate_pc_file = True;
    }
    else if VG_BOOL_CLO (arg, "--instr-count-only", instr_count_only) {}
+   else if VG_XACT_CLO (arg, "--bb-out-format=text",   binary_output, False) {}
+   else if VG_XACT_CLO (arg, "--bb-out-format=binary", binary_output, True) {}
+   else if VG_BINT_CLO (arg, "--simpoints",        clo_simpoints, 0, 100) {}
+   else if VG_STR_CLO  (arg, "--simpoint-out-file", clo_simpoint_out_file) {}
    else {
       return False;
    }
@@ -543,6 +1024,10 @@ static void bbv_print_usage(void)
 "   --pc-out-file=<file>       filename for BB addresses and function names\n"
 "   --interval-size=<num>      interval size\n"
 "   --instr-count-only=yes|no  only print total instruction count\n"
+"   --bb-out-format=text|binary  format of the BBV file [text]\n"
+"   --simpoints=<num>          choose up to <num> SimPoints per thread [0]\n"
+"   --simpoint-out-file=<file> filename for SimPoints, and weights in\n"
+"                              <file>.weights [simpoints.out.%%p]\n"
    );
 }
 
@@ -581,13 +1066,26 @@ static void bbv_fini(Int exitcode)
             /* Print results to display */
          VG_(umsg)("%s\n", buf);
 
-            /* open the output file if it hasn't already */
-         if (bbv_thread[i].bbtrace_fp == NULL) {
-            bbv_thread[i].bbtrace_fp=open_tracefile(i);
+         if (binary_output) {
+            if (bbv_thread[i].out_buf == NULL) {
+               open_binary_tracefile(i);
+            }
+            flush_binary(&bbv_thread[i]);
+            VG_(close)(bbv_thread[i].bbtrace_fd);
+         }
+         else {
+               /* open the output file if it hasn't already */
+            if (bbv_thread[i].bbtrace_fp == NULL) {
+               bbv_thread[i].bbtrace_fp=open_tracefile(i);
+            }
+               /* Also print to results file */
+            VG_(fprintf)(bbv_thread[i].bbtrace_fp, "%s", buf);
+            VG_(fclose)(bbv_thread[i].bbtrace_fp);
+         }
+
+         if (clo_simpoints > 0 && bbv_thread[i].n_intervals > 0) {
+            write_simpoints(i);
          }
-            /* Also print to results file */
-         VG_(fprintf)(bbv_thread[i].bbtrace_fp, "%s", buf);
-         VG_(fclose)(bbv_thread[i].bbtrace_fp);
       }
    }
 }
@@ -612,9 +1110,7 @@ static void bbv_pre_clo_init(void)
    VG_(track_start_client_code)( bbv_thread_called );
 
 
-   instr_info_table = VG_(OSetGen_Create)(/*keyOff*/0,
-                                          NULL,
-                                          VG_(malloc), "bbv.1", VG_(free));
+   instr_info_table = VG_(HT_construct)("bbv.1");
 
    bbv_thread=allocate_new_thread(bbv_thread,0,allocated_threads);
 }
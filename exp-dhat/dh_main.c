@@ -38,6 +38,7 @@
 #include "pub_tool_mallocfree.h"
 #include "pub_tool_options.h"
 #include "pub_tool_replacemalloc.h"
+#include "pub_tool_threadstate.h"  // VG_(get_running_tid)
 #include "pub_tool_tooliface.h"
 #include "pub_tool_wordfm.h"
 
@@ -62,11 +63,34 @@ static ULong g_cur_bytes_live  = 0; // curr # bytes live
 static ULong g_max_blocks_live = 0; // bytes and blocks at
 static ULong g_max_bytes_live  = 0; // the max residency point
 
+// --line-sample: count accesses per cache line for 1 in this many blocks
+// of each allocation point.  0 means never.
+static Int clo_line_sample = 0;
+
 
 //------------------------------------------------------------//
-//--- an Interval Tree of live blocks                      ---//
+//--- a page index of live blocks                          ---//
 //------------------------------------------------------------//
 
+#define LINE_BITS  6
+#define LINE_SZB   (1 << LINE_BITS)
+/* Only the first LINE_LIMIT lines of a block are counted. */
+#define LINE_LIMIT 1024
+
+/* Access counts for one line of a sampled block.  Lines are LINE_SZB
+   byte chunks counted from the first byte of the block, so that line N
+   covers the same fields in every block of an allocation point.  They
+   match the hardware cache lines only if the block is line aligned. */
+typedef
+   struct {
+      UInt   n_reads;   /* accesses, latching at 0xFFFFFFFF */
+      UInt   n_writes;
+      UInt   tset;      /* accessing threads, as a set of (tid % 32) */
+      UShort writer;    /* first thread writing the line, or 0 */
+      Bool   multi_writer;  /* written by more than one thread */
+   }
+   LineInfo;
+
 /* Tracks information about live blocks. */
 typedef
    struct {
@@ -80,87 +104,296 @@ typedef
          therefore at 0xFFFF.  Can be NULL if the block is resized or if
          the block is larger than HISTOGRAM_SIZE_LIMIT. */
       UShort*     histoW; /* [0 .. req_szB-1] */
+      /* Per cache line access counts, if the block is sampled (see
+         --line-sample).  NULL otherwise, or once the block is resized. */
+      LineInfo*   lines;  /* [0 .. n_lines-1] */
+      UInt        n_lines;
    }
    Block;
 
-/* May not contain zero-sized blocks.  May not contain
-   overlapping blocks. */
-static WordFM* interval_tree = NULL;  /* WordFM* Block* void */
+/* Every memory access has to be attributed to the block containing it,
+   if any, so the lookup must be cheap.  Live blocks are indexed by the
+   pages they overlap, in a two-level table like memcheck's primary
+   map: the primary map points to leaves of LEAF_PAGES page slots, and
+   leaves for addresses above the primary map are in an auxiliary FM.
+
+   A page slot is
+   - 0 if no block overlaps the page,
+   - a Block* if exactly one block overlaps the page (always the case
+     for the inner pages of a big block),
+   - a PageBlocks* with bit 0 set if several blocks overlap the page.
+   Blocks don't overlap, so the PageBlocks are sorted by payload, and
+   the block containing an address is the last one starting at or
+   below it, if it extends that far.
+
+   Primary map entries without any blocks point to a shared all-zero
+   leaf, so a lookup never needs to check for a missing leaf.  The
+   index is updated on each malloc/free/realloc, in time proportional
+   to the number of pages of the block. */
+
+#define PAGE_BITS     12
+#define LEAF_BITS     10
+#define LEAF_PAGES    (1 << LEAF_BITS)
+#define LEAF_MASK     (LEAF_PAGES - 1)
+#define LEAF_SHIFT    (PAGE_BITS + LEAF_BITS)
+#if VG_WORDSIZE == 4
+#  define PRIMARY_BITS  (32 - LEAF_SHIFT)   /* all of the address space */
+#else
+#  define PRIMARY_BITS  14                  /* the lowest 64GB */
+#endif
+#define PRIMARY_SIZE  (1 << PRIMARY_BITS)
+
+typedef
+   struct {
+      UWord slot[LEAF_PAGES];
+   }
+   Leaf;
+
+typedef
+   struct {
+      UInt   n_blocks;
+      UInt   size;  /* entries allocated in blocks[] */
+      Block* blocks[];
+   }
+   PageBlocks;
 
-/* Here's the comparison function.  Since the tree is required
-to contain non-zero sized, non-overlapping blocks, it's good
-enough to consider any overlap as a match. */
-static Word interval_tree_Cmp ( UWord k1, UWord k2 )
+#define IS_PAGE_BLOCKS(slot)  (((slot) & 1) != 0)
+#define PAGE_BLOCKS(slot)     ((PageBlocks*)((slot) & ~(UWord)1))
+
+static Leaf    empty_leaf;
+static Leaf*   primary_map[PRIMARY_SIZE];
+static WordFM* aux_leaves = NULL;  /* WordFM* leaf number Leaf* */
+
+// 1-entry cache for the auxiliary leaves
+static UWord aux_cache_leafno = 0;
+static Leaf* aux_cache_leaf   = NULL;
+
+static UWord stats__n_fBc_single = 0;
+static UWord stats__n_fBc_shared = 0;
+static UWord stats__n_fBc_notfound = 0;
+static UWord stats__n_leaves = 0;
+static UWord stats__n_shared_pages = 0;
+
+static Leaf* new_leaf ( void )
 {
-   Block* b1 = (Block*)k1;
-   Block* b2 = (Block*)k2;
-   tl_assert(b1->req_szB > 0);
-   tl_assert(b2->req_szB > 0);
-   if (b1->payload + b1->req_szB <= b2->payload) return -1;
-   if (b2->payload + b2->req_szB <= b1->payload) return  1;
-   return 0;
+   Leaf* leaf = VG_(malloc)("dh.main.new_leaf.1", sizeof(Leaf));
+   VG_(memset)(leaf, 0, sizeof(Leaf));
+   stats__n_leaves++;
+   return leaf;
 }
 
-// 2-entry cache for find_Block_containing
-static Block* fbc_cache0 = NULL;
-static Block* fbc_cache1 = NULL;
+static Leaf* get_aux_leaf ( UWord leafno, Bool for_update )
+{
+   UWord keyW, valW;
+   Leaf* leaf;
+
+   if (aux_cache_leaf && aux_cache_leafno == leafno)
+      return aux_cache_leaf;
+   if (VG_(lookupFM)( aux_leaves, &keyW, &valW, leafno )) {
+      leaf = (Leaf*)valW;
+   } else if (for_update) {
+      leaf = new_leaf();
+      VG_(addToFM)( aux_leaves, leafno, (UWord)leaf );
+   } else {
+      return &empty_leaf;
+   }
+   aux_cache_leafno = leafno;
+   aux_cache_leaf   = leaf;
+   return leaf;
+}
 
-static UWord stats__n_fBc_cached = 0;
-static UWord stats__n_fBc_uncached = 0;
-static UWord stats__n_fBc_notfound = 0;
+static inline Leaf* get_leaf ( Addr a )
+{
+   UWord leafno = a >> LEAF_SHIFT;
+   if (LIKELY(leafno < PRIMARY_SIZE))
+      return primary_map[leafno];
+   return get_aux_leaf( leafno, False );
+}
+
+static UWord* get_slot_for_update ( Addr a )
+{
+   UWord leafno = a >> LEAF_SHIFT;
+   Leaf* leaf;
+   if (leafno < PRIMARY_SIZE) {
+      if (primary_map[leafno] == &empty_leaf)
+         primary_map[leafno] = new_leaf();
+      leaf = primary_map[leafno];
+   } else {
+      leaf = get_aux_leaf( leafno, True );
+   }
+   return &leaf->slot[(a >> PAGE_BITS) & LEAF_MASK];
+}
+
+// Index of the last block in pb starting at or below a, or -1.
+static Int find_in_PageBlocks ( const PageBlocks* pb, Addr a )
+{
+   Int lo = 0, hi = pb->n_blocks;
+   while (lo < hi) {
+      Int mid = (lo + hi) / 2;
+      if (pb->blocks[mid]->payload <= a)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   return lo - 1;
+}
 
 static Block* find_Block_containing ( Addr a )
 {
-   if (LIKELY(fbc_cache0
-              && fbc_cache0->payload <= a 
-              && a < fbc_cache0->payload + fbc_cache0->req_szB)) {
-      // found at 0
-      stats__n_fBc_cached++;
-      return fbc_cache0;
-   }
-   if (LIKELY(fbc_cache1
-              && fbc_cache1->payload <= a 
-              && a < fbc_cache1->payload + fbc_cache1->req_szB)) {
-      // found at 1; swap 0 and 1
-      Block* tmp = fbc_cache0;
-      fbc_cache0 = fbc_cache1;
-      fbc_cache1 = tmp;
-      stats__n_fBc_cached++;
-      return fbc_cache0;
-   }
-   Block fake;
-   fake.payload = a;
-   fake.req_szB = 1;
-   UWord foundkey = 1;
-   UWord foundval = 1;
-   Bool found = VG_(lookupFM)( interval_tree,
-                               &foundkey, &foundval, (UWord)&fake );
-   if (!found) {
-      stats__n_fBc_notfound++;
-      return NULL;
+   UWord  slot = get_leaf(a)->slot[(a >> PAGE_BITS) & LEAF_MASK];
+   Block* bk;
+
+   if (LIKELY(!IS_PAGE_BLOCKS(slot))) {
+      bk = (Block*)slot;
+      if (LIKELY(bk && bk->payload <= a && a < bk->payload + bk->req_szB)) {
+         stats__n_fBc_single++;
+         return bk;
+      }
+   } else {
+      PageBlocks* pb = PAGE_BLOCKS(slot);
+      Int i = find_in_PageBlocks(pb, a);
+      if (i >= 0) {
+         bk = pb->blocks[i];
+         if (a < bk->payload + bk->req_szB) {
+            stats__n_fBc_shared++;
+            return bk;
+         }
+      }
    }
-   tl_assert(foundval == 0); // we don't store vals in the interval tree
-   tl_assert(foundkey != 1);
-   Block* res = (Block*)foundkey;
-   tl_assert(res != &fake);
-   // put at the top position
-   fbc_cache1 = fbc_cache0;
-   fbc_cache0 = res;
-   stats__n_fBc_uncached++;
-   return res;
+   stats__n_fBc_notfound++;
+   return NULL;
 }
 
-// delete a block; asserts if not found.  (viz, 'a' must be
-// known to be present.)
-static void delete_Block_starting_at ( Addr a )
+static void add_Block_to_page ( UWord* slotP, Block* bk )
 {
-   Block fake;
-   fake.payload = a;
-   fake.req_szB = 1;
-   Bool found = VG_(delFromFM)( interval_tree,
-                                NULL, NULL, (Addr)&fake );
-   tl_assert(found);
-   fbc_cache0 = fbc_cache1 = NULL;
+   PageBlocks* pb;
+   Int i;
+
+   if (*slotP == 0) {
+      *slotP = (UWord)bk;
+      return;
+   }
+   if (!IS_PAGE_BLOCKS(*slotP)) {
+      // Second block on this page: switch to a PageBlocks.
+      pb = VG_(malloc)("dh.main.add_Block_to_page.1",
+                       sizeof(PageBlocks) + 4 * sizeof(Block*));
+      pb->n_blocks  = 1;
+      pb->size      = 4;
+      pb->blocks[0] = (Block*)*slotP;
+      stats__n_shared_pages++;
+   } else {
+      pb = PAGE_BLOCKS(*slotP);
+      if (pb->n_blocks == pb->size) {
+         pb->size *= 2;
+         pb = VG_(realloc)("dh.main.add_Block_to_page.2", pb,
+                           sizeof(PageBlocks) + pb->size * sizeof(Block*));
+      }
+   }
+   i = find_in_PageBlocks(pb, bk->payload) + 1;
+   VG_(memmove)(&pb->blocks[i+1], &pb->blocks[i],
+                (pb->n_blocks - i) * sizeof(Block*));
+   pb->blocks[i] = bk;
+   pb->n_blocks++;
+   *slotP = (UWord)pb | 1;
+}
+
+static void remove_Block_from_page ( UWord* slotP, Block* bk )
+{
+   PageBlocks* pb;
+   Int i;
+
+   if (!IS_PAGE_BLOCKS(*slotP)) {
+      tl_assert(*slotP == (UWord)bk);
+      *slotP = 0;
+      return;
+   }
+   pb = PAGE_BLOCKS(*slotP);
+   i = find_in_PageBlocks(pb, bk->payload);
+   tl_assert(i >= 0 && pb->blocks[i] == bk);
+   pb->n_blocks--;
+   VG_(memmove)(&pb->blocks[i], &pb->blocks[i+1],
+                (pb->n_blocks - i) * sizeof(Block*));
+   if (pb->n_blocks == 1) {
+      // Back to a single block on this page.
+      *slotP = (UWord)pb->blocks[0];
+      VG_(free)(pb);
+      stats__n_shared_pages--;
+   }
+}
+
+#define FIRST_PAGE(bk)  ((bk)->payload >> PAGE_BITS)
+#define LAST_PAGE(bk)   (((bk)->payload + (bk)->req_szB - 1) >> PAGE_BITS)
+
+// Add bk to, or remove it from, the pages firstPage .. lastPage.
+static void index_Block_pages ( Block* bk, Addr firstPage, Addr lastPage,
+                                Bool add )
+{
+   Addr page;
+   for (page = firstPage; page <= lastPage; page++) {
+      UWord* slotP = get_slot_for_update(page << PAGE_BITS);
+      if (add)
+         add_Block_to_page(slotP, bk);
+      else
+         remove_Block_from_page(slotP, bk);
+   }
+}
+
+/* May not contain zero-sized blocks.  May not contain
+   overlapping blocks. */
+static void add_Block ( Block* bk )
+{
+   tl_assert(bk->req_szB > 0);
+   index_Block_pages(bk, FIRST_PAGE(bk), LAST_PAGE(bk), True/*add*/);
+}
+
+static void delete_Block ( Block* bk )
+{
+   index_Block_pages(bk, FIRST_PAGE(bk), LAST_PAGE(bk), False/*!add*/);
+}
+
+// Call f for each block in leaf number leafno, once per block.
+static void forall_Blocks_in_Leaf ( Leaf* leaf, UWord leafno,
+                                    void (*f)(Block*) )
+{
+   UWord i, j;
+   for (i = 0; i < LEAF_PAGES; i++) {
+      UWord slot = leaf->slot[i];
+      Addr  page = (leafno << LEAF_BITS) + i;
+      // Visit each block only from the page holding its start.
+      if (!IS_PAGE_BLOCKS(slot)) {
+         Block* bk = (Block*)slot;
+         if (bk && FIRST_PAGE(bk) == page)
+            f(bk);
+      } else {
+         PageBlocks* pb = PAGE_BLOCKS(slot);
+         for (j = 0; j < pb->n_blocks; j++)
+            if (FIRST_PAGE(pb->blocks[j]) == page)
+               f(pb->blocks[j]);
+      }
+   }
+}
+
+static void forall_Blocks ( void (*f)(Block*) )
+{
+   UWord leafno, keyW, valW;
+   for (leafno = 0; leafno < PRIMARY_SIZE; leafno++)
+      if (primary_map[leafno] != &empty_leaf)
+         forall_Blocks_in_Leaf(primary_map[leafno], leafno, f);
+   VG_(initIterFM)( aux_leaves );
+   while (VG_(nextIterFM)( aux_leaves, &keyW, &valW ))
+      forall_Blocks_in_Leaf((Leaf*)valW, keyW, f);
+   VG_(doneIterFM)( aux_leaves );
+}
+
+static void init_Block_index ( void )
+{
+   UWord i;
+   for (i = 0; i < PRIMARY_SIZE; i++)
+      primary_map[i] = &empty_leaf;
+   aux_leaves = VG_(newFM)( VG_(malloc),
+                            "dh.main.aux_leaves.1",
+                            VG_(free),
+                            NULL/*unboxedcmp*/ );
 }
 
 
@@ -168,6 +401,20 @@ static void delete_Block_starting_at ( Addr a )
 //--- a FM of allocation points (APs)                      ---//
 //------------------------------------------------------------//
 
+/* Access counts for one cache line, summed over the sampled blocks of
+   an allocation point. */
+typedef
+   struct {
+      ULong n_reads;
+      ULong n_writes;
+      UInt  tset;            /* union of the blocks' thread sets */
+      UInt  n_blocks;        /* nr of blocks long enough to have
+                                the line */
+      UInt  n_multi_writer;  /* nr of blocks in which more than one
+                                thread wrote the line */
+   }
+   APLine;
+
 typedef
    struct {
       // the allocation point that we're summarising stats for
@@ -210,6 +457,14 @@ typedef
       enum { Unknown=999, Exactly, Mixed } xsize_tag;
       SizeT xsize;
       UInt* histo; /* [0 .. xsize-1] */
+      /* Per line access counts of the sampled blocks folded in so far
+         (see --line-sample).  n_lines is that of the longest such
+         block; lines[i].n_blocks says how many blocks line i is
+         summed over. */
+      ULong   line_blocks;     /* nr of sampled blocks folded in */
+      ULong   line_unaligned;  /* ... of which not LINE_SZB aligned */
+      UInt    n_lines;
+      APLine* lines;           /* [0 .. n_lines-1] */
    }
    APInfo;
 
@@ -218,6 +473,53 @@ typedef
 static WordFM* apinfo = NULL;  /* WordFM* ExeContext* APInfo* */
 
 
+static void alloc_Block_lines ( Block* bk )
+{
+   SizeT n_lines = (bk->req_szB + LINE_SZB - 1) >> LINE_BITS;
+   if (n_lines == 0)
+      n_lines = 1;
+   if (n_lines > LINE_LIMIT)
+      n_lines = LINE_LIMIT;
+   bk->n_lines = n_lines;
+   bk->lines = VG_(malloc)("dh.main.alloc_Block_lines.1",
+                           bk->n_lines * sizeof(LineInfo));
+   VG_(memset)(bk->lines, 0, bk->n_lines * sizeof(LineInfo));
+}
+
+/* Add the per line counts of 'bk' to those of its AP, and stop
+   counting per line for 'bk'. */
+static void fold_Block_lines ( APInfo* api, Block* bk )
+{
+   UInt i;
+
+   if (!bk->lines)
+      return;
+
+   if (bk->n_lines > api->n_lines) {
+      api->lines = VG_(realloc)("dh.main.fold_Block_lines.1", api->lines,
+                                bk->n_lines * sizeof(APLine));
+      VG_(memset)(&api->lines[api->n_lines], 0,
+                  (bk->n_lines - api->n_lines) * sizeof(APLine));
+      api->n_lines = bk->n_lines;
+   }
+   for (i = 0; i < bk->n_lines; i++) {
+      api->lines[i].n_reads  += bk->lines[i].n_reads;
+      api->lines[i].n_writes += bk->lines[i].n_writes;
+      api->lines[i].tset     |= bk->lines[i].tset;
+      api->lines[i].n_blocks++;
+      if (bk->lines[i].multi_writer)
+         api->lines[i].n_multi_writer++;
+   }
+   api->line_blocks++;
+   if (bk->payload & (LINE_SZB - 1))
+      api->line_unaligned++;
+
+   VG_(free)(bk->lines);
+   bk->lines   = NULL;
+   bk->n_lines = 0;
+}
+
+
 /* 'bk' is being introduced (has just been allocated).  Find the
    relevant APInfo entry for it, or create one, based on the block's
    allocation EC.  Then, update the APInfo to the extent that we
@@ -267,6 +569,10 @@ static void intro_Block ( Block* bk )
    api->tot_blocks++;
    api->tot_bytes += bk->req_szB;
 
+   // count accesses per line for 1 in clo_line_sample blocks
+   if (clo_line_sample > 0 && (api->tot_blocks - 1) % clo_line_sample == 0)
+      alloc_Block_lines(bk);
+
    // update summary globals
    g_tot_blocks++;
    g_tot_bytes += bk->req_szB;
@@ -330,6 +636,7 @@ static void retire_Block ( Block* bk, Bool because_freed )
    // access counts
    api->n_reads  += bk->n_reads;
    api->n_writes += bk->n_writes;
+   fold_Block_lines(api, bk);
 
    // histo stuff.  First, do state transitions for xsize/xsize_tag.
    switch (api->xsize_tag) {
@@ -457,7 +764,7 @@ void* new_block ( ThreadId tid, void* p, SizeT req_szB, SizeT req_alignB,
    if ((SSizeT)req_szB < 0) return NULL;
 
    if (req_szB == 0)
-      req_szB = 1;  /* can't allow zero-sized blocks in the interval tree */
+      req_szB = 1;  /* can't allow zero-sized blocks in the block index */
 
    // Allocate and zero if necessary
    if (!p) {
@@ -481,6 +788,8 @@ void* new_block ( ThreadId tid, void* p, SizeT req_szB, SizeT req_alignB,
    bk->allocd_at = g_guest_instrs_executed;
    bk->n_reads   = 0;
    bk->n_writes  = 0;
+   bk->lines     = NULL;  // set up by intro_Block, if sampled
+   bk->n_lines   = 0;
    // set up histogram array, if the block isn't too large
    bk->histoW = NULL;
    if (req_szB <= HISTOGRAM_SIZE_LIMIT) {
@@ -488,9 +797,7 @@ void* new_block ( ThreadId tid, void* p, SizeT req_szB, SizeT req_alignB,
       VG_(memset)(bk->histoW, 0, req_szB * sizeof(UShort));
    }
 
-   Bool present = VG_(addToFM)( interval_tree, (UWord)bk, (UWord)0/*no val*/);
-   tl_assert(!present);
-   fbc_cache0 = fbc_cache1 = NULL;
+   add_Block(bk);
 
    intro_Block(bk);
 
@@ -525,7 +832,7 @@ void die_block ( void* p, Bool custom_free )
    retire_Block(bk, True/*because_freed*/);
 
    VG_(cli_free)( (void*)bk->payload );
-   delete_Block_starting_at( bk->payload );
+   delete_Block(bk);
    if (bk->histoW) {
       VG_(free)( bk->histoW );
       bk->histoW = NULL;
@@ -563,14 +870,26 @@ void* renew_block ( ThreadId tid, void* p_old, SizeT new_req_szB )
       VG_(free)(bk->histoW);
       bk->histoW = NULL;
    }
+   // Same for the per line counts, but keep those collected so far.
+   if (bk->lines) {
+      UWord keyW, valW;
+      Bool found = VG_(lookupFM)( apinfo, &keyW, &valW, (UWord)bk->ap );
+      tl_assert(found);
+      fold_Block_lines( (APInfo*)valW, bk );
+   }
 
    // Actually do the allocation, if necessary.
    if (new_req_szB <= bk->req_szB) {
 
-      // New size is smaller or same; block not moved.
+      // New size is smaller or same; block not moved.  Drop it from
+      // the pages it no longer overlaps.
+      Addr old_last_page = LAST_PAGE(bk);
       apinfo_change_cur_bytes_live(bk->ap,
                                    (Long)new_req_szB - (Long)bk->req_szB);
       bk->req_szB = new_req_szB;
+      if (LAST_PAGE(bk) < old_last_page)
+         index_Block_pages(bk, LAST_PAGE(bk) + 1, old_last_page,
+                           False/*!add*/);
       return p_old;
 
    } else {
@@ -588,10 +907,10 @@ void* renew_block ( ThreadId tid, void* p_old, SizeT new_req_szB )
       VG_(cli_free)(p_old);
 
       // Since the block has moved, we need to re-insert it into the
-      // interval tree at the new place.  Do this by removing
+      // block index at the new place.  Do this by removing
       // and re-adding it.
-      delete_Block_starting_at( (Addr)p_old );
-      // now 'bk' is no longer in the tree, but the Block itself
+      delete_Block(bk);
+      // now 'bk' is no longer in the index, but the Block itself
       // is still alive
 
       // Update the metadata.
@@ -601,10 +920,7 @@ void* renew_block ( ThreadId tid, void* p_old, SizeT new_req_szB )
       bk->req_szB = new_req_szB;
 
       // and re-add
-      Bool present
-         = VG_(addToFM)( interval_tree, (UWord)bk, (UWord)0/*no val*/); 
-      tl_assert(!present);
-      fbc_cache0 = fbc_cache1 = NULL;
+      add_Block(bk);
 
       return p_new;
    }
@@ -697,6 +1013,32 @@ void inc_histo_for_block ( Block* bk, Addr addr, UWord szB )
    }
 }
 
+static
+void inc_lines_for_block ( Block* bk, Addr addr, UWord szB, Bool isWrite )
+{
+   ThreadId tid = VG_(get_running_tid)();
+   UWord i, lineMin, lineMax1;
+   if (szB == 0)
+      return;
+   lineMin  = (addr - bk->payload) >> LINE_BITS;
+   lineMax1 = ((addr + szB - 1 - bk->payload) >> LINE_BITS) + 1;
+   if (lineMax1 > bk->n_lines)
+      lineMax1 = bk->n_lines;
+   for (i = lineMin; i < lineMax1; i++) {
+      LineInfo* li = &bk->lines[i];
+      li->tset |= 1U << (tid % 32);
+      if (isWrite) {
+         if (li->n_writes < 0xFFFFFFFF) li->n_writes++;
+         if (li->writer == 0)
+            li->writer = (UShort)tid;
+         else if (li->writer != (UShort)tid)
+            li->multi_writer = True;
+      } else {
+         if (li->n_reads < 0xFFFFFFFF) li->n_reads++;
+      }
+   }
+}
+
 static VG_REGPARM(2)
 void dh_handle_write ( Addr addr, UWord szB )
 {
@@ -705,6 +1047,8 @@ void dh_handle_write ( Addr addr, UWord szB )
       bk->n_writes += szB;
       if (bk->histoW)
          inc_histo_for_block(bk, addr, szB);
+      if (bk->lines)
+         inc_lines_for_block(bk, addr, szB, True/*isWrite*/);
    }
 }
 
@@ -716,6 +1060,8 @@ void dh_handle_read ( Addr addr, UWord szB )
       bk->n_reads += szB;
       if (bk->histoW)
          inc_histo_for_block(bk, addr, szB);
+      if (bk->lines)
+         inc_lines_for_block(bk, addr, szB, False/*!isWrite*/);
    }
 }
 
@@ -1039,6 +1385,8 @@ static Bool dh_process_cmd_line_option(const HChar* arg)
 {
    if VG_BINT_CLO(arg, "--show-top-n", clo_show_top_n, 1, 100000) {}
 
+   else if VG_BINT_CLO(arg, "--line-sample", clo_line_sample, 0, 1000000) {}
+
    else if VG_STR_CLO(arg, "--sort-by", clo_sort_by) {
        ULong (*dummyFn)(APInfo*);
        Bool dummyB;
@@ -1068,6 +1416,8 @@ static void dh_print_usage(void)
 "                tot-bytes-allocd  bytes allocated in total (turnover)\n"
 "                max-blocks-live   maximum live blocks\n"
 "                tot-blocks-allocd blocks allocated in total (turnover)\n"
+"    --line-sample=<N>         count accesses per 64-byte cache line in 1\n"
+"                              of every N blocks of each alloc point [0=never]\n"
    );
 }
 
@@ -1092,6 +1442,76 @@ static void show_N_div_100( /*OUT*/HChar* buf, ULong n )
                 nR);
 }
 
+static UInt n_threads_in_tset ( UInt tset )
+{
+   UInt n = 0;
+   for ( ; tset != 0; tset &= tset - 1)
+      n++;
+   return n;
+}
+
+#define N_HOT_LINES 5
+
+static void show_APInfo_lines ( APInfo* api )
+{
+   UInt  hot[N_HOT_LINES];
+   UInt  n_hot = 0, n_multi = 0;
+   UInt  i, j;
+   Int   last_used = -1;
+
+   // Pick the N_HOT_LINES most accessed lines, and the last accessed one.
+   for (i = 0; i < api->n_lines; i++) {
+      ULong acc = api->lines[i].n_reads + api->lines[i].n_writes;
+      if (acc == 0)
+         continue;
+      last_used = i;
+      for (j = n_hot; j > 0; j--) {
+         APLine* l = &api->lines[hot[j-1]];
+         if (l->n_reads + l->n_writes >= acc)
+            break;
+         if (j < N_HOT_LINES)
+            hot[j] = hot[j-1];
+      }
+      if (j < N_HOT_LINES)
+         hot[j] = i;
+      if (n_hot < N_HOT_LINES)
+         n_hot++;
+   }
+
+   VG_(umsg)("\nCache line accesses (%d-byte lines from the block start, "
+             "%'llu sampled blocks, %'llu not %d-byte aligned):\n",
+             LINE_SZB, api->line_blocks, api->line_unaligned, LINE_SZB);
+   VG_(umsg)("\n");
+   if (n_hot == 0) {
+      VG_(umsg)("   none\n");
+      return;
+   }
+   for (i = 0; i < n_hot; i++) {
+      APLine* l = &api->lines[hot[i]];
+      UInt n_thr = n_threads_in_tset(l->tset);
+      VG_(umsg)("%s [%4u]  %'llu rd, %'llu wr, %u thread%s, %'u block%s\n",
+                i == 0 ? "hottest:" : "        ", hot[i],
+                l->n_reads, l->n_writes, n_thr, n_thr == 1 ? "" : "s",
+                l->n_blocks, l->n_blocks == 1 ? "" : "s");
+   }
+   if (last_used + 1 < api->n_lines) {
+      VG_(umsg)("cold tail: lines %d..%u never accessed (%u of %u lines "
+                "of the longest block)\n",
+                last_used + 1, api->n_lines - 1,
+                api->n_lines - 1 - last_used, api->n_lines);
+   }
+   for (i = 0; i < api->n_lines; i++) {
+      if (api->lines[i].n_multi_writer == 0)
+         continue;
+      if (n_multi++ == 0)
+         VG_(umsg)("written by more than one thread "
+                   "(possible false sharing):\n");
+      VG_(umsg)("          [%4u]  in %'u of %'u blocks\n",
+                i, api->lines[i].n_multi_writer, api->lines[i].n_blocks);
+   }
+}
+
+
 static void show_APInfo ( APInfo* api )
 {
    HChar bufA[80];   // large enough
@@ -1163,6 +1583,9 @@ static void show_APInfo ( APInfo* api )
       }
       VG_(umsg)("\n");
    }
+
+   if (api->lines)
+      show_APInfo_lines(api);
 }
 
 
@@ -1274,6 +1697,11 @@ static void show_top_n_apinfos ( void )
 }
 
 
+static void retire_live_Block ( Block* bk )
+{
+   retire_Block(bk, False/*!because_freed*/);
+}
+
 static void dh_fini(Int exit_status)
 {
    // Before printing statistics, we must harvest access counts for
@@ -1281,15 +1709,7 @@ static void dh_fini(Int exit_status)
    // access ratios which are too low (zero, in the worst case)
    // for such blocks, since the accesses that do get made will
    // (if we skip this step) not get folded into the AP summaries.
-   UWord keyW, valW;
-   VG_(initIterFM)( interval_tree );
-   while (VG_(nextIterFM)( interval_tree, &keyW, &valW )) {
-      Block* bk = (Block*)keyW;
-      tl_assert(valW == 0);
-      tl_assert(bk);
-      retire_Block(bk, False/*!because_freed*/);
-   }
-   VG_(doneIterFM)( interval_tree );
+   forall_Blocks(retire_live_Block);
 
    // show results
    VG_(umsg)("======== SUMMARY STATISTICS ========\n");
@@ -1333,11 +1753,13 @@ static void dh_fini(Int exit_status)
 
    if (VG_(clo_stats)) {
       VG_(dmsg)(" dhat: find_Block_containing:\n");
-      VG_(dmsg)("             found: %'lu (%'lu cached + %'lu uncached)\n",
-                stats__n_fBc_cached + stats__n_fBc_uncached,
-                stats__n_fBc_cached,
-                stats__n_fBc_uncached);
+      VG_(dmsg)("             found: %'lu (%'lu single + %'lu shared page)\n",
+                stats__n_fBc_single + stats__n_fBc_shared,
+                stats__n_fBc_single,
+                stats__n_fBc_shared);
       VG_(dmsg)("          notfound: %'lu\n", stats__n_fBc_notfound);
+      VG_(dmsg)("        page index: %'lu leaves, %'lu shared pages\n",
+                stats__n_leaves, stats__n_shared_pages);
       VG_(dmsg)("\n");
    }
 }
@@ -1390,14 +1812,8 @@ static void dh_pre_clo_init(void)
    //VG_(track_pre_mem_read_asciiz) ( check_mem_is_defined_asciiz );
    VG_(track_post_mem_write)      ( dh_handle_noninsn_write );
 
-   tl_assert(!interval_tree);
-   tl_assert(!fbc_cache0);
-   tl_assert(!fbc_cache1);
-
-   interval_tree = VG_(newFM)( VG_(malloc),
-                               "dh.main.interval_tree.1",
-                               VG_(free),
-                               interval_tree_Cmp );
+   tl_assert(!aux_leaves);
+   init_Block_index();
 
    apinfo = VG_(newFM)( VG_(malloc),
                         "dh.main.apinfo.1",
@@ -134,7 +134,9 @@ typedef
       _VG_USERREQ__HG_PTHREAD_COND_BROADCAST_POST,/* pth_cond_t* */
       _VG_USERREQ__HG_RTLD_BIND_GUARD,            /* int flags */
       _VG_USERREQ__HG_RTLD_BIND_CLEAR,            /* int flags */
-      _VG_USERREQ__HG_GNAT_DEPENDENT_MASTER_JOIN  /* void*d, void*m */
+      _VG_USERREQ__HG_GNAT_DEPENDENT_MASTER_JOIN, /* void*d, void*m */
+      _VG_USERREQ__HG_ARANGE_WATCH,          /* Addr a, ulong len */
+      _VG_USERREQ__HG_ARANGE_UNWATCH         /* Addr a, ulong len */
    } Vg_TCheckClientRequest;
 
 
@@ -399,6 +401,24 @@ typedef
                  unsigned long,(_qzz_len))
 
 
+/* Watch a range of memory.  When Helgrind is run with
+   --watch-only=yes or --watch-sample-pages=N, only accesses to
+   watched ranges (and to sampled pages) are race-checked; accesses
+   elsewhere are skipped entirely, which makes long runs much cheaper.
+   Without those options, this has no effect.  DRD also honours this
+   request. */
+#define VALGRIND_HG_WATCH_RANGE(_qzz_start, _qzz_len)        \
+   DO_CREQ_v_WW(_VG_USERREQ__HG_ARANGE_WATCH,                \
+                 void*,(_qzz_start),                         \
+                 unsigned long,(_qzz_len))
+
+/* Stop watching a range of memory. */
+#define VALGRIND_HG_UNWATCH_RANGE(_qzz_start, _qzz_len)      \
+   DO_CREQ_v_WW(_VG_USERREQ__HG_ARANGE_UNWATCH,              \
+                 void*,(_qzz_start),                         \
+                 unsigned long,(_qzz_len))
+
+
 /*  Checks the accessibility bits for addresses [zza..zza+zznbytes-1].
     If zzabits array is provided, copy the accessibility bits in zzabits.
    Return values:
@@ -84,6 +84,14 @@ Bool  HG_(clo_delta_stacktrace) = False;
 
 UWord HG_(clo_conflict_cache_size) = 2000000;
 
+UWord HG_(clo_history_budget) = 32;
+
+UWord HG_(clo_history_sample_rate) = 16;
+
+UWord HG_(clo_shadow_cache_size) = 65536;
+
+UWord HG_(clo_shadow_cache_ways) = 1;
+
 UWord HG_(clo_sanity_flags) = 0;
 
 Bool  HG_(clo_free_is_write) = False;
@@ -91,6 +99,10 @@ Bool  HG_(clo_free_is_write) = False;
 UWord HG_(clo_vts_pruning) = 1;
 
 Bool  HG_(clo_check_stack_refs) = True;
+Bool  HG_(clo_watch_only) = False;
+UWord HG_(clo_watch_sample_pages) = 0;
+
+Bool  HG_(clo_model_atomics) = False;
 
 /*--------------------------------------------------------------------*/
 /*--- end                                              hg_basics.c ---*/
@@ -90,7 +90,15 @@ extern Bool HG_(clo_cmp_race_err_addrs);
       vector-clock-change boundaries ("dragovers").  This involves
       collecting and storing large numbers of call stacks just in case
       we might need to show them later, and so is expensive (although
-      very useful). */
+      very useful).
+
+   3: "sampled": like "full", but within a fixed memory budget
+      (see HG_(clo_history_budget)).  Only a sample of the accesses
+      of each address range has its stack trace collected, except for
+      addresses which have already been involved in a race, whose
+      accesses are all collected from then on.  The first report of a
+      race may thus lack the conflicting stack, but later reports on
+      the same location will show it. */
 extern UWord HG_(clo_history_level);
 
 /* For full history level, determines how the stack trace is computed.
@@ -109,6 +117,23 @@ extern Bool  HG_(clo_delta_stacktrace);
    amd 10 million.  Default is 1 million. */
 extern UWord HG_(clo_conflict_cache_size);
 
+/* For "sampled" history level, the memory (in MB) that the
+   conflicting-access map (previous accesses and their stack traces)
+   may use, and the sampling rate: one access out of this many (a
+   power of 2) is collected in each address range.  Defaults are 32 MB
+   and 16. */
+extern UWord HG_(clo_history_budget);
+extern UWord HG_(clo_history_sample_rate);
+
+/* Number of lines in the cache of shadow memory (libhb's cache_shmem),
+   and number of ways of each set of the cache.  Both are powers of 2.
+   Default is 65536 lines, direct mapped (1 way).  Bigger and more
+   associative caches reduce the line fetches and writebacks for
+   programs with big working sets, at the price of memory and of a
+   slower miss handling. */
+extern UWord HG_(clo_shadow_cache_size);
+extern UWord HG_(clo_shadow_cache_ways);
+
 /* Sanity check level.  This is an or-ing of
    SCE_{THREADS,LOCKS,BIGRANGE,ACCESS,LAOG}. */
 extern UWord HG_(clo_sanity_flags);
@@ -136,6 +161,19 @@ extern UWord HG_(clo_vts_pruning);
    the stack, which speeds things up a bit.  Default: True. */
 extern Bool HG_(clo_check_stack_refs); 
 
+/* When True, only accesses to the address ranges given to
+   VALGRIND_HG_WATCH_RANGE are race-checked.  When nonzero, a
+   power of 2 N, accesses to a pseudo-randomly chosen 1 in N of the
+   pages are race-checked too, and --watch-only=yes is implied.
+   Defaults: False and 0. */
+extern Bool  HG_(clo_watch_only);
+extern UWord HG_(clo_watch_sample_pages);
+
+/* When True, atomic read-modify-write instructions (CAS, LL/SC) are
+   not race-checked, but treated as an acquire and, if they succeed, a
+   release on the accessed location.  Default: False. */
+extern Bool HG_(clo_model_atomics);
+
 #endif /* ! __HG_BASICS_H */
 
 /*--------------------------------------------------------------------*/
@@ -457,6 +457,12 @@ UInt HG_(update_extra) ( const Error* err )
                     conf_locksHeldW,
                     True/*allowed_to_be_invalid*/
                  );
+            /* At history level 3, the conflicting segment bounds
+               were also collected; the exact access supersedes
+               them. */
+            xe->XE.Race.h1_ct              = NULL;
+            xe->XE.Race.h1_ct_mbsegstartEC = NULL;
+            xe->XE.Race.h1_ct_mbsegendEC   = NULL;
         }
       }
 
@@ -78,6 +78,9 @@ typedef  UInt         ThrID;
    The core may later re-use the same ThreadId for what is a logically
    completely different thread, which of course must have a different
    Thread structure. */
+/* Number of entries in Thread.laog_cache.  Must be a power of 2. */
+#define HG_LAOG_CACHE_SIZE 4
+
 typedef
    struct _Thread {
       /* ADMIN */
@@ -119,6 +122,16 @@ typedef
          --ignore-thread-creation. */
       Int synchr_nesting;
 
+      /* Lock acquisitions already checked against the lock order
+         graph, so that a thread repeatedly taking the same lock with
+         the same set of locks held need not redo the graph search.
+         See laog__pre_thread_acquires_lock. */
+      struct {
+         struct _Lock* lk;
+         WordSetID     locksetA;
+         UInt          laog_gen;
+      } laog_cache[HG_LAOG_CACHE_SIZE];
+
 #if defined(VGO_solaris)
       Int      bind_guard_flag; /* Bind flag from the runtime linker. */
 #endif /* VGO_solaris */
@@ -59,6 +59,7 @@
 #include "pub_tool_addrinfo.h"
 #include "pub_tool_xtree.h"
 #include "pub_tool_xtmemory.h"
+#include "pub_tool_rangemap.h"
 
 #include "hg_basics.h"
 #include "hg_wordset.h"
@@ -2048,6 +2049,105 @@ void evh__mem_help_cwrite_N(Addr a, SizeT size) {
 }
 
 
+/* ------------------------------------------------------- */
+/* -------------- watched address ranges ----------------- */
+/* ------------------------------------------------------- */
+
+/* With --watch-only=yes or --watch-sample-pages=N, only accesses to
+   ranges given to VALGRIND_HG_WATCH_RANGE, and to a pseudo-random 1
+   in N of the pages, are race-checked.  The instrumented code filters
+   accesses inline: it tests whether the address is in
+   [watch_lo, watch_lo + watch_szB), the smallest range containing all
+   watched ranges, and whether the page is sampled.  Only then is a
+   helper called, which does the exact check against watched_ranges
+   before updating the shadow state.  Accesses filtered out never reach
+   libhb, so they cost a few instructions each. */
+
+/* Watched ranges are bound to 1, everything else to 0. */
+static RangeMap* watched_ranges = NULL;
+
+/* Loaded by the instrumented code, hence UWords at fixed addresses.
+   watch_szB is zero if nothing is watched. */
+static UWord watch_lo  = 0;
+static UWord watch_szB = 0;
+
+/* log2 of HG_(clo_watch_sample_pages), or zero if not sampling. */
+static UInt watch_sample_bits = 0;
+
+/* A page is sampled if the top watch_sample_bits bits of its number
+   times this (2^64 divided by the golden ratio) are zero. */
+#define WATCH_SAMPLE_MULT  ((UWord)0x9E3779B97F4A7C15ULL)
+#define WATCH_PAGE_SHIFT   12
+
+static inline Bool watch_restricted ( void )
+{
+   return HG_(clo_watch_only) || watch_sample_bits > 0;
+}
+
+static inline Bool watch_page_is_sampled ( Addr a )
+{
+   return watch_sample_bits > 0
+          && (((a >> WATCH_PAGE_SHIFT) * WATCH_SAMPLE_MULT)
+              >> (8 * sizeof(UWord) - watch_sample_bits)) == 0;
+}
+
+static Bool is_watched ( Addr a, SizeT szB )
+{
+   UWord lo, hi, val;
+   if (watch_page_is_sampled(a))
+      return True;
+   if (watch_szB == 0)
+      return False;
+   /* Adjacent ranges with the same value are merged, so the range
+      following an unwatched one is watched. */
+   VG_(lookupRangeMap)(&lo, &hi, &val, watched_ranges, a);
+   return val != 0 || hi < a + szB - 1;
+}
+
+/* Bind [a, a+len) to |val| (1: watch, 0: unwatch) and recompute the
+   range containing all watched ranges. */
+static void watch_set_range ( Addr a, SizeT len, UWord val )
+{
+   UWord lo, hi, v, first, last;
+   UInt  i, n;
+   tl_assert(len > 0);
+   if (watched_ranges == NULL)
+      watched_ranges = VG_(newRangeMap)( HG_(zalloc), "hg.wsr.1",
+                                         HG_(free), 0 );
+   VG_(bindRangeMap)( watched_ranges, a, a + len - 1, val );
+   first = 1;
+   last  = 0;
+   n = VG_(sizeRangeMap)( watched_ranges );
+   for (i = 0; i < n; i++) {
+      VG_(indexRangeMap)( &lo, &hi, &v, watched_ranges, i );
+      if (v == 0)
+         continue;
+      if (first > last)
+         first = lo;
+      last = hi;
+   }
+   if (first > last) {
+      watch_lo  = 0;
+      watch_szB = 0;
+   } else {
+      watch_lo  = first;
+      watch_szB = last - first + 1;
+   }
+}
+
+static VG_REGPARM(2)
+void evh__mem_help_watched_cread_N(Addr a, SizeT size) {
+   if (is_watched(a, size))
+      evh__mem_help_cread_N(a, size);
+}
+
+static VG_REGPARM(2)
+void evh__mem_help_watched_cwrite_N(Addr a, SizeT size) {
+   if (is_watched(a, size))
+      evh__mem_help_cwrite_N(a, size);
+}
+
+
 /* ------------------------------------------------------- */
 /* -------------- events to do with mutexes -------------- */
 /* ------------------------------------------------------- */
@@ -3457,6 +3557,107 @@ void evh__HG_USERSO_FORGET_ALL ( ThreadId tid, UWord usertag )
 }
 
 
+
+/* ----------------------------------------------------- */
+/* ------- events to do with atomic instructions ------- */
+/* ----------------------------------------------------- */
+
+/* With --model-atomics=yes, atomic read-modify-write instructions
+   (CAS and LL/SC) are not race-checked.  Instead an atomic RMW on
+   address A is treated as an acquire on A and, if it succeeded, also
+   as a release on A.  Each such A is bound to an SO.  Releases do a
+   weak send, so the SO accumulates the vector clocks of all threads
+   that ever released on A, much like a C11 release sequence, and
+   acquires do a strong receive from it.  The SOs are freed when the
+   heap block containing A is freed. */
+
+/* Addr -> SO* */
+static WordFM* map_atomic_to_SO = NULL;
+
+static UWord stats__atomic_rmws    = 0;
+static UWord stats__atomic_acquires = 0;
+
+static SO* map_atomic_to_SO_lookup ( Addr a, Bool alloc ) {
+   UWord key, val;
+   if (UNLIKELY(map_atomic_to_SO == NULL)) {
+      if (!alloc)
+         return NULL;
+      map_atomic_to_SO = VG_(newFM)( HG_(zalloc),
+                                     "hg.atoS.1", HG_(free), NULL );
+   }
+   if (VG_(lookupFM)( map_atomic_to_SO, &key, &val, a )) {
+      tl_assert(key == (UWord)a);
+      return (SO*)val;
+   } else if (alloc) {
+      SO* so = libhb_so_alloc();
+      VG_(addToFM)( map_atomic_to_SO, a, (UWord)so );
+      return so;
+   } else {
+      return NULL;
+   }
+}
+
+/* Free the SOs of all atomic locations in [a, a+len). */
+static void map_atomic_to_SO_forget_range ( Addr a, SizeT len ) {
+   UWord keyW, valW;
+   Bool  found;
+   if (map_atomic_to_SO == NULL || VG_(sizeFM)( map_atomic_to_SO ) == 0)
+      return;
+   while (True) {
+      VG_(initIterAtFM)( map_atomic_to_SO, a );
+      found = VG_(nextIterFM)( map_atomic_to_SO, &keyW, &valW );
+      VG_(doneIterFM)( map_atomic_to_SO );
+      if (!found || keyW >= a + len)
+         break;
+      VG_(delFromFM)( map_atomic_to_SO, &keyW, &valW, keyW );
+      libhb_so_dealloc( (SO*)valW );
+   }
+}
+
+/* Called after an atomic CAS on A.  SUCCESS is nonzero if it
+   succeeded, that is, if it actually wrote memory. */
+static VG_REGPARM(2)
+void evh__atomic_rmw ( Addr a, UWord success )
+{
+   Thread* thr = get_current_Thread_in_C_C();
+   SO*     so;
+   if (UNLIKELY(thr->synchr_nesting > 0))
+      return;
+   stats__atomic_rmws++;
+   so = map_atomic_to_SO_lookup( a, success != 0 );
+   if (so == NULL)
+      return; /* failed CAS on a location never released on */
+   libhb_so_recv( thr->hbthr, so, True/*strong_recv*/ );
+   if (success)
+      libhb_so_send( thr->hbthr, so, False/*!strong_send*/ );
+}
+
+/* Called after a load-linked from A. */
+static VG_REGPARM(1)
+void evh__atomic_acquire ( Addr a )
+{
+   Thread* thr = get_current_Thread_in_C_C();
+   SO*     so;
+   if (UNLIKELY(thr->synchr_nesting > 0))
+      return;
+   stats__atomic_acquires++;
+   so = map_atomic_to_SO_lookup( a, False );
+   if (so)
+      libhb_so_recv( thr->hbthr, so, True/*strong_recv*/ );
+}
+
+/* Called after a successful store-conditional to A. */
+static VG_REGPARM(1)
+void evh__atomic_release ( Addr a )
+{
+   Thread* thr = get_current_Thread_in_C_C();
+   if (UNLIKELY(thr->synchr_nesting > 0))
+      return;
+   stats__atomic_rmws++;
+   libhb_so_send( thr->hbthr, map_atomic_to_SO_lookup( a, True ),
+                  False/*!strong_send*/ );
+}
+
 #if defined(VGO_solaris)
 /* ----------------------------------------------------- */
 /* --- events to do with bind guard/clear intercepts --- */
@@ -3543,6 +3744,12 @@ typedef
 /* lock order acquisition graph */
 static WordFM* laog = NULL; /* WordFM Lock* LAOGLinks* */
 
+/* Bumped whenever an edge is added to or removed from 'laog'.  Used
+   to validate the per-thread Thread.laog_cache entries. */
+static UInt laog_gen = 1;
+
+static UWord stats__laog_cache_hits = 0;
+
 /* EXPOSITION ONLY: for each edge in 'laog', record the two places
    where that edge was created, so that we can show the user later if
    we need to. */
@@ -3737,6 +3944,9 @@ static void laog__add_edge ( Lock* src, Lock* dst ) {
 
    tl_assert( (presentF && presentR) || (!presentF && !presentR) );
 
+   if (!presentF)
+      laog_gen++;
+
    if (!presentF && src->acquired_at && dst->acquired_at) {
       LAOGLinkExposition expo;
       /* If this edge is entering the graph, and we have acquired_at
@@ -3773,6 +3983,7 @@ static void laog__del_edge ( Lock* src, Lock* dst ) {
    UWord      keyW;
    LAOGLinks* links;
    if (0) VG_(printf)("laog__del_edge enter %p %p\n", src, dst);
+   laog_gen++;
    /* Update the out edges for src */
    keyW  = 0;
    links = NULL;
@@ -3952,6 +4163,7 @@ static void laog__pre_thread_acquires_lock (
    UWord*   ls_words;
    UWord    ls_size, i;
    Lock*    other;
+   UWord    ci;
 
    /* It may be that 'thr' already holds 'lk' and is recursively
       relocking in.  In this case we just ignore the call. */
@@ -3959,6 +4171,18 @@ static void laog__pre_thread_acquires_lock (
    if (HG_(elemWS)( univ_lsets, thr->locksetA, (UWord)lk ))
       return;
 
+   /* If this exact acquisition (same lock, same locks held) was
+      already checked and the graph has not changed since, then the
+      search below would find nothing and the edges are all present
+      already. */
+   ci = ((UWord)lk >> 4) & (HG_LAOG_CACHE_SIZE - 1);
+   if (thr->laog_cache[ci].lk == lk
+       && thr->laog_cache[ci].locksetA == thr->locksetA
+       && thr->laog_cache[ci].laog_gen == laog_gen) {
+      stats__laog_cache_hits++;
+      return;
+   }
+
    /* First, the check.  Complain if there is any path in laog from lk
       to any of the locks already held by thr, since if any such path
       existed, it would mean that previously lk was acquired before
@@ -4056,6 +4280,14 @@ static void laog__pre_thread_acquires_lock (
       laog__add_edge( old, lk );
    }
 
+   /* Remember a clean check; one that found a lock order error is
+      redone each time, so as to keep reporting it. */
+   if (!other) {
+      thr->laog_cache[ci].lk       = lk;
+      thr->laog_cache[ci].locksetA = thr->locksetA;
+      thr->laog_cache[ci].laog_gen = laog_gen;
+   }
+
    /* Why "except_Locks" ?  We're here because a lock is being
       acquired by a thread, and we're in an inconsistent state here.
       See the call points in evhH__post_thread_{r,w}_acquires_lock.
@@ -4090,6 +4322,10 @@ static void laog__handle_one_lock_deletion ( Lock* lk )
    UWord preds_size, succs_size, i, j;
    UWord *preds_words, *succs_words;
 
+   /* 'lk' is going away, and its address may be reused for some
+      other lock, so invalidate all Thread.laog_cache entries. */
+   laog_gen++;
+
    preds = laog__preds( lk );
    succs = laog__succs( lk );
 
@@ -4288,6 +4524,7 @@ static void handle_free ( ThreadId tid, void* p )
 
    /* Tell the lower level memory wranglers. */
    evh__die_mem_heap( (Addr)p, szB );
+   map_atomic_to_SO_forget_range( (Addr)p, szB );
 }
 
 static void hg_cli__free ( ThreadId tid, void* p ) {
@@ -4344,6 +4581,7 @@ static void* hg_cli__realloc ( ThreadId tid, void* payloadV, SizeT new_size )
          old range contained a lock, then die_mem_heap will complain.
          Is that the correct behaviour?  Not sure. */
       evh__die_mem_heap( payload, md->szB );
+      map_atomic_to_SO_forget_range( payload, md->szB );
 
       /* Copy from old to new */
       for (i = 0; i < md->szB; i++)
@@ -4486,6 +4724,86 @@ static IRExpr* mk_And1 ( IRSB* sbOut, IRExpr* arg1, IRExpr* arg2 )
    return mkexpr(res);
 }
 
+static IRExpr* mk_Or1 ( IRSB* sbOut, IRExpr* arg1, IRExpr* arg2 )
+{
+   tl_assert(arg1 && arg2);
+   tl_assert(isIRAtom(arg1));
+   tl_assert(isIRAtom(arg2));
+   /* As mk_And1, but with Or32. */
+   IRTemp wide1 = newIRTemp(sbOut->tyenv, Ity_I32);
+   IRTemp wide2 = newIRTemp(sbOut->tyenv, Ity_I32);
+   IRTemp ored  = newIRTemp(sbOut->tyenv, Ity_I32);
+   IRTemp res   = newIRTemp(sbOut->tyenv, Ity_I1);
+   addStmtToIRSB(sbOut, assign(wide1, unop(Iop_1Uto32, arg1)));
+   addStmtToIRSB(sbOut, assign(wide2, unop(Iop_1Uto32, arg2)));
+   addStmtToIRSB(sbOut, assign(ored, binop(Iop_Or32, mkexpr(wide1),
+                                                     mkexpr(wide2))));
+   addStmtToIRSB(sbOut, assign(res, unop(Iop_32to1, mkexpr(ored))));
+   return mkexpr(res);
+}
+
+/* Generate the guard condition for --watch-only / --watch-sample-pages,
+   for an access of szB bytes overlapping [watch_lo, watch_lo + watch_szB):
+      (addr - (watch_lo - (szB - 1))) <u watch_szB + (szB - 1)
+   or, if sampling,
+      ... || ((addr >> 12) * WATCH_SAMPLE_MULT) >> (W - bits) == 0
+   watch_lo and watch_szB are loaded at run time, so that watching
+   more ranges does not require discarding translations. */
+static IRExpr* mk_watch_guard ( IRSB* sbOut, IRExpr* addr, IRType tyAddr,
+                                Int szB )
+{
+#  if defined(VG_BIGENDIAN)
+#    define WATCH_END Iend_BE
+#  else
+#    define WATCH_END Iend_LE
+#  endif
+   const Bool is64 = tyAddr == Ity_I64;
+   IRTemp lo   = newIRTemp(sbOut->tyenv, tyAddr);
+   IRTemp len  = newIRTemp(sbOut->tyenv, tyAddr);
+   IRTemp off  = newIRTemp(sbOut->tyenv, tyAddr);
+   IRTemp inR  = newIRTemp(sbOut->tyenv, Ity_I1);
+   addStmtToIRSB(sbOut, assign(lo, IRExpr_Load(WATCH_END, tyAddr,
+                                      mkIRExpr_HWord((HWord)&watch_lo))));
+   addStmtToIRSB(sbOut, assign(len, IRExpr_Load(WATCH_END, tyAddr,
+                                       mkIRExpr_HWord((HWord)&watch_szB))));
+   if (szB > 1) {
+      IRTemp lo2  = newIRTemp(sbOut->tyenv, tyAddr);
+      IRTemp len2 = newIRTemp(sbOut->tyenv, tyAddr);
+      addStmtToIRSB(sbOut, assign(lo2, binop(is64 ? Iop_Sub64 : Iop_Sub32,
+                                             mkexpr(lo),
+                                             mkIRExpr_HWord(szB - 1))));
+      addStmtToIRSB(sbOut, assign(len2, binop(is64 ? Iop_Add64 : Iop_Add32,
+                                              mkexpr(len),
+                                              mkIRExpr_HWord(szB - 1))));
+      lo  = lo2;
+      len = len2;
+   }
+   addStmtToIRSB(sbOut, assign(off, binop(is64 ? Iop_Sub64 : Iop_Sub32,
+                                          addr, mkexpr(lo))));
+   addStmtToIRSB(sbOut, assign(inR, binop(is64 ? Iop_CmpLT64U : Iop_CmpLT32U,
+                                          mkexpr(off), mkexpr(len))));
+   if (watch_sample_bits == 0)
+      return mkexpr(inR);
+
+   IRTemp page = newIRTemp(sbOut->tyenv, tyAddr);
+   IRTemp hash = newIRTemp(sbOut->tyenv, tyAddr);
+   IRTemp top  = newIRTemp(sbOut->tyenv, tyAddr);
+   IRTemp smp  = newIRTemp(sbOut->tyenv, Ity_I1);
+   addStmtToIRSB(sbOut, assign(page, binop(is64 ? Iop_Shr64 : Iop_Shr32, addr,
+                                 IRExpr_Const(IRConst_U8(WATCH_PAGE_SHIFT)))));
+   addStmtToIRSB(sbOut, assign(hash, binop(is64 ? Iop_Mul64 : Iop_Mul32,
+                                 mkexpr(page),
+                                 mkIRExpr_HWord(WATCH_SAMPLE_MULT))));
+   addStmtToIRSB(sbOut, assign(top, binop(is64 ? Iop_Shr64 : Iop_Shr32,
+                                 mkexpr(hash),
+                                 IRExpr_Const(IRConst_U8((is64 ? 64 : 32)
+                                                         - watch_sample_bits)))));
+   addStmtToIRSB(sbOut, assign(smp, binop(is64 ? Iop_CmpEQ64 : Iop_CmpEQ32,
+                                 mkexpr(top), mkIRExpr_HWord(0))));
+   return mk_Or1(sbOut, mkexpr(inR), mkexpr(smp));
+#  undef WATCH_END
+}
+
 static void instrument_mem_access ( IRSB*   sbOut, 
                                     IRExpr* addr,
                                     Int     szB,
@@ -4519,7 +4837,18 @@ static void instrument_mem_access ( IRSB*   sbOut,
 
    /* So the effective address is in 'addr' now. */
    regparms = 1; // unless stated otherwise
-   if (isStore) {
+   if (watch_restricted()) {
+      /* The helper re-checks the address, see mk_watch_guard. */
+      regparms = 2;
+      if (isStore) {
+         hName = "evh__mem_help_watched_cwrite_N";
+         hAddr = &evh__mem_help_watched_cwrite_N;
+      } else {
+         hName = "evh__mem_help_watched_cread_N";
+         hAddr = &evh__mem_help_watched_cread_N;
+      }
+      argv = mkIRExprVec_2( addr, mkIRExpr_HWord( szB ));
+   } else if (isStore) {
       switch (szB) {
          case 1:
             hName = "evh__mem_help_cwrite_1";
@@ -4670,6 +4999,11 @@ static void instrument_mem_access ( IRSB*   sbOut,
       di->guard = mkexpr(guardA);
    }
 
+   if (watch_restricted()) {
+      di->guard = mk_And1(sbOut, di->guard,
+                          mk_watch_guard(sbOut, addr, tyAddr, szB));
+   }
+
    /* If there's a guard on the access itself (as supplied by the
       caller of this routine), we need to AND that in to any guard we
       might already have. */
@@ -4713,6 +5047,63 @@ void addInvalidateCachedStack (IRSB*   bbOut,
    /// ???? anything more efficient than assign a Word???
 }
 
+/* For --model-atomics=yes.  Call evh__atomic_rmw after CAS,
+   passing it whether the CAS succeeded, that is, whether the old value
+   equals the expected value.  Must be called after CAS itself has been
+   added to sbOut. */
+static void instrument_atomic_cas ( IRSB* sbOut, IRCAS* cas, IRType hWordTy )
+{
+   IRType   ty = typeOfIRExpr(sbOut->tyenv, cas->expdLo);
+   IROp     opEQ;
+   IRTemp   eq, succW;
+   IRExpr*  success;
+   IRDirty* di;
+   switch (ty) {
+      case Ity_I8:  opEQ = Iop_CmpEQ8;  break;
+      case Ity_I16: opEQ = Iop_CmpEQ16; break;
+      case Ity_I32: opEQ = Iop_CmpEQ32; break;
+      case Ity_I64: opEQ = Iop_CmpEQ64; break;
+      default: tl_assert(0);
+   }
+   eq = newIRTemp(sbOut->tyenv, Ity_I1);
+   addStmtToIRSB(sbOut, assign(eq, binop(opEQ, mkexpr(cas->oldLo),
+                                               cas->expdLo)));
+   success = mkexpr(eq);
+   if (cas->oldHi != IRTemp_INVALID) {
+      IRTemp eqHi = newIRTemp(sbOut->tyenv, Ity_I1);
+      addStmtToIRSB(sbOut, assign(eqHi, binop(opEQ, mkexpr(cas->oldHi),
+                                                    cas->expdHi)));
+      success = mk_And1(sbOut, success, mkexpr(eqHi));
+   }
+   succW = newIRTemp(sbOut->tyenv, hWordTy);
+   addStmtToIRSB(sbOut, assign(succW, unop(hWordTy == Ity_I64
+                                              ? Iop_1Uto64 : Iop_1Uto32,
+                                           success)));
+   di = unsafeIRDirty_0_N( 2/*regparms*/, "evh__atomic_rmw",
+                           VG_(fnptr_to_fnentry)( &evh__atomic_rmw ),
+                           mkIRExprVec_2( cas->addr, mkexpr(succW) ) );
+   addStmtToIRSB( sbOut, IRStmt_Dirty(di) );
+}
+
+/* For --model-atomics=yes.  A load-linked is an acquire and a
+   successful store-conditional a release.  Must be called after the
+   LLSC statement ST has been added to sbOut. */
+static void instrument_atomic_llsc ( IRSB* sbOut, IRStmt* st )
+{
+   IRDirty* di;
+   if (st->Ist.LLSC.storedata == NULL) {
+      di = unsafeIRDirty_0_N( 1/*regparms*/, "evh__atomic_acquire",
+                              VG_(fnptr_to_fnentry)( &evh__atomic_acquire ),
+                              mkIRExprVec_1( st->Ist.LLSC.addr ) );
+   } else {
+      di = unsafeIRDirty_0_N( 1/*regparms*/, "evh__atomic_release",
+                              VG_(fnptr_to_fnentry)( &evh__atomic_release ),
+                              mkIRExprVec_1( st->Ist.LLSC.addr ) );
+      di->guard = mkexpr(st->Ist.LLSC.result);
+   }
+   addStmtToIRSB( sbOut, IRStmt_Dirty(di) );
+}
+
 static
 IRSB* hg_instrument ( VgCallbackClosure* closure,
                       IRSB* bbIn,
@@ -4844,7 +5235,8 @@ IRSB* hg_instrument ( VgCallbackClosure* closure,
 
          case Ist_CAS: {
             /* Atomic read-modify-write cycle.  Just pretend it's a
-               read. */
+               read, or with --model-atomics=yes, model it as an
+               acquire and release on the location instead. */
             IRCAS* cas    = st->Ist.CAS.details;
             Bool   isDCAS = cas->oldHi != IRTemp_INVALID;
             if (isDCAS) {
@@ -4854,6 +5246,12 @@ IRSB* hg_instrument ( VgCallbackClosure* closure,
                tl_assert(!cas->expdHi);
                tl_assert(!cas->dataHi);
             }
+            if (HG_(clo_model_atomics)) {
+               addStmtToIRSB( bbOut, st );
+               if (!inLDSO)
+                  instrument_atomic_cas( bbOut, cas, hWordTy );
+               continue;
+            }
             /* Just be boring about it. */
             if (!inLDSO) {
                instrument_mem_access(
@@ -4872,8 +5270,15 @@ IRSB* hg_instrument ( VgCallbackClosure* closure,
          case Ist_LLSC: {
             /* We pretend store-conditionals don't exist, viz, ignore
                them.  Whereas load-linked's are treated the same as
-               normal loads. */
+               normal loads.  Unless --model-atomics=yes, see
+               instrument_atomic_llsc. */
             IRType dataTy;
+            if (HG_(clo_model_atomics)) {
+               addStmtToIRSB( bbOut, st );
+               if (!inLDSO)
+                  instrument_atomic_llsc( bbOut, st );
+               continue;
+            }
             if (st->Ist.LLSC.storedata == NULL) {
                /* LL */
                dataTy = typeOfIRTemp(bbIn->tyenv, st->Ist.LLSC.result);
@@ -5156,7 +5561,7 @@ static Bool handle_gdb_monitor_command (ThreadId tid, HChar *req)
          if (HG_(clo_history_level) < 2) {
             VG_(gdb_printf)
                ("helgrind must be started with --history-level=full"
-                " to use accesshistory\n");
+                " or =sampled to use accesshistory\n");
             return True;
          }
          if (VG_(strtok_get_address_and_size) (&address, &szB, &ssaveptr)) {
@@ -5238,6 +5643,22 @@ Bool hg_handle_client_request ( ThreadId tid, UWord* args, UWord* ret)
          }
          break;
 
+      case _VG_USERREQ__HG_ARANGE_WATCH:
+         if (0) VG_(printf)("HG_ARANGE_WATCH(%#lx,%lu)\n",
+                            args[1], args[2]);
+         if (args[2] > 0) { /* length */
+            watch_set_range(args[1], args[2], 1);
+         }
+         break;
+
+      case _VG_USERREQ__HG_ARANGE_UNWATCH:
+         if (0) VG_(printf)("HG_ARANGE_UNWATCH(%#lx,%lu)\n",
+                            args[1], args[2]);
+         if (args[2] > 0) { /* length */
+            watch_set_range(args[1], args[2], 0);
+         }
+         break;
+
       case _VG_USERREQ__HG_ARANGE_MAKE_TRACKED:
          if (0) VG_(printf)("HG_ARANGE_MAKE_TRACKED(%#lx,%lu)\n",
                             args[1], args[2]);
@@ -5740,6 +6161,8 @@ static Bool hg_process_cmd_line_option ( const HChar* arg )
                             HG_(clo_history_level), 1);
    else if VG_XACT_CLO(arg, "--history-level=full",
                             HG_(clo_history_level), 2);
+   else if VG_XACT_CLO(arg, "--history-level=sampled",
+                            HG_(clo_history_level), 3);
 
    else if VG_BOOL_CLO(arg, "--delta-stacktrace",
                             HG_(clo_delta_stacktrace)) {}
@@ -5747,6 +6170,28 @@ static Bool hg_process_cmd_line_option ( const HChar* arg )
    else if VG_BINT_CLO(arg, "--conflict-cache-size",
                        HG_(clo_conflict_cache_size), 10*1000, 150*1000*1000) {}
 
+   else if VG_BINT_CLO(arg, "--history-budget",
+                       HG_(clo_history_budget), 1, 4096) {}
+   else if VG_BINT_CLO(arg, "--history-sample-rate",
+                       HG_(clo_history_sample_rate), 1, 65536) {
+      if (0 != (HG_(clo_history_sample_rate)
+                & (HG_(clo_history_sample_rate) - 1)))
+         VG_(fmsg_bad_option)(arg, "must be a power of 2\n");
+   }
+
+   else if VG_BINT_CLO(arg, "--shadow-cache-size",
+                       HG_(clo_shadow_cache_size), 1024, 1024*1024) {
+      if (0 != (HG_(clo_shadow_cache_size)
+                & (HG_(clo_shadow_cache_size) - 1)))
+         VG_(fmsg_bad_option)(arg, "must be a power of 2\n");
+   }
+   else if VG_BINT_CLO(arg, "--shadow-cache-ways",
+                       HG_(clo_shadow_cache_ways), 1, 16) {
+      if (0 != (HG_(clo_shadow_cache_ways)
+                & (HG_(clo_shadow_cache_ways) - 1)))
+         VG_(fmsg_bad_option)(arg, "must be a power of 2\n");
+   }
+
    /* "stuvwx" --> stuvwx (binary) */
    else if VG_STR_CLO(arg, "--hg-sanity-flags", tmp_str) {
       Int j;
@@ -5780,6 +6225,16 @@ static Bool hg_process_cmd_line_option ( const HChar* arg )
 
    else if VG_BOOL_CLO(arg, "--check-stack-refs",
                             HG_(clo_check_stack_refs)) {}
+   else if VG_BOOL_CLO(arg, "--model-atomics",
+                            HG_(clo_model_atomics)) {}
+   else if VG_BOOL_CLO(arg, "--watch-only",
+                            HG_(clo_watch_only)) {}
+   else if VG_BINT_CLO(arg, "--watch-sample-pages",
+                       HG_(clo_watch_sample_pages), 0, 1024*1024) {
+      if (0 != (HG_(clo_watch_sample_pages)
+                & (HG_(clo_watch_sample_pages) - 1)))
+         VG_(fmsg_bad_option)(arg, "must be a power of 2\n");
+   }
    else if VG_BOOL_CLO(arg, "--ignore-thread-creation",
                             HG_(clo_ignore_thread_creation)) {}
 
@@ -5794,8 +6249,10 @@ static void hg_print_usage ( void )
    VG_(printf)(
 "    --free-is-write=no|yes    treat heap frees as writes [no]\n"
 "    --track-lockorders=no|yes show lock ordering errors? [yes]\n"
-"    --history-level=none|approx|full [full]\n"
+"    --history-level=none|approx|full|sampled [full]\n"
 "       full:   show both stack traces for a data race (can be very slow)\n"
+"       sampled: as full, but within a memory budget and collecting\n"
+"               only a sample of the accesses (faster)\n"
 "       approx: full trace for one thread, approx for the other (faster)\n"
 "       none:   only show trace for one thread in a race (fastest)\n"
 "    --delta-stacktrace=no|yes [yes on linux amd64/x86]\n"
@@ -5803,8 +6260,22 @@ static void hg_print_usage ( void )
 "        yes : derive a stacktrace from the previous stacktrace\n"
 "          if there was no call/return or similar instruction\n"
 "    --conflict-cache-size=N   size of 'full' history cache [2000000]\n"
+"    --history-budget=<MB>     memory for 'sampled' history [32]\n"
+"    --history-sample-rate=N   'sampled' history collects 1 access in N,\n"
+"                              a power of 2 [16]\n"
+"    --shadow-cache-size=N     lines in the shadow memory cache,\n"
+"                              a power of 2 [65536]\n"
+"    --shadow-cache-ways=1|2|4|8|16  associativity of the shadow\n"
+"                              memory cache [1]\n"
 "    --check-stack-refs=no|yes race-check reads and writes on the\n"
 "                              main stack and thread stacks? [yes]\n"
+"    --model-atomics=no|yes    treat atomic read-modify-write insns\n"
+"                              as acquire/release instead of race-\n"
+"                              checking them [no]\n"
+"    --watch-only=no|yes       only race-check ranges given to\n"
+"                              VALGRIND_HG_WATCH_RANGE [no]\n"
+"    --watch-sample-pages=N    also race-check 1 in N pages, a power\n"
+"                              of 2; N > 0 implies --watch-only=yes [0]\n"
 "    --ignore-thread-creation=yes|no Ignore activities during thread\n"
 "                              creation [%s]\n",
 HG_(clo_ignore_thread_creation) ? "yes" : "no"
@@ -5884,6 +6355,7 @@ static void hg_print_stats (void)
                   (Int)(laog ? VG_(sizeFM)( laog ) : 0));
       VG_(printf)(" LAOG exposition: %'8d map size\n",
                   (Int)(laog_exposition ? VG_(sizeFM)( laog_exposition ) : 0));
+      VG_(printf)("      LAOG cache: %'8lu hits\n", stats__laog_cache_hits);
    }
 
    VG_(printf)("           locks: %'8lu acquires, "
@@ -5891,6 +6363,13 @@ static void hg_print_stats (void)
                stats__lockN_acquires,
                stats__lockN_releases
               );
+   if (HG_(clo_model_atomics)) {
+      VG_(printf)("         atomics: %'8lu rmws, %'lu LL acquires"
+                  " (%d map size)\n",
+                  stats__atomic_rmws, stats__atomic_acquires,
+                  (Int)(map_atomic_to_SO
+                        ? VG_(sizeFM)( map_atomic_to_SO ) : 0));
+   }
    VG_(printf)("   sanity checks: %'8lu\n", stats__sanity_checks);
 
    VG_(printf)("\n");
@@ -5907,7 +6386,7 @@ static void hg_fini ( Int exitcode )
    }
 
    if (VG_(clo_verbosity) == 1 && !VG_(clo_xml)
-       && HG_(clo_history_level) >= 2) {
+       && HG_(clo_history_level) == 2) {
       VG_(umsg)( 
          "Use --history-level=approx or =none to gain increased speed, at\n" );
       VG_(umsg)(
@@ -5981,6 +6460,9 @@ static void hg_post_clo_init ( void )
    /////////////////////////////////////////////
 
 
+   while ((1UL << watch_sample_bits) < HG_(clo_watch_sample_pages))
+      watch_sample_bits++;
+
    if (HG_(clo_track_lockorders))
       laog__init();
 
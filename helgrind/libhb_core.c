@@ -324,10 +324,21 @@ struct _Thr {
       set them to VtsID_INVALID. */
    Bool joinedwith_done;
 
+   /* Is initially False, and is set to True once this thread's
+      ScalarTSs have been pruned from all VTSs (after it became very
+      dead).  From then on, an epoch naming this thread no longer
+      constrains anything (see SVal E values). */
+   Bool pruned;
+
    /* A small integer giving a unique identity to this Thr.  See
       comments on the definition of ScalarTS for details. */
    ThrID thrid : SCALARTS_N_THRBITS;
 
+   /* This thread's own scalar clock, that is, viW[thrid] (which is
+      also viR[thrid]).  It only changes when the thread ticks its own
+      clocks.  Used to make epochs (see SVal E values). */
+   ULong own_tym;
+
    /* A filter that removes references for which we believe that
       msmcread/msmcwrite will not change the state, nor report a
       race. */
@@ -372,6 +383,7 @@ struct _SO {
    struct _SO* admin_next;
    VtsID viR; /* r-clock of sender */
    VtsID viW; /* w-clock of sender */
+   ThrID last_sender; /* see libhb_so_send; 0 if none */
    UInt  magic;
 };
 
@@ -396,6 +408,7 @@ static void VtsID__rcinc ( VtsID ii );
 static void VtsID__rcdec ( VtsID ii );
 
 static inline Bool SVal__isC ( SVal s );
+static inline Bool SVal__isE ( SVal s );
 static inline VtsID SVal__unC_Rmin ( SVal s );
 static inline VtsID SVal__unC_Wmin ( SVal s );
 static inline SVal SVal__mkC ( VtsID rmini, VtsID wmini );
@@ -588,10 +601,19 @@ static inline Bool is_sane_SecMap ( SecMap* sm ) {
 
 /* ------ Cache ------ */
 
-#define N_WAY_BITS 16
-#define N_WAY_NENT (1 << N_WAY_BITS)
+/* The cache is set associative.  It has HG_(clo_shadow_cache_size)
+   lines, in sets of HG_(clo_shadow_cache_ways) ways; both are powers
+   of 2.  An address can only be cached in the set given by its line
+   number modulo the number of sets.
+
+   The entries of a set are kept in most recently used first order,
+   so that a hit is found (by get_cacheline) by looking at the first
+   entry of the set only.  Other hits and misses are handled in
+   get_cacheline_MISS, which moves the entry to the front of its set,
+   so that the replacement is LRU.  Only the (tag, line) entries move;
+   the CacheLines themselves stay where they are.
 
-/* Each tag is the address of the associated CacheLine, rounded down
+   Each tag is the address of the associated CacheLine, rounded down
    to a CacheLine address boundary.  A CacheLine size must be a power
    of 2 and must be 8 or more.  Hence an easy way to initialise the
    cache so it is empty is to set all the tag values to any value % 8
@@ -600,8 +622,19 @@ static inline Bool is_sane_SecMap ( SecMap* sm ) {
    with a bogus tag. */
 typedef
    struct {
-      CacheLine lyns0[N_WAY_NENT];
-      Addr      tags0[N_WAY_NENT];
+      Addr       tag;
+      CacheLine* cl;
+   }
+   CacheEnt;
+
+typedef
+   struct {
+      CacheEnt*  ents;      /* nEnt entries, nWays per set */
+      CacheLine* lyns;      /* nEnt lines */
+      UWord      nEnt;
+      UWord      nWays;
+      UWord      waysShift; /* log2(nWays) */
+      UWord      setMask;   /* nEnt/nWays - 1 */
    }
    Cache;
 
@@ -618,6 +651,11 @@ static inline Bool is_valid_scache_tag ( Addr tag ) {
 static WordFM* map_shmem = NULL; /* WordFM Addr SecMap* */
 static Cache   cache_shmem;
 
+/* Index of the first entry of the cache set for address 'a'. */
+static inline UWord cache_set_wix ( Addr a ) {
+   return ((a >> N_LINE_BITS) & cache_shmem.setMask) << cache_shmem.waysShift;
+}
+
 
 static UWord stats__secmaps_search       = 0; // # SM finds
 static UWord stats__secmaps_search_slow  = 0; // # SM lookupFMs
@@ -636,6 +674,7 @@ static UWord stats__cache_F_wbacks       = 0; // # F lines written back
 static UWord stats__cache_flushes_invals = 0; // # cache flushes and invals
 static UWord stats__cache_totrefs        = 0; // # total accesses
 static UWord stats__cache_totmisses      = 0; // # misses
+static UWord stats__cache_way_hits       = 0; // # hits not in way 0
 static ULong stats__cache_make_New_arange = 0; // total arange made New
 static ULong stats__cache_make_New_inZrep = 0; // arange New'd on Z reps
 static UWord stats__cline_normalises     = 0; // # calls to cacheline_normalise
@@ -665,6 +704,7 @@ static UWord stats__vts__cmpLEQ          = 0; // # calls to VTS__cmpLEQ
 static UWord stats__vts__cmp_structural  = 0; // # calls to VTS__cmp_structural
 static UWord stats__vts_tab_GC           = 0; // # nr of vts_tab GC
 static UWord stats__vts_pruning          = 0; // # nr of vts pruning
+static UWord stats__so_recv_fast         = 0; // # SO recvs skipping joins
 
 // # calls to VTS__cmp_structural w/ slow case
 static UWord stats__vts__cmp_structural_slow = 0;
@@ -806,6 +846,89 @@ static SecMap* shmem__alloc_or_recycle_SecMap ( void )
    return sm;
 }
 
+/*--------------- SecMap index --------------- */
+
+/* Searching map_shmem for a SecMap costs a walk down an AVL tree,
+   which for big working sets means a cache miss per level.  So the
+   SecMaps are also indexed by a radix tree on their address, which
+   finds any SecMap in three loads.  The index only covers addresses
+   below 2^SMIX_ADDR_BITS; SecMaps above that are found via map_shmem.
+   map_shmem stays the master copy, used to iterate over all SecMaps.
+   Index nodes are allocated as needed and never freed. */
+#if VG_WORDSIZE == 8
+#  define SMIX_ADDR_BITS 48
+#else
+#  define SMIX_ADDR_BITS 32
+#endif
+#define SMIX_L3_BITS 12
+#define SMIX_L1_BITS ((SMIX_ADDR_BITS - N_SECMAP_BITS - SMIX_L3_BITS) / 2)
+#define SMIX_L2_BITS (SMIX_ADDR_BITS - N_SECMAP_BITS - SMIX_L3_BITS \
+                      - SMIX_L1_BITS)
+
+typedef struct { SecMap* sm[1 << SMIX_L3_BITS]; } SMIndexL3;
+typedef struct { SMIndexL3* l3[1 << SMIX_L2_BITS]; } SMIndexL2;
+static SMIndexL2* smIndex[1 << SMIX_L1_BITS];
+
+static inline Bool smIndex_covers ( Addr gaKey ) {
+   return ((ULong)gaKey >> SMIX_ADDR_BITS) == 0;
+}
+
+static inline SecMap* smIndex_find ( Addr gaKey )
+{
+   UWord      n = gaKey >> N_SECMAP_BITS;
+   SMIndexL2* l2;
+   SMIndexL3* l3;
+   l2 = smIndex[n >> (SMIX_L3_BITS + SMIX_L2_BITS)];
+   if (!l2)
+      return NULL;
+   l3 = l2->l3[(n >> SMIX_L3_BITS) & ((1 << SMIX_L2_BITS) - 1)];
+   if (!l3)
+      return NULL;
+   return l3->sm[n & ((1 << SMIX_L3_BITS) - 1)];
+}
+
+static void smIndex_set ( Addr gaKey, SecMap* sm )
+{
+   UWord       n = gaKey >> N_SECMAP_BITS;
+   SMIndexL2** l2p;
+   SMIndexL3** l3p;
+   tl_assert(smIndex_covers(gaKey));
+   l2p = &smIndex[n >> (SMIX_L3_BITS + SMIX_L2_BITS)];
+   if (!*l2p) {
+      if (!sm)
+         return;
+      *l2p = HG_(zalloc)( "libhb.smIndex_set.1", sizeof(SMIndexL2) );
+   }
+   l3p = &(*l2p)->l3[(n >> SMIX_L3_BITS) & ((1 << SMIX_L2_BITS) - 1)];
+   if (!*l3p) {
+      if (!sm)
+         return;
+      *l3p = HG_(zalloc)( "libhb.smIndex_set.2", sizeof(SMIndexL3) );
+   }
+   (*l3p)->sm[n & ((1 << SMIX_L3_BITS) - 1)] = sm;
+}
+
+/* Add or remove the SecMap at gaKey in map_shmem and smIndex. */
+static void shmem__add_SecMap ( Addr gaKey, SecMap* sm )
+{
+   VG_(addToFM)( map_shmem, (UWord)gaKey, (UWord)sm );
+   if (smIndex_covers(gaKey))
+      smIndex_set(gaKey, sm);
+   stats__secmaps_in_map_shmem++;
+}
+static void shmem__del_SecMap ( Addr gaKey, SecMap* sm )
+{
+   SecMap* fm_sm;
+   Addr    fm_gaKey;
+   if (!VG_(delFromFM)(map_shmem, &fm_gaKey, (UWord*)&fm_sm, gaKey))
+      tl_assert (0);
+   tl_assert (gaKey == fm_gaKey);
+   tl_assert (sm == fm_sm);
+   if (smIndex_covers(gaKey))
+      smIndex_set(gaKey, NULL);
+   stats__secmaps_in_map_shmem--;
+}
+
 typedef struct { Addr gaKey; SecMap* sm; } SMCacheEnt;
 static SMCacheEnt smCache[3] = { {1,NULL}, {1,NULL}, {1,NULL} };
 
@@ -831,9 +954,12 @@ static SecMap* shmem__find_SecMap ( Addr ga )
    }
    // end Cache
    stats__secmaps_search_slow++;
-   if (VG_(lookupFM)( map_shmem,
-                      NULL/*keyP*/, (UWord*)&sm, (UWord)gaKey )) {
-      tl_assert(sm != NULL);
+   if (LIKELY(smIndex_covers(gaKey)))
+      sm = smIndex_find(gaKey);
+   else if (!VG_(lookupFM)( map_shmem,
+                            NULL/*keyP*/, (UWord*)&sm, (UWord)gaKey ))
+      sm = NULL;
+   if (sm) {
       smCache[2] = smCache[1];
       smCache[1] = smCache[0];
       smCache[0].gaKey = gaKey;
@@ -878,9 +1004,9 @@ static UWord shmem__SecMap_do_GC(Bool really)
          LineZ* lineZ = &sm->linesZ[i];
          if (lineZ->dict[0] != SVal_INVALID) {
             ok_to_GC = lineZ->dict[0] == SVal_NOACCESS
-               && !SVal__isC (lineZ->dict[1])
-               && !SVal__isC (lineZ->dict[2])
-               && !SVal__isC (lineZ->dict[3]);
+               && !SVal__isC (lineZ->dict[1]) && !SVal__isE (lineZ->dict[1])
+               && !SVal__isC (lineZ->dict[2]) && !SVal__isE (lineZ->dict[2])
+               && !SVal__isC (lineZ->dict[3]) && !SVal__isE (lineZ->dict[3]);
          } else {
             LineF *lineF = LineF_Ptr(lineZ);
             n_linesF++;
@@ -891,8 +1017,6 @@ static UWord shmem__SecMap_do_GC(Bool really)
       if (ok_to_GC)
          ok_GCed++;
       if (ok_to_GC && really) {
-        SecMap *fm_sm;
-        Addr fm_gaKey;
         /* We cannot remove a SecMap from map_shmem while iterating.
            So, stop iteration, remove from map_shmem, recreate the iteration
            on the next SecMap. */
@@ -908,11 +1032,7 @@ static UWord shmem__SecMap_do_GC(Bool really)
               }
            }
         }
-        if (!VG_(delFromFM)(map_shmem, &fm_gaKey, (UWord*)&fm_sm, gaKey))
-          tl_assert (0);
-        stats__secmaps_in_map_shmem--;
-        tl_assert (gaKey == fm_gaKey);
-        tl_assert (sm == fm_sm);
+        shmem__del_SecMap (gaKey, sm);
         stats__secmaps_scanGCed++;
         push_SecMap_on_freelist (sm);
         VG_(initIterAtFM) (map_shmem, gaKey + N_SECMAP_ARANGE);
@@ -958,8 +1078,7 @@ static SecMap* shmem__find_or_alloc_SecMap ( Addr ga )
       Addr gaKey = shmem__round_to_SecMap_base(ga);
       sm = shmem__alloc_or_recycle_SecMap();
       tl_assert(sm);
-      VG_(addToFM)( map_shmem, (UWord)gaKey, (UWord)sm );
-      stats__secmaps_in_map_shmem++;
+      shmem__add_SecMap( gaKey, sm );
       if (CHECK_ZSM) tl_assert(is_sane_SecMap(sm));
       return sm;
    }
@@ -1502,10 +1621,10 @@ static __attribute__((noinline)) void cacheline_wback ( UWord wix )
    if (0)
    VG_(printf)("scache wback line %d\n", (Int)wix);
 
-   tl_assert(wix >= 0 && wix < N_WAY_NENT);
+   tl_assert(wix >= 0 && wix < cache_shmem.nEnt);
 
-   tag =  cache_shmem.tags0[wix];
-   cl  = &cache_shmem.lyns0[wix];
+   tag = cache_shmem.ents[wix].tag;
+   cl  = cache_shmem.ents[wix].cl;
 
    /* The cache line may have been invalidated; if so, ignore it. */
    if (!is_valid_scache_tag(tag))
@@ -1641,10 +1760,10 @@ static __attribute__((noinline)) void cacheline_fetch ( UWord wix )
    if (0)
    VG_(printf)("scache fetch line %d\n", (Int)wix);
 
-   tl_assert(wix >= 0 && wix < N_WAY_NENT);
+   tl_assert(wix >= 0 && wix < cache_shmem.nEnt);
 
-   tag =  cache_shmem.tags0[wix];
-   cl  = &cache_shmem.lyns0[wix];
+   tag = cache_shmem.ents[wix].tag;
+   cl  = cache_shmem.ents[wix].cl;
 
    /* reject nonsense requests */
    tl_assert(is_valid_scache_tag(tag));
@@ -1685,18 +1804,21 @@ static void shmem__invalidate_scache_range (Addr ga, SizeT szB)
    tl_assert (0 == (szB & (N_LINE_ARANGE - 1)));
    
 
-   Word ga_ix = (ga >> N_LINE_BITS) & (N_WAY_NENT - 1);
-   Word nwix = szB / N_LINE_ARANGE;
+   UWord nSets = cache_shmem.setMask + 1;
+   UWord set   = (ga >> N_LINE_BITS) & cache_shmem.setMask;
+   UWord nset  = szB / N_LINE_ARANGE;
+   UWord i;
 
-   if (nwix > N_WAY_NENT)
-      nwix = N_WAY_NENT; // no need to check several times the same entry.
+   if (nset > nSets)
+      nset = nSets; // no need to check several times the same set.
 
-   for (wix = 0; wix < nwix; wix++) {
-      if (address_in_range(cache_shmem.tags0[ga_ix], ga, szB))
-         cache_shmem.tags0[ga_ix] = 1/*INVALID*/;
-      ga_ix++;
-      if (UNLIKELY(ga_ix == N_WAY_NENT))
-         ga_ix = 0;
+   for (i = 0; i < nset; i++) {
+      CacheEnt* ents = &cache_shmem.ents[set << cache_shmem.waysShift];
+      for (wix = 0; wix < cache_shmem.nWays; wix++) {
+         if (address_in_range(ents[wix].tag, ga, szB))
+            ents[wix].tag = 1/*INVALID*/;
+      }
+      set = (set + 1) & cache_shmem.setMask;
    }
 }
 
@@ -1706,15 +1828,15 @@ static void shmem__flush_and_invalidate_scache ( void ) {
    Addr tag;
    if (0) VG_(printf)("%s","scache flush and invalidate\n");
    tl_assert(!is_valid_scache_tag(1));
-   for (wix = 0; wix < N_WAY_NENT; wix++) {
-      tag = cache_shmem.tags0[wix];
+   for (wix = 0; wix < cache_shmem.nEnt; wix++) {
+      tag = cache_shmem.ents[wix].tag;
       if (tag == 1/*INVALID*/) {
          /* already invalid; nothing to do */
       } else {
          tl_assert(is_valid_scache_tag(tag));
          cacheline_wback( wix );
       }
-      cache_shmem.tags0[wix] = 1/*INVALID*/;
+      cache_shmem.ents[wix].tag = 1/*INVALID*/;
    }
    stats__cache_flushes_invals++;
 }
@@ -1745,6 +1867,20 @@ static inline UWord get_tree_offset ( Addr a ) {
    return a & 7;
 }
 
+/* Returns the cache line holding 'a', or NULL if 'a' is not in the
+   cache.  Does not change the replacement order. */
+static inline CacheLine* find_cacheline ( Addr a )
+{
+   Addr      tag  = a & ~(N_LINE_ARANGE - 1);
+   CacheEnt* ents = &cache_shmem.ents[cache_set_wix(a)];
+   UWord     w;
+   for (w = 0; w < cache_shmem.nWays; w++) {
+      if (ents[w].tag == tag)
+         return ents[w].cl;
+   }
+   return NULL;
+}
+
 static __attribute__((noinline))
        CacheLine* get_cacheline_MISS ( Addr a ); /* fwds */
 static inline CacheLine* get_cacheline ( Addr a )
@@ -1752,10 +1888,10 @@ static inline CacheLine* get_cacheline ( Addr a )
    /* tag is 'a' with the in-line offset masked out, 
       eg a[31]..a[4] 0000 */
    Addr       tag = a & ~(N_LINE_ARANGE - 1);
-   UWord      wix = (a >> N_LINE_BITS) & (N_WAY_NENT - 1);
+   UWord      wix = cache_set_wix(a);
    stats__cache_totrefs++;
-   if (LIKELY(tag == cache_shmem.tags0[wix])) {
-      return &cache_shmem.lyns0[wix];
+   if (LIKELY(tag == cache_shmem.ents[wix].tag)) {
+      return cache_shmem.ents[wix].cl;
    } else {
       return get_cacheline_MISS( a );
    }
@@ -1768,29 +1904,55 @@ static __attribute__((noinline))
       eg a[31]..a[4] 0000 */
 
    CacheLine* cl;
-   Addr*      tag_old_p;
-   Addr       tag = a & ~(N_LINE_ARANGE - 1);
-   UWord      wix = (a >> N_LINE_BITS) & (N_WAY_NENT - 1);
-
-   tl_assert(tag != cache_shmem.tags0[wix]);
-
-   /* Dump the old line into the backing store. */
-   stats__cache_totmisses++;
-
-   cl        = &cache_shmem.lyns0[wix];
-   tag_old_p = &cache_shmem.tags0[wix];
+   CacheEnt   ent;
+   Addr       tag   = a & ~(N_LINE_ARANGE - 1);
+   UWord      wix   = cache_set_wix(a);
+   CacheEnt*  ents  = &cache_shmem.ents[wix];
+   UWord      nWays = cache_shmem.nWays;
+   UWord      w, victim;
+
+   tl_assert(tag != ents[0].tag);
+
+   /* Look in the other ways of the set.  If it is not there, the
+      victim is the least recently used line, unless there is an
+      invalid one. */
+   victim = nWays - 1;
+   for (w = 1; w < nWays; w++) {
+      if (ents[w].tag == tag)
+         break;
+      if (ents[w].tag == 1/*INVALID*/)
+         victim = w;
+   }
 
-   if (is_valid_scache_tag( *tag_old_p )) {
-      /* EXPENSIVE and REDUNDANT: callee does it */
+   if (w < nWays) {
+      stats__cache_way_hits++;
+      victim = w;
+      cl = ents[victim].cl;
+   } else {
+      /* Dump the old line into the backing store. */
+      stats__cache_totmisses++;
+      if (ents[0].tag == 1/*INVALID*/)
+         victim = 0;
+
+      cl = ents[victim].cl;
+      if (is_valid_scache_tag( ents[victim].tag )) {
+         /* EXPENSIVE and REDUNDANT: callee does it */
+         if (CHECK_ZSM)
+            tl_assert(is_sane_CacheLine(cl)); /* EXPENSIVE */
+         cacheline_wback( wix + victim );
+      }
+      /* and reload the new one */
+      ents[victim].tag = tag;
+      cacheline_fetch( wix + victim );
       if (CHECK_ZSM)
          tl_assert(is_sane_CacheLine(cl)); /* EXPENSIVE */
-      cacheline_wback( wix );
    }
-   /* and reload the new one */
-   *tag_old_p = tag;
-   cacheline_fetch( wix );
-   if (CHECK_ZSM)
-      tl_assert(is_sane_CacheLine(cl)); /* EXPENSIVE */
+
+   /* Make it the most recently used entry of the set. */
+   ent = ents[victim];
+   for (w = victim; w > 0; w--)
+      ents[w] = ents[w-1];
+   ents[0] = ent;
    return cl;
 }
 
@@ -1984,10 +2146,24 @@ static void zsm_init ( void )
    map_shmem = VG_(newFM)( HG_(zalloc), "libhb.zsm_init.1 (map_shmem)",
                            HG_(free), 
                            NULL/*unboxed UWord cmp*/);
-   /* Invalidate all cache entries. */
+   /* Allocate the cache, and invalidate all its entries. */
+   cache_shmem.nEnt  = HG_(clo_shadow_cache_size);
+   cache_shmem.nWays = HG_(clo_shadow_cache_ways);
+   tl_assert(cache_shmem.nEnt >= cache_shmem.nWays);
+   tl_assert(0 == (cache_shmem.nEnt & (cache_shmem.nEnt - 1)));
+   tl_assert(0 == (cache_shmem.nWays & (cache_shmem.nWays - 1)));
+   cache_shmem.waysShift = 0;
+   while ((1UL << cache_shmem.waysShift) < cache_shmem.nWays)
+      cache_shmem.waysShift++;
+   cache_shmem.setMask = (cache_shmem.nEnt >> cache_shmem.waysShift) - 1;
+   cache_shmem.ents = HG_(zalloc)( "libhb.zsm_init.2 (cache ents)",
+                                   cache_shmem.nEnt * sizeof(CacheEnt) );
+   cache_shmem.lyns = HG_(zalloc)( "libhb.zsm_init.3 (cache lines)",
+                                   cache_shmem.nEnt * sizeof(CacheLine) );
    tl_assert(!is_valid_scache_tag(1));
-   for (UWord wix = 0; wix < N_WAY_NENT; wix++) {
-      cache_shmem.tags0[wix] = 1/*INVALID*/;
+   for (UWord wix = 0; wix < cache_shmem.nEnt; wix++) {
+      cache_shmem.ents[wix].tag = 1/*INVALID*/;
+      cache_shmem.ents[wix].cl  = &cache_shmem.lyns[wix];
    }
 
    LineF_pool_allocator = VG_(newPA) (
@@ -2119,7 +2295,17 @@ static void verydead_thread_table_sort_and_check (XArray* thrids)
 /* A VTS contains .ts, its vector clock, and also .id, a field to hold
    a backlink for the caller's convenience.  Since we have no idea
    what to set that to in the library, it always gets set to
-   VtsID_INVALID. */
+   VtsID_INVALID.
+
+   A VTS is sparse: .ts only holds the non-zero entries, sorted by
+   ThrID, so that joins and comparisons are merges over the non-zero
+   entries of both args.  Once a thread has exited and been joined
+   with, pruning (see vts_tab__do_GC) removes its entry from every VTS,
+   so that the size of VTSs follows the number of threads not yet
+   exited and joined with.  An exited thread that is never joined with
+   keeps its entry: it orders the accesses the thread made after its
+   last synchronisation, which no other thread's clock covers.
+   --stats=yes prints the number and size of the live VTSs. */
 typedef
    struct {
       VtsID    id;
@@ -2157,8 +2343,10 @@ static void VTS__tick ( /*OUT*/VTS* out, Thr* me, VTS* vts );
 
 /* Create in 'out' a VTS which is the join (max) of 'a' and
    'b'. Caller must have pre-allocated 'out' sufficiently big to hold
-   the result in all possible cases. */
-static void VTS__join ( /*OUT*/VTS* out, VTS* a, VTS* b );
+   the result in all possible cases.  Returns 1 if the result is equal
+   to 'a' (that is, 'b' <= 'a'), else 2 if it is equal to 'b', else
+   0. */
+static Int VTS__join ( /*OUT*/VTS* out, VTS* a, VTS* b );
 
 /* Compute the partial ordering relation of the two args.  Although we
    could be completely general and return an enumeration value (EQ,
@@ -2395,12 +2583,13 @@ static void VTS__tick ( /*OUT*/VTS* out, Thr* me, VTS* vts )
 /* Return a new VTS constructed as the join (max) of the 2 args.
    Neither arg is modified.
 */
-static void VTS__join ( /*OUT*/VTS* out, VTS* a, VTS* b )
+static Int VTS__join ( /*OUT*/VTS* out, VTS* a, VTS* b )
 {
    UInt     ia, ib, useda, usedb;
    ULong    tyma, tymb, tymMax;
    ThrID    thrid;
    UInt     ncommon = 0;
+   Bool     a_geq = True, b_geq = True;
 
    stats__vts__join++;
 
@@ -2478,6 +2667,8 @@ static void VTS__join ( /*OUT*/VTS* out, VTS* a, VTS* b )
 
       /* having laboriously determined (thr, tyma, tymb), do something
          useful with it. */
+      if (tyma < tymb) a_geq = False;
+      if (tymb < tyma) b_geq = False;
       tymMax = tyma > tymb ? tyma : tymb;
       if (tymMax > 0) {
          UInt hi = out->usedTS++;
@@ -2490,6 +2681,7 @@ static void VTS__join ( /*OUT*/VTS* out, VTS* a, VTS* b )
    tl_assert(is_sane_VTS(out));
    tl_assert(out->usedTS <= out->sizeTS);
    tl_assert(out->usedTS == useda + usedb - ncommon);
+   return a_geq ? 1 : b_geq ? 2 : 0;
 }
 
 
@@ -2679,6 +2871,27 @@ ULong VTS__indexAt_SLOW ( VTS* vts, Thr* idx )
 }
 
 
+/* Return vts[thrid], by binary search, since the ScalarTSs are in
+   increasing order of thrid.  Used when checking epochs, so it has to
+   be quick.
+*/
+static inline ULong VTS__indexAt_ThrID ( VTS* vts, ThrID thrid )
+{
+   UWord lo = 0, hi = vts->usedTS;
+   while (lo < hi) {
+      UWord     mid = (lo + hi) / 2;
+      ScalarTS* st  = &vts->ts[mid];
+      if (st->thrid == thrid)
+         return st->tym;
+      if (st->thrid < thrid)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   return 0;
+}
+
+
 /* See comment on prototype above.
 */
 static void VTS__declare_thread_very_dead ( Thr* thr )
@@ -3226,6 +3439,7 @@ static void vts_tab__do_GC ( Bool show_stats )
          ThrID thrid = 
             *(ThrID*)VG_(indexXA)( verydead_thread_table_not_pruned, i );
          VG_(addToXA)( verydead_thread_table, &thrid );
+         Thr__from_ThrID(thrid)->pruned = True;
       }
       verydead_thread_table_sort_and_check (verydead_thread_table);
       VG_(dropHeadXA) (verydead_thread_table_not_pruned, nBT);
@@ -3398,6 +3612,7 @@ static ULong stats__cmpLEQ_queries = 0;
 static ULong stats__cmpLEQ_misses  = 0;
 static ULong stats__join2_queries  = 0;
 static ULong stats__join2_misses   = 0;
+static ULong stats__join2_dominated = 0;
 
 static inline UInt ROL32 ( UInt w, Int n ) {
    w = (w << n) | (w >> (32-n));
@@ -3504,8 +3719,14 @@ static VtsID VtsID__join2_WRK ( VtsID vi1, VtsID vi2 ) {
    vts1 = VtsID__to_VTS(vi1);
    vts2 = VtsID__to_VTS(vi2);
    temp_max_sized_VTS->usedTS = 0;
-   VTS__join(temp_max_sized_VTS, vts1,vts2);
-   res = vts_tab__find__or__clone_and_add(temp_max_sized_VTS);
+   /* Commonly one arg is <= the other, e.g. a thread joining in a
+      location's clock it already knows about.  Then the join is the
+      other arg, and there is no need to look it up in vts_set. */
+   switch (VTS__join(temp_max_sized_VTS, vts1,vts2)) {
+      case 1:  res = vi1; stats__join2_dominated++; break;
+      case 2:  res = vi2; stats__join2_dominated++; break;
+      default: res = vts_tab__find__or__clone_and_add(temp_max_sized_VTS);
+   }
    ////++
    join2_cache[hash].vi1 = vi1;
    join2_cache[hash].vi2 = vi2;
@@ -3524,6 +3745,16 @@ static VtsID VtsID__mk_Singleton ( Thr* thr, ULong tym ) {
    return vts_tab__find__or__clone_and_add(temp_max_sized_VTS);
 }
 
+/* create the VTS standing for the epoch [thrid:tym], that is a
+   singleton, or the empty VTS if thrid has been pruned already */
+static VtsID VtsID__mk_Epoch ( ThrID thrid, ULong tym ) {
+   Thr* thr = Thr__from_ThrID(thrid);
+   temp_max_sized_VTS->usedTS = 0;
+   if (!thr->pruned)
+      VTS__singleton(temp_max_sized_VTS, thr,tym);
+   return vts_tab__find__or__clone_and_add(temp_max_sized_VTS);
+}
+
 /* tick operation, creates value 1 if specified index is absent */
 static VtsID VtsID__tick ( VtsID vi, Thr* idx ) {
    VTS* vts = VtsID__to_VTS(vi);
@@ -3538,6 +3769,11 @@ static ULong VtsID__indexAt ( VtsID vi, Thr* idx ) {
    return VTS__indexAt_SLOW( vts, idx );
 }
 
+/* index into a VTS, quickly */
+static inline ULong VtsID__indexAt_ThrID ( VtsID vi, ThrID thrid ) {
+   return VTS__indexAt_ThrID( VtsID__to_VTS(vi), thrid );
+}
+
 /* Assuming that !cmpLEQ(vi1, vi2), find the index of the first (or
    any, really) element in vi1 which is pointwise greater-than the
    corresponding element in vi2.  If no such element exists, return
@@ -4069,7 +4305,7 @@ static Thr* Thr__new ( void )
    thr->llexit_done = False;
    thr->joinedwith_done = False;
    thr->filter = HG_(zalloc)( "libhb.Thr__new.2", sizeof(Filter) );
-   if (HG_(clo_history_level) == 1)
+   if (HG_(clo_history_level) == 1 || HG_(clo_history_level) == 3)
       thr->local_Kws_n_stacks
          = VG_(newXA)( HG_(zalloc),
                        "libhb.Thr__new.3 (local_Kws_and_stacks)",
@@ -4105,8 +4341,9 @@ static void note_local_Kw_n_stack_for ( Thr* thr )
    ULong_n_EC pair;
    tl_assert(thr);
 
-   // We only collect this info at history level 1 (approx)
-   if (HG_(clo_history_level) != 1) 
+   // We only collect this info at history levels 1 (approx) and
+   // 3 (sampled)
+   if (HG_(clo_history_level) != 1 && HG_(clo_history_level) != 3)
       return;
 
    /* This is the scalar Kw for thr. */
@@ -4168,15 +4405,93 @@ static Int cmp__ULong_n_EC__by_ULong ( const ULong_n_EC* pair1,
 
       <---------30--------->    <---------30--------->
    00 X-----Rmin-VtsID-----X 00 X-----Wmin-VtsID-----X   C(Rmin,Wmin)
+   01 0 X---Thr---X X-----Rtym-----X X-----Wtym------X   E(Thr:Rtym,Thr:Wtym)
+   01 1 X-Rthr-X X-Wthr-X X----Rtym----X X----Wtym---X   E(Rthr:Rtym,Wthr:Wtym)
    10 X--------------------X XX X--------------------X   A: SVal_NOACCESS
    11 0--------------------0 00 0--------------------0   A: SVal_INVALID
 
+   E values are C values whose constraints are epochs, so that they
+   can be stored, and checked, without referring to any VTS.  The
+   epoch Thr:tym stands for Thr's VTS at the end of the segment in
+   which its scalar clock is tym.  That is exact: a thread's own
+   scalar clock only leaves it (by a send, or by creating a child)
+   just before it ticks, so any VTS holding tym or more at Thr's index
+   is at least Thr's VTS during that segment.  Hence 'Rmin <= K'
+   reduces to 'Rtym <= K[Rthr]', and is trivially true when the
+   accessing thread is Rthr itself.
+
+   Writes make E(Thr:now,Thr:now).  Reads keep a location in E form as
+   long as its previous accesses all happen before the read: a single
+   thread accessing a location uses the first form, a location last
+   written by one thread and then read by another, the second one.
+   Locations read by several concurrent threads, racy locations, and
+   epochs too big for the fields (Rtym >= 2^21 in the first form;
+   thread numbers >= 1024 + 2^13 or Rtym >= 2^17 in the second one)
+   use C values, and E values are converted ("inflated") to C values
+   when needed.
 */
 #define SVAL_TAGMASK (3ULL << 62)
 
+#define SVAL_E_2THR        (1ULL << 61)
+#define SVAL_E1_RTYMBITS   ((61 - SCALARTS_N_THRBITS) / 2)
+#define SVAL_E1_WTYMBITS   (61 - SCALARTS_N_THRBITS - SVAL_E1_RTYMBITS)
+#define SVAL_E2_THRBITS    13
+#define SVAL_E2_RTYMBITS   17
+#define SVAL_E2_WTYMBITS   18
+#define SVAL_MASK(_nbits)  ((1ULL << (_nbits)) - 1)
+
 static inline Bool SVal__isC ( SVal s ) {
    return (0ULL << 62) == (s & SVAL_TAGMASK);
 }
+static inline Bool SVal__isE ( SVal s ) {
+   return (1ULL << 62) == (s & SVAL_TAGMASK);
+}
+/* Make E(rthr:rtym,wthr:wtym), or return SVal_INVALID if that doesn't
+   fit. */
+static inline SVal SVal__mkE ( ThrID rthr, ULong rtym,
+                               ThrID wthr, ULong wtym ) {
+   if (LIKELY(rthr == wthr)) {
+      if (UNLIKELY(rtym > SVAL_MASK(SVAL_E1_RTYMBITS)
+                   || wtym > SVAL_MASK(SVAL_E1_WTYMBITS)))
+         return SVal_INVALID;
+      return (1ULL << 62)
+             | (((ULong)rthr) << (SVAL_E1_RTYMBITS + SVAL_E1_WTYMBITS))
+             | (rtym << SVAL_E1_WTYMBITS)
+             | wtym;
+   } else {
+      ULong rix = rthr - 1024;
+      ULong wix = wthr - 1024;
+      if (UNLIKELY(rix > SVAL_MASK(SVAL_E2_THRBITS)
+                   || wix > SVAL_MASK(SVAL_E2_THRBITS)
+                   || rtym > SVAL_MASK(SVAL_E2_RTYMBITS)
+                   || wtym > SVAL_MASK(SVAL_E2_WTYMBITS)))
+         return SVal_INVALID;
+      return (1ULL << 62) | SVAL_E_2THR
+             | (rix << (SVAL_E2_THRBITS
+                        + SVAL_E2_RTYMBITS + SVAL_E2_WTYMBITS))
+             | (wix << (SVAL_E2_RTYMBITS + SVAL_E2_WTYMBITS))
+             | (rtym << SVAL_E2_WTYMBITS)
+             | wtym;
+   }
+}
+static inline void SVal__unE ( SVal s, /*OUT*/ThrID* rthr, /*OUT*/ULong* rtym,
+                                       /*OUT*/ThrID* wthr, /*OUT*/ULong* wtym ) {
+   tl_assert(SVal__isE(s));
+   if (LIKELY(!(s & SVAL_E_2THR))) {
+      *rthr = *wthr = (ThrID)((s >> (SVAL_E1_RTYMBITS + SVAL_E1_WTYMBITS))
+                              & SVAL_MASK(SCALARTS_N_THRBITS));
+      *rtym = (s >> SVAL_E1_WTYMBITS) & SVAL_MASK(SVAL_E1_RTYMBITS);
+      *wtym = s & SVAL_MASK(SVAL_E1_WTYMBITS);
+   } else {
+      *rthr = 1024 + (ThrID)((s >> (SVAL_E2_THRBITS
+                                    + SVAL_E2_RTYMBITS + SVAL_E2_WTYMBITS))
+                             & SVAL_MASK(SVAL_E2_THRBITS));
+      *wthr = 1024 + (ThrID)((s >> (SVAL_E2_RTYMBITS + SVAL_E2_WTYMBITS))
+                             & SVAL_MASK(SVAL_E2_THRBITS));
+      *rtym = (s >> SVAL_E2_WTYMBITS) & SVAL_MASK(SVAL_E2_RTYMBITS);
+      *wtym = s & SVAL_MASK(SVAL_E2_WTYMBITS);
+   }
+}
 static inline SVal SVal__mkC ( VtsID rmini, VtsID wmini ) {
    //tl_assert(VtsID__is_valid(rmini));
    //tl_assert(VtsID__is_valid(wmini));
@@ -4199,6 +4514,28 @@ static inline SVal SVal__mkA ( void ) {
    return 2ULL << 62;
 }
 
+/* The state of a location just written by thr, C(viW,viW), in E form
+   if it fits. */
+static inline SVal SVal__mkWrite ( Thr* thr ) {
+   SVal s = SVal__mkE( thr->thrid, thr->own_tym, thr->thrid, thr->own_tym );
+   if (UNLIKELY(s == SVal_INVALID))
+      s = SVal__mkC( thr->viW, thr->viW );
+   return s;
+}
+
+/* Convert an E value to the equivalent C value.  Wmin is made to
+   include Rmin, as the C invariant Rmin <= Wmin requires; with epochs
+   that is implicit. */
+static SVal SVal__inflate ( SVal s ) {
+   ThrID rthr, wthr;
+   ULong rtym, wtym;
+   VtsID rmini;
+   SVal__unE( s, &rthr, &rtym, &wthr, &wtym );
+   rmini = VtsID__mk_Epoch( rthr, rtym );
+   return SVal__mkC( rmini,
+                     VtsID__join2( rmini, VtsID__mk_Epoch( wthr, wtym ) ) );
+}
+
 /* Direct callback from lib_zsm. */
 static inline void SVal__rcinc ( SVal s ) {
    if (SVal__isC(s)) {
@@ -4298,6 +4635,14 @@ static void free_RCEC ( RCEC* rcec ) {
 //////////// END RCEC pool allocator
 
 static RCEC** contextTab = NULL; /* hash table of RCEC*s */
+static UWord  contextTab_size = N_RCEC_TAB; /* nr of slots in contextTab */
+
+/* Max nr of RCECs, or 0 if unlimited.  Only limited at history level 3,
+   where reaching it causes an immediate GC of the unreferenced RCECs. */
+static UWord  RCEC_max = 0;
+
+/* Max nr of OldRefs, each referencing one RCEC.  See oldrefHT below. */
+static UWord  oldrefHTN_max = 0;
 
 /* Count of allocated RCEC having ref count > 0 */
 static UWord RCEC_referenced = 0;
@@ -4381,6 +4726,8 @@ static void move_RCEC_one_step_forward ( RCEC** headp, RCEC* ec )
 }
 
 
+static void do_RCEC_GC ( void );
+
 /* Find the given RCEC in the tree, and return a pointer to it.  Or,
    if not present, add the given one to the tree (by making a copy of
    it, so the caller can immediately deallocate the original) and
@@ -4404,7 +4751,7 @@ static RCEC* ctxt__find_or_add ( RCEC* example )
 
    /* Search the hash table to see if we already have it. */
    stats__ctxt_tab_qs++;
-   hent = example->frames_hash % N_RCEC_TAB;
+   hent = example->frames_hash % contextTab_size;
    copy = contextTab[hent];
    while (1) {
       if (!copy) break;
@@ -4423,6 +4770,14 @@ static RCEC* ctxt__find_or_add ( RCEC* example )
          move_RCEC_one_step_forward( &contextTab[hent], copy );
       }
    } else {
+      /* At RCEC_max, collect the unreferenced RCECs.  There are some
+         only if fewer RCECs can be referenced by OldRefs than RCEC_max:
+         otherwise, or if all are referenced anyway, let the table grow
+         rather than have do_RCEC_GC assert. */
+      if (UNLIKELY(RCEC_max > 0 && stats__ctxt_tab_curr >= RCEC_max)
+          && oldrefHTN_max < RCEC_max
+          && stats__ctxt_tab_curr > RCEC_referenced)
+         do_RCEC_GC();
       copy = alloc_RCEC();
       tl_assert(copy != example);
       *copy = *example;
@@ -4799,7 +5154,8 @@ static Word cmp_oldref_tsw (const void* node1, const void* node2 )
 //////////// BEGIN OldRef pool allocator
 static PoolAlloc* oldref_pool_allocator;
 // Note: We only allocate elements in this pool allocator, we never free them.
-// We stop allocating elements at VG_(clo_conflict_cache_size).
+// We stop allocating elements at oldrefHTN_max, which is
+// VG_(clo_conflict_cache_size) or derived from HG_(clo_history_budget).
 //////////// END OldRef pool allocator
 
 static OldRef mru; 
@@ -4850,7 +5206,7 @@ static UWord     oldrefHTN    = 0;    /* # elems in oldrefHT */
    have already been allocated. */
 static OldRef* alloc_or_reuse_OldRef ( void )
 {
-   if (oldrefHTN < HG_(clo_conflict_cache_size)) {
+   if (oldrefHTN < oldrefHTN_max) {
       oldrefHTN++;
       return VG_(allocEltPA) ( oldref_pool_allocator );
    } else {
@@ -4960,6 +5316,85 @@ static void event_map_bind ( Addr a, SizeT szB, Bool isW, Thr* thr )
 }
 
 
+
+/* History level 3 ("sampled") decides, for each access that changes
+   the shadow value, whether event_map_bind is called.
+
+   Each address range of 2^EVM_RANGE_BITS bytes is hashed onto a slot
+   of evm_sample, which remembers the range and the thread that last
+   accessed it.  An access is always recorded when the range or the
+   thread differs from the slot's, since the first access of a thread
+   to a range is the likely conflicting access of a later race.  Else
+   one access out of HG_(clo_history_sample_rate) is recorded.
+   Sampling per range rather than globally avoids a few very hot
+   ranges taking all the samples.
+
+   evm_hot is a direct-mapped set of the 8-byte granules on which a
+   race was detected.  All the accesses to these are recorded, so that
+   once a location has raced, the next report on it finds the
+   conflicting stack trace.  A granule evicted from evm_hot falls back
+   to sampling. */
+#define EVM_RANGE_BITS 6
+#define EVM_N_SAMPLES 4096 /* power of 2 */
+#define EVM_N_HOT 4096 /* power of 2 */
+
+typedef
+   struct {
+      Addr  range; /* address >> EVM_RANGE_BITS */
+      ThrID thrid;
+      UInt  ctr;
+   }
+   EvmSample;
+
+static EvmSample evm_sample[EVM_N_SAMPLES];
+static Addr      evm_hot[EVM_N_HOT]; /* granule address, or 0 if empty */
+
+static UWord stats__evm_sample_hot = 0;
+static UWord stats__evm_sample_new = 0;
+static UWord stats__evm_sample_taken = 0;
+static UWord stats__evm_sample_skipped = 0;
+static UWord stats__evm_hot_marks = 0;
+
+static inline UWord evm_hot_ix ( Addr a ) {
+   return (a >> 3) & (EVM_N_HOT - 1);
+}
+
+static void event_map_mark_hot ( Addr a )
+{
+   Addr g = a & ~(Addr)7;
+   if (g == 0)
+      return;
+   if (evm_hot[evm_hot_ix(a)] != g) {
+      evm_hot[evm_hot_ix(a)] = g;
+      stats__evm_hot_marks++;
+   }
+}
+
+static inline Bool event_map_sample ( Addr a, Thr* thr )
+{
+   Addr       range = a >> EVM_RANGE_BITS;
+   EvmSample* smp;
+   if (evm_hot[evm_hot_ix(a)] == (a & ~(Addr)7)) {
+      stats__evm_sample_hot++;
+      return True;
+   }
+   smp = &evm_sample[range & (EVM_N_SAMPLES - 1)];
+   if (smp->range != range || smp->thrid != thr->thrid) {
+      smp->range = range;
+      smp->thrid = thr->thrid;
+      smp->ctr   = 1;
+      stats__evm_sample_new++;
+      return True;
+   }
+   if ((smp->ctr++ & (HG_(clo_history_sample_rate) - 1)) == 0) {
+      stats__evm_sample_taken++;
+      return True;
+   }
+   stats__evm_sample_skipped++;
+   return False;
+}
+
+
 /* Extract info from the conflicting-access machinery.
    Returns the most recent conflicting access with thr/[a, a+szB[/isW. */
 Bool libhb_event_map_lookup ( /*OUT*/ExeContext** resEC,
@@ -5111,11 +5546,37 @@ static void event_map_init ( void )
                              HG_(free)
                           );
 
+   /* At history level 3, size the OldRefs, the RCECs and their tables
+      to fit within HG_(clo_history_budget).  Each OldRef references
+      one RCEC; we allow as many unreferenced RCECs again before
+      collecting them, and count a hash table slot for each. */
+   oldrefHTN_max = HG_(clo_conflict_cache_size);
+   if (HG_(clo_history_level) == 3) {
+      static const UWord primes[]
+         = { 1021, 4093, 16381, 65521, N_RCEC_TAB };
+      SizeT budget = HG_(clo_history_budget) * 1024 * 1024;
+      SizeT fixed  = sizeof(evm_sample) + sizeof(evm_hot);
+      SizeT perRef = sizeof(OldRef) + 2 * sizeof(RCEC)
+                     + 2 * sizeof(void*);
+      oldrefHTN_max = budget > fixed + 1000 * perRef
+                      ? (budget - fixed) / perRef : 1000;
+      RCEC_max = 2 * oldrefHTN_max;
+      contextTab_size = primes[0];
+      for (i = 0; i < (Word)(sizeof(primes)/sizeof(primes[0])); i++)
+         if (primes[i] <= oldrefHTN_max / 2)
+            contextTab_size = primes[i];
+      if (VG_(clo_verbosity) > 1)
+         VG_(message)(Vg_DebugMsg,
+                      "libhb: sampled history: %lu OldRefs, %lu RCECs,"
+                      " %lu contextTab slots\n",
+                      oldrefHTN_max, RCEC_max, contextTab_size);
+   }
+
    /* Context table */
    tl_assert(!contextTab);
    contextTab = HG_(zalloc)( "libhb.event_map_init.2 (context table)",
-                             N_RCEC_TAB * sizeof(RCEC*) );
-   for (i = 0; i < N_RCEC_TAB; i++)
+                             contextTab_size * sizeof(RCEC*) );
+   for (i = 0; i < contextTab_size; i++)
       contextTab[i] = NULL;
 
    /* Oldref pool allocator */
@@ -5156,7 +5617,7 @@ static void event_map__check_reference_counts ( void )
       these to fall to zero before a GC, but the GC must get rid of
       all those that are zero, hence none should be zero after a
       GC. */
-   for (i = 0; i < N_RCEC_TAB; i++) {
+   for (i = 0; i < contextTab_size; i++) {
       for (rcec = contextTab[i]; rcec; rcec = rcec->next) {
          nEnts++;
          tl_assert(rcec);
@@ -5181,7 +5642,7 @@ static void event_map__check_reference_counts ( void )
    }
 
    /* compare check ref counts with actual */
-   for (i = 0; i < N_RCEC_TAB; i++) {
+   for (i = 0; i < contextTab_size; i++) {
       for (rcec = contextTab[i]; rcec; rcec = rcec->next) {
          tl_assert(rcec->rc == rcec->rcX);
       }
@@ -5200,14 +5661,14 @@ static void do_RCEC_GC ( void )
                    " %lu cur ents(ref'd %lu),"
                    " %lu max ents\n",
                    ctr++,
-                   (UWord)N_RCEC_TAB,
+                   contextTab_size,
                    stats__ctxt_tab_curr, RCEC_referenced,
                    stats__ctxt_tab_max );
    }
    tl_assert (stats__ctxt_tab_curr > RCEC_referenced);
 
    /* Throw away all RCECs with zero reference counts */
-   for (i = 0; i < N_RCEC_TAB; i++) {
+   for (i = 0; i < contextTab_size; i++) {
       RCEC** pp = &contextTab[i];
       RCEC*  p  = *pp;
       while (p) {
@@ -5242,6 +5703,24 @@ static ULong stats__msmcread         = 0;
 static ULong stats__msmcread_change  = 0;
 static ULong stats__msmcwrite        = 0;
 static ULong stats__msmcwrite_change = 0;
+static ULong stats__msmcread_epoch   = 0;
+static ULong stats__msmcwrite_epoch  = 0;
+static ULong stats__msm_inflate      = 0;
+
+/* Does the epoch thrid:tym happen before acc_thr's clock vi (its viR
+   or viW)?  See comments on SVal E values.  Accesses by a thread are
+   ordered after its own earlier accesses, and an epoch of a thread
+   which has been pruned from all VTSs doesn't constrain anything any
+   more, in the same way as the pruned C values. */
+static inline Bool epoch_LEQ ( ThrID thrid, ULong tym,
+                               Thr* acc_thr, VtsID vi )
+{
+   if (LIKELY(thrid == acc_thr->thrid))
+      return True;
+   if (LIKELY(tym <= VtsID__indexAt_ThrID( vi, thrid )))
+      return True;
+   return Thr__from_ThrID(thrid)->pruned;
+}
 
 /* Some notes on the H1 history mechanism:
 
@@ -5304,7 +5783,7 @@ static void record_race_info ( Thr* acc_thr,
       we know the error is not a duplicate. */
 
    /* Stacks for the bounds of the (or one of the) conflicting
-      segment(s).  These are only set at history_level 1. */
+      segment(s).  These are only set at history_level 1 and 3. */
    ExeContext* hist1_seg_start = NULL;
    ExeContext* hist1_seg_end   = NULL;
    Thread*     hist1_conf_thr  = NULL;
@@ -5312,9 +5791,15 @@ static void record_race_info ( Thr* acc_thr,
    tl_assert(acc_thr);
    tl_assert(acc_thr->hgthread);
    tl_assert(acc_thr->hgthread->hbthr == acc_thr);
-   tl_assert(HG_(clo_history_level) >= 0 && HG_(clo_history_level) <= 2);
+   tl_assert(HG_(clo_history_level) >= 0 && HG_(clo_history_level) <= 3);
 
-   if (HG_(clo_history_level) == 1) {
+   /* At history_level 3, collect all the accesses to this location
+      from now on, so as to have the conflicting access if it races
+      again. */
+   if (HG_(clo_history_level) == 3)
+      event_map_mark_hot( acc_addr );
+
+   if (HG_(clo_history_level) == 1 || HG_(clo_history_level) == 3) {
       Bool found;
       Word firstIx, lastIx;
       ULong_n_EC key;
@@ -5406,6 +5891,12 @@ static void record_race_info ( Thr* acc_thr,
 
 static Bool is_sane_SVal_C ( SVal sv ) {
    Bool leq;
+   if (SVal__isE(sv)) {
+      ThrID rthr, wthr;
+      ULong rtym, wtym;
+      SVal__unE( sv, &rthr, &rtym, &wthr, &wtym );
+      return rthr != wthr || rtym <= wtym;
+   }
    if (!SVal__isC(sv)) return True;
    leq = VtsID__cmpLEQ( SVal__unC_Rmin(sv), SVal__unC_Wmin(sv) );
    return leq;
@@ -5420,6 +5911,7 @@ static inline SVal msmcread ( SVal svOld,
                               Addr acc_addr, SizeT szB )
 {
    SVal svNew = SVal_INVALID;
+   SVal svC   = svOld;
    stats__msmcread++;
 
    /* Redundant sanity check on the constraints */
@@ -5427,11 +5919,29 @@ static inline SVal msmcread ( SVal svOld,
       tl_assert(is_sane_SVal_C(svOld));
    }
 
-   if (LIKELY(SVal__isC(svOld))) {
+   if (LIKELY(SVal__isE(svOld))) {
+      ThrID rthr, wthr;
+      ULong rtym, wtym;
+      SVal__unE( svOld, &rthr, &rtym, &wthr, &wtym );
+      if (LIKELY(epoch_LEQ(rthr, rtym, acc_thr, acc_thr->viR)
+                 && epoch_LEQ(wthr, wtym, acc_thr, acc_thr->viW))) {
+         /* no race, and Wmin `join` tviW == tviW */
+         svNew = SVal__mkE( rthr, rtym, acc_thr->thrid, acc_thr->own_tym );
+         if (LIKELY(svNew != SVal_INVALID)) {
+            stats__msmcread_epoch++;
+            goto out;
+         }
+      }
+      /* Read-shared or racy location, or epoch too big: do it the
+         hard way. */
+      stats__msm_inflate++;
+      svC = SVal__inflate( svOld );
+   }
+   if (LIKELY(SVal__isC(svC))) {
       VtsID tviR  = acc_thr->viR;
       VtsID tviW  = acc_thr->viW;
-      VtsID rmini = SVal__unC_Rmin(svOld);
-      VtsID wmini = SVal__unC_Wmin(svOld);
+      VtsID rmini = SVal__unC_Rmin(svC);
+      VtsID wmini = SVal__unC_Wmin(svC);
       Bool  leq   = VtsID__cmpLEQ(rmini,tviR);
       if (LIKELY(leq)) {
          /* no race */
@@ -5468,7 +5978,8 @@ static inline SVal msmcread ( SVal svOld,
    if (UNLIKELY(svNew != svOld)) {
       tl_assert(svNew != SVal_INVALID);
       if (HG_(clo_history_level) >= 2
-          && SVal__isC(svOld) && SVal__isC(svNew)) {
+          && !SVal__isA(svOld) && !SVal__isA(svNew)
+          && (HG_(clo_history_level) == 2 || event_map_sample(acc_addr, acc_thr))) {
          event_map_bind( acc_addr, szB, False/*!isWrite*/, acc_thr );
          stats__msmcread_change++;
       }
@@ -5485,6 +5996,7 @@ static inline SVal msmcwrite ( SVal svOld,
                               Addr acc_addr, SizeT szB )
 {
    SVal svNew = SVal_INVALID;
+   SVal svC   = svOld;
    stats__msmcwrite++;
 
    /* Redundant sanity check on the constraints */
@@ -5492,16 +6004,30 @@ static inline SVal msmcwrite ( SVal svOld,
       tl_assert(is_sane_SVal_C(svOld));
    }
 
-   if (LIKELY(SVal__isC(svOld))) {
+   if (LIKELY(SVal__isE(svOld))) {
+      ThrID rthr, wthr;
+      ULong rtym, wtym;
+      SVal__unE( svOld, &rthr, &rtym, &wthr, &wtym );
+      if (LIKELY(epoch_LEQ(wthr, wtym, acc_thr, acc_thr->viW))) {
+         /* no race */
+         svNew = SVal__mkWrite( acc_thr );
+         stats__msmcwrite_epoch++;
+         goto out;
+      }
+      /* Racy location: do it the hard way. */
+      stats__msm_inflate++;
+      svC = SVal__inflate( svOld );
+   }
+   if (LIKELY(SVal__isC(svC))) {
       VtsID tviW  = acc_thr->viW;
-      VtsID wmini = SVal__unC_Wmin(svOld);
+      VtsID wmini = SVal__unC_Wmin(svC);
       Bool  leq   = VtsID__cmpLEQ(wmini,tviW);
       if (LIKELY(leq)) {
          /* no race */
-         svNew = SVal__mkC( tviW, tviW );
+         svNew = SVal__mkWrite( acc_thr );
          goto out;
       } else {
-         VtsID rmini = SVal__unC_Rmin(svOld);
+         VtsID rmini = SVal__unC_Rmin(svC);
          /* assert on sanity of constraints. */
          Bool leqxx = VtsID__cmpLEQ(rmini,wmini);
          tl_assert(leqxx);
@@ -5541,7 +6067,8 @@ static inline SVal msmcwrite ( SVal svOld,
    if (UNLIKELY(svNew != svOld)) {
       tl_assert(svNew != SVal_INVALID);
       if (HG_(clo_history_level) >= 2
-          && SVal__isC(svOld) && SVal__isC(svNew)) {
+          && !SVal__isA(svOld) && !SVal__isA(svNew)
+          && (HG_(clo_history_level) == 2 || event_map_sample(acc_addr, acc_thr))) {
          event_map_bind( acc_addr, szB, True/*isWrite*/, acc_thr );
          stats__msmcwrite_change++;
       }
@@ -6100,9 +6627,7 @@ static void zsm_sset_range ( Addr a, SizeT len, SVal svNew )
       static UWord n_New_not_in_cache = 0;
       /* tag is 'a' with the in-line offset masked out, 
          eg a[31]..a[4] 0000 */
-      Addr       tag = a & ~(N_LINE_ARANGE - 1);
-      UWord      wix = (a >> N_LINE_BITS) & (N_WAY_NENT - 1);
-      if (LIKELY(tag == cache_shmem.tags0[wix])) {
+      if (LIKELY(find_cacheline(a) != NULL)) {
          n_New_in_cache++;
       } else {
          n_New_not_in_cache++;
@@ -6144,13 +6669,11 @@ static void zsm_sset_range ( Addr a, SizeT len, SVal svNew )
 
       while (1) {
          Addr tag;
-         UWord wix;
          if (aligned_start >= after_start)
             break;
          tl_assert(get_cacheline_offset(aligned_start) == 0);
          tag = aligned_start & ~(N_LINE_ARANGE - 1);
-         wix = (aligned_start >> N_LINE_BITS) & (N_WAY_NENT - 1);
-         if (tag == cache_shmem.tags0[wix]) {
+         if (find_cacheline(aligned_start) != NULL) {
             UWord i;
             for (i = 0; i < N_LINE_ARANGE / 8; i++)
                zsm_swrite64( aligned_start + i * 8, svNew );
@@ -6444,7 +6967,7 @@ void libhb_Thr_resumes ( Thr* thr )
       at all, get one right now.  This is easier than figuring out
       exactly when at thread startup we can and can't take a stack
       snapshot. */
-   if (HG_(clo_history_level) == 1) {
+   if (HG_(clo_history_level) == 1 || HG_(clo_history_level) == 3) {
       tl_assert(thr->local_Kws_n_stacks);
       if (VG_(sizeXA)( thr->local_Kws_n_stacks ) == 0)
          note_local_Kw_n_stack_for(thr);
@@ -6466,6 +6989,7 @@ static SO* SO__Alloc ( void )
    SO* so = HG_(zalloc)( "libhb.SO__Alloc.1", sizeof(SO) );
    so->viR   = VtsID_INVALID;
    so->viW   = VtsID_INVALID;
+   so->last_sender = 0;
    so->magic = SO_MAGIC;
    /* Add to double linked list */
    if (admin_SO) {
@@ -6583,6 +7107,7 @@ Thr* libhb_init (
    vi  = VtsID__mk_Singleton( thr, 1 );
    thr->viR = vi;
    thr->viW = vi;
+   thr->own_tym = 1;
    VtsID__rcinc(thr->viR);
    VtsID__rcinc(thr->viW);
 
@@ -6610,12 +7135,14 @@ Thr* libhb_create ( Thr* parent )
 
    tl_assert(VtsID__indexAt( child->viR, child ) == 1);
    tl_assert(VtsID__indexAt( child->viW, child ) == 1);
+   child->own_tym = 1;
 
    /* and the parent has to move along too */
    VtsID__rcdec(parent->viR);
    VtsID__rcdec(parent->viW);
    parent->viR = VtsID__tick( parent->viR, parent );
    parent->viW = VtsID__tick( parent->viW, parent );
+   parent->own_tym++;
    Filter__clear(parent->filter, "libhb_create(parent)");
    VtsID__rcinc(parent->viR);
    VtsID__rcinc(parent->viW);
@@ -6659,8 +7186,11 @@ void libhb_shutdown ( Bool show_stats )
                   stats__secmaps_search, stats__secmaps_search_slow);
 
       VG_(printf)("%s","\n");
-      VG_(printf)("   cache: %'lu totrefs (%'lu misses)\n",
-                  stats__cache_totrefs, stats__cache_totmisses );
+      VG_(printf)("   cache: %'lu lines, %'lu ways\n",
+                  cache_shmem.nEnt, cache_shmem.nWays );
+      VG_(printf)("   cache: %'lu totrefs (%'lu misses, %'lu hits in ways > 0)\n",
+                  stats__cache_totrefs, stats__cache_totmisses,
+                  stats__cache_way_hits );
       VG_(printf)("   cache: %'14lu Z-fetch,    %'14lu F-fetch\n",
                   stats__cache_Z_fetches, stats__cache_F_fetches );
       VG_(printf)("   cache: %'14lu Z-wback,    %'14lu F-wback\n",
@@ -6711,10 +7241,16 @@ void libhb_shutdown ( Bool show_stats )
                   stats__msmcread, stats__msmcread_change);
       VG_(printf)("   libhb: %'13llu msmcwrite (%'llu dragovers)\n",
                   stats__msmcwrite, stats__msmcwrite_change);
+      VG_(printf)("   libhb: %'13llu epoch reads, %'llu epoch writes,"
+                  " %'llu inflations\n",
+                  stats__msmcread_epoch, stats__msmcwrite_epoch,
+                  stats__msm_inflate);
       VG_(printf)("   libhb: %'13llu cmpLEQ queries (%'llu misses)\n",
                   stats__cmpLEQ_queries, stats__cmpLEQ_misses);
-      VG_(printf)("   libhb: %'13llu join2  queries (%'llu misses)\n",
-                  stats__join2_queries, stats__join2_misses);
+      VG_(printf)("   libhb: %'13llu join2  queries (%'llu misses, "
+                  "%'llu dominated)\n",
+                  stats__join2_queries, stats__join2_misses,
+                  stats__join2_dominated);
 
       VG_(printf)("%s","\n");
       VG_(printf)("   libhb: VTSops: tick %'lu,  join %'lu,  cmpLEQ %'lu\n",
@@ -6726,6 +7262,8 @@ void libhb_shutdown ( Bool show_stats )
                    stats__vts_set__focaa, stats__vts_set__focaa_a );
       VG_(printf)( "   libhb: VTSops: indexAt_SLOW %'lu\n",
                    stats__vts__indexat_slow );
+      VG_(printf)( "   libhb: SO recvs by last sender (no join) %'lu\n",
+                   stats__so_recv_fast );
 
       VG_(printf)("%s","\n");
       VG_(printf)(
@@ -6734,6 +7272,25 @@ void libhb_shutdown ( Bool show_stats )
       );
       VG_(printf)("   libhb: #%lu vts_tab GC    #%lu vts pruning\n",
                   stats__vts_tab_GC, stats__vts_pruning);
+      {
+         /* The size of the live VTSs, which pruning keeps in line with
+            the number of threads not yet exited and joined with. */
+         UWord i, nLive = 0, nSTSs = 0, maxSTSs = 0, szB = 0;
+         for (i = 0; i < VG_(sizeXA)( vts_tab ); i++) {
+            const VtsTE* te = VG_(indexXA)( vts_tab, i );
+            if (te->vts == NULL)
+               continue;
+            nLive++;
+            nSTSs += te->vts->usedTS;
+            if (te->vts->usedTS > maxSTSs)
+               maxSTSs = te->vts->usedTS;
+            /* as allocated by VTS__new, including the header */
+            szB += sizeof(VTS) + (te->vts->sizeTS+1) * sizeof(ScalarTS);
+         }
+         VG_(printf)("   libhb: %lu live VTSs, %lu ScalarTSs"
+                     " (max %lu per VTS), %lu VTS bytes\n",
+                     nLive, nSTSs, maxSTSs, szB);
+      }
       VG_(printf)( "   libhb: %lu entries in vts_set\n",
                    VG_(sizeFM)( vts_set ) );
 
@@ -6789,9 +7346,17 @@ void libhb_shutdown ( Bool show_stats )
       VG_(printf)( "   libhb: contextTab: %lu slots,"
                    " %lu cur ents(ref'd %lu),"
                    " %lu max ents\n",
-                   (UWord)N_RCEC_TAB,
+                   contextTab_size,
                    stats__ctxt_tab_curr, RCEC_referenced,
                    stats__ctxt_tab_max );
+      if (HG_(clo_history_level) == 3)
+         VG_(printf)( "   libhb: sampled history: %lu OldRefs max,"
+                      " %'lu hot %'lu new %'lu sampled %'lu skipped,"
+                      " %'lu hot marks\n",
+                      oldrefHTN_max, stats__evm_sample_hot,
+                      stats__evm_sample_new,
+                      stats__evm_sample_taken, stats__evm_sample_skipped,
+                      stats__evm_hot_marks);
       VG_(printf) ("   libhb: stats__cached_rcec "
                    "identical %'lu updated %'lu fresh %'lu\n",
                    stats__cached_rcec_identical, stats__cached_rcec_updated,
@@ -6812,7 +7377,7 @@ void libhb_shutdown ( Bool show_stats )
          RCEC *p;
 
          for (i = 0; i <= MAXCHAIN; i++) chains[i] = 0;
-         for (i = 0; i < N_RCEC_TAB; i++) {
+         for (i = 0; i < contextTab_size; i++) {
             n = 0;
             for (p = contextTab[i]; p; p = p->next)
                n++;
@@ -6976,11 +7541,28 @@ void libhb_so_send ( Thr* thr, SO* so, Bool strong_send )
       VtsID__rcinc(so->viW);
    }
 
-   /* move both parent clocks along */
+   /* If the SO now holds exactly the sender's clocks, remember who
+      sent them.  Until someone else sends on it, a receive by that
+      same thread cannot advance its clocks (they only ever grow), so
+      libhb_so_recv can skip the joins entirely.  This is the common
+      case of a thread re-acquiring an uncontended lock. */
+   so->last_sender = (so->viR == thr->viR && so->viW == thr->viW)
+                        ? thr->thrid : 0;
+
+   /* move both parent clocks along.  The r- and w-clocks are very
+      often the same VTS, in which case tick it only once. */
    VtsID__rcdec(thr->viR);
    VtsID__rcdec(thr->viW);
-   thr->viR = VtsID__tick( thr->viR, thr );
-   thr->viW = VtsID__tick( thr->viW, thr );
+   if (thr->viR == thr->viW) {
+      thr->viR = VtsID__tick( thr->viR, thr );
+      thr->viW = thr->viR;
+   } else {
+      thr->viR = VtsID__tick( thr->viR, thr );
+      thr->viW = VtsID__tick( thr->viW, thr );
+   }
+   thr->own_tym++;
+   if (CHECK_MSM)
+      tl_assert(thr->own_tym == VtsID__indexAt( thr->viW, thr ));
    if (!thr->llexit_done) {
       Filter__clear(thr->filter, "libhb_so_send");
       note_local_Kw_n_stack_for(thr);
@@ -6999,7 +7581,14 @@ void libhb_so_recv ( Thr* thr, SO* so, Bool strong_recv )
    tl_assert(so);
    tl_assert(so->magic == SO_MAGIC);
 
-   if (so->viR != VtsID_INVALID) {
+   if (so->viR != VtsID_INVALID && so->last_sender == thr->thrid) {
+      /* Fast path: 'thr' was the last thread to send on 'so', and the
+         SO holds the clocks it had at that point.  Its own clocks
+         dominate those, so the joins below would be no-ops. */
+      tl_assert(so->viW != VtsID_INVALID);
+      stats__so_recv_fast++;
+
+   } else if (so->viR != VtsID_INVALID) {
       tl_assert(so->viW != VtsID_INVALID);
 
       /* Weak receive (basically, an R-acquisition of a R-W lock).
@@ -7078,7 +7667,7 @@ static void trace ( Thr* thr, Addr a, SizeT szB, const HChar* s )
 
 void libhb_srange_new ( Thr* thr, Addr a, SizeT szB )
 {
-   SVal sv = SVal__mkC(thr->viW, thr->viW);
+   SVal sv = SVal__mkWrite(thr);
    tl_assert(is_sane_SVal_C(sv));
    if (0 && TRACEME(a,szB)) trace(thr,a,szB,"nw-before");
    zsm_sset_range( a, szB, sv );
@@ -7229,9 +7818,6 @@ static void zsm_sset_range_noaccess (Addr addr, SizeT len)
       while (sm_start < AFC) {
          SecMap *sm = shmem__find_SecMap (sm_start);
          if (sm) {
-            Addr gaKey;
-            SecMap *fm_sm;
-
             if (CHECK_ZSM) tl_assert(is_sane_SecMap(sm));
             for (UInt lz = 0; lz < N_SECMAP_ZLINES; lz++) {
                LineZ *lineZ = &sm->linesZ[lz];
@@ -7240,11 +7826,7 @@ static void zsm_sset_range_noaccess (Addr addr, SizeT len)
                else
                   clear_LineF_of_Z(lineZ);
             }
-            if (!VG_(delFromFM)(map_shmem, &gaKey, (UWord*)&fm_sm, sm_start))
-               tl_assert (0);
-            stats__secmaps_in_map_shmem--;
-            tl_assert (gaKey == sm_start);
-            tl_assert (sm == fm_sm);
+            shmem__del_SecMap (sm_start, sm);
             stats__secmaps_ssetGCed++;
             push_SecMap_on_freelist (sm);
          }
@@ -7298,14 +7880,13 @@ UWord libhb_srange_get_abits (Addr a, UChar *abits, SizeT len)
    for (SizeT i = 0; i < len; i++) {
       SVal       sv = SVal_INVALID;
       Addr       b = a + i;
-      Addr       tag = b & ~(N_LINE_ARANGE - 1);
-      UWord      wix = (b >> N_LINE_BITS) & (N_WAY_NENT - 1);
+      CacheLine* cl = find_cacheline(b);
       UWord      cloff = get_cacheline_offset(b);
 
       /* Note: we do not use get_cacheline(b) to avoid creating cachelines
          and/or SecMap for non addressable bytes. */
-      if (tag == cache_shmem.tags0[wix]) {
-         CacheLine copy = cache_shmem.lyns0[wix];
+      if (cl != NULL) {
+         CacheLine copy = *cl;
          /* We work on a copy of the cacheline, as we do not want to
             record the client request as a real read.
             The below is somewhat similar to zsm_sapply08__msmcread but
@@ -7395,7 +7976,7 @@ void libhb_maybe_GC ( void )
      Avoid growing too much the nr of RCEC keeps the memory use low,
      and avoids to have too many elements in the (fixed) contextTab hashtable.
    */
-   if (UNLIKELY(stats__ctxt_tab_curr > N_RCEC_TAB/2
+   if (UNLIKELY(stats__ctxt_tab_curr > contextTab_size/2
                 && stats__ctxt_tab_curr + 1000 >= stats__ctxt_tab_max
                 && (stats__ctxt_tab_curr * 3)/4 > RCEC_referenced))
       do_RCEC_GC();
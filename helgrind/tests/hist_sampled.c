@@ -0,0 +1,41 @@
+/* Check --history-level=sampled with a very low sampling rate: the
+   first access of a thread to an address range is always collected,
+   and once 'x' has raced, all its accesses are collected, so both
+   races show the exact conflicting access. */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static volatile int x;
+
+static void ms_sleep ( long ms )
+{
+   struct timespec delay = { 0, ms * 1000 * 1000 };
+   nanosleep(&delay, 0);
+}
+
+static void* child_fn ( void* arg )
+{
+   x = 1;          /* first access of the child to x's range */
+   ms_sleep(200);
+   x = 3;          /* races with x = 2, collected as x is hot */
+   return NULL;
+}
+
+int main ( void )
+{
+   pthread_t child;
+   if (pthread_create(&child, NULL, child_fn, NULL)) {
+      perror("pthread_create");
+      exit(1);
+   }
+   ms_sleep(100);
+   x = 2;          /* races with child's x = 1 */
+   if (pthread_join(child, NULL)) {
+      perror("pthread join");
+      exit(1);
+   }
+   return 0;
+}
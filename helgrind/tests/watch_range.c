@@ -0,0 +1,42 @@
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "helgrind/helgrind.h"
+
+/* Parent and child both modify x and y with no locking.  Only y is
+   watched, so with --watch-only=yes only the races on y are reported. */
+
+int x = 0;
+int y = 0;
+
+void* child_fn ( void* arg )
+{
+   /* Unprotected relative to parent */
+   x++;
+   y++;
+   return NULL;
+}
+
+int main ( void )
+{
+   const struct timespec delay = { 0, 100 * 1000 * 1000 };
+   pthread_t child;
+   VALGRIND_HG_WATCH_RANGE(&y, sizeof(y));
+   if (pthread_create(&child, NULL, child_fn, NULL)) {
+      perror("pthread_create");
+      exit(1);
+   }
+   nanosleep(&delay, 0);
+   /* Unprotected relative to child */
+   x++;
+   y++;
+
+   if (pthread_join(child, NULL)) {
+      perror("pthread join");
+      exit(1);
+   }
+   VALGRIND_HG_UNWATCH_RANGE(&y, sizeof(y));
+
+   return 0;
+}
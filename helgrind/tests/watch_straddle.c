@@ -0,0 +1,41 @@
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "helgrind/helgrind.h"
+
+/* Parent and child both modify an 8-byte double of which only the last
+   four bytes are watched.  Every access starts below the watched range,
+   so with --watch-only=yes the races are only reported if the watch
+   check tests for overlap rather than for the start address alone. */
+
+union { double d; int i[2]; } z;
+
+void* child_fn ( void* arg )
+{
+   /* Unprotected relative to parent */
+   z.d += 1.0;
+   return NULL;
+}
+
+int main ( void )
+{
+   const struct timespec delay = { 0, 100 * 1000 * 1000 };
+   pthread_t child;
+   VALGRIND_HG_WATCH_RANGE(&z.i[1], sizeof(z.i[1]));
+   if (pthread_create(&child, NULL, child_fn, NULL)) {
+      perror("pthread_create");
+      exit(1);
+   }
+   nanosleep(&delay, 0);
+   /* Unprotected relative to child */
+   z.d += 1.0;
+
+   if (pthread_join(child, NULL)) {
+      perror("pthread join");
+      exit(1);
+   }
+   VALGRIND_HG_UNWATCH_RANGE(&z.i[1], sizeof(z.i[1]));
+
+   return 0;
+}
@@ -220,6 +220,10 @@ extern void VG_(pp_addrinfo) ( Addr a, const AddrInfo* ai );
      has a recently freed list. */
 extern void VG_(pp_addrinfo_mc) ( Addr a, const AddrInfo* ai, Bool maybe_gcc );
 
+/* Writes the AddrInfo ai describing a as fields of the error being
+   written to the binary report (see VG_(binrep_word) et al). */
+extern void VG_(binrep_addrinfo) ( Addr a, const AddrInfo* ai );
+
 #endif   // __PUB_TOOL_ADDRINFO_H
 
 /*--------------------------------------------------------------------*/
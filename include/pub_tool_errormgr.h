@@ -106,6 +106,24 @@ extern Bool VG_(unique_error) ( ThreadId tid, ErrorKind ekind,
 extern Bool VG_(get_line) ( Int fd, HChar** bufpp, SizeT* nBufp, Int* lineno );
 
 
+/* ------------------------------------------------------------------ */
+/* Binary reports.  With --binary-report-file=<file>, errors are not
+   printed: each error shown is appended to <file> as a record holding
+   its kind, thread and the raw IPs of its stack trace, without any
+   symbolisation.  The valgrind-report script converts such a file to
+   text, XML or JSON, symbolising the stack traces offline.
+
+   A tool supporting binary reports (see VG_(needs_binary_report))
+   describes the tool-specific part of an error by calling these
+   functions from its binrep_Error method.  'field' names the value in
+   the converted report; it must be a string literal.  Stack traces are
+   written only once per ExeContext, however many errors refer to them. */
+extern void VG_(binrep_word)       ( const HChar* field, UWord w );
+extern void VG_(binrep_sword)      ( const HChar* field, Word w );
+extern void VG_(binrep_string)     ( const HChar* field, const HChar* s );
+extern void VG_(binrep_ExeContext) ( const HChar* field, ExeContext* ec );
+
+
 /* ------------------------------------------------------------------ */
 /* Suppressions describe errors which we want to suppress, ie, not
    show the user, usually because it is caused by a problem in a library
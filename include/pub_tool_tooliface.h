@@ -492,6 +492,14 @@ extern void VG_(needs_malloc_replacement)(
  * it". */
 extern void VG_(needs_xml_output) ( void );
 
+/* Can the tool write its errors to a binary report
+   (--binary-report-file)?  binrep_Error is called instead of pp_Error
+   for each error shown, and describes the tool-specific part of the
+   error with the VG_(binrep_*) functions of pub_tool_errormgr.h. */
+extern void VG_(needs_binary_report) (
+   void (*binrep_Error)(const Error* err)
+);
+
 /* Does the tool want to have one final pass over the IR after tree
    building but before instruction selection?  If so specify the
    function here. */
@@ -656,6 +664,9 @@ void VG_(track_copy_reg_to_mem)(void(*f)(CorePart part, ThreadId tid,
    order to run client code blocks, so the times bracketed by
    'start_client_code'..'stop_client_code' are a subset of the times
    when thread 'tid' holds the cpu lock.
+
+   'start_client_code' is one of the points at which a tool may call
+   VG_(discard_translations_safely).
 */
 void VG_(track_start_client_code)(
         void(*f)(ThreadId tid, ULong blocks_dispatched)
@@ -136,6 +136,19 @@ extern XTree* VG_(XT_snapshot)(XTree* xt);
 /*  Non frozen dup currently not needed : 
     extern XTree* VG_(XT_dup)(XTree* xt); */
 
+/* Create an XTree sharing the exe contexts of xt, but without any data.
+   VG_(XT_grow) then gives it (initialised) data for the first xecus of xt,
+   which can be updated with VG_(XT_add_to_xecu)/VG_(XT_sub_from_xecu).
+   This allows to rebuild a past state of xt from a log of the updates
+   done to xt, rather than keeping a snapshot of each state.
+   Inserting new exe contexts in the resulting XTree is not allowed. */
+extern XTree* VG_(XT_empty_copy)(XTree* xt);
+
+/* Initialise the data of the xecus of xt that have no data yet, up to
+   n_xecu-1.  n_xecu must not exceed the nr of xecus in the XTree from
+   which xt was copied. */
+extern void VG_(XT_grow)(XTree* xt, UInt n_xecu);
+
 /* Free all memory associated with an XTRee. */
 extern void VG_(XT_delete)(XTree* xt);
 
@@ -159,6 +172,10 @@ extern Xecu VG_(XT_sub_from_ec)(XTree* xt, ExeContext* ec, const void* value);
 extern void VG_(XT_add_to_xecu)(XTree* xt, Xecu xecu, const void* value);
 extern void VG_(XT_sub_from_xecu)(XTree* xt, Xecu xecu, const void* value);
 
+/* Return the nr of xecus with data in xt: these are the xecus 0 to
+   VG_(XT_n_xecu)(xt)-1. */
+extern UInt VG_(XT_n_xecu)(XTree* xt);
+
 /* Return the nr of IPs selected for xecu. 0 means fully filtered. */
 extern UInt VG_(XT_n_ips_sel)(XTree* xt, Xecu xecu);
 
@@ -415,7 +415,7 @@ static Bool ms_process_cmd_line_option(const HChar* arg)
 
    else if VG_BINT_CLO(arg, "--detailed-freq",  clo_detailed_freq, 1, 1000000) {}
 
-   else if VG_BINT_CLO(arg, "--max-snapshots",  clo_max_snapshots, 10, 1000) {}
+   else if VG_BINT_CLO(arg, "--max-snapshots",  clo_max_snapshots, 10, 1000000) {}
 
    else if VG_STR_CLO(arg, "--massif-out-file", clo_massif_out_file) {}
 
@@ -487,6 +487,98 @@ static ULong alloc_szB(const void* value)
 }
 
 
+//------------------------------------------------------------//
+//--- XTree change log                                     ---//
+//------------------------------------------------------------//
+
+// Detailed snapshots do not copy heap_xt, which would cost time
+// proportional to the nr of stacktraces ever seen at each detailed
+// snapshot.  Instead, the changes done to heap_xt are accumulated per xecu,
+// and a detailed snapshot appends the changes of the xecus modified since
+// the previous one to heap_log.  The snapshot then just records how far
+// heap_log describes heap_xt; its XTree is rebuilt when writing the
+// snapshots, by replaying heap_log in an empty copy of heap_xt.
+//
+// A change is a SizeT added modulo 2^N: a decrease of n bytes is
+// recorded as the addition of -n.
+typedef
+   struct {
+      Xecu  xecu;
+      SizeT delta;
+   }
+   LogEntry;
+
+static LogEntry* heap_log      = NULL;
+static UWord     heap_log_used = 0;   // Nr of entries in heap_log.
+static UWord     heap_log_sz   = 0;   // Nr of entries allocated.
+
+// Changes of the xecus, not yet in heap_log.  dirty_xecus lists the xecus
+// with a changed flag set.
+typedef
+   struct {
+      SizeT delta;
+      Bool  changed;
+   }
+   XecuChange;
+
+static XecuChange* xecu_changes    = NULL;
+static Xecu*       dirty_xecus     = NULL;
+static UInt        n_dirty_xecus   = 0;
+static UInt        xecu_changes_sz = 0;  // Size of both arrays.
+
+static void record_heap_xt_change(Xecu xecu, SizeT delta)
+{
+   if (UNLIKELY(xecu >= xecu_changes_sz)) {
+      UInt i;
+      UInt new_sz = 2 * xecu_changes_sz;
+      if (new_sz <= xecu) new_sz = xecu + 1;
+      if (new_sz < 1000)  new_sz = 1000;
+      xecu_changes = VG_(realloc)("ms.main.rhxc.1", xecu_changes,
+                                  new_sz * sizeof(XecuChange));
+      dirty_xecus  = VG_(realloc)("ms.main.rhxc.2", dirty_xecus,
+                                  new_sz * sizeof(Xecu));
+      for (i = xecu_changes_sz; i < new_sz; i++) {
+         xecu_changes[i].delta   = 0;
+         xecu_changes[i].changed = False;
+      }
+      xecu_changes_sz = new_sz;
+   }
+
+   xecu_changes[xecu].delta += delta;
+   if (!xecu_changes[xecu].changed) {
+      xecu_changes[xecu].changed = True;
+      dirty_xecus[n_dirty_xecus++] = xecu;
+   }
+}
+
+static void add_to_heap_log(Xecu xecu, SizeT delta)
+{
+   if (heap_log_used == heap_log_sz) {
+      heap_log_sz = ( 0 == heap_log_sz ? 1000 : 2 * heap_log_sz );
+      heap_log = VG_(realloc)("ms.main.athl.1", heap_log,
+                              heap_log_sz * sizeof(LogEntry));
+   }
+   heap_log[heap_log_used].xecu  = xecu;
+   heap_log[heap_log_used].delta = delta;
+   heap_log_used++;
+}
+
+// Move the pending changes of heap_xt to heap_log.  Afterwards, heap_log
+// describes the current state of heap_xt.
+static void flush_heap_xt_changes(void)
+{
+   UInt i;
+   for (i = 0; i < n_dirty_xecus; i++) {
+      XecuChange* c = &xecu_changes[ dirty_xecus[i] ];
+      if (0 != c->delta)
+         add_to_heap_log(dirty_xecus[i], c->delta);
+      c->delta   = 0;
+      c->changed = False;
+   }
+   n_dirty_xecus = 0;
+}
+
+
 //------------------------------------------------------------//
 //--- XTree Operations                                     ---//
 //------------------------------------------------------------//
@@ -612,10 +704,14 @@ static ExeContext* make_ec(ThreadId tid, Bool exclude_first_entry)
 static Xecu add_heap_xt( ThreadId tid, SizeT req_szB, Bool exclude_first_entry)
 {
    ExeContext *ec = make_ec(tid, exclude_first_entry);
+   Xecu xecu;
 
    if (UNLIKELY(VG_(clo_xtree_memory) == Vg_XTMemory_Full))
       VG_(XTMemory_Full_alloc)(req_szB, ec);
-   return VG_(XT_add_to_ec) (heap_xt, ec, &req_szB);
+   xecu = VG_(XT_add_to_ec) (heap_xt, ec, &req_szB);
+   if (req_szB > 0)
+      record_heap_xt_change(xecu, req_szB);
+   return xecu;
 }
 
 // Substract req_szB from the heap_xt where.
@@ -627,6 +723,7 @@ static void sub_heap_xt(Xecu where, SizeT req_szB, Bool exclude_first_entry)
       return;
 
    VG_(XT_sub_from_xecu) (heap_xt, where, &req_szB);
+   record_heap_xt_change(where, -req_szB);
    if (UNLIKELY(VG_(clo_xtree_memory) == Vg_XTMemory_Full)) {
       ExeContext *ec_free = make_ec(VG_(get_running_tid)(),
                                     exclude_first_entry);
@@ -664,12 +761,15 @@ typedef
       SizeT heap_szB;
       SizeT heap_extra_szB;// Heap slop + admin bytes.
       SizeT stacks_szB;
-      XTree* xt;    // Snapshot of heap_xt, if a detailed snapshot,
-   }                // otherwise NULL.
+      Bool  detailed;
+      UInt  n_xecu;   // If detailed: heap_xt had n_xecu xecus, with the
+      UWord log_end;  // state given by heap_log[0 .. log_end-1].
+   }
    Snapshot;
 
 static UInt      next_snapshot_i = 0;  // Index of where next snapshot will go.
 static Snapshot* snapshots;            // Array of snapshots.
+static Int       peak_snapshot_i = -1; // Index of the Peak snapshot, if any.
 
 static Bool is_snapshot_in_use(Snapshot* snapshot)
 {
@@ -679,7 +779,9 @@ static Bool is_snapshot_in_use(Snapshot* snapshot)
       tl_assert(snapshot->heap_extra_szB == 0);
       tl_assert(snapshot->heap_szB       == 0);
       tl_assert(snapshot->stacks_szB     == 0);
-      tl_assert(snapshot->xt             == NULL);
+      tl_assert(snapshot->detailed       == False);
+      tl_assert(snapshot->n_xecu         == 0);
+      tl_assert(snapshot->log_end        == 0);
       return False;
    } else {
       tl_assert(snapshot->time           != UNUSED_SNAPSHOT_TIME);
@@ -689,7 +791,7 @@ static Bool is_snapshot_in_use(Snapshot* snapshot)
 
 static Bool is_detailed_snapshot(Snapshot* snapshot)
 {
-   return (snapshot->xt ? True : False);
+   return snapshot->detailed;
 }
 
 static Bool is_uncullable_snapshot(Snapshot* snapshot)
@@ -702,7 +804,8 @@ static Bool is_uncullable_snapshot(Snapshot* snapshot)
 static void sanity_check_snapshot(Snapshot* snapshot)
 {
    // Not much we can sanity check.
-   tl_assert(snapshot->xt == NULL || snapshot->kind != Unused);
+   tl_assert(!snapshot->detailed || snapshot->kind != Unused);
+   tl_assert(snapshot->log_end <= heap_log_used);
 }
 
 // All the used entries should look used, all the unused ones should be clear.
@@ -717,10 +820,9 @@ static void sanity_check_snapshots_array(void)
    }
 }
 
-// This zeroes all the fields in the snapshot, but does not free the xt
-// XTree if present.  It also does a sanity check unless asked not to;  we
-// can't sanity check at startup when clearing the initial snapshots because
-// they're full of junk.
+// This zeroes all the fields in the snapshot.  It also does a sanity check
+// unless asked not to;  we can't sanity check at startup when clearing the
+// initial snapshots because they're full of junk.
 static void clear_snapshot(Snapshot* snapshot, Bool do_sanity_check)
 {
    if (do_sanity_check) sanity_check_snapshot(snapshot);
@@ -729,21 +831,17 @@ static void clear_snapshot(Snapshot* snapshot, Bool do_sanity_check)
    snapshot->heap_extra_szB = 0;
    snapshot->heap_szB       = 0;
    snapshot->stacks_szB     = 0;
-   snapshot->xt             = NULL;
+   snapshot->detailed       = False;
+   snapshot->n_xecu         = 0;
+   snapshot->log_end        = 0;
 }
 
-// This zeroes all the fields in the snapshot, and frees the heap XTree xt if
-// present.
+// This zeroes all the fields in the snapshot.  The heap_log entries of a
+// detailed snapshot are kept, as the next detailed snapshots are described
+// relative to them;  compact_heap_log merges them with the next ones.
 static void delete_snapshot(Snapshot* snapshot)
 {
-   // Nb: if there's an XTree, we free it after calling clear_snapshot,
-   // because clear_snapshot does a sanity check which includes checking the
-   // XTree.
-   XTree* tmp_xt = snapshot->xt;
    clear_snapshot(snapshot, /*do_sanity_check*/True);
-   if (tmp_xt) {
-       VG_(XT_delete)(tmp_xt);
-   }
 }
 
 static void VERB_snapshot(Int verbosity, const HChar* prefix, Int i)
@@ -766,6 +864,104 @@ static void VERB_snapshot(Int verbosity, const HChar* prefix, Int i)
    );
 }
 
+// Merge the heap_log entries between two remaining detailed snapshots:
+// the entries of culled detailed snapshots can't simply be dropped, as the
+// following snapshots are described relative to them.  Merging keeps
+// heap_log from growing with the nr of detailed snapshots ever taken:
+// each remaining detailed snapshot has at most one entry per xecu.
+static void compact_heap_log(void)
+{
+   #define NO_POS ((UWord)-1)
+   UInt   n_xecu = VG_(XT_n_xecu)(heap_xt);
+   UWord* pos;   // Position in heap_log of the entry of the xecu in the
+                 // current segment, or NO_POS.
+   UWord  r = 0, w = 0, seg_start, end, k;
+   UInt   i;
+
+   pos = VG_(malloc)("ms.main.chl.1", n_xecu * sizeof(UWord));
+   for (i = 0; i < n_xecu; i++)
+      pos[i] = NO_POS;
+
+   // The last segment holds the entries after the last detailed snapshot.
+   for (i = 0; i <= next_snapshot_i; i++) {
+      if (i < next_snapshot_i && !is_detailed_snapshot(&snapshots[i]))
+         continue;
+      end = ( i < next_snapshot_i ? snapshots[i].log_end : heap_log_used );
+      seg_start = w;
+      for ( ; r < end; r++) {
+         Xecu xecu = heap_log[r].xecu;
+         if (NO_POS == pos[xecu]) {
+            pos[xecu] = w;
+            heap_log[w++] = heap_log[r];
+         } else {
+            heap_log[pos[xecu]].delta += heap_log[r].delta;
+         }
+      }
+      // Drop the changes that cancelled out, and reset pos.
+      end = w;
+      w = seg_start;
+      for (k = seg_start; k < end; k++) {
+         pos[heap_log[k].xecu] = NO_POS;
+         if (0 != heap_log[k].delta)
+            heap_log[w++] = heap_log[k];
+      }
+      if (i < next_snapshot_i)
+         snapshots[i].log_end = w;
+   }
+   VERB(3, "Compacted heap log from %lu to %lu entries\n", heap_log_used, w);
+   heap_log_used = w;
+
+   VG_(free)(pos);
+   #undef NO_POS
+}
+
+// A candidate for culling, and the timespan it had when it was pushed on
+// the heap.
+typedef
+   struct {
+      Time timespan;
+      Int  j;
+   }
+   CullCand;
+
+static Bool cull_cand_lt(const CullCand* a, const CullCand* b)
+{
+   return a->timespan < b->timespan
+      || (a->timespan == b->timespan && a->j < b->j);
+}
+
+static void push_cull_cand(CullCand* heap, Int* n, Time timespan, Int j)
+{
+   Int i = (*n)++;
+   heap[i].timespan = timespan;
+   heap[i].j        = j;
+   while (i > 0 && cull_cand_lt(&heap[i], &heap[(i-1)/2])) {
+      CullCand tmp   = heap[i];
+      heap[i]        = heap[(i-1)/2];
+      heap[(i-1)/2]  = tmp;
+      i = (i-1)/2;
+   }
+}
+
+static CullCand pop_cull_cand(CullCand* heap, Int* n)
+{
+   CullCand top = heap[0];
+   Int i = 0;
+
+   heap[0] = heap[--(*n)];
+   while (True) {
+      Int l = 2*i + 1, r = l + 1, min = i;
+      if (l < *n && cull_cand_lt(&heap[l], &heap[min])) min = l;
+      if (r < *n && cull_cand_lt(&heap[r], &heap[min])) min = r;
+      if (min == i) break;
+      CullCand tmp = heap[i];
+      heap[i]      = heap[min];
+      heap[min]    = tmp;
+      i = min;
+   }
+   return top;
+}
+
 // Cull half the snapshots;  we choose those that represent the smallest
 // time-spans, because that gives us the most even distribution of snapshots
 // over time.  (It's possible to lose interesting spikes, however.)
@@ -774,69 +970,88 @@ static void VERB_snapshot(Int verbosity, const HChar* prefix, Int i)
 // timeframe, and remove it.  We repeat this until (N/2) snapshots are gone.
 // We have to do this one snapshot at a time, rather than finding the (N/2)
 // smallest snapshots in one hit, because when a snapshot is removed, its
-// neighbours immediately cover greater timespans.  So it's O(N^2), but N is
-// small, and it's not done very often.
+// neighbours immediately cover greater timespans.  The timespans are kept
+// in a heap;  when a snapshot is removed, its neighbours are pushed again
+// with their new timespans, and the outdated entries are skipped when they
+// reach the top.  Timespans only grow, so the outdated entries are never
+// bigger than the current ones.  So it's O(N log N), which matters with
+// big --max-snapshots values.
 //
 // Once we're done, we return the new smallest interval between snapshots.
 // That becomes our minimum time interval.
 static UInt cull_snapshots(void)
 {
-   Int  i, jp, j, jn, min_timespan_i;
+   Int  i, j, min_timespan_i;
    Int  n_deleted = 0;
    Time min_timespan;
+   Int* prev;        // Neighbours of the not-yet-removed snapshots.
+   Int* next;
+   CullCand* heap;
+   Int  n_heap = 0;
 
    n_cullings++;
 
-   // Sets j to the index of the first not-yet-removed snapshot at or after i
-   #define FIND_SNAPSHOT(i, j) \
-      for (j = i; \
-           j < clo_max_snapshots && !is_snapshot_in_use(&snapshots[j]); \
-           j++) { }
-
    VERB(2, "Culling...\n");
 
+   prev = VG_(malloc)("ms.main.cs.1", clo_max_snapshots * sizeof(Int));
+   next = VG_(malloc)("ms.main.cs.2", clo_max_snapshots * sizeof(Int));
+   // Each removal pushes at most two entries.
+   heap = VG_(malloc)("ms.main.cs.3", 2 * clo_max_snapshots * sizeof(CullCand));
+
+   // The timespan for snapshot n = d(N-1,N)+d(N,N+1), where d(A,B) is the
+   // time between snapshot A and B.  We don't consider the first and last
+   // snapshots for removal.  Nb: We never cull the peak snapshot.
+   #define TIMESPAN(j)   (snapshots[next[j]].time - snapshots[prev[j]].time)
+   #define IS_CAND(j)    (0 != (j) && clo_max_snapshots-1 != (j) \
+                          && Peak != snapshots[j].kind)
+   for (j = 0; j < clo_max_snapshots; j++) {
+      prev[j] = j - 1;
+      next[j] = j + 1;
+   }
+   for (j = 1; j < clo_max_snapshots-1; j++) {
+      tl_assert(TIMESPAN(j) >= 0);
+      if (IS_CAND(j))
+         push_cull_cand(heap, &n_heap, TIMESPAN(j), j);
+   }
+
    // First we remove enough snapshots by clearing them in-place.  Once
    // that's done, we can slide the remaining ones down.
    for (i = 0; i < clo_max_snapshots/2; i++) {
-      // Find the snapshot representing the smallest timespan.  The timespan
-      // for snapshot n = d(N-1,N)+d(N,N+1), where d(A,B) is the time between
-      // snapshot A and B.  We don't consider the first and last snapshots for
-      // removal.
-      Snapshot* min_snapshot;
-      Int min_j;
-
-      // Initial triple: (prev, curr, next) == (jp, j, jn)
-      // Initial min_timespan is the first one.
-      jp = 0;
-      FIND_SNAPSHOT(1,   j);
-      FIND_SNAPSHOT(j+1, jn);
-      min_timespan = 0x7fffffffffffffffLL;
-      min_j        = -1;
-      while (jn < clo_max_snapshots) {
-         Time timespan = snapshots[jn].time - snapshots[jp].time;
-         tl_assert(timespan >= 0);
-         // Nb: We never cull the peak snapshot.
-         if (Peak != snapshots[j].kind && timespan < min_timespan) {
-            min_timespan = timespan;
-            min_j        = j;
-         }
-         // Move on to next triple
-         jp = j;
-         j  = jn;
-         FIND_SNAPSHOT(jn+1, jn);
-      }
+      CullCand min;
+
+      // Find the snapshot representing the smallest timespan.
+      do {
+         tl_assert(n_heap > 0);    // Check we found a minimum.
+         min = pop_cull_cand(heap, &n_heap);
+      } while (!is_snapshot_in_use(&snapshots[min.j])
+               || min.timespan != TIMESPAN(min.j));
+
       // We've found the least important snapshot, now delete it.  First
       // print it if necessary.
-      tl_assert(-1 != min_j);    // Check we found a minimum.
-      min_snapshot = & snapshots[ min_j ];
       if (VG_(clo_verbosity) > 1) {
          HChar buf[64];   // large enough
-         VG_(snprintf)(buf, 64, " %3d (t-span = %lld)", i, min_timespan);
-         VERB_snapshot(2, buf, min_j);
+         VG_(snprintf)(buf, 64, " %3d (t-span = %lld)", i, min.timespan);
+         VERB_snapshot(2, buf, min.j);
       }
-      delete_snapshot(min_snapshot);
+      delete_snapshot(&snapshots[min.j]);
       n_deleted++;
+
+      // Unlink it;  its neighbours now cover greater timespans.
+      next[prev[min.j]] = next[min.j];
+      prev[next[min.j]] = prev[min.j];
+      j = prev[min.j];
+      if (IS_CAND(j))
+         push_cull_cand(heap, &n_heap, TIMESPAN(j), j);
+      j = next[min.j];
+      if (IS_CAND(j))
+         push_cull_cand(heap, &n_heap, TIMESPAN(j), j);
    }
+   #undef TIMESPAN
+   #undef IS_CAND
+
+   VG_(free)(prev);
+   VG_(free)(next);
+   VG_(free)(heap);
 
    // Slide down the remaining snapshots over the removed ones.  First set i
    // to point to the first empty slot, and j to the first full slot after
@@ -845,12 +1060,16 @@ static UInt cull_snapshots(void)
    for (j = i; !is_snapshot_in_use( &snapshots[j] ); j++) { }
    for (  ; j < clo_max_snapshots; j++) {
       if (is_snapshot_in_use( &snapshots[j] )) {
+         if (Peak == snapshots[j].kind)
+            peak_snapshot_i = i;
          snapshots[i++] = snapshots[j];
          clear_snapshot(&snapshots[j], /*do_sanity_check*/True);
       }
    }
    next_snapshot_i = i;
 
+   compact_heap_log();
+
    // Check snapshots array looks ok after changes.
    sanity_check_snapshots_array();
 
@@ -950,7 +1169,10 @@ take_snapshot(Snapshot* snapshot, SnapshotKind kind, Time my_time,
    if (clo_heap) {
       snapshot->heap_szB = heap_szB;
       if (is_detailed) {
-         snapshot->xt = VG_(XT_snapshot)(heap_xt);
+         flush_heap_xt_changes();
+         snapshot->detailed = True;
+         snapshot->n_xecu   = VG_(XT_n_xecu)(heap_xt);
+         snapshot->log_end  = heap_log_used;
       }
       snapshot->heap_extra_szB = heap_extra_szB;
    }
@@ -1037,8 +1259,6 @@ maybe_take_snapshot(SnapshotKind kind, const HChar* what)
 
    // Update peak data, if it's a Peak snapshot.
    if (Peak == kind) {
-      Int i, number_of_peaks_snapshots_found = 0;
-
       // Sanity check the size, then update our recorded peak.
       SizeT snapshot_total_szB =
          snapshot->heap_szB + snapshot->heap_extra_szB + snapshot->stacks_szB;
@@ -1046,14 +1266,12 @@ maybe_take_snapshot(SnapshotKind kind, const HChar* what)
          "%ld, %ld\n", snapshot_total_szB, peak_snapshot_total_szB);
       peak_snapshot_total_szB = snapshot_total_szB;
 
-      // Find the old peak snapshot, if it exists, and mark it as normal.
-      for (i = 0; i < next_snapshot_i; i++) {
-         if (Peak == snapshots[i].kind) {
-            snapshots[i].kind = Normal;
-            number_of_peaks_snapshots_found++;
-         }
+      // Mark the old peak snapshot, if it exists, as normal.
+      if (-1 != peak_snapshot_i) {
+         tl_assert(Peak == snapshots[peak_snapshot_i].kind);
+         snapshots[peak_snapshot_i].kind = Normal;
       }
-      tl_assert(number_of_peaks_snapshots_found <= 1);
+      peak_snapshot_i = next_snapshot_i;
    }
 
    // Finish up verbosity and stats stuff.
@@ -1763,7 +1981,9 @@ IRSB* ms_instrument ( VgCallbackClosure* closure,
 //--- Writing snapshots                                    ---//
 //------------------------------------------------------------//
 
-static void pp_snapshot(MsFile *fp, Snapshot* snapshot, Int snapshot_n)
+// xt is the XTree of a detailed snapshot, rebuilt from heap_log, or NULL.
+static void pp_snapshot(MsFile *fp, Snapshot* snapshot, XTree* xt,
+                        Int snapshot_n)
 {
    const Massif_Header header = (Massif_Header) {
       .snapshot_n    = snapshot_n,
@@ -1781,7 +2001,19 @@ static void pp_snapshot(MsFile *fp, Snapshot* snapshot, Int snapshot_n)
 
    sanity_check_snapshot(snapshot);
 
-   VG_(XT_massif_print)(fp, snapshot->xt, &header, alloc_szB);
+   VG_(XT_massif_print)(fp, xt, &header, alloc_szB);
+}
+
+// Bring xt, an empty copy of heap_xt holding the state described by
+// heap_log[0 .. *log_pos-1], to the state of the detailed snapshot.
+static void replay_heap_log(XTree* xt, UWord* log_pos, Snapshot* snapshot)
+{
+   tl_assert(*log_pos <= snapshot->log_end);
+   VG_(XT_grow)(xt, snapshot->n_xecu);
+   for ( ; *log_pos < snapshot->log_end; (*log_pos)++) {
+      VG_(XT_add_to_xecu)(xt, heap_log[*log_pos].xecu,
+                          &heap_log[*log_pos].delta);
+   }
 }
 
 static void write_snapshots_to_file(const HChar* massif_out_file, 
@@ -1790,6 +2022,8 @@ static void write_snapshots_to_file(const HChar* massif_out_file,
 {
    Int i;
    MsFile *fp;
+   XTree* xt = NULL;
+   UWord log_pos = 0;
 
    fp = VG_(XT_massif_open)(massif_out_file,
                             NULL,
@@ -1800,8 +2034,17 @@ static void write_snapshots_to_file(const HChar* massif_out_file,
 
    for (i = 0; i < nr_elements; i++) {
       Snapshot* snapshot = & snapshots_array[i];
-      pp_snapshot(fp, snapshot, i);     // Detailed snapshot!
+      if (is_detailed_snapshot(snapshot)) {
+         if (xt == NULL)
+            xt = VG_(XT_empty_copy)(heap_xt);
+         replay_heap_log(xt, &log_pos, snapshot);
+         pp_snapshot(fp, snapshot, xt, i);
+      } else {
+         pp_snapshot(fp, snapshot, NULL, i);
+      }
    }
+   if (xt)
+      VG_(XT_delete)(xt);
    VG_(XT_massif_close) (fp);
 }
 
@@ -713,6 +713,138 @@ void MC_(pp_Error) ( const Error* err )
    }
 }
 
+/* The binary report counterpart of MC_(pp_Error): writes the raw values
+   of the error instead of formatting them.  The kind and the stack
+   trace of the error are written by the core. */
+
+static void binrep_origin ( ExeContext* ec, UInt okind )
+{
+   const HChar* src = NULL;
+
+   switch (okind) {
+      case MC_OKIND_STACK:   src = "stack"; break;
+      case MC_OKIND_HEAP:    src = "heap"; break;
+      case MC_OKIND_USER:    src = "client request"; break;
+      case MC_OKIND_UNKNOWN: src = "unknown"; break;
+   }
+   tl_assert(src); /* guards against invalid 'okind' */
+
+   VG_(binrep_string)( "origin.kind", src );
+   VG_(binrep_ExeContext)( "origin", ec );
+}
+
+void MC_(binrep_Error) ( const Error* err )
+{
+   MC_Error* extra = VG_(get_error_extra)(err);
+   Addr      a     = VG_(get_error_address)(err);
+
+   switch (VG_(get_error_kind)(err)) {
+      case Err_CoreMem:
+         VG_(binrep_string)( "what", VG_(get_error_string)(err) );
+         break;
+
+      case Err_Value:
+         MC_(any_value_errors) = True;
+         VG_(binrep_word)( "size", extra->Err.Value.szB );
+         if (extra->Err.Value.origin_ec)
+            binrep_origin( extra->Err.Value.origin_ec,
+                           extra->Err.Value.otag & 3 );
+         break;
+
+      case Err_Cond:
+         MC_(any_value_errors) = True;
+         if (extra->Err.Cond.origin_ec)
+            binrep_origin( extra->Err.Cond.origin_ec,
+                           extra->Err.Cond.otag & 3 );
+         break;
+
+      case Err_RegParam:
+         MC_(any_value_errors) = True;
+         VG_(binrep_string)( "param", VG_(get_error_string)(err) );
+         if (extra->Err.RegParam.origin_ec)
+            binrep_origin( extra->Err.RegParam.origin_ec,
+                           extra->Err.RegParam.otag & 3 );
+         break;
+
+      case Err_MemParam:
+         if (!extra->Err.MemParam.isAddrErr)
+            MC_(any_value_errors) = True;
+         VG_(binrep_string)( "param", VG_(get_error_string)(err) );
+         VG_(binrep_word)( "unaddressable", extra->Err.MemParam.isAddrErr );
+         VG_(binrep_addrinfo)( a, &extra->Err.MemParam.ai );
+         if (extra->Err.MemParam.origin_ec && !extra->Err.MemParam.isAddrErr)
+            binrep_origin( extra->Err.MemParam.origin_ec,
+                           extra->Err.MemParam.otag & 3 );
+         break;
+
+      case Err_User:
+         if (!extra->Err.User.isAddrErr)
+            MC_(any_value_errors) = True;
+         VG_(binrep_word)( "unaddressable", extra->Err.User.isAddrErr );
+         VG_(binrep_addrinfo)( a, &extra->Err.User.ai );
+         if (extra->Err.User.origin_ec && !extra->Err.User.isAddrErr)
+            binrep_origin( extra->Err.User.origin_ec,
+                           extra->Err.User.otag & 3 );
+         break;
+
+      case Err_Free:
+         VG_(binrep_addrinfo)( a, &extra->Err.Free.ai );
+         break;
+
+      case Err_FreeMismatch:
+         VG_(binrep_addrinfo)( a, &extra->Err.FreeMismatch.ai );
+         break;
+
+      case Err_Addr:
+         VG_(binrep_word)( "write", extra->Err.Addr.isWrite );
+         VG_(binrep_word)( "size", extra->Err.Addr.szB );
+         if (extra->Err.Addr.maybe_gcc)
+            VG_(binrep_word)( "below_sp", 1 );
+         VG_(binrep_addrinfo)( a, &extra->Err.Addr.ai );
+         break;
+
+      case Err_Jump:
+         VG_(binrep_addrinfo)( a, &extra->Err.Jump.ai );
+         break;
+
+      case Err_Overlap:
+         VG_(binrep_string)( "function", VG_(get_error_string)(err) );
+         VG_(binrep_word)( "dst", extra->Err.Overlap.dst );
+         VG_(binrep_word)( "src", extra->Err.Overlap.src );
+         if (extra->Err.Overlap.szB != 0)
+            VG_(binrep_word)( "size", extra->Err.Overlap.szB );
+         break;
+
+      case Err_IllegalMempool:
+         VG_(binrep_addrinfo)( a, &extra->Err.IllegalMempool.ai );
+         break;
+
+      case Err_Leak: {
+         LossRecord* lr = extra->Err.Leak.lr;
+         VG_(binrep_string)( "leak.kind", xml_leak_kind(lr->key.state) );
+         VG_(binrep_word)( "leak.bytes", lr->szB );
+         VG_(binrep_word)( "leak.indirect_bytes", lr->indirect_szB );
+         VG_(binrep_word)( "leak.blocks", lr->num_blocks );
+         VG_(binrep_word)( "leak.record", extra->Err.Leak.n_this_record );
+         VG_(binrep_word)( "leak.records", extra->Err.Leak.n_total_records );
+         break;
+      }
+
+      case Err_FishyValue:
+         VG_(binrep_string)( "function",
+                             extra->Err.FishyValue.function_name );
+         VG_(binrep_string)( "argument",
+                             extra->Err.FishyValue.argument_name );
+         VG_(binrep_sword)( "value", (SSizeT)extra->Err.FishyValue.value );
+         break;
+
+      default:
+         VG_(printf)("Error:\n  unknown Memcheck error code %d\n",
+                     VG_(get_error_kind)(err));
+         VG_(tool_panic)("unknown error code in mc_binrep_Error)");
+   }
+}
+
 /*------------------------------------------------------------*/
 /*--- Recording errors                                     ---*/
 /*------------------------------------------------------------*/
@@ -790,6 +922,33 @@ void MC_(record_cond_error) ( ThreadId tid, UInt otag )
    VG_(maybe_record_error)( tid, Err_Cond, /*addr*/0, /*s*/NULL, &extra );
 }
 
+/* Report a value error withheld by --expensive-definedness-checks=profile
+   at an instruction which did not run again (see mc_main.c).  'where' is
+   the stack trace recorded when the error happened; szB is 0 for a
+   conditional jump. */
+void MC_(record_withheld_value_error) ( ThreadId tid, ExeContext* where,
+                                        Int szB, UInt otag )
+{
+   MC_Error extra;
+   ErrorKind ekind;
+   tl_assert( MC_(clo_mc_level) >= 2 );
+   if (otag > 0)
+      tl_assert( MC_(clo_mc_level) == 3 );
+   if (szB == 0) {
+      ekind = Err_Cond;
+      extra.Err.Cond.otag      = otag;
+      extra.Err.Cond.origin_ec = NULL;  /* Filled in later */
+   } else {
+      ekind = Err_Value;
+      extra.Err.Value.szB       = szB;
+      extra.Err.Value.otag      = otag;
+      extra.Err.Value.origin_ec = NULL;  /* Filled in later */
+   }
+   VG_(unique_error)( tid, ekind, /*addr*/0, /*s*/NULL, &extra, where,
+                      /*print_error*/True, /*allow_GDB_attach*/False,
+                      /*count_error*/True );
+}
+
 /* --- Called from non-generated code --- */
 
 /* This is for memory errors in signal-related memory. */
@@ -1078,24 +1237,29 @@ static void describe_addr ( DiEpoch ep, Addr a, /*OUT*/AddrInfo* ai )
       We however detect and report that this is a recently re-allocated
       block. */
    /* -- Search for a currently malloc'd block which might bracket it. -- */
-   VG_(HT_ResetIter)(MC_(malloc_list));
-   while ( (mc = VG_(HT_Next)(MC_(malloc_list))) ) {
-      if (!MC_(is_mempool_block)(mc) && 
-           addr_is_in_MC_Chunk_default_REDZONE_SZB(mc, a)) {
-         ai->tag = Addr_Block;
-         ai->Addr.Block.block_kind = Block_Mallocd;
-         if (MC_(get_freed_block_bracketting)( a ))
-            ai->Addr.Block.block_desc = "recently re-allocated block";
-         else
-            ai->Addr.Block.block_desc = "block";
-         ai->Addr.Block.block_szB  = mc->szB;
-         ai->Addr.Block.rwoffset   = (Word)a - (Word)mc->data;
-         ai->Addr.Block.allocated_at = MC_(allocated_at)(mc);
-         VG_(initThreadInfo) (&ai->Addr.Block.alloc_tinfo);
-         ai->Addr.Block.freed_at = MC_(freed_at)(mc);
-         return;
+   mc = MC_(get_live_slab_block_bracketting)( a );
+   if (mc == NULL) {
+      VG_(HT_ResetIter)(MC_(malloc_list));
+      while ( (mc = VG_(HT_Next)(MC_(malloc_list))) ) {
+         if (!MC_(is_mempool_block)(mc) && 
+              addr_is_in_MC_Chunk_default_REDZONE_SZB(mc, a))
+            break;
       }
    }
+   if (mc) {
+      ai->tag = Addr_Block;
+      ai->Addr.Block.block_kind = Block_Mallocd;
+      if (MC_(get_freed_block_bracketting)( a ))
+         ai->Addr.Block.block_desc = "recently re-allocated block";
+      else
+         ai->Addr.Block.block_desc = "block";
+      ai->Addr.Block.block_szB  = mc->szB;
+      ai->Addr.Block.rwoffset   = (Word)a - (Word)mc->data;
+      ai->Addr.Block.allocated_at = MC_(allocated_at)(mc);
+      VG_(initThreadInfo) (&ai->Addr.Block.alloc_tinfo);
+      ai->Addr.Block.freed_at = MC_(freed_at)(mc);
+      return;
+   }
    /* -- Search for a recently freed block which might bracket it. -- */
    mc = MC_(get_freed_block_bracketting)( a );
    if (mc) {
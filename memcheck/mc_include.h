@@ -125,6 +125,17 @@ Bool MC_(is_mempool_block)( MC_Chunk* mc_search );
    is found. */
 MC_Chunk* MC_(get_freed_block_bracketting)( Addr a );
 
+/* Searches the slabs of --malloc-slabs=yes for a live block which might
+   bracket Addr a.  Return the MC_Chunk* for this block or NULL. */
+MC_Chunk* MC_(get_live_slab_block_bracketting)( Addr a );
+
+/* Returns a VG_(malloc)'d array of all the live malloc'd blocks: those of
+   MC_(malloc_list) and those in slabs.  NULL if there are none. */
+MC_Chunk** MC_(get_malloc_chunks) ( UInt* n_chunks );
+
+/* Sets up the size classes of --malloc-slabs=yes. */
+void MC_(init_malloc_slabs) ( void );
+
 /* For efficient pooled alloc/free of the MC_Chunk. */
 extern PoolAlloc* MC_(chunk_poolalloc);
 
@@ -143,10 +154,16 @@ void MC_(make_mem_noaccess)        ( Addr a, SizeT len );
 void MC_(make_mem_undefined_w_otag)( Addr a, SizeT len, UInt otag );
 void MC_(make_mem_defined)         ( Addr a, SizeT len );
 void MC_(copy_address_range_state) ( Addr src, Addr dst, SizeT len );
+/* Give back the secondary maps of [a, a+len) that are entirely noaccess. */
+void MC_(recycle_noaccess_secmaps) ( Addr a, SizeT len );
 
 void MC_(xtmemory_report) ( const HChar* filename, Bool fini );
 
 void MC_(print_malloc_stats) ( void );
+/* Statistics about the freed blocks queue(s), for --stats=yes. */
+void MC_(print_freelist_stats) ( void );
+/* Statistics about the slabs of --malloc-slabs=yes. */
+void MC_(print_slab_stats) ( void );
 /* nr of free operations done */
 SizeT MC_(get_cmalloc_n_frees) ( void );
 
@@ -276,6 +293,7 @@ enum {
    MCPE_COPY_ADDRESS_RANGE_STATE,
    MCPE_COPY_ADDRESS_RANGE_STATE_LOOP1,
    MCPE_COPY_ADDRESS_RANGE_STATE_LOOP2,
+   MCPE_COPY_ADDRESS_RANGE_STATE_SPAN,
    MCPE_CHECK_MEM_IS_NOACCESS,
    MCPE_CHECK_MEM_IS_NOACCESS_LOOP,
    MCPE_IS_MEM_ADDRESSABLE,
@@ -527,6 +545,7 @@ extern Bool MC_(any_value_errors);
 Bool MC_(eq_Error)           ( VgRes res, const Error* e1, const Error* e2 );
 void MC_(before_pp_Error)    ( const Error* err );
 void MC_(pp_Error)           ( const Error* err );
+void MC_(binrep_Error)       ( const Error* err );
 UInt MC_(update_Error_extra) ( const Error* err );
 
 Bool MC_(is_recognised_suppression) ( const HChar* name, Supp* su );
@@ -549,6 +568,8 @@ void MC_(record_address_error) ( ThreadId tid, Addr a, Int szB,
                                  Bool isWrite );
 void MC_(record_cond_error)    ( ThreadId tid, UInt otag );
 void MC_(record_value_error)   ( ThreadId tid, Int szB, UInt otag );
+void MC_(record_withheld_value_error) ( ThreadId tid, ExeContext* where,
+                                        Int szB, UInt otag );
 void MC_(record_jump_error)    ( ThreadId tid, Addr a );
 
 void MC_(record_free_error)            ( ThreadId tid, Addr a ); 
@@ -622,6 +643,20 @@ extern Long MC_(clo_freelist_vol);
    in the "big block" freed blocks queue. */
 extern Long MC_(clo_freelist_big_blocks);
 
+/* If > 0, freed blocks are quarantined in one queue per size class,
+   and the total volume of all the queues never exceeds this value.
+   MC_(clo_freelist_vol) is then not used. */
+extern Long MC_(clo_freelist_budget);
+
+/* With MC_(clo_freelist_budget), once the quarantine is full only one
+   in every MC_(clo_freelist_sample) freed blocks of a size class is
+   quarantined, the others being released immediately. */
+extern Int MC_(clo_freelist_sample);
+
+/* Allocate the small blocks from size-class slabs, whose MC_Chunks are
+   not kept in MC_(malloc_list)?  Default: NO */
+extern Bool MC_(clo_malloc_slabs);
+
 /* Do leak check at exit?  default: NO */
 extern LeakCheckMode MC_(clo_leak_check);
 
@@ -732,6 +767,7 @@ typedef
    enum {
       EdcNO = 1000,  // All operations instrumented cheaply
       EdcAUTO,       // Chosen dynamically by analysing the block
+      EdcPROFILE,    // Cheap, unless the block has raised a value error
       EdcYES         // All operations instrumented expensively
    }
    ExpensiveDefinednessChecks;
@@ -770,6 +806,17 @@ VG_REGPARM(0) void MC_(helperc_value_check4_fail_no_o) ( void );
 VG_REGPARM(0) void MC_(helperc_value_check1_fail_no_o) ( void );
 VG_REGPARM(0) void MC_(helperc_value_check0_fail_no_o) ( void );
 
+/* For --expensive-definedness-checks=profile: has a value error been
+   seen at the instruction at 'a', so that superblocks containing it
+   should be instrumented expensively? */
+Bool MC_(is_expensive_insn) ( Addr a );
+
+/* If an error withheld at the instruction at 'a' is still pending,
+   returns a handle to pass to MC_(helperc_withheld_insn_rerun) each
+   time the instruction runs, else NULL. */
+void* MC_(withheld_error_insn) ( Addr a );
+VG_REGPARM(1) void MC_(helperc_withheld_insn_rerun) ( HWord );
+
 /* V-bits load/store helpers */
 VG_REGPARM(1) void MC_(helperc_STOREV64be) ( Addr, ULong );
 VG_REGPARM(1) void MC_(helperc_STOREV64le) ( Addr, ULong );
@@ -347,7 +347,7 @@ find_active_chunks(Int* pn_chunks)
    // First we collect all the malloc chunks into an array and sort it.
    // We do this because we want to query the chunks by interior
    // pointers, requiring binary search.
-   mallocs = (MC_Chunk**) VG_(HT_to_array)( MC_(malloc_list), &n_mallocs );
+   mallocs = MC_(get_malloc_chunks)( &n_mallocs );
    if (n_mallocs == 0) {
       tl_assert(mallocs == NULL);
       *pn_chunks = 0;
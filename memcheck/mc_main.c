@@ -46,6 +46,7 @@
 #include "pub_tool_rangemap.h"
 #include "pub_tool_replacemalloc.h"
 #include "pub_tool_tooliface.h"
+#include "pub_tool_transtab.h"
 #include "pub_tool_threadstate.h"
 #include "pub_tool_xarray.h"
 #include "pub_tool_xtree.h"
@@ -328,6 +329,8 @@ static Int   max_noaccess_SMs  = 0;
 static Int   max_undefined_SMs = 0;
 static Int   max_defined_SMs   = 0;
 static Int   max_non_DSM_SMs   = 0;
+/* # non-distinguished SMs given back by MC_(recycle_noaccess_secmaps) */
+static Int   n_recycled_SMs    = 0;
 
 /* # searches initiated in auxmap_L1, and # base cmps required */
 static ULong n_auxmap_L1_searches  = 0;
@@ -1651,6 +1654,161 @@ void mc_STOREVn_slow ( Addr a, SizeT nBits, ULong vbytes, Bool bigendian )
 }
 
 
+/*------------------------------------------------------------*/
+/*--- Word-at-a-time operations on vabits8 ranges.         ---*/
+/*------------------------------------------------------------*/
+
+/* These work on the vabits8 of n_chunks consecutive 4-byte chunks of
+   one sec-map, starting at vabits8 index 'off'.  The middle of the
+   range is done a UWord of vabits8 (16 or 32 bytes of client memory)
+   at a time, in loops simple enough for the compiler to widen further
+   where the host has vector registers. */
+
+/* Replicate vabits8 in each byte of a UWord. */
+static INLINE UWord vabits8_to_word ( UChar vabits8 )
+{
+   return (UWord)vabits8 * (~(UWord)0 / 0xFF);
+}
+
+/* Non-zero iff at least one 2-bit field of w is VA_BITS2_PARTDEFINED. */
+static INLINE UWord word_has_partdefined ( UWord w )
+{
+   return w & (w >> 1) & vabits8_to_word(0x55);
+}
+
+/* Non-zero iff at least one 2-bit field of w is VA_BITS2_NOACCESS. */
+static INLINE UWord word_has_noaccess ( UWord w )
+{
+   return ~(w | (w >> 1)) & vabits8_to_word(0x55);
+}
+
+static void fill_vabits8 ( SecMap* sm, UWord off, UWord n_chunks,
+                           UChar vabits8 )
+{
+   UChar* p   = &sm->vabits8[off];
+   UChar* end = p + n_chunks;
+   UWord  w   = vabits8_to_word(vabits8);
+
+   tl_assert(off + n_chunks <= SM_CHUNKS);
+   while (p < end && !VG_IS_WORD_ALIGNED(p))
+      *p++ = vabits8;
+   while ((UWord)(end - p) >= sizeof(UWord)) {
+      *(UWord*)p = w;
+      p += sizeof(UWord);
+   }
+   while (p < end)
+      *p++ = vabits8;
+}
+
+/* Return the number of leading chunks of the range whose vabits8 are
+   equal to vabits8. */
+static UWord n_vabits8_equal ( SecMap* sm, UWord off, UWord n_chunks,
+                               UChar vabits8 )
+{
+   const UChar* start = &sm->vabits8[off];
+   const UChar* p     = start;
+   const UChar* end   = p + n_chunks;
+   UWord        w     = vabits8_to_word(vabits8);
+
+   if (is_distinguished_sm(sm))
+      return sm->vabits8[0] == vabits8 ? n_chunks : 0;
+   while (p < end && !VG_IS_WORD_ALIGNED(p) && *p == vabits8)
+      p++;
+   if (VG_IS_WORD_ALIGNED(p))
+      while ((UWord)(end - p) >= sizeof(UWord) && *(const UWord*)p == w)
+         p += sizeof(UWord);
+   while (p < end && *p == vabits8)
+      p++;
+   return p - start;
+}
+
+/* Return the number of leading chunks of the range without any
+   noaccess byte. */
+static UWord n_vabits8_addressable ( SecMap* sm, UWord off,
+                                     UWord n_chunks )
+{
+   const UChar* start = &sm->vabits8[off];
+   const UChar* p     = start;
+   const UChar* end   = p + n_chunks;
+
+   if (is_distinguished_sm(sm))
+      return sm->vabits8[0] != VA_BITS8_NOACCESS ? n_chunks : 0;
+   while (p < end && !VG_IS_WORD_ALIGNED(p) && !word_has_noaccess(*p | ~(UWord)0xFF))
+      p++;
+   if (VG_IS_WORD_ALIGNED(p))
+      while ((UWord)(end - p) >= sizeof(UWord)
+             && !word_has_noaccess(*(const UWord*)p))
+         p += sizeof(UWord);
+   while (p < end && !word_has_noaccess(*p | ~(UWord)0xFF))
+      p++;
+   return p - start;
+}
+
+/* Copy the vabits8 of n_chunks chunks from sm_src at off_src to sm_dst
+   at off_dst, together with the sec-V-bits of the partially defined
+   bytes.  src and dst are the client addresses of the first chunk. */
+static void copy_vabits8 ( SecMap* sm_src, UWord off_src, Addr src,
+                           SecMap* sm_dst, UWord off_dst, Addr dst,
+                           UWord n_chunks )
+{
+   const UChar* p = &sm_src->vabits8[off_src];
+   UWord        i, j;
+   UChar        vabits8;
+
+   tl_assert(!is_distinguished_sm(sm_dst));
+   tl_assert(off_src + n_chunks <= SM_CHUNKS);
+   tl_assert(off_dst + n_chunks <= SM_CHUNKS);
+   VG_(memcpy)(&sm_dst->vabits8[off_dst], p, n_chunks);
+
+   /* Partially defined bytes are rare: skip a UWord of vabits8 at a
+      time when there are none. */
+   i = 0;
+   while (i < n_chunks) {
+      if (VG_IS_WORD_ALIGNED(p + i) && n_chunks - i >= sizeof(UWord)
+          && !word_has_partdefined(*(const UWord*)(p + i))) {
+         i += sizeof(UWord);
+         continue;
+      }
+      vabits8 = p[i];
+      if (word_has_partdefined(vabits8)) {
+         for (j = 0; j < 4; j++) {
+            if (VA_BITS2_PARTDEFINED == ((vabits8 >> (2*j)) & 0x3))
+               set_sec_vbits8( dst + 4*i + j, get_sec_vbits8( src + 4*i + j ) );
+         }
+      }
+      i++;
+   }
+}
+
+/* Return the length of the longest prefix of [a, a+len) made of whole
+   4-aligned chunks which are all defined (if want_defined) or all
+   addressable (otherwise). */
+static SizeT checked_prefix_len ( Addr a, SizeT len, Bool want_defined )
+{
+   SizeT   done = 0;
+   SecMap* sm;
+   UWord   off, n, n_ok;
+
+   if (!VG_IS_4_ALIGNED(a))
+      return 0;
+   while (len - done >= 4) {
+      off = SM_OFF(a + done);
+      n   = (len - done) >> 2;
+      if (n > SM_CHUNKS - off)
+         n = SM_CHUNKS - off;
+      sm = maybe_get_secmap_for(a + done);
+      if (sm == NULL)
+         return done;
+      n_ok = want_defined ? n_vabits8_equal(sm, off, n, VA_BITS8_DEFINED)
+                          : n_vabits8_addressable(sm, off, n);
+      done += n_ok << 2;
+      if (n_ok < n)
+         break;
+   }
+   return done;
+}
+
+
 /*------------------------------------------------------------*/
 /*--- Setting permissions over address ranges.             ---*/
 /*------------------------------------------------------------*/
@@ -1658,9 +1816,9 @@ void mc_STOREVn_slow ( Addr a, SizeT nBits, ULong vbytes, Bool bigendian )
 static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
                                       UWord dsm_num )
 {
-   UWord    sm_off, sm_off16;
+   UWord    sm_off;
    UWord    vabits2 = vabits16 & 0x3;
-   SizeT    lenA, lenB, len_to_next_secmap;
+   SizeT    lenA, lenB, lenW, len_to_next_secmap;
    Addr     aNext;
    SecMap*  sm;
    SecMap** sm_ptr;
@@ -1793,14 +1951,13 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
       a    += 1;
       lenA -= 1;
    }
-   // 8-aligned, 8 byte steps
-   while (True) {
-      if (lenA < 8) break;
+   // 8-aligned, a UWord of vabits8 at a time
+   if (lenA >= 8) {
       PROF_EVENT(MCPE_SET_ADDRESS_RANGE_PERMS_LOOP8A);
-      sm_off16 = SM_OFF_16(a);
-      sm->vabits16[sm_off16] = vabits16;
-      a    += 8;
-      lenA -= 8;
+      lenW = lenA & ~(SizeT)7;
+      fill_vabits8( sm, SM_OFF(a), lenW >> 2, (UChar)vabits16 );
+      a    += lenW;
+      lenA -= lenW;
    }
    // 1 byte steps
    while (True) {
@@ -1866,14 +2023,13 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
    }
    sm = *sm_ptr;
 
-   // 8-aligned, 8 byte steps
-   while (True) {
-      if (lenB < 8) break;
+   // 8-aligned, a UWord of vabits8 at a time
+   if (lenB >= 8) {
       PROF_EVENT(MCPE_SET_ADDRESS_RANGE_PERMS_LOOP8B);
-      sm_off16 = SM_OFF_16(a);
-      sm->vabits16[sm_off16] = vabits16;
-      a    += 8;
-      lenB -= 8;
+      lenW = lenB & ~(SizeT)7;
+      fill_vabits8( sm, SM_OFF(a), lenW >> 2, (UChar)vabits16 );
+      a    += lenW;
+      lenB -= lenW;
    }
    // 1 byte steps
    while (True) {
@@ -1898,6 +2054,40 @@ void MC_(make_mem_noaccess) ( Addr a, SizeT len )
       ocache_sarp_Clear_Origins ( a, len );
 }
 
+/* Called when the freed block [a, a+len) is given back to the
+   allocator.  set_address_range_perms only swaps in the distinguished
+   noaccess secondary for sec-maps it covers entirely, so the partial
+   sec-maps at either end of a freed block stay issued even once all
+   their neighbours are freed too.  Replace any such sec-map that is
+   now entirely noaccess by the distinguished one.  Scanning a sec-map
+   costs SM_CHUNKS bytes of reads, so don't bother for small ranges. */
+void MC_(recycle_noaccess_secmaps) ( Addr a, SizeT len )
+{
+   Addr     sm_a;
+   SecMap** sm_ptr;
+   UWord    i;
+
+   if (len < SM_SIZE / 8)
+      return;
+
+   for (sm_a = start_of_this_sm(a); sm_a < a + len; sm_a += SM_SIZE) {
+      sm_ptr = get_secmap_ptr(sm_a);
+      if (is_distinguished_sm(*sm_ptr))
+         continue;
+      tl_assert(VA_BITS8_NOACCESS == 0);
+      for (i = 0; i < SM_CHUNKS / sizeof(UWord); i++)
+         if (((UWord*)(*sm_ptr))[i] != 0)
+            break;
+      if (i < SM_CHUNKS / sizeof(UWord))
+         continue;
+      SysRes sres = VG_(am_munmap_valgrind)((Addr)*sm_ptr, sizeof(SecMap));
+      tl_assert2(! sr_isError(sres), "SecMap valgrind munmap failure\n");
+      update_SM_counts(*sm_ptr, &sm_distinguished[SM_DIST_NOACCESS]);
+      *sm_ptr = &sm_distinguished[SM_DIST_NOACCESS];
+      n_recycled_SMs++;
+   }
+}
+
 static void make_mem_undefined ( Addr a, SizeT len )
 {
    PROF_EVENT(MCPE_MAKE_MEM_UNDEFINED);
@@ -1999,9 +2189,12 @@ static void make_mem_defined_if_noaccess ( Addr a, SizeT len )
 
 void MC_(copy_address_range_state) ( Addr src, Addr dst, SizeT len )
 {
-   SizeT i, j;
-   UChar vabits2, vabits8;
-   Bool  aligned, nooverlap;
+   SizeT    i, j;
+   UChar    vabits2;
+   Bool     aligned, nooverlap;
+   UWord    off_src, off_dst, n;
+   SecMap*  sm_src;
+   SecMap** sm_dst_ptr;
 
    DEBUG("MC_(copy_address_range_state)\n");
    PROF_EVENT(MCPE_COPY_ADDRESS_RANGE_STATE);
@@ -2014,29 +2207,46 @@ void MC_(copy_address_range_state) ( Addr src, Addr dst, SizeT len )
 
    if (nooverlap && aligned) {
 
-      /* Vectorised fast case, when no overlap and suitably aligned */
-      /* vector loop */
+      /* Vectorised fast case, when no overlap and suitably aligned:
+         copy the vabits8 of as many chunks as fit in both the source
+         and the destination sec-map at once. */
       i = 0;
       while (len >= 4) {
-         vabits8 = get_vabits8_for_aligned_word32( src+i );
-         set_vabits8_for_aligned_word32( dst+i, vabits8 );
-         if (LIKELY(VA_BITS8_DEFINED == vabits8 
-                            || VA_BITS8_UNDEFINED == vabits8 
-                            || VA_BITS8_NOACCESS == vabits8)) {
-            /* do nothing */
+         PROF_EVENT(MCPE_COPY_ADDRESS_RANGE_STATE_SPAN);
+         off_src = SM_OFF(src+i);
+         off_dst = SM_OFF(dst+i);
+         n       = len >> 2;
+         if (n > SM_CHUNKS - off_src) n = SM_CHUNKS - off_src;
+         if (n > SM_CHUNKS - off_dst) n = SM_CHUNKS - off_dst;
+         sm_src     = get_secmap_for_reading( src+i );
+         sm_dst_ptr = get_secmap_ptr( dst+i );
+         if (is_distinguished_sm(sm_src) && n == SM_CHUNKS) {
+            /* A whole sec-map: share the distinguished secondary,
+               freeing the destination one if needed. */
+            if (*sm_dst_ptr != sm_src) {
+               if (!is_distinguished_sm(*sm_dst_ptr)) {
+                  SysRes sres = VG_(am_munmap_valgrind)((Addr)*sm_dst_ptr,
+                                                        sizeof(SecMap));
+                  tl_assert2(! sr_isError(sres),
+                             "SecMap valgrind munmap failure\n");
+               }
+               update_SM_counts(*sm_dst_ptr, sm_src);
+               *sm_dst_ptr = sm_src;
+            }
+         } else if (is_distinguished_sm(sm_src)) {
+            if (*sm_dst_ptr != sm_src) {
+               if (is_distinguished_sm(*sm_dst_ptr))
+                  *sm_dst_ptr = copy_for_writing(*sm_dst_ptr);
+               fill_vabits8( *sm_dst_ptr, off_dst, n, sm_src->vabits8[0] );
+            }
          } else {
-            /* have to copy secondary map info */
-            if (VA_BITS2_PARTDEFINED == get_vabits2( src+i+0 ))
-               set_sec_vbits8( dst+i+0, get_sec_vbits8( src+i+0 ) );
-            if (VA_BITS2_PARTDEFINED == get_vabits2( src+i+1 ))
-               set_sec_vbits8( dst+i+1, get_sec_vbits8( src+i+1 ) );
-            if (VA_BITS2_PARTDEFINED == get_vabits2( src+i+2 ))
-               set_sec_vbits8( dst+i+2, get_sec_vbits8( src+i+2 ) );
-            if (VA_BITS2_PARTDEFINED == get_vabits2( src+i+3 ))
-               set_sec_vbits8( dst+i+3, get_sec_vbits8( src+i+3 ) );
+            if (is_distinguished_sm(*sm_dst_ptr))
+               *sm_dst_ptr = copy_for_writing(*sm_dst_ptr);
+            copy_vabits8( sm_src, off_src, src+i,
+                          *sm_dst_ptr, off_dst, dst+i, n );
          }
-         i += 4;
-         len -= 4;
+         i   += n << 2;
+         len -= n << 2;
       }
       /* fixup loop */
       while (len >= 1) {
@@ -4143,6 +4353,10 @@ static Bool is_mem_addressable ( Addr a, SizeT len,
    UWord vabits2;
 
    PROF_EVENT(MCPE_IS_MEM_ADDRESSABLE);
+   /* Skip quickly over the leading addressable chunks. */
+   i = checked_prefix_len(a, len, /*want_defined*/False);
+   a   += i;
+   len -= i;
    for (i = 0; i < len; i++) {
       PROF_EVENT(MCPE_IS_MEM_ADDRESSABLE_LOOP);
       vabits2 = get_vabits2(a);
@@ -4186,6 +4400,10 @@ static MC_ReadResult is_mem_defined ( Addr a, SizeT len,
 
    if (otag)     *otag = 0;
    if (bad_addr) *bad_addr = 0;
+   /* Skip quickly over the leading defined chunks. */
+   i = checked_prefix_len(a, len, /*want_defined*/True);
+   a   += i;
+   len -= i;
    for (i = 0; i < len; i++) {
       PROF_EVENT(MCPE_IS_MEM_DEFINED_LOOP);
       vabits2 = get_vabits2(a);
@@ -5635,6 +5853,152 @@ void MC_(helperc_STOREV8) ( Addr a, UWord vbits8 )
 }
 
 
+/*------------------------------------------------------------*/
+/*--- Profile-guided choice of definedness-check detail    ---*/
+/*------------------------------------------------------------*/
+
+/* With --expensive-definedness-checks=profile, superblocks are
+   instrumented with the cheap V-bit propagation rules to begin with (see
+   MC_(instrument)).  The first value-check failure at a given
+   instruction is only taken as a candidate: it is not reported, the
+   instruction is entered into expensive_insns, and the translations
+   covering it are discarded at the start of the next time slice (they
+   may not be discarded from within generated code).  Retranslation
+   then instruments the whole superblock expensively, so a genuine error
+   is reported the next time the instruction runs, whereas a false
+   positive due to the cheap rules disappears.  Clean code is never
+   retranslated and keeps running at the cheap speed.
+
+   The withheld error is kept, and the expensive translation calls
+   MC_(helperc_withheld_insn_rerun) when the instruction runs again,
+   which drops it.  An instruction which never runs again thus still
+   has its error pending when its thread exits, or when the program
+   ends, and it is reported then (see flush_withheld_errors). */
+
+typedef
+   struct _ExpInsn {
+      struct _ExpInsn* next;
+      Addr             addr;      // guest address of the instruction
+      Bool             discarded; // have its cheap translations gone?
+      // The first error withheld at the instruction, while still
+      // pending.  where is NULL once the error is dropped or reported.
+      ExeContext*      where;
+      ThreadId         tid;
+      Int              szB;       // 0 for a conditional jump
+      UInt             otag;
+   }
+   ExpInsn;
+
+static VgHashTable* expensive_insns = NULL;
+
+/* Number of entries in expensive_insns with .discarded == False. */
+static UInt n_expensive_insns_pending = 0;
+
+/* Stats */
+static ULong n_value_errors_withheld = 0;
+static ULong n_value_errors_flushed  = 0;
+
+Bool MC_(is_expensive_insn) ( Addr a )
+{
+   return expensive_insns != NULL
+          && VG_(HT_lookup)(expensive_insns, a) != NULL;
+}
+
+void* MC_(withheld_error_insn) ( Addr a )
+{
+   ExpInsn* ei;
+
+   if (expensive_insns == NULL)
+      return NULL;
+   ei = VG_(HT_lookup)(expensive_insns, a);
+   return ei != NULL && ei->where != NULL ? ei : NULL;
+}
+
+VG_REGPARM(1)
+void MC_(helperc_withheld_insn_rerun) ( HWord eiW )
+{
+   ExpInsn* ei = (ExpInsn*)eiW;
+   ei->where = NULL;
+}
+
+/* Report the errors still pending for thread tid, or for all threads
+   if tid is VG_INVALID_THREADID. */
+static void flush_withheld_errors ( ThreadId tid )
+{
+   ExpInsn* ei;
+
+   VG_(HT_ResetIter)(expensive_insns);
+   while ( (ei = VG_(HT_Next)(expensive_insns)) ) {
+      if (ei->where == NULL)
+         continue;
+      if (tid != VG_INVALID_THREADID && ei->tid != tid)
+         continue;
+      MC_(record_withheld_value_error)( ei->tid, ei->where,
+                                        ei->szB, ei->otag );
+      ei->where = NULL;
+      n_value_errors_flushed++;
+   }
+}
+
+static void mc_pre_thread_ll_exit ( ThreadId tid )
+{
+   flush_withheld_errors( tid );
+}
+
+/* Called for each value-check failure, szB being 0 for a conditional
+   jump.  Returns True if the error should be withheld because the
+   failing instruction is (still) instrumented cheaply. */
+static Bool withhold_value_error ( ThreadId tid, Int szB, UInt otag )
+{
+   ExpInsn* ei;
+   Addr     a;
+
+   if (LIKELY(MC_(clo_expensive_definedness_checks) != EdcPROFILE))
+      return False;
+
+   a = VG_(get_IP)(tid);
+#  if defined(VGA_arm)
+   /* Thumb code: IMarks carry the instruction address with bit 0 clear. */
+   a &= ~(Addr)1;
+#  endif
+   ei = VG_(HT_lookup)(expensive_insns, a);
+   if (ei == NULL) {
+      ei = VG_(malloc)("mc.withhold_value_error.1", sizeof(ExpInsn));
+      ei->addr      = a;
+      ei->discarded = False;
+      ei->where     = VG_(record_ExeContext)(tid, 0);
+      ei->tid       = tid;
+      ei->szB       = szB;
+      ei->otag      = otag;
+      VG_(HT_add_node)(expensive_insns, ei);
+      n_expensive_insns_pending++;
+   }
+   if (ei->discarded)
+      return False;
+   n_value_errors_withheld++;
+   return True;
+}
+
+/* Throw away the cheap translations of the instructions that had a
+   value error withheld since the previous time slice. */
+static void mc_start_client_code ( ThreadId tid, ULong bbs_done )
+{
+   ExpInsn* ei;
+
+   if (LIKELY(n_expensive_insns_pending == 0))
+      return;
+
+   VG_(HT_ResetIter)(expensive_insns);
+   while ( (ei = VG_(HT_Next)(expensive_insns)) ) {
+      if (ei->discarded)
+         continue;
+      VG_(discard_translations_safely)(ei->addr, 1, "mc_start_client_code");
+      ei->discarded = True;
+   }
+   n_expensive_insns_pending = 0;
+}
+
+
 /*------------------------------------------------------------*/
 /*--- Functions called directly from generated code:       ---*/
 /*--- Value-check failure handlers.                        ---*/
@@ -5643,54 +6007,74 @@ void MC_(helperc_STOREV8) ( Addr a, UWord vbits8 )
 /* Call these ones when an origin is available ... */
 VG_REGPARM(1)
 void MC_(helperc_value_check0_fail_w_o) ( UWord origin ) {
-   MC_(record_cond_error) ( VG_(get_running_tid)(), (UInt)origin );
+   ThreadId tid = VG_(get_running_tid)();
+   if (withhold_value_error(tid, 0, (UInt)origin)) return;
+   MC_(record_cond_error) ( tid, (UInt)origin );
 }
 
 VG_REGPARM(1)
 void MC_(helperc_value_check1_fail_w_o) ( UWord origin ) {
-   MC_(record_value_error) ( VG_(get_running_tid)(), 1, (UInt)origin );
+   ThreadId tid = VG_(get_running_tid)();
+   if (withhold_value_error(tid, 1, (UInt)origin)) return;
+   MC_(record_value_error) ( tid, 1, (UInt)origin );
 }
 
 VG_REGPARM(1)
 void MC_(helperc_value_check4_fail_w_o) ( UWord origin ) {
-   MC_(record_value_error) ( VG_(get_running_tid)(), 4, (UInt)origin );
+   ThreadId tid = VG_(get_running_tid)();
+   if (withhold_value_error(tid, 4, (UInt)origin)) return;
+   MC_(record_value_error) ( tid, 4, (UInt)origin );
 }
 
 VG_REGPARM(1)
 void MC_(helperc_value_check8_fail_w_o) ( UWord origin ) {
-   MC_(record_value_error) ( VG_(get_running_tid)(), 8, (UInt)origin );
+   ThreadId tid = VG_(get_running_tid)();
+   if (withhold_value_error(tid, 8, (UInt)origin)) return;
+   MC_(record_value_error) ( tid, 8, (UInt)origin );
 }
 
 VG_REGPARM(2) 
 void MC_(helperc_value_checkN_fail_w_o) ( HWord sz, UWord origin ) {
-   MC_(record_value_error) ( VG_(get_running_tid)(), (Int)sz, (UInt)origin );
+   ThreadId tid = VG_(get_running_tid)();
+   if (withhold_value_error(tid, (Int)sz, (UInt)origin)) return;
+   MC_(record_value_error) ( tid, (Int)sz, (UInt)origin );
 }
 
 /* ... and these when an origin isn't available. */
 
 VG_REGPARM(0)
 void MC_(helperc_value_check0_fail_no_o) ( void ) {
-   MC_(record_cond_error) ( VG_(get_running_tid)(), 0/*origin*/ );
+   ThreadId tid = VG_(get_running_tid)();
+   if (withhold_value_error(tid, 0, 0)) return;
+   MC_(record_cond_error) ( tid, 0/*origin*/ );
 }
 
 VG_REGPARM(0)
 void MC_(helperc_value_check1_fail_no_o) ( void ) {
-   MC_(record_value_error) ( VG_(get_running_tid)(), 1, 0/*origin*/ );
+   ThreadId tid = VG_(get_running_tid)();
+   if (withhold_value_error(tid, 1, 0)) return;
+   MC_(record_value_error) ( tid, 1, 0/*origin*/ );
 }
 
 VG_REGPARM(0)
 void MC_(helperc_value_check4_fail_no_o) ( void ) {
-   MC_(record_value_error) ( VG_(get_running_tid)(), 4, 0/*origin*/ );
+   ThreadId tid = VG_(get_running_tid)();
+   if (withhold_value_error(tid, 4, 0)) return;
+   MC_(record_value_error) ( tid, 4, 0/*origin*/ );
 }
 
 VG_REGPARM(0)
 void MC_(helperc_value_check8_fail_no_o) ( void ) {
-   MC_(record_value_error) ( VG_(get_running_tid)(), 8, 0/*origin*/ );
+   ThreadId tid = VG_(get_running_tid)();
+   if (withhold_value_error(tid, 8, 0)) return;
+   MC_(record_value_error) ( tid, 8, 0/*origin*/ );
 }
 
 VG_REGPARM(1) 
 void MC_(helperc_value_checkN_fail_no_o) ( HWord sz ) {
-   MC_(record_value_error) ( VG_(get_running_tid)(), (Int)sz, 0/*origin*/ );
+   ThreadId tid = VG_(get_running_tid)();
+   if (withhold_value_error(tid, (Int)sz, 0)) return;
+   MC_(record_value_error) ( tid, (Int)sz, 0/*origin*/ );
 }
 
 
@@ -5950,6 +6334,9 @@ static Bool mc_expensive_sanity_check ( void )
 Bool          MC_(clo_partial_loads_ok)       = True;
 Long          MC_(clo_freelist_vol)           = 20*1000*1000LL;
 Long          MC_(clo_freelist_big_blocks)    =  1*1000*1000LL;
+Long          MC_(clo_freelist_budget)        = 0;
+Int           MC_(clo_freelist_sample)        = 1;
+Bool          MC_(clo_malloc_slabs)           = False;
 LeakCheckMode MC_(clo_leak_check)             = LC_Summary;
 VgRes         MC_(clo_leak_resolution)        = Vg_HighRes;
 UInt          MC_(clo_show_leak_kinds)        = R2S(Possible) | R2S(Unreached);
@@ -6057,6 +6444,15 @@ static Bool mc_process_cmd_line_options(const HChar* arg)
                        MC_(clo_freelist_big_blocks),
                        0, 10*1000*1000*1000LL) {}
 
+   else if VG_BINT_CLO(arg, "--freelist-budget",
+                       MC_(clo_freelist_budget),
+                       0, 10*1000*1000*1000LL) {}
+
+   else if VG_BINT_CLO(arg, "--freelist-sample",
+                       MC_(clo_freelist_sample), 1, 1000000) {}
+
+   else if VG_BOOL_CLO(arg, "--malloc-slabs", MC_(clo_malloc_slabs)) {}
+
    else if VG_XACT_CLO(arg, "--leak-check=no",
                             MC_(clo_leak_check), LC_Off) {}
    else if VG_XACT_CLO(arg, "--leak-check=summary",
@@ -6166,6 +6562,9 @@ static Bool mc_process_cmd_line_options(const HChar* arg)
                             MC_(clo_expensive_definedness_checks), EdcNO) {}
    else if VG_XACT_CLO(arg, "--expensive-definedness-checks=auto",
                             MC_(clo_expensive_definedness_checks), EdcAUTO) {}
+   else if VG_XACT_CLO(arg, "--expensive-definedness-checks=profile",
+                            MC_(clo_expensive_definedness_checks),
+                            EdcPROFILE) {}
    else if VG_XACT_CLO(arg, "--expensive-definedness-checks=yes",
                             MC_(clo_expensive_definedness_checks), EdcYES) {}
 
@@ -6210,10 +6609,16 @@ static void mc_print_usage(void)
 "    --undef-value-errors=no|yes      check for undefined value errors [yes]\n"
 "    --track-origins=no|yes           show origins of undefined values? [no]\n"
 "    --partial-loads-ok=no|yes        too hard to explain here; see manual [yes]\n"
-"    --expensive-definedness-checks=no|auto|yes\n"
+"    --expensive-definedness-checks=no|auto|profile|yes\n"
 "                                     Use extra-precise definedness tracking [auto]\n"
 "    --freelist-vol=<number>          volume of freed blocks queue     [20000000]\n"
 "    --freelist-big-blocks=<number>   releases first blocks with size>= [1000000]\n"
+"    --freelist-budget=<number>       hard limit of a per-size-class freed\n"
+"                                     blocks quarantine (0 = use --freelist-vol) [0]\n"
+"    --freelist-sample=<number>       when the quarantine is full, keep only\n"
+"                                     1 in <number> freed blocks per class [1]\n"
+"    --malloc-slabs=no|yes            allocate small blocks from size-class\n"
+"                                     slabs (faster malloc/free) [no]\n"
 "    --workaround-gcc296-bugs=no|yes  self explanatory [no].  Deprecated.\n"
 "                                     Use --ignore-range-below-sp instead.\n"
 "    --ignore-ranges=0xPP-0xQQ[,0xRR-0xSS]   assume given addresses are OK\n"
@@ -7260,6 +7665,7 @@ static const HChar* MC_(event_ctr_name)[MCPE_LAST] = {
    [MCPE_COPY_ADDRESS_RANGE_STATE] = "copy_address_range_state",
    [MCPE_COPY_ADDRESS_RANGE_STATE_LOOP1] = "copy_address_range_state(loop1)",
    [MCPE_COPY_ADDRESS_RANGE_STATE_LOOP2] = "copy_address_range_state(loop2)",
+   [MCPE_COPY_ADDRESS_RANGE_STATE_SPAN] = "copy_address_range_state(span)",
    [MCPE_CHECK_MEM_IS_NOACCESS] = "check_mem_is_noaccess",
    [MCPE_CHECK_MEM_IS_NOACCESS_LOOP] = "check_mem_is_noaccess(loop)",
    [MCPE_IS_MEM_ADDRESSABLE] = "is_mem_addressable",
@@ -7757,7 +8163,8 @@ static void mc_post_clo_init ( void )
       MC_(clo_leak_check) = LC_Full;
    }
 
-   if (MC_(clo_freelist_big_blocks) >= MC_(clo_freelist_vol)
+   if (MC_(clo_freelist_budget) == 0
+       && MC_(clo_freelist_big_blocks) >= MC_(clo_freelist_vol)
        && VG_(clo_verbosity) == 1 && !VG_(clo_xml)) {
       VG_(message)(Vg_UserMsg,
                    "Warning: --freelist-big-blocks value %lld has no effect\n"
@@ -7777,6 +8184,12 @@ static void mc_post_clo_init ( void )
 
    tl_assert( MC_(clo_mc_level) >= 1 && MC_(clo_mc_level) <= 3 );
 
+   if (MC_(clo_expensive_definedness_checks) == EdcPROFILE) {
+      expensive_insns = VG_(HT_construct)( "MC_(expensive_insns)" );
+      VG_(track_start_client_code)( mc_start_client_code );
+      VG_(track_pre_thread_ll_exit)( mc_pre_thread_ll_exit );
+   }
+
    if (MC_(clo_mc_level) == 3) {
       /* We're doing origin tracking. */
 #     ifdef PERF_FAST_STACK
@@ -7888,6 +8301,9 @@ static void mc_post_clo_init ( void )
        "mc.cMC.1 (MC_Chunk pools)",
        VG_(free));
 
+   if (MC_(clo_malloc_slabs))
+      MC_(init_malloc_slabs)();
+
    /* Do not check definedness of guest state if --undef-value-errors=no */
    if (MC_(clo_mc_level) >= 2)
       VG_(track_pre_reg_read) ( mc_pre_reg_read );
@@ -7918,8 +8334,14 @@ static void mc_print_stats (void)
 {
    SizeT max_secVBit_szB, max_SMs_szB, max_shmem_szB;
 
-   VG_(message)(Vg_DebugMsg, " memcheck: freelist: vol %lld length %lld\n",
-                VG_(free_queue_volume), VG_(free_queue_length));
+   MC_(print_freelist_stats)();
+   MC_(print_slab_stats)();
+   if (expensive_insns != NULL)
+      VG_(message)(Vg_DebugMsg,
+         " memcheck: definedness profile: %'llu value errors withheld, "
+         "%'llu reported at exit, %'u insns instrumented expensively\n",
+         n_value_errors_withheld, n_value_errors_flushed,
+         VG_(HT_count_nodes)(expensive_insns));
    VG_(message)(Vg_DebugMsg,
       " memcheck: sanity checks: %d cheap, %d expensive\n",
       n_sanity_cheap, n_sanity_expensive );
@@ -7941,6 +8363,7 @@ static void mc_print_stats (void)
 
    print_SM_info("n_issued     ", n_issued_SMs);
    print_SM_info("n_deissued   ", n_deissued_SMs);
+   print_SM_info("n_recycled   ", n_recycled_SMs);
    print_SM_info("max_noaccess ", max_noaccess_SMs);
    print_SM_info("max_undefined", max_undefined_SMs);
    print_SM_info("max_defined  ", max_defined_SMs);
@@ -8010,6 +8433,9 @@ static void mc_print_stats (void)
 
 static void mc_fini ( Int exitcode )
 {
+   if (expensive_insns != NULL)
+      flush_withheld_errors( VG_INVALID_THREADID );
+
    MC_(xtmemory_report) (VG_(clo_xtree_memory_file), True);
    MC_(print_malloc_stats)();
 
@@ -8172,6 +8598,7 @@ static void mc_pre_clo_init(void)
    MC_(Malloc_Redzone_SzB) = VG_(malloc_effective_client_redzone_size)();
 
    VG_(needs_xml_output)          ();
+   VG_(needs_binary_report)       ( MC_(binrep_Error) );
 
    VG_(track_new_mem_startup)     ( mc_new_mem_startup );
 
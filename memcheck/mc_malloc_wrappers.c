@@ -84,9 +84,15 @@ MC_Chunk* create_MC_Chunk ( ThreadId tid, Addr p, SizeT szB,
 static inline
 void delete_MC_Chunk (MC_Chunk* mc);
 
+/* Size-class slabs for small blocks, see below. */
+typedef struct _Slab Slab;
+static Slab* slab_of_chunk      ( const MC_Chunk* mc );
+static void  slab_release_chunk ( Slab* s, MC_Chunk* mc );
+
 /* Records blocks after freeing. */
-/* Blocks freed by the client are queued in one of two lists of
-   freed blocks not yet physically freed:
+/* Blocks freed by the client are queued in one of several lists of
+   freed blocks not yet physically freed.
+   By default, only two lists are used:
    "big blocks" freed list.
    "small blocks" freed list
    The blocks with a size >= MC_(clo_freelist_big_blocks)
@@ -94,16 +100,135 @@ void delete_MC_Chunk (MC_Chunk* mc);
    This allows a client to allocate and free big blocks
    (e.g. bigger than VG_(clo_freelist_vol)) without losing
    immediately all protection against dangling pointers.
-   position [0] is for big blocks, [1] is for small blocks. */
-static MC_Chunk* freed_list_start[2]  = {NULL, NULL};
-static MC_Chunk* freed_list_end[2]    = {NULL, NULL};
+   position [0] is for big blocks, [1] is for small blocks.
+
+   With --freelist-budget, the small blocks are instead spread over
+   one list per power-of-two size class, [1] for blocks of size 0,
+   [2] for size 1, [3] for sizes 2..3, [4] for sizes 4..7, etc.
+   When the total volume exceeds the budget, the big blocks are
+   released first, then the oldest block of the class holding the
+   biggest volume.  So, a burst of frees of one size does not flush
+   the quarantined blocks of all the other sizes. */
+#define N_FREED_LISTS 24
+static MC_Chunk* freed_list_start[N_FREED_LISTS];
+static MC_Chunk* freed_list_end[N_FREED_LISTS];
+/* Volume of each freed list, only maintained with --freelist-budget. */
+static Long      freed_list_vol[N_FREED_LISTS];
+/* Nr of blocks of each class not quarantined since the last one that
+   was, for --freelist-sample. */
+static Int       freed_list_skipped[N_FREED_LISTS];
+
+/* Stats for the --freelist-budget quarantine. */
+static ULong n_freed_released_at_free = 0;
+static ULong n_freed_evicted          = 0;
+
+static Int freed_list_nr ( SizeT szB )
+{
+   Int l;
+
+   if (szB >= MC_(clo_freelist_big_blocks))
+      return 0;
+   if (MC_(clo_freelist_budget) == 0)
+      return 1;
+   for (l = 1; szB > 0 && l < N_FREED_LISTS-1; l++)
+      szB >>= 1;
+   return l;
+}
+
+/* Give a freed block back to the allocator, and forget about it. */
+static void release_freed_block ( MC_Chunk* mc )
+{
+   Slab* s = slab_of_chunk ( mc );
+
+   if (s != NULL) {
+      /* The chunk belongs to the slot: nothing to delete. */
+      slab_release_chunk ( s, mc );
+      return;
+   }
+   if (MC_AllocCustom != mc->allockind) {
+      MC_(recycle_noaccess_secmaps)( mc->data - MC_(Malloc_Redzone_SzB),
+                                     mc->szB + 2*MC_(Malloc_Redzone_SzB) );
+      VG_(cli_free) ( (void*)(mc->data) );
+   }
+   delete_MC_Chunk ( mc );
+}
+
+/* Remove the oldest block of freed list l, and release it. */
+static void release_head_of_freed_list ( Int l )
+{
+   const Bool show = False;
+   MC_Chunk* mc1;
+
+   tl_assert(freed_list_start[l] != NULL);
+   tl_assert(freed_list_end[l] != NULL);
+
+   mc1 = freed_list_start[l];
+   VG_(free_queue_volume) -= (Long)mc1->szB;
+   VG_(free_queue_length)--;
+   freed_list_vol[l] -= (Long)mc1->szB;
+   if (show)
+      VG_(printf)("mc_freelist: discard: volume now %lld\n", 
+                  VG_(free_queue_volume));
+   tl_assert(VG_(free_queue_volume) >= 0);
+
+   if (freed_list_start[l] == freed_list_end[l]) {
+      freed_list_start[l] = freed_list_end[l] = NULL;
+   } else {
+      freed_list_start[l] = mc1->next;
+   }
+   mc1->next = NULL; /* just paranoia */
+
+   release_freed_block ( mc1 );
+}
+
+/* Release blocks until the quarantine volume is <= MC_(clo_freelist_budget).
+   The block 'keep' (just queued) is only released if it is the
+   last one left. */
+static void release_over_budget_blocks ( const MC_Chunk* keep )
+{
+   Int i, l;
+
+   while (VG_(free_queue_volume) > MC_(clo_freelist_budget)) {
+      if (freed_list_start[0] != NULL && freed_list_start[0] != keep) {
+         l = 0;
+      } else {
+         l = -1;
+         for (i = 1; i < N_FREED_LISTS; i++) {
+            if (freed_list_start[i] == NULL || freed_list_start[i] == keep)
+               continue;
+            if (l == -1 || freed_list_vol[i] > freed_list_vol[l])
+               l = i;
+         }
+         if (l == -1)
+            l = freed_list_nr(keep->szB);
+      }
+      n_freed_evicted++;
+      release_head_of_freed_list(l);
+   }
+}
 
 /* Put a shadow chunk on the freed blocks queue, possibly freeing up
    some of the oldest blocks in the queue at the same time. */
 static void add_to_freed_queue ( MC_Chunk* mc )
 {
    const Bool show = False;
-   const int l = (mc->szB >= MC_(clo_freelist_big_blocks) ? 0 : 1);
+   const Int l = freed_list_nr(mc->szB);
+
+   if (MC_(clo_freelist_budget) > 0) {
+      /* Once the quarantine is full, only keep a sample of the freed
+         blocks, so that the quarantined blocks of a class are spread
+         over a longer period of time.  A block that cannot fit at all
+         is released immediately. */
+      if (mc->szB > MC_(clo_freelist_budget)
+          || (VG_(free_queue_volume) + (Long)mc->szB
+              > MC_(clo_freelist_budget)
+              && ++freed_list_skipped[l] < MC_(clo_freelist_sample))) {
+         n_freed_released_at_free++;
+         release_freed_block ( mc );
+         return;
+      }
+      freed_list_skipped[l] = 0;
+   }
 
    /* Put it at the end of the freed list, unless the block
       would be directly released any way : in this case, we
@@ -114,7 +239,8 @@ static void add_to_freed_queue ( MC_Chunk* mc )
       freed_list_end[l]    = freed_list_start[l] = mc;
    } else {
       tl_assert(freed_list_end[l]->next == NULL);
-      if (mc->szB >= MC_(clo_freelist_vol)) {
+      if (MC_(clo_freelist_budget) == 0
+          && mc->szB >= MC_(clo_freelist_vol)) {
          mc->next = freed_list_start[l];
          freed_list_start[l] = mc;
       } else {
@@ -124,10 +250,16 @@ static void add_to_freed_queue ( MC_Chunk* mc )
       }
    }
    VG_(free_queue_volume) += (Long)mc->szB;
+   freed_list_vol[l] += (Long)mc->szB;
    if (show)
       VG_(printf)("mc_freelist: acquire: volume now %lld\n", 
                   VG_(free_queue_volume));
    VG_(free_queue_length)++;
+
+   /* The budget is a hard limit: enforce it now rather than at the
+      next allocation. */
+   if (MC_(clo_freelist_budget) > 0)
+      release_over_budget_blocks ( mc );
 }
 
 /* Release enough of the oldest blocks to bring the free queue
@@ -137,7 +269,6 @@ static void add_to_freed_queue ( MC_Chunk* mc )
    On exit, VG_(free_queue_volume) will be <= MC_(clo_freelist_vol). */
 static void release_oldest_block(void)
 {
-   const Bool show = False;
    int i;
    tl_assert (VG_(free_queue_volume) > MC_(clo_freelist_vol));
    tl_assert (freed_list_start[0] != NULL || freed_list_start[1] != NULL);
@@ -145,29 +276,7 @@ static void release_oldest_block(void)
    for (i = 0; i < 2; i++) {
       while (VG_(free_queue_volume) > MC_(clo_freelist_vol)
              && freed_list_start[i] != NULL) {
-         MC_Chunk* mc1;
-
-         tl_assert(freed_list_end[i] != NULL);
-         
-         mc1 = freed_list_start[i];
-         VG_(free_queue_volume) -= (Long)mc1->szB;
-         VG_(free_queue_length)--;
-         if (show)
-            VG_(printf)("mc_freelist: discard: volume now %lld\n", 
-                        VG_(free_queue_volume));
-         tl_assert(VG_(free_queue_volume) >= 0);
-         
-         if (freed_list_start[i] == freed_list_end[i]) {
-            freed_list_start[i] = freed_list_end[i] = NULL;
-         } else {
-            freed_list_start[i] = mc1->next;
-         }
-         mc1->next = NULL; /* just paranoia */
-
-         /* free MC_Chunk */
-         if (MC_AllocCustom != mc1->allockind)
-            VG_(cli_free) ( (void*)(mc1->data) );
-         delete_MC_Chunk ( mc1 );
+         release_head_of_freed_list(i);
       }
    }
 }
@@ -175,7 +284,7 @@ static void release_oldest_block(void)
 MC_Chunk* MC_(get_freed_block_bracketting) (Addr a)
 {
    int i;
-   for (i = 0; i < 2; i++) {
+   for (i = 0; i < N_FREED_LISTS; i++) {
       MC_Chunk*  mc;
       mc = freed_list_start[i];
       while (mc) {
@@ -188,13 +297,24 @@ MC_Chunk* MC_(get_freed_block_bracketting) (Addr a)
    return NULL;
 }
 
-/* Allocate a shadow chunk, put it on the appropriate list.
+void MC_(print_freelist_stats) ( void )
+{
+   VG_(message)(Vg_DebugMsg, " memcheck: freelist: vol %lld length %lld\n",
+                VG_(free_queue_volume), VG_(free_queue_length));
+   if (MC_(clo_freelist_budget) > 0)
+      VG_(message)(Vg_DebugMsg,
+                   " memcheck: freelist: budget %lld, %llu released"
+                   " at free, %llu evicted\n",
+                   MC_(clo_freelist_budget),
+                   n_freed_released_at_free, n_freed_evicted);
+}
+
+/* Initialise the shadow chunk of a newly allocated block.
    If needed, release oldest blocks from freed list. */
 static
-MC_Chunk* create_MC_Chunk ( ThreadId tid, Addr p, SizeT szB,
-                            MC_AllocKind kind)
+void init_MC_Chunk ( ThreadId tid, MC_Chunk* mc, Addr p, SizeT szB,
+                     MC_AllocKind kind)
 {
-   MC_Chunk* mc  = VG_(allocEltPA)(MC_(chunk_poolalloc));
    mc->data      = p;
    mc->szB       = szB;
    mc->allockind = kind;
@@ -207,9 +327,21 @@ MC_Chunk* create_MC_Chunk ( ThreadId tid, Addr p, SizeT szB,
    MC_(set_allocated_at) (tid, mc);
 
    /* Each time a new MC_Chunk is created, release oldest blocks
-      if the free list volume is exceeded. */
-   if (VG_(free_queue_volume) > MC_(clo_freelist_vol))
+      if the free list volume is exceeded.  With --freelist-budget,
+      the volume is instead bounded by add_to_freed_queue. */
+   if (MC_(clo_freelist_budget) == 0
+       && VG_(free_queue_volume) > MC_(clo_freelist_vol))
       release_oldest_block();
+}
+
+/* Allocate a shadow chunk, put it on the appropriate list.
+   If needed, release oldest blocks from freed list. */
+static
+MC_Chunk* create_MC_Chunk ( ThreadId tid, Addr p, SizeT szB,
+                            MC_AllocKind kind)
+{
+   MC_Chunk* mc  = VG_(allocEltPA)(MC_(chunk_poolalloc));
+   init_MC_Chunk ( tid, mc, p, szB, kind );
 
    /* Paranoia ... ensure the MC_Chunk is off-limits to the client, so
       the mc->data field isn't visible to the leak checker.  If memory
@@ -227,6 +359,583 @@ void delete_MC_Chunk (MC_Chunk* mc)
    VG_(freeEltPA) (MC_(chunk_poolalloc), mc);
 }
 
+/*------------------------------------------------------------*/
+/*--- Size-class slabs for small blocks                    ---*/
+/*------------------------------------------------------------*/
+
+/* With --malloc-slabs=yes, small malloc'd blocks are carved out of
+   slabs: SLAB_SZB bytes of client arena memory, each serving a single
+   size class.  The slots of a slab are laid out back to back as
+   [redzone][payload], followed by a final redzone, so that the trailing
+   redzone of a block is the leading redzone of the next slot.  The whole
+   slab is made noaccess once, when it is created: allocating and freeing
+   a block then only has to change the state of its payload.
+
+   The MC_Chunk of each slot lives in an array parallel to the slots, in
+   the slab descriptor.  Such chunks are not in MC_(malloc_list).  A
+   block is instead found from its address through the slab map, a two
+   level table indexed by the 64KB page of the address, so that the
+   malloc/free fast paths do no hashing and allocate no MC_Chunk.  The
+   slabs are shared by all threads, which are serialised by the big lock
+   anyway. */
+
+#define SLAB_SZB      (64 * 1024)
+#define SLAB_MAX_SZB  1024   /* Bigger blocks are not put in slabs. */
+
+/* The states of a slot. */
+#define SLOT_FREE   0   /* Never used, or in the free_slots list. */
+#define SLOT_LIVE   1   /* Holds a malloc'd block. */
+#define SLOT_FREED  2   /* Holds a freed block, e.g. in the freed queue. */
+
+struct _Slab {
+   Addr          base;        // Start of the SLAB_SZB bytes of the slab.
+   UInt          cls;         // Size class.
+   UInt          n_used;      // Nr of slots not SLOT_FREE.
+   UInt          n_fresh;     // Slots [n_fresh, n_slots) were never used.
+   MC_Chunk*     free_slots;  // Released slots, linked through ->next.
+   UChar*        state;       // SLOT_* of each slot.
+   UChar*        chunks;      // The MC_Chunk of each slot.
+   struct _Slab* prev_avail;  // The slabs of cls having free slots.
+   struct _Slab* next_avail;
+   struct _Slab* prev;        // All the slabs.
+   struct _Slab* next;
+};
+
+typedef
+   struct {
+      SizeT szB;       // Biggest block size of the class.
+      SizeT stride;    // Distance between two slots.
+      UInt  n_slots;   // Nr of slots in a slab, 0 if the class is unused.
+      Slab* avail;     // Slabs of the class having free slots.
+   }
+   SlabClass;
+
+static const UInt slab_class_szB[]
+   = { 16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256,
+       320, 384, 448, 512, 640, 768, 896, 1024 };
+#define N_SLAB_CLASSES (sizeof(slab_class_szB) / sizeof(slab_class_szB[0]))
+
+static SlabClass slab_classes[N_SLAB_CLASSES];
+
+/* The class of a block size szB is size_to_slab_class[(szB+15)/16]. */
+static UChar size_to_slab_class[SLAB_MAX_SZB/16 + 1];
+
+/* The payload of slot k of slab s starts at
+   s->base + slab_lead + k * slab_classes[s->cls].stride. */
+static SizeT slab_lead      = 0;
+static SizeT slab_chunk_szB = 0;
+
+static Slab* all_slabs = NULL;
+
+/* The slab map.  Being at least 64KB long, a slab overlaps at most two
+   64KB pages, and a page at most two slabs.  On 64-bit hosts, the map
+   covers the bottom 2^48 bytes of address space: no slab is created
+   above that. */
+typedef
+   struct {
+      Slab* s[2];
+   }
+   SlabMapEnt;
+
+#if VG_WORDSIZE == 8
+#  define N_SLAB_MAP_L1 (1 << 16)
+#else
+#  define N_SLAB_MAP_L1 1
+#endif
+#define N_SLAB_MAP_L2 (1 << 16)
+
+static SlabMapEnt* slab_map[N_SLAB_MAP_L1];
+
+/* Stats */
+static UInt  n_slabs            = 0;
+static UInt  n_slabs_max        = 0;
+static UInt  n_live_slab_chunks = 0;
+static ULong n_slab_allocs      = 0;
+
+void MC_(init_malloc_slabs) ( void )
+{
+   const SizeT align = VG_(clo_alignment);
+   UInt c, i;
+
+   tl_assert(MC_(clo_malloc_slabs));
+   slab_lead      = VG_ROUNDUP(MC_(Malloc_Redzone_SzB), align);
+   slab_chunk_szB = sizeof(MC_Chunk)
+                    + MC_(n_where_pointers)() * sizeof(ExeContext*);
+   for (c = 0; c < N_SLAB_CLASSES; c++) {
+      SlabClass* sc = &slab_classes[c];
+      sc->szB     = slab_class_szB[c];
+      sc->stride  = slab_lead + VG_ROUNDUP(sc->szB, align);
+      sc->n_slots = (SLAB_SZB - slab_lead) / sc->stride;
+      /* With huge redzones, slabs are not worth it. */
+      if (sc->n_slots < 8)
+         sc->n_slots = 0;
+      sc->avail   = NULL;
+   }
+   c = 0;
+   for (i = 0; i <= SLAB_MAX_SZB/16; i++) {
+      while (slab_class_szB[c] < i * 16)
+         c++;
+      size_to_slab_class[i] = c;
+   }
+}
+
+static SlabMapEnt* slab_map_ent ( Addr a, Bool create )
+{
+   const ULong i1 = (ULong)a >> 32;
+
+   if (i1 >= N_SLAB_MAP_L1)
+      return NULL;
+   if (slab_map[i1] == NULL) {
+      if (!create)
+         return NULL;
+      slab_map[i1] = VG_(calloc)("mc.slab_map_ent.1",
+                                 N_SLAB_MAP_L2, sizeof(SlabMapEnt));
+   }
+   return &slab_map[i1][(a >> 16) & (N_SLAB_MAP_L2 - 1)];
+}
+
+static Bool slab_map_add ( Slab* s )
+{
+   Addr a;
+
+   if (((ULong)(s->base + SLAB_SZB - 1) >> 32) >= N_SLAB_MAP_L1)
+      return False;
+   for (a = s->base & ~(Addr)0xFFFF; a < s->base + SLAB_SZB; a += 0x10000) {
+      SlabMapEnt* e = slab_map_ent(a, True);
+      if (e->s[0] == NULL) {
+         e->s[0] = s;
+      } else {
+         tl_assert(e->s[1] == NULL);
+         e->s[1] = s;
+      }
+   }
+   return True;
+}
+
+static void slab_map_remove ( const Slab* s )
+{
+   Addr a;
+
+   for (a = s->base & ~(Addr)0xFFFF; a < s->base + SLAB_SZB; a += 0x10000) {
+      SlabMapEnt* e = slab_map_ent(a, False);
+      tl_assert(e != NULL);
+      if (e->s[0] == s) {
+         e->s[0] = NULL;
+      } else {
+         tl_assert(e->s[1] == s);
+         e->s[1] = NULL;
+      }
+   }
+}
+
+/* The slab containing a, or NULL. */
+static Slab* find_slab ( Addr a )
+{
+   const SlabMapEnt* e = slab_map_ent(a, False);
+
+   if (e == NULL)
+      return NULL;
+   if (e->s[0] != NULL && a - e->s[0]->base < SLAB_SZB)
+      return e->s[0];
+   if (e->s[1] != NULL && a - e->s[1]->base < SLAB_SZB)
+      return e->s[1];
+   return NULL;
+}
+
+static inline MC_Chunk* slab_chunk ( const Slab* s, UInt k )
+{
+   return (MC_Chunk*)(s->chunks + k * slab_chunk_szB);
+}
+
+static inline UInt slab_chunk_index ( const Slab* s, const MC_Chunk* mc )
+{
+   return ((const UChar*)mc - s->chunks) / slab_chunk_szB;
+}
+
+/* The slot of s whose payload starts at a, or -1. */
+static Int slab_slot_at ( const Slab* s, Addr a )
+{
+   const SizeT stride = slab_classes[s->cls].stride;
+   UWord off;
+
+   if (a < s->base + slab_lead)
+      return -1;
+   off = a - (s->base + slab_lead);
+   if (off % stride != 0 || off / stride >= s->n_fresh)
+      return -1;
+   return off / stride;
+}
+
+/* The slab whose slot has mc as chunk, or NULL if mc is not the chunk of
+   a slab slot. */
+static Slab* slab_of_chunk ( const MC_Chunk* mc )
+{
+   Slab* s;
+
+   if (!MC_(clo_malloc_slabs))
+      return NULL;
+   s = find_slab(mc->data);
+   if (s != NULL
+       && (const UChar*)mc >= s->chunks
+       && (const UChar*)mc <  s->chunks + s->n_fresh * slab_chunk_szB)
+      return s;
+   return NULL;
+}
+
+/* The chunk of the slab block starting at a and in the given state,
+   or NULL. */
+static MC_Chunk* slab_chunk_at ( Addr a, UChar state )
+{
+   Slab* s;
+   Int   k;
+
+   if (!MC_(clo_malloc_slabs))
+      return NULL;
+   s = find_slab(a);
+   if (s == NULL)
+      return NULL;
+   k = slab_slot_at(s, a);
+   if (k == -1 || s->state[k] != state)
+      return NULL;
+   return slab_chunk(s, k);
+}
+
+static void slab_set_state ( MC_Chunk* mc, UChar from, UChar to )
+{
+   Slab* s = slab_of_chunk(mc);
+   UInt  k;
+
+   tl_assert(s != NULL);
+   k = slab_chunk_index(s, mc);
+   tl_assert(s->state[k] == from);
+   s->state[k] = to;
+   if (from == SLOT_LIVE)
+      n_live_slab_chunks--;
+   if (to == SLOT_LIVE)
+      n_live_slab_chunks++;
+}
+
+static void slab_avail_add ( Slab* s )
+{
+   SlabClass* sc = &slab_classes[s->cls];
+
+   s->prev_avail = NULL;
+   s->next_avail = sc->avail;
+   if (sc->avail != NULL)
+      sc->avail->prev_avail = s;
+   sc->avail = s;
+}
+
+static void slab_avail_remove ( Slab* s )
+{
+   SlabClass* sc = &slab_classes[s->cls];
+
+   if (s->prev_avail != NULL)
+      s->prev_avail->next_avail = s->next_avail;
+   else
+      sc->avail = s->next_avail;
+   if (s->next_avail != NULL)
+      s->next_avail->prev_avail = s->prev_avail;
+   s->prev_avail = s->next_avail = NULL;
+}
+
+static Slab* new_slab ( UInt cls )
+{
+   const SlabClass* sc = &slab_classes[cls];
+   const SizeT chunks_szB = sc->n_slots * slab_chunk_szB;
+   Slab* s;
+   Addr  base;
+
+   base = (Addr)VG_(cli_malloc)( VG_(clo_alignment), SLAB_SZB );
+   if (base == 0)
+      return NULL;
+   s = VG_(malloc)("mc.new_slab.1", sizeof(Slab));
+   s->base = base;
+   if (!slab_map_add(s)) {
+      VG_(cli_free)( (void*)base );
+      VG_(free)( s );
+      return NULL;
+   }
+   s->cls        = cls;
+   s->n_used     = 0;
+   s->n_fresh    = 0;
+   s->free_slots = NULL;
+   s->state      = VG_(calloc)("mc.new_slab.2", sc->n_slots, sizeof(UChar));
+   s->chunks     = VG_(malloc)("mc.new_slab.3", chunks_szB);
+
+   /* As in create_MC_Chunk, but once for all the chunks of the slab. */
+   if (!MC_(check_mem_is_noaccess)( (Addr)s->chunks, chunks_szB, NULL ))
+      VG_(tool_panic)("new_slab: shadow area is accessible");
+   MC_(make_mem_noaccess)( base, SLAB_SZB );
+
+   s->prev = NULL;
+   s->next = all_slabs;
+   if (all_slabs != NULL)
+      all_slabs->prev = s;
+   all_slabs = s;
+   slab_avail_add(s);
+
+   n_slabs++;
+   if (n_slabs > n_slabs_max)
+      n_slabs_max = n_slabs;
+   return s;
+}
+
+static void delete_slab ( Slab* s )
+{
+   slab_avail_remove(s);
+   if (s->prev != NULL)
+      s->prev->next = s->next;
+   else
+      all_slabs = s->next;
+   if (s->next != NULL)
+      s->next->prev = s->prev;
+   slab_map_remove(s);
+
+   MC_(recycle_noaccess_secmaps)( s->base, SLAB_SZB );
+   VG_(cli_free)( (void*)s->base );
+   VG_(free)( s->state );
+   VG_(free)( s->chunks );
+   VG_(free)( s );
+   n_slabs--;
+}
+
+/* Take a free slot for a block of szB bytes, and return its chunk with
+   only the data field set, or NULL if no slab can be used. */
+static MC_Chunk* slab_alloc_chunk ( SizeT szB )
+{
+   const UInt cls = size_to_slab_class[(szB + 15) / 16];
+   SlabClass* sc  = &slab_classes[cls];
+   Slab*      s   = sc->avail;
+   MC_Chunk*  mc;
+   UInt       k;
+
+   if (sc->n_slots == 0)
+      return NULL;
+   if (s == NULL) {
+      s = new_slab(cls);
+      if (s == NULL)
+         return NULL;
+   }
+   if (s->free_slots != NULL) {
+      mc = s->free_slots;
+      s->free_slots = mc->next;
+      k = slab_chunk_index(s, mc);
+   } else {
+      k = s->n_fresh++;
+      mc = slab_chunk(s, k);
+      mc->data = s->base + slab_lead + k * sc->stride;
+   }
+   tl_assert(s->state[k] == SLOT_FREE);
+   s->state[k] = SLOT_LIVE;
+   s->n_used++;
+   if (s->free_slots == NULL && s->n_fresh == sc->n_slots)
+      slab_avail_remove(s);
+
+   n_live_slab_chunks++;
+   n_slab_allocs++;
+   return mc;
+}
+
+/* Make the slot of the freed block mc free again. */
+static void slab_release_chunk ( Slab* s, MC_Chunk* mc )
+{
+   const SlabClass* sc = &slab_classes[s->cls];
+   const UInt k = slab_chunk_index(s, mc);
+
+   tl_assert(s->state[k] == SLOT_FREED);
+   s->state[k] = SLOT_FREE;
+   if (s->free_slots == NULL && s->n_fresh == sc->n_slots)
+      slab_avail_add(s);
+   mc->next = s->free_slots;
+   s->free_slots = mc;
+   s->n_used--;
+
+   /* Keep an empty slab only if no other slab of the class has room. */
+   if (s->n_used == 0 && (sc->avail != s || s->next_avail != NULL))
+      delete_slab(s);
+}
+
+/* Iteration over the live slab blocks. */
+static Slab* slab_iter_slab = NULL;
+static UInt  slab_iter_k    = 0;
+
+static void slab_iter_reset ( void )
+{
+   slab_iter_slab = all_slabs;
+   slab_iter_k    = 0;
+}
+
+static MC_Chunk* slab_iter_next ( void )
+{
+   while (slab_iter_slab != NULL) {
+      while (slab_iter_k < slab_iter_slab->n_fresh) {
+         const UInt k = slab_iter_k++;
+         if (slab_iter_slab->state[k] == SLOT_LIVE)
+            return slab_chunk(slab_iter_slab, k);
+      }
+      slab_iter_slab = slab_iter_slab->next;
+      slab_iter_k    = 0;
+   }
+   return NULL;
+}
+
+/* Take out of their slabs the live slab blocks lying in [start, end),
+   as remove_live_chunk does, and return them in a VG_(malloc)'d array.
+   They are all collected before any is freed, as freeing a block can
+   delete its slab. */
+static MC_Chunk** slab_remove_live_chunks_in ( Addr start, Addr end,
+                                               UInt* n_chunks )
+{
+   MC_Chunk** chunks = NULL;
+   UInt       n = 0, n_max = 0, k;
+   Slab*      s;
+
+   for (s = all_slabs; s != NULL; s = s->next) {
+      if (s->base >= end || s->base + SLAB_SZB <= start)
+         continue;
+      for (k = 0; k < s->n_fresh; k++) {
+         MC_Chunk* mc = slab_chunk(s, k);
+         if (s->state[k] != SLOT_LIVE
+             || mc->data < start || mc->data + mc->szB > end)
+            continue;
+         if (n == n_max) {
+            n_max  = n_max == 0 ? 16 : 2 * n_max;
+            chunks = VG_(realloc)("mc.slab_remove_live_chunks_in.1",
+                                  chunks, n_max * sizeof(MC_Chunk*));
+         }
+         chunks[n++] = mc;
+      }
+   }
+   for (k = 0; k < n; k++)
+      slab_set_state(chunks[k], SLOT_LIVE, SLOT_FREED);
+   *n_chunks = n;
+   return chunks;
+}
+
+/* The size a slab block mc can be given without overlapping the next
+   slot, or 0 if mc is not in a slab. */
+static SizeT slab_chunk_max_szB ( const MC_Chunk* mc )
+{
+   const Slab* s = slab_of_chunk(mc);
+
+   return s == NULL ? 0 : slab_classes[s->cls].stride - slab_lead;
+}
+
+MC_Chunk* MC_(get_live_slab_block_bracketting) ( Addr a )
+{
+   Slab* s;
+   Int   k, i;
+
+   if (!MC_(clo_malloc_slabs))
+      return NULL;
+   s = find_slab(a);
+   if (s == NULL)
+      return NULL;
+
+   /* a is in the redzone or payload of slot k, or maybe in the trailing
+      redzone of the block of slot k-1. */
+   if (a < s->base + slab_lead)
+      k = 0;
+   else
+      k = (a - (s->base + slab_lead)) / slab_classes[s->cls].stride;
+   for (i = 0; i < 3; i++) {
+      const Int j = (i == 0 ? k : i == 1 ? k + 1 : k - 1);
+      MC_Chunk* mc;
+      if (j < 0 || j >= s->n_fresh || s->state[j] != SLOT_LIVE)
+         continue;
+      mc = slab_chunk(s, j);
+      if (VG_(addr_is_in_block)( a, mc->data, mc->szB,
+                                 MC_(Malloc_Redzone_SzB) ))
+         return mc;
+   }
+   return NULL;
+}
+
+void MC_(print_slab_stats) ( void )
+{
+   if (!MC_(clo_malloc_slabs))
+      return;
+   VG_(message)(Vg_DebugMsg,
+                " memcheck: slabs: %u in use (%u max), %u live blocks,"
+                " %llu blocks allocated\n",
+                n_slabs, n_slabs_max, n_live_slab_chunks, n_slab_allocs);
+}
+
+
+/*------------------------------------------------------------*/
+/*--- The set of live malloc'd blocks                      ---*/
+/*------------------------------------------------------------*/
+
+/* Live blocks are either in a slab or in MC_(malloc_list).  A custom
+   block (VALGRIND_MALLOCLIKE_BLOCK) can start at the same address as a
+   slab block: the blocks of kind MC_AllocCustom are searched for in
+   MC_(malloc_list) first. */
+
+static MC_Chunk* lookup_live_chunk ( Addr p, MC_AllocKind kind )
+{
+   MC_Chunk* mc;
+
+   if (kind == MC_AllocCustom) {
+      mc = VG_(HT_lookup) ( MC_(malloc_list), (UWord)p );
+      return mc ? mc : slab_chunk_at ( p, SLOT_LIVE );
+   }
+   mc = slab_chunk_at ( p, SLOT_LIVE );
+   return mc ? mc : VG_(HT_lookup) ( MC_(malloc_list), (UWord)p );
+}
+
+static MC_Chunk* remove_live_chunk ( Addr p, MC_AllocKind kind )
+{
+   MC_Chunk* mc;
+
+   if (kind == MC_AllocCustom) {
+      mc = VG_(HT_remove) ( MC_(malloc_list), (UWord)p );
+      if (mc != NULL)
+         return mc;
+   }
+   mc = slab_chunk_at ( p, SLOT_LIVE );
+   if (mc != NULL) {
+      slab_set_state ( mc, SLOT_LIVE, SLOT_FREED );
+      return mc;
+   }
+   return kind == MC_AllocCustom
+          ? NULL : VG_(HT_remove) ( MC_(malloc_list), (UWord)p );
+}
+
+/* Make a block taken out by remove_live_chunk live again. */
+static void reinsert_live_chunk ( MC_Chunk* mc )
+{
+   if (slab_of_chunk ( mc ) != NULL)
+      slab_set_state ( mc, SLOT_FREED, SLOT_LIVE );
+   else
+      VG_(HT_add_node)( MC_(malloc_list), mc );
+}
+
+MC_Chunk** MC_(get_malloc_chunks) ( UInt* n_chunks )
+{
+   MC_Chunk** chunks;
+   MC_Chunk*  mc;
+   UInt       n_ht, i;
+
+   if (n_live_slab_chunks == 0)
+      return (MC_Chunk**) VG_(HT_to_array)( MC_(malloc_list), n_chunks );
+
+   n_ht   = VG_(HT_count_nodes)( MC_(malloc_list) );
+   chunks = VG_(malloc)("mc.get_malloc_chunks.1",
+                        (n_ht + n_live_slab_chunks) * sizeof(MC_Chunk*));
+   i = 0;
+   VG_(HT_ResetIter)( MC_(malloc_list) );
+   while ( (mc = VG_(HT_Next)( MC_(malloc_list) )) )
+      chunks[i++] = mc;
+   slab_iter_reset();
+   while ( (mc = slab_iter_next()) )
+      chunks[i++] = mc;
+   tl_assert(i == n_ht + n_live_slab_chunks);
+   *n_chunks = i;
+   return chunks;
+}
+
+
 // True if mc is in the given block list.
 static Bool in_block_list (const VgHashTable *block_list, MC_Chunk* mc)
 {
@@ -254,6 +963,10 @@ static Bool in_block_list (const VgHashTable *block_list, MC_Chunk* mc)
 // True if mc is a live block (not yet freed).
 static Bool live_block (MC_Chunk* mc)
 {
+   const Slab* s = slab_of_chunk(mc);
+   if (s != NULL)
+      return s->state[slab_chunk_index(s, mc)] == SLOT_LIVE;
+
    if (mc->allockind == MC_AllocCustom) {
       MC_Mempool* mp;
       VG_(HT_ResetIter)(MC_(mempool_list));
@@ -362,16 +1075,24 @@ void* MC_(new_block) ( ThreadId tid,
                        Bool is_zeroed, MC_AllocKind kind,
                        VgHashTable *table)
 {
-   MC_Chunk* mc;
+   MC_Chunk* mc = NULL;
 
    // Allocate and zero if necessary
    if (p) {
       tl_assert(MC_AllocCustom == kind);
    } else {
       tl_assert(MC_AllocCustom != kind);
-      p = (Addr)VG_(cli_malloc)( alignB, szB );
-      if (!p) {
-         return NULL;
+      tl_assert(table == MC_(malloc_list));
+      if (MC_(clo_malloc_slabs) && szB <= SLAB_MAX_SZB
+          && alignB <= VG_(clo_alignment))
+         mc = slab_alloc_chunk( szB );
+      if (mc) {
+         p = mc->data;
+      } else {
+         p = (Addr)VG_(cli_malloc)( alignB, szB );
+         if (!p) {
+            return NULL;
+         }
       }
       if (is_zeroed) {
          VG_(memset)((void*)p, 0, szB);
@@ -385,8 +1106,12 @@ void* MC_(new_block) ( ThreadId tid,
    // Only update stats if allocation succeeded.
    cmalloc_n_mallocs ++;
    cmalloc_bs_mallocd += (ULong)szB;
-   mc = create_MC_Chunk (tid, p, szB, kind);
-   VG_(HT_add_node)( table, mc );
+   if (mc) {
+      init_MC_Chunk (tid, mc, p, szB, kind);
+   } else {
+      mc = create_MC_Chunk (tid, p, szB, kind);
+      VG_(HT_add_node)( table, mc );
+   }
 
    if (is_zeroed)
       MC_(make_mem_defined)( p, szB );
@@ -461,7 +1186,10 @@ void die_and_free_mem ( ThreadId tid, MC_Chunk* mc, SizeT rzB )
    }
 
    /* Note: make redzones noaccess again -- just in case user made them
-      accessible with a client request... */
+      accessible with a client request...  Slab redzones are only made
+      noaccess when the slab is created. */
+   if (slab_of_chunk(mc) != NULL)
+      rzB = 0;
    MC_(make_mem_noaccess)( mc->data-rzB, mc->szB + 2*rzB );
 
    /* Record where freed */
@@ -488,9 +1216,9 @@ void record_freemismatch_error (ThreadId tid, MC_Chunk* mc)
       again a "clean allocated block", report the error, and then
       re-remove the chunk.  This avoids to do a VG_(HT_lookup)
       followed by a VG_(HT_remove) in all "non-erroneous cases". */
-   VG_(HT_add_node)( MC_(malloc_list), mc );
+   reinsert_live_chunk( mc );
    MC_(record_freemismatch_error) ( tid, mc );
-   if ((mc != VG_(HT_remove) ( MC_(malloc_list), (UWord)mc->data )))
+   if ((mc != remove_live_chunk ( mc->data, mc->allockind )))
       tl_assert(0);
 }
 
@@ -500,7 +1228,7 @@ void MC_(handle_free) ( ThreadId tid, Addr p, UInt rzB, MC_AllocKind kind )
 
    cmalloc_n_frees++;
 
-   mc = VG_(HT_remove) ( MC_(malloc_list), (UWord)p );
+   mc = remove_live_chunk ( p, kind );
    if (mc == NULL) {
       MC_(record_free_error) ( tid, p );
    } else {
@@ -546,7 +1274,7 @@ void* MC_(realloc) ( ThreadId tid, void* p_old, SizeT new_szB )
    cmalloc_bs_mallocd += (ULong)new_szB;
 
    /* Remove the old block */
-   old_mc = VG_(HT_remove) ( MC_(malloc_list), (UWord)p_old );
+   old_mc = remove_live_chunk ( (Addr)p_old, MC_AllocMalloc );
    if (old_mc == NULL) {
       MC_(record_free_error) ( tid, (Addr)p_old );
       /* We return to the program regardless. */
@@ -564,7 +1292,13 @@ void* MC_(realloc) ( ThreadId tid, void* p_old, SizeT new_szB )
    old_szB = old_mc->szB;
 
    /* Get new memory */
-   a_new = (Addr)VG_(cli_malloc)(VG_(clo_alignment), new_szB);
+   new_mc = NULL;
+   if (MC_(clo_malloc_slabs) && new_szB <= SLAB_MAX_SZB)
+      new_mc = slab_alloc_chunk( new_szB );
+   if (new_mc)
+      a_new = new_mc->data;
+   else
+      a_new = (Addr)VG_(cli_malloc)(VG_(clo_alignment), new_szB);
 
    if (a_new) {
       /* In all cases, even when the new size is smaller or unchanged, we
@@ -575,11 +1309,16 @@ void* MC_(realloc) ( ThreadId tid, void* p_old, SizeT new_szB )
          to the old block also depends on the size of the freed blocks
          queue). */
 
-      // Allocate a new chunk.
-      new_mc = create_MC_Chunk( tid, a_new, new_szB, MC_AllocMalloc );
+      if (new_mc) {
+         // The slot comes with its chunk.
+         init_MC_Chunk( tid, new_mc, a_new, new_szB, MC_AllocMalloc );
+      } else {
+         // Allocate a new chunk.
+         new_mc = create_MC_Chunk( tid, a_new, new_szB, MC_AllocMalloc );
 
-      // Now insert the new mc (with a new 'data' field) into malloc_list.
-      VG_(HT_add_node)( MC_(malloc_list), new_mc );
+         // Now insert the new mc (with a new 'data' field) into malloc_list.
+         VG_(HT_add_node)( MC_(malloc_list), new_mc );
+      }
 
       /* Retained part is copied, red zones set as normal */
 
@@ -639,7 +1378,7 @@ void* MC_(realloc) ( ThreadId tid, void* p_old, SizeT new_szB )
       /* Could not allocate new client memory.
          Re-insert the old_mc (with the old ptr) in the HT, as old_mc was
          unconditionally removed at the beginning of the function. */
-      VG_(HT_add_node)( MC_(malloc_list), old_mc );
+      reinsert_live_chunk( old_mc );
    }
 
    return (void*)a_new;
@@ -647,7 +1386,7 @@ void* MC_(realloc) ( ThreadId tid, void* p_old, SizeT new_szB )
 
 SizeT MC_(malloc_usable_size) ( ThreadId tid, void* p )
 {
-   MC_Chunk* mc = VG_(HT_lookup) ( MC_(malloc_list), (UWord)p );
+   MC_Chunk* mc = lookup_live_chunk ( (Addr)p, MC_AllocMalloc );
 
    // There may be slop, but pretend there isn't because only the asked-for
    // area will be marked as addressable.
@@ -661,7 +1400,7 @@ SizeT MC_(malloc_usable_size) ( ThreadId tid, void* p )
 void MC_(handle_resizeInPlace)(ThreadId tid, Addr p,
                                SizeT oldSizeB, SizeT newSizeB, SizeT rzB)
 {
-   MC_Chunk* mc = VG_(HT_lookup) ( MC_(malloc_list), (UWord)p );
+   MC_Chunk* mc = lookup_live_chunk ( p, MC_AllocCustom );
    if (!mc || mc->szB != oldSizeB || newSizeB == 0) {
       /* Reject if: p is not found, or oldSizeB is wrong,
          or new block would be empty. */
@@ -672,6 +1411,14 @@ void MC_(handle_resizeInPlace)(ThreadId tid, Addr p,
    if (oldSizeB == newSizeB)
       return;
 
+   /* A block in a slab cannot grow past its slot, which would overlap
+      the next block. */
+   if (newSizeB > oldSizeB && slab_chunk_max_szB ( mc ) != 0
+       && newSizeB > slab_chunk_max_szB ( mc )) {
+      MC_(record_free_error) ( tid, p );
+      return;
+   }
+
    if (UNLIKELY(VG_(clo_xtree_memory) == Vg_XTMemory_Full))
        VG_(XTMemory_Full_resize_in_place)(oldSizeB,  newSizeB, mc->where[0]);
 
@@ -728,6 +1475,20 @@ static void free_mallocs_in_mempool_block (MC_Mempool* mp,
 	 die_and_free_mem(tid, mc, mp->rzB);
       }
    }
+
+   if (n_live_slab_chunks > 0) {
+      UInt       n_chunks, i;
+      MC_Chunk** chunks = slab_remove_live_chunks_in(StartAddr, EndAddr,
+                                                     &n_chunks);
+      for (i = 0; i < n_chunks; i++) {
+         if (VG_(clo_verbosity) > 2) {
+            VG_(message)(Vg_UserMsg, "Auto-free of 0x%lx size=%lu\n",
+                         chunks[i]->data, (chunks[i]->szB + 0UL));
+         }
+         die_and_free_mem(tid, chunks[i], mp->rzB);
+      }
+      VG_(free)(chunks);
+   }
 }
 
 void MC_(create_mempool)(Addr pool, UInt rzB, Bool is_zeroed,
@@ -1144,6 +1905,8 @@ Bool MC_(mempool_exists)(Addr pool)
 static void xtmemory_report_next_block(XT_Allocs* xta, ExeContext** ec_alloc)
 {
    MC_Chunk* mc = VG_(HT_Next)(MC_(malloc_list));
+   if (!mc)
+      mc = slab_iter_next();
    if (mc) {
       xta->nbytes = mc->szB;
       xta->nblocks = 1;
@@ -1156,6 +1919,7 @@ void MC_(xtmemory_report) ( const HChar* filename, Bool fini )
 { 
    // Make xtmemory_report_next_block ready to be called.
    VG_(HT_ResetIter)(MC_(malloc_list));
+   slab_iter_reset();
 
    VG_(XTMemory_report)(filename, fini, xtmemory_report_next_block,
                         VG_(XT_filter_1top_and_maybe_below_main));
@@ -1182,6 +1946,11 @@ void MC_(print_malloc_stats) ( void )
       nblocks++;
       nbytes += (ULong)mc->szB;
    }
+   slab_iter_reset();
+   while ( (mc = slab_iter_next()) ) {
+      nblocks++;
+      nbytes += (ULong)mc->szB;
+   }
 
    VG_(umsg)(
       "HEAP SUMMARY:\n"
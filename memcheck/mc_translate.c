@@ -8062,6 +8062,38 @@ static void preInstrumentationAnalysis ( /*OUT*/HowUsed** useEnvP,
 }
 
 
+/* For --expensive-definedness-checks=profile.  If an error withheld at
+   the instruction at 'addr' is still pending, tell mc_main each time
+   the instruction runs, so that the error is dropped rather than
+   reported at exit. */
+static void noteWithheldErrorInsn ( MCEnv* mce, Addr addr )
+{
+   IRDirty* di;
+   void*    ei = MC_(withheld_error_insn)( addr );
+
+   if (ei == NULL)
+      return;
+   di = unsafeIRDirty_0_N(
+           1/*regparms*/, "MC_(helperc_withheld_insn_rerun)",
+           VG_(fnptr_to_fnentry)( &MC_(helperc_withheld_insn_rerun) ),
+           mkIRExprVec_1( mkIRExpr_HWord( (HWord)ei ) ) );
+   stmt( 'V', mce, IRStmt_Dirty(di) );
+}
+
+/* For --expensive-definedness-checks=profile: does |sb_in| contain an
+   instruction at which a value error has been seen? */
+static Bool containsExpensiveInsn ( const IRSB* sb_in )
+{
+   Int i;
+   for (i = 0; i < sb_in->stmts_used; i++) {
+      const IRStmt* st = sb_in->stmts[i];
+      if (st->tag == Ist_IMark && MC_(is_expensive_insn)(st->Ist.IMark.addr))
+         return True;
+   }
+   return False;
+}
+
+
 IRSB* MC_(instrument) ( VgCallbackClosure* closure,
                         IRSB* sb_in, 
                         const VexGuestLayout* layout, 
@@ -8120,6 +8152,20 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
       /* Select 'expensive for everything'.  mce.tmpHowUsed remains NULL. */
       DetailLevelByOp__set_all( &mce.dlbo, DLexpensive );
    }
+   else if (MC_(clo_expensive_definedness_checks) == EdcPROFILE) {
+      /* Stay cheap for everything, unless the block contains literals
+         which are known to need the accurate interpretation, or an
+         instruction at which a value error has already been seen (see
+         MC_(is_expensive_insn)).  In either case select 'expensive for
+         everything'.  The tmp-use analysis results are not needed. */
+      Bool hasBogusLiterals = False;
+      preInstrumentationAnalysis( &mce.tmpHowUsed, &hasBogusLiterals, sb_in );
+      VG_(free)( mce.tmpHowUsed );
+      mce.tmpHowUsed = NULL;
+
+      if (hasBogusLiterals || containsExpensiveInsn( sb_in ))
+         DetailLevelByOp__set_all( &mce.dlbo, DLexpensive );
+   }
    else {
       tl_assert(MC_(clo_expensive_definedness_checks) == EdcAUTO);
       /* We'll make our own selection, based on known per-target constraints
@@ -8331,6 +8377,8 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
             break;
 
          case Ist_IMark:
+            if (MC_(clo_expensive_definedness_checks) == EdcPROFILE)
+               noteWithheldErrorInsn( &mce, st->Ist.IMark.addr );
             break;
 
          case Ist_NoOp:
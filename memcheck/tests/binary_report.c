@@ -0,0 +1,29 @@
+#include <stdlib.h>
+
+/* Errors written with --binary-report-file, then converted back to text
+   by valgrind-report. */
+
+static void overrun(char* p, int n)
+{
+   p[n] = 'x';
+}
+
+int main(void)
+{
+   char* p = malloc(10);
+   int*  u = malloc(sizeof(int));
+   int   i;
+
+   for (i = 0; i < 3; i++)
+      overrun(p, 10);        // one error, three occurrences
+
+   if (*u == 42)             // uninitialised
+      p[0] = 'y';
+
+   free(p);
+   free(p);                  // invalid free
+   free(u);
+
+   malloc(32);               // definitely lost
+   return 0;
+}
@@ -0,0 +1,42 @@
+/* With --expensive-definedness-checks=profile, the comparison in
+   is_special() initially gets the cheap instrumentation, which gives a
+   false "Conditional jump" error (see bug340392.c).  That error must
+   not be reported, whereas the genuine error in the same loop must be. */
+
+#include <stdlib.h>
+
+typedef struct {
+  unsigned char c;
+  int i;
+  void *foo;
+} S;
+
+__attribute__((noinline))
+static int is_special (S *s)
+{
+  return s->c == 0 && s->i == 1 && s->foo == getenv ("BLAH");
+}
+
+__attribute__((noinline))
+static void bump (int *n)
+{
+  (*n)++;
+}
+
+int main (void)
+{
+  int i, n = 0;
+  volatile int *undef = malloc (sizeof (int));
+  S *s = malloc (sizeof (S));
+
+  s->c = 1;
+  for (i = 0; i < 10; i++) {
+    if (is_special (s))
+      bump (&n);
+    if (*undef == 42)
+      bump (&n);
+  }
+  free ((void *)undef);
+  free (s);
+  return 0;
+}
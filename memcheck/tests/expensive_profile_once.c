@@ -0,0 +1,38 @@
+/* With --expensive-definedness-checks=profile, the first error at an
+   instruction is withheld until it runs again.  Errors at instructions
+   which run only once must still be reported: the one in the thread
+   when the thread exits, the one in main when the program ends. */
+
+#include <pthread.h>
+#include <stdlib.h>
+
+__attribute__((noinline))
+static void bump (int *n)
+{
+  (*n)++;
+}
+
+static void* child (void* arg)
+{
+  volatile int *undef = malloc (sizeof (int));
+  int n = 0;
+
+  if (*undef == 42)
+    bump (&n);
+  free ((void *)undef);
+  return NULL;
+}
+
+int main (void)
+{
+  pthread_t t;
+  volatile int *undef = malloc (sizeof (int));
+  int n = 0;
+
+  pthread_create (&t, NULL, child, NULL);
+  pthread_join (t, NULL);
+  if (*undef == 42)
+    bump (&n);
+  free ((void *)undef);
+  return 0;
+}
@@ -0,0 +1,33 @@
+#include <stdlib.h>
+/* To be run with --freelist-budget=100000 */
+static void jumped(void)
+{
+   ;
+}
+int main(int argc, char *argv[])
+{
+   char *small = NULL;
+   char *medium = NULL;
+   int i;
+
+   /* Verify that freeing many blocks of another size class does not
+      flush a small block out of the quarantine: the budget is
+      reclaimed from the class holding the biggest volume. */
+   small = malloc (100);
+   free(small);
+   for (i = 0; i < 50; i++) {
+      medium = malloc (20000);
+      free(medium);
+   }
+   if (small[10] > 0x0) jumped();
+   if (medium[10] > 0x0) jumped();
+
+   /* Blocks of the small block class are evicted only when this
+      class is the biggest one. */
+   for (i = 0; i < 50; i++) {
+      medium = malloc (100);
+      free(medium);
+   }
+   if (small[20] > 0x0) jumped();
+   return 0;
+}
@@ -0,0 +1,55 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../memcheck.h"
+
+/* Exercises blocks allocated from the size-class slabs
+   (--malloc-slabs=yes): overruns into the redzone, use after free,
+   realloc moving a block between size classes, a leak, and resizing in
+   place, which cannot grow a block past its slot. */
+
+static char* leaked;
+
+int main(void)
+{
+   char* a[100];
+   char* p;
+   int i;
+
+   /* Fill several slabs of a few size classes. */
+   for (i = 0; i < 100; i++)
+      a[i] = malloc(16 + (i % 4) * 40);
+
+   /* Overrun and underrun into the redzones. */
+   a[10][16 + 2 * 40] = 'x';
+   a[11][-1] = 'x';
+
+   /* Use after free. */
+   free(a[20]);
+   a[20][0] = 'x';
+
+   /* realloc from one class to another, then out of the slabs. */
+   p = malloc(10);
+   memset(p, 0, 10);
+   p = realloc(p, 100);
+   p[99] = p[5];
+   p[100] = 'x';
+   p = realloc(p, 5000);
+   free(p);
+
+   for (i = 0; i < 100; i++)
+      if (i != 20 && i != 30)
+         free(a[i]);
+
+   /* a[30] is still reachable through leaked; the other leak is lost. */
+   leaked = a[30];
+   malloc(24);
+
+   /* Shrink and grow back in place, but not past the slot. */
+   p = malloc(40);
+   VALGRIND_RESIZEINPLACE_BLOCK(p, 40, 20, 0);
+   VALGRIND_RESIZEINPLACE_BLOCK(p, 20, 48, 0);
+   VALGRIND_RESIZEINPLACE_BLOCK(p, 48, 1000, 0);
+   p[47] = 'x';
+   free(p);
+   return 0;
+}
@@ -0,0 +1,68 @@
+// This artificial program exercises the shadow memory operations done
+// by Memcheck on large address ranges, rather than on individual
+// loads and stores:
+//  * realloc of big blocks          -> copy_address_range_state
+//  * calloc and free of big blocks  -> make_mem_defined, make_mem_noaccess
+//  * read() into a big buffer       -> check addressable, make_mem_defined
+//  * write() from a big buffer      -> check defined
+//  * mmap/munmap of big regions     -> set_address_range_perms on
+//                                      whole secondary maps
+// Some of the ranges are deliberately not 64KB aligned, so that the
+// partial secondary maps at either end are exercised too.
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define MB        (1024*1024)
+#define BUF_SZB   (16*MB + 12)
+#define MAP_SZB   (256*MB)
+#define REPS      50
+
+int main(void)
+{
+   int   i, fd_in, fd_out;
+   char* p;
+   char* q;
+   long  sum = 0;
+
+   fd_in  = open("/dev/zero", O_RDONLY);
+   fd_out = open("/dev/null", O_WRONLY);
+   assert(fd_in >= 0 && fd_out >= 0);
+
+   for (i = 0; i < REPS; i++) {
+      // Grow a block by copying it twice.
+      p = malloc(BUF_SZB / 4);
+      assert(p);
+      memset(p, i, BUF_SZB / 4);
+      p = realloc(p, BUF_SZB / 2);
+      p = realloc(p, BUF_SZB);
+      assert(p);
+
+      // Syscalls on the whole buffer.
+      assert(read(fd_in, p + 4, BUF_SZB - 8) == BUF_SZB - 8);
+      assert(write(fd_out, p, BUF_SZB) == BUF_SZB);
+      sum += p[BUF_SZB / 2];
+      free(p);
+
+      q = calloc(1, BUF_SZB);
+      assert(q);
+      sum += q[i];
+      free(q);
+
+      // Map, touch and unmap a big region.
+      p = mmap(NULL, MAP_SZB, PROT_READ|PROT_WRITE,
+               MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+      assert(p != MAP_FAILED);
+      p[i * 4096] = 1;
+      sum += p[MAP_SZB - 1];
+      munmap(p, MAP_SZB);
+   }
+
+   close(fd_in);
+   close(fd_out);
+   return ( sum == 0xdeadbeef ? 1 : 0 );
+}
@@ -0,0 +1,79 @@
+// This artificial program has many threads that each stride through a
+// large private working set, touching a different 4KB page on nearly
+// every access, and that all read from a large shared table.  It was
+// written to tune the access bitmaps of DRD: every page touched by a
+// segment has its own second level bitmap, so the lookup of these
+// bitmaps dominates when the working set is spread over many pages.
+//
+// Usage: stride [nr_threads [mb_per_thread [nr_passes]]]
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PAGE_SZB   4096
+#define STRIDE     (PAGE_SZB + 64)
+
+static int nr_thr = 8;
+static int mb_per_thr = 16;
+static int nr_passes = 4;
+
+static unsigned char* shared;
+static long shared_szb;
+
+static void* stride_fn(void* v)
+{
+   const long szb = (long)mb_per_thr * 1024 * 1024;
+   unsigned char* mine = malloc(szb);
+   long sum = 0;
+   long i;
+   int pass;
+
+   if (mine == NULL) {
+      perror("malloc");
+      exit(1);
+   }
+   for (pass = 0; pass < nr_passes; pass++) {
+      for (i = (pass * 8) % PAGE_SZB; i < szb; i += STRIDE) {
+         mine[i] += 1;
+         sum += shared[(i + (long)v * PAGE_SZB) % shared_szb];
+      }
+   }
+   free(mine);
+   return (void*)sum;
+}
+
+int main(int argc, char** argv)
+{
+   pthread_t* thr;
+   long t;
+   long total = 0;
+
+   if (argc > 1)
+      nr_thr = atoi(argv[1]);
+   if (argc > 2)
+      mb_per_thr = atoi(argv[2]);
+   if (argc > 3)
+      nr_passes = atoi(argv[3]);
+
+   shared_szb = (long)mb_per_thr * 1024 * 1024;
+   shared = calloc(shared_szb, 1);
+   thr = malloc(nr_thr * sizeof(*thr));
+   if (shared == NULL || thr == NULL) {
+      perror("malloc");
+      return 1;
+   }
+
+   for (t = 0; t < nr_thr; t++)
+      pthread_create(&thr[t], NULL, stride_fn, (void*)t);
+   for (t = 0; t < nr_thr; t++) {
+      void* res;
+      pthread_join(thr[t], &res);
+      total += (long)res;
+   }
+
+   printf("%ld\n", total);
+   free(thr);
+   free(shared);
+   return 0;
+}